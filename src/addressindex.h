@@ -287,6 +287,72 @@ struct CAddressHistoryValue {
     }
 };
 
+/** Totals of the address history entries of an address, kept up to date with them */
+struct CAddressSummaryValue {
+    CAmount spendable;
+    CAmount stakable;
+    CAmount voting_weight;
+    //! sum of the positive spendable changes
+    CAmount received;
+    //! number of history entries, i.e. transactions touching the address
+    unsigned int txcount;
+    int firstHeight;
+    int lastHeight;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 44;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata64(s, spendable);
+        ser_writedata64(s, stakable);
+        ser_writedata64(s, voting_weight);
+        ser_writedata64(s, received);
+        ser_writedata32(s, txcount);
+        ser_writedata32(s, firstHeight);
+        ser_writedata32(s, lastHeight);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        spendable = ser_readdata64(s);
+        stakable = ser_readdata64(s);
+        voting_weight = ser_readdata64(s);
+        received = ser_readdata64(s);
+        txcount = ser_readdata32(s);
+        firstHeight = ser_readdata32(s);
+        lastHeight = ser_readdata32(s);
+    }
+
+    CAddressSummaryValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        spendable = 0;
+        stakable = 0;
+        voting_weight = 0;
+        received = 0;
+        txcount = 0;
+        firstHeight = -1;
+        lastHeight = -1;
+    }
+
+    bool IsNull() const {
+        return txcount == 0;
+    }
+
+    //! Add (or remove, when fConnect is false) one history entry
+    void Apply(const CAddressHistoryValue& value, bool fConnect) {
+        int nSign = fConnect ? 1 : -1;
+        spendable += nSign * value.spendable;
+        stakable += nSign * value.stakable;
+        voting_weight += nSign * value.voting_weight;
+        if (value.spendable > 0)
+            received += nSign * value.spendable;
+        txcount += nSign;
+    }
+};
+
 struct CAddressIndexIteratorKey {
     unsigned int type;
     uint160 hashBytes;
@@ -0,0 +1,51 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <dnsserver.h>
+
+static bool LookupExample(const std::string& name, const std::string& subdomain, std::map<std::string, std::string>& data)
+{
+    data["a"] = "192.0.2.1, 192.0.2.2";
+    data["aaaa"] = "2001:db8::1";
+    data["email"] = "admin@example.org";
+    return true;
+}
+
+static std::vector<unsigned char> BuildQuery(const std::string& label, uint16_t type)
+{
+    std::vector<unsigned char> query = {0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    query.push_back(label.size());
+    query.insert(query.end(), label.begin(), label.end());
+    query.push_back(5);
+    query.insert(query.end(), {'0', 'd', 'y', 'n', 's'});
+    query.push_back(0);
+    query.insert(query.end(), {(unsigned char)(type >> 8), (unsigned char)(type & 0xff), 0x00, 0x01});
+    return query;
+}
+
+// Repeated queries for the same name, answered from the cache.
+static void DNSCachedQuery(benchmark::State& state)
+{
+    CDNSResponder responder(LookupExample);
+    std::vector<unsigned char> query = BuildQuery("example", 1);
+    std::vector<unsigned char> response;
+    while (state.KeepRunning()) {
+        responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response);
+    }
+}
+
+// With the cache disabled, every query goes through the lookup and the encoding.
+static void DNSUncachedQuery(benchmark::State& state)
+{
+    CDNSResponder responder(LookupExample, 0);
+    std::vector<unsigned char> query = BuildQuery("example", 255);
+    std::vector<unsigned char> response;
+    while (state.KeepRunning()) {
+        responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response);
+    }
+}
+
+BENCHMARK(DNSCachedQuery);
+BENCHMARK(DNSUncachedQuery);
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <blockencodings.h>
+#include <blsct/verification.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
 #include <chainparams.h>
@@ -13,10 +14,110 @@
 #include <main.h>
 #include <util.h>
 
+#include <algorithm>
+#include <deque>
 #include <unordered_map>
 
 #define MIN_TRANSACTION_BASE_SIZE (::GetSerializeSize(CTransaction(), SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS))
 
+/** Most combined BLSCT transactions whose parts are remembered, there is at most one per block */
+static const size_t MAX_COMBINED_BLSCT_PARTS = 64;
+
+static CCriticalSection cs_combinedParts;
+static std::map<uint256, std::vector<uint256> > mapCombinedParts;
+static std::deque<uint256> vCombinedPartsOrder;
+
+void AddCombinedBLSCTParts(const uint256& hash, const std::vector<uint256>& vParts)
+{
+    LOCK(cs_combinedParts);
+    if (!mapCombinedParts.insert(std::make_pair(hash, vParts)).second)
+        return;
+    vCombinedPartsOrder.push_back(hash);
+    while (vCombinedPartsOrder.size() > MAX_COMBINED_BLSCT_PARTS) {
+        mapCombinedParts.erase(vCombinedPartsOrder.front());
+        vCombinedPartsOrder.pop_front();
+    }
+}
+
+static bool GetCombinedBLSCTParts(const uint256& hash, std::vector<uint256>& vParts)
+{
+    LOCK(cs_combinedParts);
+    std::map<uint256, std::vector<uint256> >::const_iterator it = mapCombinedParts.find(hash);
+    if (it == mapCombinedParts.end())
+        return false;
+    vParts = it->second;
+    return true;
+}
+
+/** Position of each element of v once v is sorted */
+template<typename T>
+static bool GetSortedOrder(const std::vector<T>& v, std::vector<uint16_t>& vOrder)
+{
+    if (v.size() > std::numeric_limits<uint16_t>::max())
+        return false;
+    std::vector<T> vSorted(v);
+    std::sort(vSorted.begin(), vSorted.end());
+    vOrder.clear();
+    for (const T& x: v)
+        vOrder.push_back(std::lower_bound(vSorted.begin(), vSorted.end(), x) - vSorted.begin());
+    return true;
+}
+
+/** Reorder the sorted v as given by GetSortedOrder */
+template<typename T>
+static bool ApplySortedOrder(std::vector<T>& v, const std::vector<uint16_t>& vOrder)
+{
+    if (vOrder.size() != v.size())
+        return false;
+    std::vector<T> vOrdered;
+    vOrdered.reserve(v.size());
+    std::vector<bool> fUsed(v.size());
+    for (uint16_t n: vOrder) {
+        if (n >= v.size() || fUsed[n])
+            return false;
+        fUsed[n] = true;
+        vOrdered.push_back(v[n]);
+    }
+    v.swap(vOrdered);
+    return true;
+}
+
+/** Put a combined BLSCT transaction together again as BlockAssembler::addCombinedBLSCT made it */
+static std::shared_ptr<const CTransaction> RebuildCombinedTransaction(const CombinedTransactionShortIDs& combined,
+                                                                      const std::unordered_map<uint64_t, std::shared_ptr<const CTransaction> >& parts)
+{
+    std::set<CTransaction> setParts;
+    for (uint64_t shortid: combined.shorttxids) {
+        std::unordered_map<uint64_t, std::shared_ptr<const CTransaction> >::const_iterator it = parts.find(shortid);
+        if (it == parts.end() || !it->second)
+            return nullptr;
+        setParts.insert(*it->second);
+    }
+
+    CMutableTransaction mutTx;
+    CAmount nFee;
+    CValidationState state;
+    try {
+        if (!BuildCombinedBLSCTTransaction(setParts, mutTx, nFee, state))
+            return nullptr;
+    } catch (const std::exception& e) {
+        return nullptr;
+    }
+    if (!ApplySortedOrder(mutTx.vin, combined.vinorder) || !ApplySortedOrder(mutTx.vout, combined.voutorder))
+        return nullptr;
+    mutTx.nTime = combined.nTime;
+    mutTx.vout.push_back(CTxOut(nFee, CScript(OP_RETURN)));
+
+    std::shared_ptr<const CTransaction> tx = std::make_shared<const CTransaction>(mutTx);
+
+    std::vector<uint256> vParts;
+    for (const CTransaction& part: setParts)
+        vParts.push_back(part.GetHash());
+    AddCombinedBLSCTParts(tx->GetHash(), vParts);
+
+    return tx;
+}
+
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
         shorttxids(block.vtx.size() - 1), prefilledtxn(1), vchBlockSig(block.vchBlockSig), header(block) {
@@ -26,6 +127,20 @@ CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) :
     for (size_t i = 1; i < block.vtx.size(); i++) {
         const CTransaction& tx = block.vtx[i];
         shorttxids[i - 1] = GetShortID(tx.GetHash());
+
+        // Peers have never seen a combined BLSCT transaction, but likely have its parts
+        std::vector<uint256> vParts;
+        if (combinedtxn.size() < MAX_CMPCTBLOCK_COMBINED_TXN && tx.IsBLSInput() && !tx.vout.empty() &&
+                i <= std::numeric_limits<uint16_t>::max() && GetCombinedBLSCTParts(tx.GetHash(), vParts)) {
+            CombinedTransactionShortIDs combined;
+            combined.index = i;
+            combined.nTime = tx.nTime;
+            for (const uint256& hash: vParts)
+                combined.shorttxids.push_back(GetShortID(hash));
+            if (GetSortedOrder(tx.vin, combined.vinorder) &&
+                    GetSortedOrder(std::vector<CTxOut>(tx.vout.begin(), tx.vout.end() - 1), combined.voutorder))
+                combinedtxn.push_back(combined);
+        }
     }
 }
 
@@ -52,6 +167,15 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         return READ_STATUS_INVALID;
     if (cmpctblock.shorttxids.size() + cmpctblock.prefilledtxn.size() > MAX_BLOCK_BASE_SIZE / MIN_TRANSACTION_BASE_SIZE)
         return READ_STATUS_INVALID;
+    // Only the first combined transactions are put together, they are a hint which
+    // peers running a different limit may send more of
+    std::vector<CombinedTransactionShortIDs>::const_iterator itCombinedEnd = cmpctblock.combinedtxn.begin() +
+        std::min(cmpctblock.combinedtxn.size(), (size_t)MAX_CMPCTBLOCK_COMBINED_TXN);
+    size_t nCombinedParts = 0;
+    for (std::vector<CombinedTransactionShortIDs>::const_iterator it = cmpctblock.combinedtxn.begin(); it != itCombinedEnd; ++it)
+        nCombinedParts += it->shorttxids.size();
+    if (nCombinedParts > MAX_BLOCK_BASE_SIZE / MIN_TRANSACTION_BASE_SIZE)
+        return READ_STATUS_INVALID;
 
     assert(header.IsNull() && txn_available.empty());
     header = cmpctblock.header;
@@ -103,12 +227,48 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     if (shorttxids.size() != cmpctblock.shorttxids.size())
         return READ_STATUS_FAILED; // Short ID collision
 
+    // The parts of the combined transactions are looked for along with the block's transactions
+    std::unordered_map<uint64_t, std::shared_ptr<const CTransaction> > parts;
+    for (std::vector<CombinedTransactionShortIDs>::const_iterator it = cmpctblock.combinedtxn.begin(); it != itCombinedEnd; ++it) {
+        if (it->index >= txn_available.size() || txn_available[it->index])
+            return READ_STATUS_INVALID;
+        for (uint64_t shortid: it->shorttxids)
+            parts[shortid];
+    }
+
     std::vector<bool> have_txn(txn_available.size());
-    LOCK(pool->cs);
-    const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
+    FillFromPool(*pool, cmpctblock, shorttxids, have_txn, parts);
+    // Transactions still in their Dandelion stem phase are only in the stempool
+    if (stempool && (mempool_count < shorttxids.size() || !parts.empty()))
+        FillFromPool(*stempool, cmpctblock, shorttxids, have_txn, parts);
+
+    for (std::vector<CombinedTransactionShortIDs>::const_iterator it = cmpctblock.combinedtxn.begin(); it != itCombinedEnd; ++it) {
+        const CombinedTransactionShortIDs& combined = *it;
+        if (txn_available[combined.index])
+            continue;
+        std::shared_ptr<const CTransaction> tx = RebuildCombinedTransaction(combined, parts);
+        if (!tx)
+            continue;
+        // The short id of the block's transaction tells whether it was put together right
+        std::unordered_map<uint64_t, uint16_t>::const_iterator idit = shorttxids.find(cmpctblock.GetShortID(tx->GetHash()));
+        if (idit == shorttxids.end() || idit->second != combined.index)
+            continue;
+        txn_available[combined.index] = tx;
+        combined_count++;
+    }
+
+    LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n", cmpctblock.header.GetHash().ToString(), cmpctblock.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
+void PartiallyDownloadedBlock::FillFromPool(CTxMemPool& fromPool, const CBlockHeaderAndShortTxIDs& cmpctblock, const std::unordered_map<uint64_t, uint16_t>& shorttxids,
+                                            std::vector<bool>& have_txn, std::unordered_map<uint64_t, std::shared_ptr<const CTransaction> >& parts) {
+    LOCK(fromPool.cs);
+    const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = fromPool.vTxHashes;
     for (size_t i = 0; i < vTxHashes.size(); i++) {
         uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
+        std::unordered_map<uint64_t, uint16_t>::const_iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
                 txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
@@ -117,23 +277,25 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
             } else {
                 // If we find two mempool txn that match the short id, just request it.
                 // This should be rare enough that the extra bandwidth doesn't matter,
-                // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
+                // but eating a round-trip due to FillBlock failure would be annoying.
+                // The same transaction is often in both the mempool and the stempool.
+                if (txn_available[idit->second] && txn_available[idit->second]->GetHash() != vTxHashes[i].first) {
                     txn_available[idit->second].reset();
                     mempool_count--;
                 }
             }
         }
+        if (!parts.empty()) {
+            std::unordered_map<uint64_t, std::shared_ptr<const CTransaction> >::iterator partit = parts.find(shortid);
+            if (partit != parts.end() && !partit->second)
+                partit->second = vTxHashes[i].second->GetSharedTx();
+        }
         // Though ideally we'd continue scanning for the two-txn-match-shortid case,
         // the performance win of an early exit here is too good to pass up and worth
         // the extra risk.
-        if (mempool_count == shorttxids.size())
+        if (mempool_count == shorttxids.size() && parts.empty())
             break;
     }
-
-    LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n", cmpctblock.header.GetHash().ToString(), cmpctblock.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION));
-
-    return READ_STATUS_OK;
 }
 
 bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const {
@@ -170,7 +332,7 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
         return READ_STATUS_INVALID;
     }
 
-    LogPrint("cmpctblock", "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool and %lu txn requested\n", header.GetHash().ToString(), prefilled_count, mempool_count, vtx_missing.size());
+    LogPrint("cmpctblock", "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool, %lu combined txn rebuilt and %lu txn requested\n", header.GetHash().ToString(), prefilled_count, mempool_count, combined_count, vtx_missing.size());
     if (vtx_missing.size() < 5) {
         for(const CTransaction& tx : vtx_missing)
             LogPrint("cmpctblock", "Reconstructed block %s required tx %s\n", header.GetHash().ToString(), tx.GetHash().ToString());
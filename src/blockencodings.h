@@ -6,8 +6,10 @@
 #define STOCK_BLOCK_ENCODINGS_H
 
 #include <primitives/block.h>
+#include <version.h>
 
 #include <memory>
+#include <unordered_map>
 
 class CTxMemPool;
 
@@ -119,6 +121,40 @@ struct PrefilledTransaction {
     }
 };
 
+// A combined BLSCT transaction of a CBlockHeaderAndShortTxIDs, described by the
+// transactions it combines so it can be put together again instead of requested
+struct CombinedTransactionShortIDs {
+    // Position of the transaction in the block, which also has its short id
+    uint16_t index;
+    uint32_t nTime;
+    std::vector<uint64_t> shorttxids;
+    // Position of each input and output (but the fee output, which is last)
+    // among the sorted inputs and outputs of the combined transactions
+    std::vector<uint16_t> vinorder;
+    std::vector<uint16_t> voutorder;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        uint64_t idx = index;
+        READWRITE(COMPACTSIZE(idx));
+        if (idx > std::numeric_limits<uint16_t>::max())
+            throw std::ios_base::failure("index overflowed 16-bits");
+        index = idx;
+        READWRITE(nTime);
+        READWRITE(shorttxids);
+        READWRITE(vinorder);
+        READWRITE(voutorder);
+    }
+};
+
+/** Most combined transactions a cmpctblock asks to be put together, blocks have at most one. Receivers ignore the ones after them. */
+static const unsigned int MAX_CMPCTBLOCK_COMBINED_TXN = 1;
+
+/** Remember the transactions a combined BLSCT transaction was made of, to announce it by them */
+void AddCombinedBLSCTParts(const uint256& hash, const std::vector<uint256>& vParts);
+
 typedef enum ReadStatus_t
 {
     READ_STATUS_OK,
@@ -140,6 +176,7 @@ protected:
     std::vector<uint64_t> shorttxids;
     std::vector<PrefilledTransaction> prefilledtxn;
     std::vector<unsigned char> vchBlockSig;
+    std::vector<CombinedTransactionShortIDs> combinedtxn;
 
 public:
     CBlockHeader header;
@@ -189,17 +226,24 @@ public:
             FillShortTxIDSelector();
 
         READWRITE(vchBlockSig);
+
+        if ((nVersion & ~SERIALIZE_TRANSACTION_NO_WITNESS) >= COMBINED_BLSCT_CMPCT_VERSION)
+            READWRITE(combinedtxn);
     }
 };
 
 class PartiallyDownloadedBlock {
 protected:
     std::vector<std::shared_ptr<const CTransaction> > txn_available;
-    size_t prefilled_count = 0, mempool_count = 0;
+    size_t prefilled_count = 0, mempool_count = 0, combined_count = 0;
     CTxMemPool* pool;
+    CTxMemPool* stempool;
+
+    void FillFromPool(CTxMemPool& fromPool, const CBlockHeaderAndShortTxIDs& cmpctblock, const std::unordered_map<uint64_t, uint16_t>& shorttxids,
+                      std::vector<bool>& have_txn, std::unordered_map<uint64_t, std::shared_ptr<const CTransaction> >& parts);
 public:
     CBlockHeader header;
-    PartiallyDownloadedBlock(CTxMemPool* poolIn) : pool(poolIn) {}
+    PartiallyDownloadedBlock(CTxMemPool* poolIn, CTxMemPool* stempoolIn = nullptr) : pool(poolIn), stempool(stempoolIn) {}
 
     ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock);
     bool IsTxAvailable(size_t index) const;
@@ -354,7 +354,7 @@ bool static IntRecv(char* data, size_t len, int timeout, SOCKET& hSocket)
 {
     int64_t curTime = GetTimeMillis();
     int64_t endTime = curTime + timeout;
-    // Maximum time to wait in one select call. It will take up until this time (in millis)
+    // Maximum time to wait in one call. It will take up until this time (in millis)
     // to break off in case of an interruption.
     const int64_t maxWait = 1000;
     while (len > 0 && curTime < endTime) {
@@ -367,14 +367,7 @@ bool static IntRecv(char* data, size_t len, int timeout, SOCKET& hSocket)
         } else { // Other error or blocking
             int nErr = WSAGetLastError();
             if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL) {
-                if (!IsSelectableSocket(hSocket)) {
-                    return false;
-                }
-                struct timeval tval = MillisToTimeval(std::min(endTime - curTime, maxWait));
-                fd_set fdset;
-                FD_ZERO(&fdset);
-                FD_SET(hSocket, &fdset);
-                int nRet = select(hSocket + 1, &fdset, nullptr, nullptr, &tval);
+                int nRet = WaitForSocket(hSocket, false, std::min(endTime - curTime, maxWait));
                 if (nRet == SOCKET_ERROR) {
                     return false;
                 }
@@ -690,11 +683,6 @@ bool AggregationSession::JoinSingle(int index, const std::string& hiddenService,
             if (so == INVALID_SOCKET)
                 return error("%s: Could not create socket to %s:%d", __func__, host, port);
 
-            if (!IsSelectableSocket(so)) {
-                CloseSocket(so);
-                return error("%s: Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n", __func__);
-            }
-
             int set = 1;
 #ifdef SO_NOSIGPIPE
             // Different way of disabling SIGPIPE on BSD
@@ -716,18 +704,14 @@ bool AggregationSession::JoinSingle(int index, const std::string& hiddenService,
                 int nErr = WSAGetLastError();
                 // WSAEINVAL is here because some legacy version of winsock uses it
                 if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL) {
-                    struct timeval timeout = MillisToTimeval(60);
-                    fd_set fdset;
-                    FD_ZERO(&fdset);
-                    FD_SET(so, &fdset);
-                    int nRet = select(so + 1, nullptr, &fdset, nullptr, &timeout);
+                    int nRet = WaitForSocket(so, true, 60);
                     if (nRet == 0) {
                         LogPrint("%s: connection to %s timeout\n", __func__, proxy.proxy.ToString());
                         CloseSocket(so);
                         return false;
                     }
                     if (nRet == SOCKET_ERROR) {
-                        LogPrintf("%s: select() for %s failed: %s\n", __func__, proxy.proxy.ToString(), NetworkErrorString(WSAGetLastError()));
+                        LogPrintf("%s: poll() for %s failed: %s\n", __func__, proxy.proxy.ToString(), NetworkErrorString(WSAGetLastError()));
                         CloseSocket(so);
                         return false;
                     }
@@ -743,7 +727,7 @@ bool AggregationSession::JoinSingle(int index, const std::string& hiddenService,
                         return false;
                     }
                     if (nRet != 0) {
-                        LogPrintf("%s: connect() to %s failed after select(): %s\n", __func__, proxy.proxy.ToString(), NetworkErrorString(nRet));
+                        LogPrintf("%s: connect() to %s failed after poll(): %s\n", __func__, proxy.proxy.ToString(), NetworkErrorString(nRet));
                         CloseSocket(so);
                         return false;
                     }
@@ -856,11 +840,6 @@ bool AggregationSession::JoinSingle(int index, const std::string& hiddenService,
             }
             LogPrint("net", "SOCKS5 connected %s\n", host);
 
-            if (!IsSelectableSocket(so)) {
-                CloseSocket(so);
-                return error("AggregationSession::%s: Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n", __func__);
-            }
-
             CDataStream ds(0, 0);
             ds << tx;
             std::vector<unsigned char> vBuffer(ds.begin(), ds.end());
@@ -27,6 +27,7 @@ std::vector<Scalar> BulletproofsRangeproof::twoN;
 Scalar BulletproofsRangeproof::ip12;
 
 boost::mutex BulletproofsRangeproof::init_mutex;
+boost::mutex BulletproofsRangeproof::generators_mutex;
 
 bls::G1Element BulletproofsRangeproof::G;
 std::map<TokenId, bls::G1Element> BulletproofsRangeproof::H;
@@ -105,6 +106,8 @@ bool BulletproofsRangeproof::Init()
 
 Generators BulletproofsRangeproof::GetGenerators(const TokenId& tokenId)
 {
+    boost::lock_guard<boost::mutex> lock(BulletproofsRangeproof::generators_mutex);
+
     if (BulletproofsRangeproof::H.count(tokenId))
     {
         return {BulletproofsRangeproof::G, BulletproofsRangeproof::H[tokenId], BulletproofsRangeproof::Gi, BulletproofsRangeproof::Hi};
@@ -189,6 +189,8 @@ public:
     static Scalar ip12;
 
     static boost::mutex init_mutex;
+    //! guards H, which GetGenerators extends from any thread verifying proofs
+    static boost::mutex generators_mutex;
 
     std::vector<bls::G1Element> V;
     std::vector<bls::G1Element> L;
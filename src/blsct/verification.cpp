@@ -5,98 +5,65 @@
 #include "verification.h"
 #include "utiltime.h"
 
-bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover, CAmount nMixFee)
-{
-    //auto nStart = GetTimeMicros();
-    std::map<TokenId, std::vector<std::pair<int, BulletproofsRangeproof>>> proofs;
-    std::map<TokenId, std::vector<bls::G1Element>> nonces;
+#include <deque>
+#include <map>
 
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
 
-    bls::G1Element balKey, balKeyOut;
-    bool fElementZero = true;
-    bool fElementZeroOut = true;
-
-    bool fCheckRange = tx.IsCTOutput();
-    bool fCheckBLSSignature = tx.IsBLSInput();
-    bool fCheckBalance = fCheckBLSSignature || fCheckRange;
+/** Stateless BLSCT checks of recently received transactions, by transaction hash */
+class CBLSCTPrecheckCache
+{
+private:
+    boost::mutex mutex;
+    std::map<uint256, std::shared_ptr<const CBLSCTPrecheck>> map;
+    std::deque<uint256> order;
 
-    if (fOnlyRecover)
+public:
+    std::shared_ptr<const CBLSCTPrecheck> Get(const uint256& hash)
     {
-        fCheckBLSSignature = false;
-        fCheckBalance = false;
+        boost::lock_guard<boost::mutex> lock(mutex);
+        auto it = map.find(hash);
+        if (it == map.end())
+            return nullptr;
+        return it->second;
     }
-    else if (!view.HaveInputs(tx)) {
-        return state.DoS(100, false, REJECT_INVALID, strprintf("inputs-not-available"));
-    }
-
-    if (!(fCheckRange || fCheckBalance || fCheckBLSSignature))
-        return true;
-
-    std::vector<bls::G1Element> txSigningKeys;
-    std::vector<std::vector<uint8_t>> vMessages;
-
-    Generators gens = BulletproofsRangeproof::GetGenerators();
 
-    CAmount valIn = 0;
-    CAmount valOut = 0;
-
-    if (nMixFee != 0)
+    void Add(const uint256& hash, const std::shared_ptr<const CBLSCTPrecheck>& precheck)
     {
-        Scalar sMixFee = Scalar(nMixFee);
-
-        if (nMixFee < 0)
-            sMixFee = sMixFee.Negate();
-
-        Scalar s = Scalar(sMixFee).bn;
-        bls::G1Element t = gens.H*s.bn;
-        balKey = fElementZero ? t : balKey + t;
-        valIn += nMixFee;
-        fElementZero = false;
+        boost::lock_guard<boost::mutex> lock(mutex);
+        auto inserted = map.insert(std::make_pair(hash, precheck));
+        if (!inserted.second) {
+            // Checked again with another view key
+            inserted.first->second = precheck;
+            return;
+        }
+        order.push_back(hash);
+        while (order.size() > MAX_BLSCT_PRECHECK_CACHE_SIZE) {
+            map.erase(order.front());
+            order.pop_front();
+        }
     }
+};
 
-    for (size_t j = 0; j < tx.vin.size(); j++)
-    {
-        if (fCheckBalance || fCheckBLSSignature)
-        {
-            const CTxOut &prevOut = view.GetOutputFor(tx.vin[j]);
+static CBLSCTPrecheckCache blsctPrecheckCache;
 
-            gens = BulletproofsRangeproof::GetGenerators(prevOut.tokenId);
+bool VerifyBLSCTStateless(const CTransaction &tx, bls::PrivateKey viewKey, CBLSCTPrecheck& precheck, CValidationState& state, bool fOnlyRecover)
+{
+    std::map<TokenId, std::vector<std::pair<int, BulletproofsRangeproof>>> proofs;
+    std::map<TokenId, std::vector<bls::G1Element>> nonces;
 
-            if (fCheckBalance)
-            {
-                if (prevOut.HasRangeProof())
-                {
-                    balKey = fElementZero ? prevOut.GetBulletproof().GetValueCommitments()[0] : balKey + prevOut.GetBulletproof().GetValueCommitments()[0];
-                    fElementZero = false;
-                }
-                else
-                {
-                    Scalar s = Scalar(prevOut.nValue).bn;
-                    bls::G1Element t = gens.H*s.bn;
-                    balKey = fElementZero ? t : balKey + t;
-                    valIn += prevOut.nValue;
-                    fElementZero = false;
-                }
-            }
+    precheck.viewPublicKey = viewKey.GetG1Element();
+    precheck.fOnlyRecover = fOnlyRecover;
 
-            if (fCheckBLSSignature)
-            {
-                try
-                {
-                    txSigningKeys.push_back(bls::G1Element::FromBytes(prevOut.spendingKey.data()));
-                }
-                catch(std::exception& e)
-                {
-                    return state.DoS(100, false, REJECT_INVALID, strprintf("caught-spendingkey-exception %s", e.what()));
-                }
+    bool fCheckRange = tx.IsCTOutput();
+    bool fCheckBLSSignature = tx.IsBLSInput() && !fOnlyRecover;
+    bool fCheckBalance = (tx.IsBLSInput() || fCheckRange) && !fOnlyRecover;
 
-                CHashWriter hasher(0,0);
-                hasher << tx.vin[j];
-                uint256 hash = hasher.GetHash();
-                vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
-            }
-        }
-    }
+    if (!(fCheckRange || fCheckBalance || fCheckBLSSignature))
+        return true;
+
+    Generators gens = BulletproofsRangeproof::GetGenerators();
 
     for (size_t j = 0; j < tx.vout.size(); j++)
     {
@@ -110,57 +77,15 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
 
                 if (program.action == ERR) {
                     return state.DoS(100, false, REJECT_INVALID, "error-program-vdata");
-                } else if (program.action == CREATE_TOKEN) {
-                    txSigningKeys.push_back(program.kParameters[0]);
+                } else if (program.action == CREATE_TOKEN || program.action == UPDATE_NAME_FIRST || program.action == UPDATE_NAME ||
+                           program.action == MINT || program.action == STOP_MINT) {
+                    precheck.vSigningKeys.push_back(program.kParameters[0]);
                     hash = tx.vout[j].GetHash();
-                    vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
-                } else if (program.action == UPDATE_NAME_FIRST) {
-                    txSigningKeys.push_back(program.kParameters[0]);
-                    hash = tx.vout[j].GetHash();
-                    vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
-                } else if (program.action == UPDATE_NAME) {
-                    txSigningKeys.push_back(program.kParameters[0]);
-                    hash = tx.vout[j].GetHash();
-                    vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
-                } else if (program.action == MINT) {
-                    txSigningKeys.push_back(program.kParameters[0]);
-                    hash = tx.vout[j].GetHash();
-                    vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
-
-                    auto tokenId = SerializeHash(program.kParameters[0]);
+                    precheck.vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
 
-                    Scalar s;
-                    TokenInfo token;
-
-                    if (!view.GetToken(tokenId, token))
-                        return state.DoS(100, false, REJECT_INVALID, "wrong-token-id");
-
-                    uint64_t tokenNftId = -1;
-
-                    if (token.nVersion == 0)
-                    {
-                        s = Scalar(program.nParameters[0]);
-                    }
-                    else if (token.nVersion == 1)
-                    {
-                        tokenNftId = program.nParameters[0];
-                        s = Scalar(1);
-                    }
-                    else
-                        return state.DoS(100, false, REJECT_INVALID, "wrong-token-version");
-
-                    auto gensToken = BulletproofsRangeproof::GetGenerators(TokenId(tokenId, tokenNftId));
-
-                    if (fElementZero)
-                    {
-                        balKey = gensToken.H*s.bn;
-                    }
-                    else
-                    {
-                        bls::G1Element t = gensToken.H*s.bn;
-                        balKey = balKey + t;
-                    }
-                    fElementZero = false;
+                    // The value minted depends on the version of the token
+                    if (program.action == MINT)
+                        precheck.vMints.push_back(std::make_pair(SerializeHash(program.kParameters[0]), program.nParameters[0]));
                 } else if (program.action == BURN) {
                     auto gensToken = BulletproofsRangeproof::GetGenerators(tx.vout[j].tokenId);
 
@@ -168,23 +93,19 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
 
                     auto amountH = gensToken.H*s.bn;
 
-                    if (fElementZeroOut)
+                    if (precheck.fElementZeroOut)
                     {
-                        balKeyOut = amountH;
+                        precheck.balKeyOut = amountH;
                     }
                     else
                     {
-                        balKeyOut = balKeyOut + amountH;
+                        precheck.balKeyOut = precheck.balKeyOut + amountH;
                     }
 
-                    fElementZeroOut = false;
+                    precheck.fElementZeroOut = false;
 
                     if (tx.vout[j].scriptPubKey != CScript(OP_RETURN))
                         return state.DoS(100, false, REJECT_INVALID, "burn-wrong-script");
-                } else if (program.action == STOP_MINT) {
-                    txSigningKeys.push_back(program.kParameters[0]);
-                    hash = tx.vout[j].GetHash();
-                    vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
                 }
             } catch(...) {
                 return state.DoS(100, false, REJECT_INVALID, "error-program-vdata");
@@ -216,42 +137,31 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
 
             if (fCheckBalance)
             {
-                if (fElementZeroOut)
+                if (precheck.fElementZeroOut)
                 {
-                    balKeyOut = tx.vout[j].GetBulletproof().GetValueCommitments()[0];
+                    precheck.balKeyOut = tx.vout[j].GetBulletproof().GetValueCommitments()[0];
                 }
                 else
                 {
                     bls::G1Element t = tx.vout[j].GetBulletproof().GetValueCommitments()[0];
-                    balKeyOut = balKeyOut + t;
+                    precheck.balKeyOut = precheck.balKeyOut + t;
                 }
-                fElementZeroOut = false;
+                precheck.fElementZeroOut = false;
             }
         }
         else if (fCheckBalance && tx.vout[j].nValue > 0)
         {
-            gens = BulletproofsRangeproof::GetGenerators(tx.vout[j].tokenId);
-
-            if (fElementZeroOut)
-            {
-                Scalar s = Scalar(tx.vout[j].nValue);
-                balKeyOut = gens.H*s.bn;
-            }
-            else
-            {
-                Scalar s = Scalar(tx.vout[j].nValue);
-                bls::G1Element t = gens.H*s.bn;
-                balKeyOut = balKeyOut + t;
-            }
-            valOut += tx.vout[j].nValue;
-            fElementZeroOut = false;
+            Scalar s = Scalar(tx.vout[j].nValue);
+            bls::G1Element t = gens.H*s.bn;
+            precheck.balKeyOut = precheck.fElementZeroOut ? t : precheck.balKeyOut + t;
+            precheck.fElementZeroOut = false;
         }
 
         if (fCheckBLSSignature && tx.vout[j].ephemeralKey.size() > 0)
         {
             try
             {
-                txSigningKeys.push_back(bls::G1Element::FromBytes(tx.vout[j].ephemeralKey.data()));
+                precheck.vSigningKeys.push_back(bls::G1Element::FromBytes(tx.vout[j].ephemeralKey.data()));
             }
             catch(std::exception& e)
             {
@@ -261,7 +171,7 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
             if (hash == uint256())
                 hash = tx.vout[j].GetHash();
 
-            vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
+            precheck.vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
         }
     }
 
@@ -270,7 +180,7 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
         for (auto& it: proofs){
             if (it.second.size() > 0)
             {
-                if (!VerifyBulletproof(it.second, vData, nonces[it.first], fOnlyRecover, it.first))
+                if (!VerifyBulletproof(it.second, precheck.vData, nonces[it.first], fOnlyRecover, it.first))
                 {
                     return state.DoS(100, false, REJECT_INVALID, "invalid-rangeproof");
                 }
@@ -285,10 +195,7 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
 
         try
         {
-            bls::G2Element sig = bls::G2Element::FromBytes(tx.vchBalanceSig.data());
-
-            if (!bls::BasicSchemeMPL::Verify(balKey + balKeyOut.Inverse(), balanceMsg, sig))
-                return state.DoS(100, false, REJECT_INVALID, strprintf("invalid-balanceproof"));
+            precheck.balanceSig = bls::G2Element::FromBytes(tx.vchBalanceSig.data());
         }
         catch(std::exception& e)
         {
@@ -303,9 +210,147 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
 
         try
         {
-            bls::G2Element txsig = bls::G2Element::FromBytes(tx.vchTxSig.data());
+            precheck.txSig = bls::G2Element::FromBytes(tx.vchTxSig.data());
+        }
+        catch(std::exception& e)
+        {
+            return state.DoS(100, false, REJECT_INVALID, strprintf("caught-blstxsig-exception"));
+        }
+    }
+
+    return true;
+}
+
+bool VerifyBLSCTStateful(const CTransaction &tx, const CBLSCTPrecheck& precheck, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, CAmount nMixFee)
+{
+    bls::G1Element balKey;
+    bool fElementZero = true;
+
+    bool fCheckRange = tx.IsCTOutput();
+    bool fCheckBLSSignature = tx.IsBLSInput() && !precheck.fOnlyRecover;
+    bool fCheckBalance = (tx.IsBLSInput() || fCheckRange) && !precheck.fOnlyRecover;
+
+    if (!(fCheckRange || fCheckBalance || fCheckBLSSignature))
+        return true;
+
+    vData.insert(vData.end(), precheck.vData.begin(), precheck.vData.end());
+
+    std::vector<bls::G1Element> txSigningKeys;
+    std::vector<std::vector<uint8_t>> vMessages;
+
+    Generators gens = BulletproofsRangeproof::GetGenerators();
 
-            if (!bls::AugSchemeMPL::AggregateVerify(txSigningKeys, vMessages, txsig))
+    if (nMixFee != 0)
+    {
+        Scalar sMixFee = Scalar(nMixFee);
+
+        if (nMixFee < 0)
+            sMixFee = sMixFee.Negate();
+
+        Scalar s = Scalar(sMixFee).bn;
+        bls::G1Element t = gens.H*s.bn;
+        balKey = fElementZero ? t : balKey + t;
+        fElementZero = false;
+    }
+
+    for (size_t j = 0; j < tx.vin.size(); j++)
+    {
+        if (fCheckBalance || fCheckBLSSignature)
+        {
+            const CTxOut &prevOut = view.GetOutputFor(tx.vin[j]);
+
+            gens = BulletproofsRangeproof::GetGenerators(prevOut.tokenId);
+
+            if (fCheckBalance)
+            {
+                if (prevOut.HasRangeProof())
+                {
+                    balKey = fElementZero ? prevOut.GetBulletproof().GetValueCommitments()[0] : balKey + prevOut.GetBulletproof().GetValueCommitments()[0];
+                    fElementZero = false;
+                }
+                else
+                {
+                    Scalar s = Scalar(prevOut.nValue).bn;
+                    bls::G1Element t = gens.H*s.bn;
+                    balKey = fElementZero ? t : balKey + t;
+                    fElementZero = false;
+                }
+            }
+
+            if (fCheckBLSSignature)
+            {
+                try
+                {
+                    txSigningKeys.push_back(bls::G1Element::FromBytes(prevOut.spendingKey.data()));
+                }
+                catch(std::exception& e)
+                {
+                    return state.DoS(100, false, REJECT_INVALID, strprintf("caught-spendingkey-exception %s", e.what()));
+                }
+
+                CHashWriter hasher(0,0);
+                hasher << tx.vin[j];
+                uint256 hash = hasher.GetHash();
+                vMessages.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
+            }
+        }
+    }
+
+    // Minted amounts count as inputs of the balance
+    for (const auto& mint: precheck.vMints)
+    {
+        try {
+            Scalar s;
+            TokenInfo token;
+
+            if (!view.GetToken(mint.first, token))
+                return state.DoS(100, false, REJECT_INVALID, "wrong-token-id");
+
+            uint64_t tokenNftId = -1;
+
+            if (token.nVersion == 0)
+            {
+                s = Scalar(mint.second);
+            }
+            else if (token.nVersion == 1)
+            {
+                tokenNftId = mint.second;
+                s = Scalar(1);
+            }
+            else
+                return state.DoS(100, false, REJECT_INVALID, "wrong-token-version");
+
+            auto gensToken = BulletproofsRangeproof::GetGenerators(TokenId(mint.first, tokenNftId));
+
+            bls::G1Element t = gensToken.H*s.bn;
+            balKey = fElementZero ? t : balKey + t;
+            fElementZero = false;
+        } catch(...) {
+            return state.DoS(100, false, REJECT_INVALID, "error-program-vdata");
+        }
+    }
+
+    if (fCheckBalance)
+    {
+        try
+        {
+            if (!bls::BasicSchemeMPL::Verify(balKey + precheck.balKeyOut.Inverse(), balanceMsg, precheck.balanceSig))
+                return state.DoS(100, false, REJECT_INVALID, strprintf("invalid-balanceproof"));
+        }
+        catch(std::exception& e)
+        {
+            return state.DoS(100, false, REJECT_INVALID, strprintf("caught-balanceproof-exception"));
+        }
+    }
+
+    if (fCheckBLSSignature)
+    {
+        txSigningKeys.insert(txSigningKeys.end(), precheck.vSigningKeys.begin(), precheck.vSigningKeys.end());
+        vMessages.insert(vMessages.end(), precheck.vMessages.begin(), precheck.vMessages.end());
+
+        try
+        {
+            if (!bls::AugSchemeMPL::AggregateVerify(txSigningKeys, vMessages, precheck.txSig))
                 return state.DoS(100, false, REJECT_INVALID, "invalid-bls-signature");
         }
         catch(std::exception& e)
@@ -314,11 +359,66 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
         }
     }
 
-    //std::cout << strprintf("%s: took %.2fms\n", __func__, (GetTimeMicros()-nStart)/1000);
-
     return true;
 }
 
+bool PrecheckBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, CValidationState& state)
+{
+    if (!tx.IsBLSCT())
+        return true;
+
+    std::shared_ptr<const CBLSCTPrecheck> cached = blsctPrecheckCache.Get(tx.GetHash());
+    if (cached && cached->viewPublicKey == viewKey.GetG1Element()) {
+        state = cached->state;
+        return cached->fValid;
+    }
+
+    std::shared_ptr<CBLSCTPrecheck> precheck = std::make_shared<CBLSCTPrecheck>();
+
+    try
+    {
+        precheck->fValid = VerifyBLSCTStateless(tx, viewKey, *precheck, precheck->state);
+    }
+    catch(...)
+    {
+        // Left for VerifyBLSCT to fail again in its caller's context
+        return false;
+    }
+
+    // Failures are kept as well, so they are reported in order once the transaction is verified
+    blsctPrecheckCache.Add(tx.GetHash(), precheck);
+    state = precheck->state;
+    return precheck->fValid;
+}
+
+bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover, CAmount nMixFee)
+{
+    if (!fOnlyRecover && !view.HaveInputs(tx)) {
+        return state.DoS(100, false, REJECT_INVALID, strprintf("inputs-not-available"));
+    }
+
+    std::shared_ptr<const CBLSCTPrecheck> precheck;
+
+    // The range proofs recovered with another view key are of no use to the caller
+    if (!fOnlyRecover) {
+        precheck = blsctPrecheckCache.Get(tx.GetHash());
+        if (precheck && precheck->viewPublicKey != viewKey.GetG1Element())
+            precheck = nullptr;
+    }
+
+    if (!precheck) {
+        std::shared_ptr<CBLSCTPrecheck> newPrecheck = std::make_shared<CBLSCTPrecheck>();
+        if (!VerifyBLSCTStateless(tx, viewKey, *newPrecheck, state, fOnlyRecover))
+            return false;
+        precheck = newPrecheck;
+    } else if (!precheck->fValid) {
+        state = precheck->state;
+        return false;
+    }
+
+    return VerifyBLSCTStateful(tx, *precheck, vData, view, state, nMixFee);
+}
+
 
 bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover, CAmount nMixFee)
 {
@@ -420,7 +520,7 @@ bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey,
 }
 
 
-bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx, const CStateViewCache& inputs, CValidationState& state, CAmount nMixFee)
+bool BuildCombinedBLSCTTransaction(const std::set<CTransaction> &vTx, CMutableTransaction& mutOutTx, CAmount& nFee, CValidationState& state)
 {
     std::set<CTxIn> setInputs;
     std::set<CTxOut> setOutputs;
@@ -432,7 +532,7 @@ bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx,
         return state.DoS(100, false, REJECT_INVALID, strprintf("empty-vector-combine-blsct"));
 
     bool fAnyCTOutput = false;
-    CAmount nFee = 0;
+    nFee = 0;
 
     for (auto& tx: vTx)
     {
@@ -499,11 +599,9 @@ bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx,
         }
     }
 
-    CMutableTransaction mutOutTx;
     mutOutTx.nVersion = TX_BLS_INPUT_FLAG;
     if (fAnyCTOutput)
         mutOutTx.nVersion |= TX_BLS_CT_FLAG;
-    mutOutTx.nTime = GetTime();
     mutOutTx.vin.clear();
     mutOutTx.vout.clear();
 
@@ -517,12 +615,26 @@ bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx,
         mutOutTx.vout.push_back(out);
     }
 
+    mutOutTx.SetBalanceSignature(bls::AugSchemeMPL::Aggregate(balanceSigs));
+    mutOutTx.SetTxSignature(bls::AugSchemeMPL::Aggregate(txSigs));
+
+    return true;
+}
+
+bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx, const CStateViewCache& inputs, CValidationState& state, CAmount nMixFee)
+{
+    CMutableTransaction mutOutTx;
+    CAmount nFee;
+
+    if (!BuildCombinedBLSCTTransaction(vTx, mutOutTx, nFee, state))
+        return false;
+
+    mutOutTx.nTime = GetTime();
+
     RandomShuffle(mutOutTx.vin);
     RandomShuffle(mutOutTx.vout);
 
     mutOutTx.vout.push_back(CTxOut(nFee, CScript(OP_RETURN)));
-    mutOutTx.SetBalanceSignature(bls::AugSchemeMPL::Aggregate(balanceSigs));
-    mutOutTx.SetTxSignature(bls::AugSchemeMPL::Aggregate(txSigs));
 
     outTx = mutOutTx;
 
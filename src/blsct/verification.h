@@ -22,7 +22,55 @@
 #include <schemes.hpp>
 #include <utiltime.h>
 
+#include <memory>
+#include <vector>
+
+/** Most transactions whose stateless BLSCT checks are kept for VerifyBLSCT */
+static const unsigned int MAX_BLSCT_PRECHECK_CACHE_SIZE = 10000;
+
+/**
+ * The part of the verification of a BLSCT transaction that does not depend
+ * on the outputs it spends: range proofs, point decoding and output
+ * programs. VerifyBLSCTStateful completes it against the spent outputs.
+ */
+struct CBLSCTPrecheck
+{
+    //! whether the checks passed, and why not
+    bool fValid;
+    CValidationState state;
+
+    //! public key of the view key the range proofs were recovered with
+    bls::G1Element viewPublicKey;
+    bool fOnlyRecover;
+    std::vector<RangeproofEncodedData> vData;
+
+    //! output side of the balance: value commitments, plain and burnt amounts
+    bls::G1Element balKeyOut;
+    bool fElementZeroOut;
+
+    //! keys and messages the outputs add to the transaction signature
+    std::vector<bls::G1Element> vSigningKeys;
+    std::vector<std::vector<uint8_t>> vMessages;
+
+    //! tokens minted and their amount or nft id, valued with the token version
+    std::vector<std::pair<uint256, uint64_t>> vMints;
+
+    bls::G2Element balanceSig;
+    bls::G2Element txSig;
+
+    CBLSCTPrecheck() : fValid(true), fOnlyRecover(false), fElementZeroOut(true) {}
+};
+
+bool VerifyBLSCTStateless(const CTransaction &tx, bls::PrivateKey viewKey, CBLSCTPrecheck& precheck, CValidationState& state, bool fOnlyRecover = false);
+bool VerifyBLSCTStateful(const CTransaction &tx, const CBLSCTPrecheck& precheck, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, CAmount nMixFee = 0);
+/** Run the stateless checks of a received transaction and keep them for VerifyBLSCT. Can be called without cs_main. */
+bool PrecheckBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, CValidationState& state);
 bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover = false, CAmount nMixFee = 0);
 bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover = false, CAmount nMixFee = 0);
+/**
+ * Combine vTx into one transaction, with its inputs and outputs in sorted order
+ * and without the output paying nFee. CombineBLSCTTransactions shuffles them.
+ */
+bool BuildCombinedBLSCTTransaction(const std::set<CTransaction> &vTx, CMutableTransaction& mutOutTx, CAmount& nFee, CValidationState& state);
 bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx, const CStateViewCache& inputs, CValidationState& state, CAmount nMixFee = 0);
 #endif // BLSCT_VERIFICATION_H
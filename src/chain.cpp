@@ -5,6 +5,43 @@
 
 #include <chain.h>
 
+#include <sync.h>
+
+/** Guards loading the cold part of block index entries. */
+static CCriticalSection cs_blockindexcold;
+
+/** Entries loaded since the last TakeBlockIndexColdLoaded call. */
+static std::vector<uint256> vBlockIndexColdLoaded;
+
+CBlockIndexCold& CBlockIndex::LoadCold() const
+{
+    LOCK(cs_blockindexcold);
+    if (pcold.get() == nullptr)
+    {
+        std::unique_ptr<CBlockIndexCold> pnew(new CBlockIndexCold());
+        // Entries which never made it to disk start out empty.
+        if (phashBlock == nullptr || !ReadBlockIndexCold(*phashBlock, *pnew))
+            pnew->SetNull();
+        pcold.reset(pnew.release());
+        if (phashBlock != nullptr)
+            vBlockIndexColdLoaded.push_back(*phashBlock);
+    }
+    return *pcold.get();
+}
+
+void TakeBlockIndexColdLoaded(std::vector<uint256>& vHashes)
+{
+    LOCK(cs_blockindexcold);
+    vHashes.insert(vHashes.end(), vBlockIndexColdLoaded.begin(), vBlockIndexColdLoaded.end());
+    vBlockIndexColdLoaded.clear();
+}
+
+void CBlockIndex::EvictCold()
+{
+    LOCK(cs_blockindexcold);
+    pcold.reset();
+}
+
 /**
  * CChain implementation
  */
@@ -15,6 +15,9 @@
 #include <util.h>
 #include <utilmoneystr.h>
 
+#include <atomic>
+#include <memory>
+#include <set>
 #include <vector>
 
 #define BLOCK_PROOF_OF_STAKE    0x01 // is proof-of-stake block
@@ -165,8 +168,73 @@ enum BlockStatus: uint32_t {
     BLOCK_OPT_WITNESS        =   128, //! block data in blk*.data was received with a witness-enforcing client
     BLOCK_OPT_DAO            =   256, //! DAO data structures
     BLOCK_OPT_SUPPLY         =   512, //! supply data structures
+    BLOCK_OPT_MINT           =  1024, //! mint and dzeel fields
 };
 
+/** Fields of a block index entry which are only needed when connecting the
+ *  block or when reporting about it. They are kept out of CBlockIndex so the
+ *  entries loaded for the whole chain at startup stay small. */
+class CBlockIndexCold
+{
+public:
+    int64_t nMint;
+    int64_t nCFSupply;
+    int64_t nCFLocked;
+
+    std::string strDZeel;
+
+    arith_uint256 hashProof;
+
+    CAmount nPrivateMoneySupply;
+    CAmount nPublicMoneySupply;
+
+    CBlockIndexCold()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nMint = 0;
+        nCFSupply = 0;
+        nCFLocked = 0;
+        strDZeel = "";
+        hashProof = arith_uint256();
+        nPrivateMoneySupply = 0;
+        nPublicMoneySupply = 0;
+    }
+};
+
+/** Owning pointer to the cold part of a block index entry, copied by value.
+ *  It is read without a lock, so a pointer set by another thread is only
+ *  seen together with the fields it points to. */
+class CBlockIndexColdPtr
+{
+private:
+    std::atomic<CBlockIndexCold*> ptr;
+
+public:
+    CBlockIndexColdPtr() : ptr(nullptr) {}
+    CBlockIndexColdPtr(const CBlockIndexColdPtr& other) : ptr(other.get() ? new CBlockIndexCold(*other.get()) : nullptr) {}
+    ~CBlockIndexColdPtr() { delete ptr.load(std::memory_order_acquire); }
+
+    CBlockIndexColdPtr& operator=(const CBlockIndexColdPtr& other)
+    {
+        if (this != &other)
+            reset(other.get() ? new CBlockIndexCold(*other.get()) : nullptr);
+        return *this;
+    }
+
+    CBlockIndexCold* get() const { return ptr.load(std::memory_order_acquire); }
+    void reset(CBlockIndexCold* p = nullptr) { delete ptr.exchange(p, std::memory_order_acq_rel); }
+};
+
+/** Read the cold part of the block index entry of a block from the block tree database. */
+bool ReadBlockIndexCold(const uint256& hash, CBlockIndexCold& cold);
+
+/** Append the hashes of the entries whose cold part was read from disk since the last call. */
+void TakeBlockIndexColdLoaded(std::vector<uint256>& vHashes);
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -221,23 +289,43 @@ public:
     unsigned int nBits;
     unsigned int nNonce;
 
-    int64_t nMint;
-    int64_t nCFSupply;
-    int64_t nCFLocked;
-
-    std::string strDZeel;
-
     unsigned int nFlags;  // ppcoin: block index flags
 
     uint64_t nStakeModifier; // hash modifier for proof-of-stake
 
-    arith_uint256 hashProof;
-
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
 
-    CAmount nPrivateMoneySupply;
-    CAmount nPublicMoneySupply;
+private:
+    //! Rarely used fields, loaded from the block tree database on first use. See GetCold().
+    mutable CBlockIndexColdPtr pcold;
+
+    CBlockIndexCold& LoadCold() const;
+
+public:
+    //! Return the cold fields, reading them from disk if this entry was loaded at startup.
+    const CBlockIndexCold& GetCold() const
+    {
+        CBlockIndexCold* p = pcold.get();
+        return p ? *p : LoadCold();
+    }
+
+    CBlockIndexCold& Cold()
+    {
+        CBlockIndexCold* p = pcold.get();
+        return p ? *p : LoadCold();
+    }
+
+    //! Whether the cold fields are in memory.
+    bool HaveCold() const
+    {
+        return pcold.get() != nullptr;
+    }
+
+    //! Drop the cold fields so they are read from disk again on next use. The
+    //! caller makes sure they were written to the block tree database and that
+    //! no reference returned by GetCold() or Cold() is still in use.
+    void EvictCold();
 
     void SetNull()
     {
@@ -253,14 +341,9 @@ public:
         nTx = 0;
         nChainTx = 0;
         nStatus = 0;
-        nMint = 0;
-        nCFSupply = 0;
-        nCFLocked = 0;
-        nPrivateMoneySupply = 0;
-        nPublicMoneySupply = 0;
+        pcold.reset();
         nFlags = 0;
         nStakeModifier = 0;
-        hashProof = arith_uint256();
         nVersion       = 0;
         hashMerkleRoot = uint256();
         nTime          = 0;
@@ -276,6 +359,7 @@ public:
     CBlockIndex(const CBlockHeader& block)
     {
         SetNull();
+        pcold.reset(new CBlockIndexCold());
 
         nVersion       = block.nVersion;
         hashMerkleRoot = block.hashMerkleRoot;
@@ -287,6 +371,7 @@ public:
     CBlockIndex(const CBlock& block)
     {
         SetNull();
+        pcold.reset(new CBlockIndexCold());
 
         if (block.IsProofOfStake())
         {
@@ -377,10 +462,10 @@ public:
     {
         return strprintf("CBlockIndex(nprev=%p, nFile=%u, nHeight=%d, nMint=%s, nCFSupply=%s, nCFLocked=%s, nFlags=(%s)(%d)(%s), nStakeModifier=%016x, hashProof=%s, merkle=%s, hashBlock=%s)",
                          pprev, nFile, nHeight,
-                         FormatMoney(nMint), FormatMoney(nCFSupply), FormatMoney(nCFLocked),
+                         FormatMoney(GetCold().nMint), FormatMoney(GetCold().nCFSupply), FormatMoney(GetCold().nCFLocked),
                          GeneratedStakeModifier() ? "MOD" : "-", GetStakeEntropyBit(), IsProofOfStake()? "PoS" : "PoW",
                          nStakeModifier,
-                         hashProof.ToString(),
+                         GetCold().hashProof.ToString(),
                          hashMerkleRoot.ToString(),
                          GetBlockHash().ToString());
     }
@@ -480,6 +565,79 @@ arith_uint256 GetBlockProof(const CBlockIndex& block);
 /** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params&);
 
+/** DAO votes and support signalled by a single block. */
+class CBlockVotes
+{
+public:
+    std::vector<std::pair<uint256, int>> vProposalVotes;
+    std::vector<std::pair<uint256, int>> vPaymentRequestVotes;
+    std::map<uint256, bool> mapSupport;
+    std::map<uint256, uint64_t> mapConsultationVotes;
+
+    // Voters whose cached vote list was changed by this block. Only
+    // meaningful when fVotersIndexed is set, records moved out of older
+    // block index entries do not have it.
+    bool fVotersIndexed;
+    std::set<std::vector<unsigned char>> setVoters;
+    // History entries of each voter merged by compaction while connecting
+    // this block, restored when the block is disconnected.
+    std::map<std::vector<unsigned char>, std::map<int, std::map<uint256, int64_t>>> mapCompactedVotes;
+
+    CBlockVotes() : fVotersIndexed(false) {}
+
+    bool IsEmpty() const
+    {
+        return vProposalVotes.empty() && vPaymentRequestVotes.empty() && mapSupport.empty() && mapConsultationVotes.empty() && !fVotersIndexed;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(vProposalVotes);
+        READWRITE(vPaymentRequestVotes);
+        READWRITE(mapSupport);
+        READWRITE(mapConsultationVotes);
+        READWRITE(fVotersIndexed);
+        READWRITE(setVoters);
+        READWRITE(mapCompactedVotes);
+    }
+};
+
+/** Block tree database key of the votes of a block, ordered by height. */
+struct CBlockVotesKey {
+    int nHeight;
+    uint256 blockHash;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 36;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, nHeight);
+        blockHash.Serialize(s, nType, nVersion);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        nHeight = ser_readdata32be(s);
+        blockHash.Unserialize(s, nType, nVersion);
+    }
+
+    CBlockVotesKey(int height, const uint256& hash) {
+        nHeight = height;
+        blockHash = hash;
+    }
+
+    CBlockVotesKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nHeight = 0;
+        blockHash.SetNull();
+    }
+};
+
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
 {
@@ -543,7 +701,7 @@ public:
             const_cast<CDiskBlockIndex*>(this)->prevoutStake.SetNull();
             const_cast<CDiskBlockIndex*>(this)->nStakeTime = 0;
         }
-        READWRITE(hashProof);
+        READWRITE(Cold().hashProof);
         // block header
         READWRITE(this->nVersion);
         READWRITE(hashPrev);
@@ -552,8 +710,8 @@ public:
         READWRITE(nBits);
         READWRITE(nNonce);
         READWRITE(blockHash);
-        READWRITE(nCFSupply);
-        READWRITE(nCFLocked);
+        READWRITE(Cold().nCFSupply);
+        READWRITE(Cold().nCFLocked);
 
         if (this->nStatus & BLOCK_OPT_DAO)
         {
@@ -600,8 +758,14 @@ public:
 
         if (this->nStatus & BLOCK_OPT_SUPPLY)
         {
-            READWRITE(nPrivateMoneySupply);
-            READWRITE(nPublicMoneySupply);
+            READWRITE(Cold().nPrivateMoneySupply);
+            READWRITE(Cold().nPublicMoneySupply);
+        }
+
+        if (this->nStatus & BLOCK_OPT_MINT)
+        {
+            READWRITE(Cold().nMint);
+            READWRITE(Cold().strDZeel);
         }
     }
 
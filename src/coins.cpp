@@ -8,11 +8,83 @@
 #include <main.h>
 #include <memusage.h>
 #include <random.h>
+#include <streams.h>
 #include <util.h>
 #include <utiltime.h>
+#include <version.h>
 
+#include <algorithm>
 #include <assert.h>
 
+static void StateStatsElement(CDataStream& ss, const uint256 &txid, unsigned int n, const CTxOut &out, int nHeight, bool fCoinBase)
+{
+    ss << COutPoint(txid, n);
+    ss << VARINT((uint64_t)nHeight * 2 + (fCoinBase ? 1 : 0));
+    ss << out;
+}
+
+//! Rough per-output size estimate that does not depend on the database layout.
+static uint64_t GetBogoSize(const CTxOut &out)
+{
+    return 32 /* txid */ +
+           4 /* vout index */ +
+           4 /* height + coinbase */ +
+           8 /* amount */ +
+           2 /* scriptPubKey len */ +
+           out.scriptPubKey.size() /* scriptPubKey */;
+}
+
+void CStateStats::AddOutput(const uint256 &txid, unsigned int n, const CTxOut &out, int nHeight, bool fCoinBase)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    StateStatsElement(ss, txid, n, out, nHeight, fCoinBase);
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs++;
+    nBogoSize += GetBogoSize(out);
+    nTotalAmount += out.nValue;
+    if (out.scriptPubKey.IsColdStaking()) nTotalColdAmount += out.nValue;
+    if (out.scriptPubKey.IsColdStakingv2()) nTotalColdv2Amount += out.nValue;
+}
+
+void CStateStats::RemoveOutput(const uint256 &txid, unsigned int n, const CTxOut &out, int nHeight, bool fCoinBase)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    StateStatsElement(ss, txid, n, out, nHeight, fCoinBase);
+    muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs--;
+    nBogoSize -= GetBogoSize(out);
+    nTotalAmount -= out.nValue;
+    if (out.scriptPubKey.IsColdStaking()) nTotalColdAmount -= out.nValue;
+    if (out.scriptPubKey.IsColdStakingv2()) nTotalColdv2Amount -= out.nValue;
+}
+
+void CStateStats::AddCoins(const uint256 &txid, const CCoins &coins)
+{
+    if (coins.IsPruned())
+        return;
+    nTransactions++;
+    for (unsigned int i = 0; i < coins.vout.size(); i++)
+        if (!coins.vout[i].IsNull())
+            AddOutput(txid, i, coins.vout[i], coins.nHeight, coins.fCoinBase);
+}
+
+void CStateStats::RemoveCoins(const uint256 &txid, const CCoins &coins)
+{
+    if (coins.IsPruned())
+        return;
+    nTransactions--;
+    for (unsigned int i = 0; i < coins.vout.size(); i++)
+        if (!coins.vout[i].IsNull())
+            RemoveOutput(txid, i, coins.vout[i], coins.nHeight, coins.fCoinBase);
+}
+
+uint256 CStateStats::GetHash() const
+{
+    uint256 hash;
+    muhash.Finalize(hash.begin());
+    return hash;
+}
+
 /**
  * calculate number of bytes for the bitmask, and its number of non-zero bytes
  * each bit in the bitmask represents the availability of one output, but the
@@ -53,7 +125,8 @@ bool CStateView::GetConsultation(const uint256 &cid, CConsultation& consultation
 bool CStateView::GetConsultationAnswer(const uint256 &cid, CConsultationAnswer& answer) const { return false; }
 bool CStateView::GetConsensusParameter(const int &pid, CConsensusParameter& cparameter) const { return false; }
 bool CStateView::GetToken(const uint256 &id, TokenInfo& token) const { return false; }
-bool CStateView::GetTokenUtxos(const uint256 &id, TokenUtxoValues &tokenUtxos) { return false; };
+bool CStateView::GetTokenUtxos(const TokenUtxoKey &start, size_t nLimit, TokenUtxoValues &tokenUtxos) { return false; }
+bool CStateView::GetLastTokenUtxo(const TokenUtxoKey &end, TokenUtxoEntry &tokenUtxo) { return false; }
 bool CStateView::GetNameRecord(const uint256 &id, NameRecordValue& height) const { return false; }
 bool CStateView::GetNameData(const uint256 &id, NameDataValues& data) { return false; }
 bool CStateView::HaveCoins(const uint256 &txid) const { return false; }
@@ -64,12 +137,14 @@ bool CStateView::HaveConsultation(const uint256 &cid) const { return false; }
 bool CStateView::HaveConsultationAnswer(const uint256 &cid) const { return false; }
 bool CStateView::HaveConsensusParameter(const int &pid) const { return false; }
 bool CStateView::HaveToken(const uint256 &id) const { return false; }
-bool CStateView::HaveTokenUtxos(const uint256 &id) const { return false; }
 bool CStateView::HaveNameRecord(const uint256 &id) const { return false; }
 bool CStateView::HaveNameData(const uint256 &id) const { return false; }
+bool CStateView::GetNameState(const uint256 &id, NameDataState& state) const { return false; }
 bool CStateView::GetAllProposals(CProposalMap& map) { return false; }
 int CStateView::GetExcludeVotes() const { return 0; }
 bool CStateView::SetExcludeVotes(int count) { return 0; }
+bool CStateView::GetStateStats(CStateStats& stats) const { return false; }
+bool CStateView::SetStateStats(const CStateStats& stats) { return false; }
 bool CStateView::GetAllPaymentRequests(CPaymentRequestMap& map) { return false; }
 bool CStateView::GetAllVotes(CVoteMap& map) { return false; }
 bool CStateView::GetAllConsultations(CConsultationMap& map) { return false; }
@@ -81,8 +156,8 @@ bool CStateView::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
                             CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                             CConsultationMap& mapConsultations, CConsultationAnswerMap& mapAnswers,
                             CConsensusParameterMap& mapConsensus, TokenMap& mapTokens, TokenUtxoMap& mapTokenUtxos,
-                            NameRecordMap& mapNameRecords, NameDataMap& mapNameData,
-                            const uint256 &hashBlock, const int& nCacheExcludeVotes) { return false; }
+                            NameRecordMap& mapNameRecords, NameDataMap& mapNameData, NameStateMap& mapNameStates,
+                            const uint256 &hashBlock, const int& nCacheExcludeVotes, const CStateStats& stats) { return false; }
 CStateViewCursor *CStateView::Cursor() const { return 0; }
 
 
@@ -94,7 +169,8 @@ bool CStateViewBacked::GetConsultation(const uint256 &cid, CConsultation &consul
 bool CStateViewBacked::GetConsultationAnswer(const uint256 &cid, CConsultationAnswer &answer) const { return base->GetConsultationAnswer(cid, answer); }
 bool CStateViewBacked::GetConsensusParameter(const int &pid, CConsensusParameter& cparameter) const { return base->GetConsensusParameter(pid, cparameter); }
 bool CStateViewBacked::GetToken(const uint256 &id, TokenInfo& token) const { return base->GetToken(id, token); }
-bool CStateViewBacked::GetTokenUtxos(const uint256 &id, TokenUtxoValues &tokenUtxos) { return base->GetTokenUtxos(id, tokenUtxos); }
+bool CStateViewBacked::GetTokenUtxos(const TokenUtxoKey &start, size_t nLimit, TokenUtxoValues &tokenUtxos) { return base->GetTokenUtxos(start, nLimit, tokenUtxos); }
+bool CStateViewBacked::GetLastTokenUtxo(const TokenUtxoKey &end, TokenUtxoEntry &tokenUtxo) { return base->GetLastTokenUtxo(end, tokenUtxo); }
 bool CStateViewBacked::GetNameRecord(const uint256 &id, NameRecordValue& height) const { return base->GetNameRecord(id, height); }
 bool CStateViewBacked::GetNameData(const uint256 &id, NameDataValues& data) { return base->GetNameData(id, data); }
 bool CStateViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
@@ -105,11 +181,13 @@ bool CStateViewBacked::HaveConsultation(const uint256 &cid) const { return base-
 bool CStateViewBacked::HaveConsultationAnswer(const uint256 &cid) const { return base->HaveConsultationAnswer(cid); }
 bool CStateViewBacked::HaveConsensusParameter(const int &pid) const { return base->HaveConsensusParameter(pid); }
 bool CStateViewBacked::HaveToken(const uint256 &id) const { return base->HaveToken(id); }
-bool CStateViewBacked::HaveTokenUtxos(const uint256 &id) const { return base->HaveTokenUtxos(id); }
 bool CStateViewBacked::HaveNameRecord(const uint256 &id) const { return base->HaveNameRecord(id); }
 bool CStateViewBacked::HaveNameData(const uint256 &id) const { return base->HaveNameData(id); }
+bool CStateViewBacked::GetNameState(const uint256 &id, NameDataState& state) const { return base->GetNameState(id, state); }
 int CStateViewBacked::GetExcludeVotes() const { return base->GetExcludeVotes(); }
 bool CStateViewBacked::SetExcludeVotes(int count) { return base->SetExcludeVotes(count); }
+bool CStateViewBacked::GetStateStats(CStateStats& stats) const { return base->GetStateStats(stats); }
+bool CStateViewBacked::SetStateStats(const CStateStats& stats) { return base->SetStateStats(stats); }
 bool CStateViewBacked::GetCachedVoter(const CVoteMapKey &voter, CVoteMapValue& vote) const { return base->GetCachedVoter(voter, vote); }
 bool CStateViewBacked::GetAllProposals(CProposalMap& map) { return base->GetAllProposals(map); }
 bool CStateViewBacked::GetAllPaymentRequests(CPaymentRequestMap& map) { return base->GetAllPaymentRequests(map); }
@@ -124,15 +202,108 @@ bool CStateViewBacked::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposal
                                   CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                                   CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
                                   CConsensusParameterMap& mapConsensus, TokenMap& mapTokens, TokenUtxoMap& mapTokenUtxos,
-                                  NameRecordMap& mapNameRecords, NameDataMap& mapNameData,
-                                  const uint256 &hashBlock, const int &nCacheExcludeVotes) {
-    return base->BatchWrite(mapCoins, mapProposals, mapPaymentRequests, mapVotes, mapConsultations, mapAnswers, mapConsensus, mapTokens, mapTokenUtxos, mapNameRecords, mapNameData, hashBlock, nCacheExcludeVotes);
+                                  NameRecordMap& mapNameRecords, NameDataMap& mapNameData, NameStateMap& mapNameStates,
+                                  const uint256 &hashBlock, const int &nCacheExcludeVotes, const CStateStats& stats) {
+    return base->BatchWrite(mapCoins, mapProposals, mapPaymentRequests, mapVotes, mapConsultations, mapAnswers, mapConsensus, mapTokens, mapTokenUtxos, mapNameRecords, mapNameData, mapNameStates, hashBlock, nCacheExcludeVotes, stats);
 }
 CStateViewCursor *CStateViewBacked::Cursor() const { return base->Cursor(); }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CStateViewCache::CStateViewCache(CStateView *baseIn) : CStateViewBacked(baseIn), hasModifier(false), hasModifierConsensus(false), cachedCoinsUsage(0), nCacheExcludeVotes(-1) { }
+static const char* const STATE_CACHE_CATEGORY_NAMES[STATE_CACHE_CATEGORIES] = {
+    "coins",
+    "proposals",
+    "paymentrequests",
+    "votes",
+    "consultations",
+    "answers",
+    "consensus",
+    "tokens",
+    "tokenutxos",
+    "namerecords",
+    "namedata",
+    "namestates",
+};
+
+const char* GetStateCacheCategoryName(StateCacheCategory category)
+{
+    return STATE_CACHE_CATEGORY_NAMES[category];
+}
+
+static size_t StateDynamicUsage(const uint256& key) { return 0; }
+static size_t StateDynamicUsage(const int& key) { return 0; }
+static size_t StateDynamicUsage(const CVoteMapKey& key) { return memusage::DynamicUsage(key); }
+static size_t StateDynamicUsage(const TokenUtxoKey& key) { return 0; }
+
+template <typename T>
+static size_t StateDynamicUsage(const T& value)
+{
+    return value.DynamicMemoryUsage();
+}
+
+template <typename T>
+static size_t StateDynamicUsage(const std::vector<std::pair<uint64_t, T> >& values)
+{
+    size_t ret = memusage::DynamicUsage(values);
+    for (const auto& it: values)
+        ret += it.second.DynamicMemoryUsage();
+    return ret;
+}
+
+/** Memory used by one entry of a state cache map, including its node. */
+template <typename Map>
+static size_t StateEntryUsage(const Map& map, const typename Map::value_type& entry)
+{
+    return memusage::IncrementalDynamicUsage(map) + StateDynamicUsage(entry.first) + StateDynamicUsage(entry.second);
+}
+
+template <typename Map>
+static size_t StateKeyUsage(const Map& map, const typename Map::key_type& key)
+{
+    typename Map::const_iterator it = map.find(key);
+    return it == map.end() ? 0 : StateEntryUsage(map, *it);
+}
+
+template <typename Map>
+static size_t StateMapUsage(const Map& map)
+{
+    size_t ret = 0;
+    for (const auto& it: map)
+        ret += StateEntryUsage(map, it);
+    return ret;
+}
+
+/** Swap a value into map[key], keeping the usage counter of the map up to date. */
+template <typename Map>
+static typename Map::iterator SwapIntoStateCache(Map& map, size_t& usage, const typename Map::key_type& key, typename Map::mapped_type& value)
+{
+    std::pair<typename Map::iterator, bool> ret = map.insert(std::make_pair(key, typename Map::mapped_type()));
+    if (ret.second)
+        usage += memusage::IncrementalDynamicUsage(map) + StateDynamicUsage(key);
+    usage -= StateDynamicUsage(ret.first->second);
+    ret.first->second.swap(value);
+    usage += StateDynamicUsage(ret.first->second);
+    return ret.first;
+}
+
+/** Adds the change in memory usage of one key of a state cache map to its counter when going out of scope. */
+template <typename Map>
+class CStateUsageGuard
+{
+private:
+    const Map& map;
+    const typename Map::key_type key;
+    size_t& usage;
+    size_t nUsageBefore;
+
+public:
+    CStateUsageGuard(const Map& mapIn, const typename Map::key_type& keyIn, size_t& usageIn) : map(mapIn), key(keyIn), usage(usageIn), nUsageBefore(StateKeyUsage(mapIn, keyIn)) {}
+    ~CStateUsageGuard() { usage += StateKeyUsage(map, key) - nUsageBefore; }
+};
+
+CStateViewCache::CStateViewCache(CStateView *baseIn) : CStateViewBacked(baseIn), hasModifier(false), hasModifierConsensus(false), nCacheExcludeVotes(-1), fCacheStats(false), cachedCoinsUsage(0), nAccessClock(0) {
+    std::fill(cachedStateUsage, cachedStateUsage + STATE_CACHE_CATEGORIES, 0);
+}
 
 CStateViewCache::~CStateViewCache()
 {
@@ -141,17 +312,43 @@ CStateViewCache::~CStateViewCache()
 }
 
 size_t CStateViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
+    size_t ret = 0;
+    for (int i = 0; i < STATE_CACHE_CATEGORIES; i++)
+        ret += DynamicMemoryUsage((StateCacheCategory)i);
+    return ret;
+}
+
+size_t CStateViewCache::DynamicMemoryUsage(StateCacheCategory category) const {
+    if (category == STATE_CACHE_COINS)
+        return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
+    return cachedStateUsage[category];
+}
+
+void CStateViewCache::RecomputeStateUsage() const {
+    cachedStateUsage[STATE_CACHE_PROPOSALS] = StateMapUsage(cacheProposals);
+    cachedStateUsage[STATE_CACHE_PAYMENT_REQUESTS] = StateMapUsage(cachePaymentRequests);
+    cachedStateUsage[STATE_CACHE_VOTES] = StateMapUsage(cacheVotes);
+    cachedStateUsage[STATE_CACHE_CONSULTATIONS] = StateMapUsage(cacheConsultations);
+    cachedStateUsage[STATE_CACHE_ANSWERS] = StateMapUsage(cacheAnswers);
+    cachedStateUsage[STATE_CACHE_CONSENSUS] = StateMapUsage(cacheConsensus);
+    cachedStateUsage[STATE_CACHE_TOKENS] = StateMapUsage(cacheTokens);
+    cachedStateUsage[STATE_CACHE_TOKEN_UTXOS] = StateMapUsage(cacheTokenUtxos);
+    cachedStateUsage[STATE_CACHE_NAME_RECORDS] = StateMapUsage(cacheNameRecords);
+    cachedStateUsage[STATE_CACHE_NAME_DATA] = StateMapUsage(cacheNameData);
+    cachedStateUsage[STATE_CACHE_NAME_STATES] = StateMapUsage(cacheNameStates);
 }
 
 CCoinsMap::const_iterator CStateViewCache::FetchCoins(const uint256 &txid) const {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.nLastUsed = ++nAccessClock;
         return it;
+    }
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
+    ret->second.nLastUsed = ++nAccessClock;
     tmp.swap(ret->second.coins);
     if (ret->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
@@ -173,8 +370,7 @@ CProposalMap::const_iterator CStateViewCache::FetchProposal(const uint256 &pid)
     if (!base->GetProposal(pid, tmp) || tmp.IsNull())
         return cacheProposals.end();
 
-    CProposalMap::iterator ret = cacheProposals.insert(std::make_pair(pid, CProposal())).first;
-    tmp.swap(ret->second);
+    CProposalMap::iterator ret = SwapIntoStateCache(cacheProposals, cachedStateUsage[STATE_CACHE_PROPOSALS], pid, tmp);
 
     return ret;
 }
@@ -190,8 +386,7 @@ CPaymentRequestMap::const_iterator CStateViewCache::FetchPaymentRequest(const ui
     if (!base->GetPaymentRequest(prid, tmp) || tmp.IsNull())
         return cachePaymentRequests.end();
 
-    CPaymentRequestMap::iterator ret = cachePaymentRequests.insert(std::make_pair(prid, CPaymentRequest())).first;
-    tmp.swap(ret->second);
+    CPaymentRequestMap::iterator ret = SwapIntoStateCache(cachePaymentRequests, cachedStateUsage[STATE_CACHE_PAYMENT_REQUESTS], prid, tmp);
 
     return ret;
 }
@@ -208,8 +403,7 @@ CVoteMap::const_iterator CStateViewCache::FetchVote(const CVoteMapKey &voter) co
     if (!base->GetCachedVoter(voter, tmp) || tmp.IsNull())
         return cacheVotes.end();
 
-    CVoteMap::iterator ret = cacheVotes.insert(std::make_pair(voter, CVoteList())).first;
-    tmp.swap(ret->second);
+    CVoteMap::iterator ret = SwapIntoStateCache(cacheVotes, cachedStateUsage[STATE_CACHE_VOTES], voter, tmp);
 
     return ret;
 }
@@ -225,8 +419,7 @@ CConsultationMap::const_iterator CStateViewCache::FetchConsultation(const uint25
     if (!base->GetConsultation(cid, tmp) || tmp.IsNull())
         return cacheConsultations.end();
 
-    CConsultationMap::iterator ret = cacheConsultations.insert(std::make_pair(cid, CConsultation())).first;
-    tmp.swap(ret->second);
+    CConsultationMap::iterator ret = SwapIntoStateCache(cacheConsultations, cachedStateUsage[STATE_CACHE_CONSULTATIONS], cid, tmp);
 
     return ret;
 }
@@ -242,8 +435,7 @@ CConsultationAnswerMap::const_iterator CStateViewCache::FetchConsultationAnswer(
     if (!base->GetConsultationAnswer(cid, tmp) || tmp.IsNull())
         return cacheAnswers.end();
 
-    CConsultationAnswerMap::iterator ret = cacheAnswers.insert(std::make_pair(cid, CConsultationAnswer())).first;
-    tmp.swap(ret->second);
+    CConsultationAnswerMap::iterator ret = SwapIntoStateCache(cacheAnswers, cachedStateUsage[STATE_CACHE_ANSWERS], cid, tmp);
 
     return ret;
 }
@@ -259,8 +451,7 @@ CConsensusParameterMap::const_iterator CStateViewCache::FetchConsensusParameter(
     if (!base->GetConsensusParameter(pid, tmp) || tmp.IsNull())
         return cacheConsensus.end();
 
-    CConsensusParameterMap::iterator ret = cacheConsensus.insert(std::make_pair(pid, CConsensusParameter())).first;
-    tmp.swap(ret->second);
+    CConsensusParameterMap::iterator ret = SwapIntoStateCache(cacheConsensus, cachedStateUsage[STATE_CACHE_CONSENSUS], pid, tmp);
 
     return ret;
 }
@@ -276,25 +467,7 @@ TokenMap::const_iterator CStateViewCache::FetchToken(const uint256 &id) const {
     if (!base->GetToken(id, tmp) || tmp.IsNull())
         return cacheTokens.end();
 
-    TokenMap::iterator ret = cacheTokens.insert(std::make_pair(id, TokenInfo())).first;
-    tmp.swap(ret->second);
-
-    return ret;
-}
-
-TokenUtxoMap::const_iterator CStateViewCache::FetchTokenUtxos(const uint256 &id) const {
-    TokenUtxoMap::iterator it = cacheTokenUtxos.find(id);
-
-    if (it != cacheTokenUtxos.end() && it->second.size() > 0)
-        return it;
-
-    TokenUtxoValues tmp;
-
-    if (!base->GetTokenUtxos(id, tmp) || tmp.size() == 0)
-        return cacheTokenUtxos.end();
-
-    TokenUtxoMap::iterator ret = cacheTokenUtxos.insert(std::make_pair(id, TokenUtxoValues())).first;
-    tmp.swap(ret->second);
+    TokenMap::iterator ret = SwapIntoStateCache(cacheTokens, cachedStateUsage[STATE_CACHE_TOKENS], id, tmp);
 
     return ret;
 }
@@ -314,25 +487,59 @@ NameRecordMap::const_iterator CStateViewCache::FetchNameRecord(const uint256 &id
         return cacheNameRecords.end();
     }
 
-    NameRecordMap::iterator ret = cacheNameRecords.insert(std::make_pair(id, NameRecordValue())).first;
-    tmp.swap(ret->second);
+    NameRecordMap::iterator ret = SwapIntoStateCache(cacheNameRecords, cachedStateUsage[STATE_CACHE_NAME_RECORDS], id, tmp);
 
     return ret;
 }
 
-NameDataMap::const_iterator CStateViewCache::FetchNameData(const uint256 &id) const {
-    NameDataMap::iterator it = cacheNameData.find(id);
+/**
+ * Add a change to the name history changes of a cache. A null entry marks a
+ * disconnected height and replaces the changes made at it before, so on
+ * flush the entries of that height are erased before any new one is written.
+ */
+static void AppendNameDataChange(NameDataValues& changes, const NameDataEntry& entry)
+{
+    if (entry.second.IsNull()) {
+        changes.erase(
+            std::remove_if(changes.begin(), changes.end(),
+                [&entry](const NameDataEntry & o) { return o.first == entry.first; }),
+            changes.end());
+    }
+    changes.push_back(entry);
+}
+
+void CStateViewCache::ReadNameData(const uint256 &id, NameDataValues &data) const {
+    data.clear();
+    base->GetNameData(id, data);
+
+    NameDataMap::const_iterator it = cacheNameData.find(id);
+    if (it == cacheNameData.end())
+        return;
+
+    for (auto& entry: it->second) {
+        if (entry.second.IsNull()) {
+            data.erase(
+                std::remove_if(data.begin(), data.end(),
+                    [&entry](const NameDataEntry & o) { return o.first == entry.first; }),
+                data.end());
+        } else {
+            data.push_back(entry);
+        }
+    }
+}
 
-    if (it != cacheNameData.end() && it->second.size() > 0)
+NameStateMap::const_iterator CStateViewCache::FetchNameState(const uint256 &id) const {
+    NameStateMap::iterator it = cacheNameStates.find(id);
+
+    if (it != cacheNameStates.end())
         return it;
 
-    NameDataValues tmp;
+    NameDataState tmp;
 
-    if (!base->GetNameData(id, tmp) || tmp.size() == 0)
-        return cacheNameData.end();
+    if (!base->GetNameState(id, tmp) || tmp.IsNull())
+        return cacheNameStates.end();
 
-    NameDataMap::iterator ret = cacheNameData.insert(std::make_pair(id, NameDataValues())).first;
-    tmp.swap(ret->second);
+    NameStateMap::iterator ret = SwapIntoStateCache(cacheNameStates, cachedStateUsage[STATE_CACHE_NAME_STATES], id, tmp);
 
     return ret;
 }
@@ -410,13 +617,96 @@ bool CStateViewCache::GetToken(const uint256 &id, TokenInfo &token) const {
     return false;
 }
 
-bool CStateViewCache::GetTokenUtxos(const uint256 &id, TokenUtxoValues &tokenUtxos) {
-    TokenUtxoMap::const_iterator it = FetchTokenUtxos(id);
-    if (it != cacheTokenUtxos.end() && it->second.size() > 0) {
-        tokenUtxos = it->second;
+bool CStateViewCache::GetTokenUtxos(const TokenUtxoKey &start, size_t nLimit, TokenUtxoValues &tokenUtxos) {
+    tokenUtxos.clear();
+
+    TokenUtxoMap::const_iterator itBegin = cacheTokenUtxos.lower_bound(start);
+    TokenUtxoMap::const_iterator itEnd = cacheTokenUtxos.lower_bound(TokenUtxoKey::End(start.id));
+
+    // Every entry erased here may hide one of the base, so ask it for as many more.
+    size_t nBaseLimit = nLimit;
+    if (nLimit > 0) {
+        for (TokenUtxoMap::const_iterator it = itBegin; it != itEnd; it++)
+            if (it->second.IsNull())
+                nBaseLimit++;
+    }
+
+    TokenUtxoValues vBase;
+    base->GetTokenUtxos(start, nBaseLimit, vBase);
+
+    TokenUtxoValues::const_iterator itBase = vBase.begin();
+    TokenUtxoMap::const_iterator it = itBegin;
+    while ((nLimit == 0 || tokenUtxos.size() < nLimit) && (itBase != vBase.end() || it != itEnd)) {
+        if (it == itEnd || (itBase != vBase.end() && MakeTokenUtxoKey(start.id, *itBase) < it->first)) {
+            tokenUtxos.push_back(*itBase++);
+            continue;
+        }
+        if (itBase != vBase.end() && MakeTokenUtxoKey(start.id, *itBase) == it->first)
+            itBase++;
+        if (!it->second.IsNull())
+            tokenUtxos.push_back(std::make_pair(it->first.blockHeight, it->second));
+        it++;
+    }
+
+    return tokenUtxos.size() > 0;
+}
+
+bool CStateViewCache::GetLastTokenUtxo(const TokenUtxoKey &end, TokenUtxoEntry &tokenUtxo) {
+    // The newest entry of the base that is not erased here
+    TokenUtxoKey baseEnd = end;
+    TokenUtxoEntry baseUtxo;
+    bool fBase = false;
+    while (base->GetLastTokenUtxo(baseEnd, baseUtxo)) {
+        baseEnd = MakeTokenUtxoKey(end.id, baseUtxo);
+        TokenUtxoMap::const_iterator it = cacheTokenUtxos.find(baseEnd);
+        if (it == cacheTokenUtxos.end() || !it->second.IsNull()) {
+            fBase = true;
+            break;
+        }
+    }
+
+    // The newest entry added here
+    TokenUtxoMap::const_iterator it = cacheTokenUtxos.lower_bound(end);
+    while (it != cacheTokenUtxos.begin()) {
+        --it;
+        if (it->first.id != end.id || (fBase && it->first < baseEnd))
+            break;
+        if (!it->second.IsNull()) {
+            tokenUtxo = std::make_pair(it->first.blockHeight, it->second);
+            return true;
+        }
+    }
+
+    if (fBase)
+        tokenUtxo = baseUtxo;
+    return fBase;
+}
+
+/**
+ * The index orders the outputs of one block by txid, not by the order the
+ * token moved through them. When it moved more than once in the newest
+ * block, follow the spends: each earlier output is spent by the transaction
+ * of the next one, so the output still unspent is the current one. If none
+ * is, the token left the indexed outputs and the newest key is returned.
+ */
+bool CStateViewCache::GetCurrentTokenUtxo(const uint256 &id, TokenUtxoEntry &tokenUtxo) {
+    if (!GetLastTokenUtxo(TokenUtxoKey::End(id), tokenUtxo))
+        return false;
+
+    TokenUtxoValues vBlock;
+    GetTokenUtxos(TokenUtxoKey(id, tokenUtxo.first), 0, vBlock);
+    if (vBlock.size() < 2)
         return true;
+
+    for (const TokenUtxoEntry& entry: vBlock) {
+        const CCoins* coins = AccessCoins(entry.second.hash);
+        if (coins && coins->IsAvailable(entry.second.n)) {
+            tokenUtxo = entry;
+            break;
+        }
     }
-    return false;
+
+    return true;
 }
 
 bool CStateViewCache::GetNameRecord(const uint256 &id, NameRecordValue &height) const {
@@ -430,9 +720,14 @@ bool CStateViewCache::GetNameRecord(const uint256 &id, NameRecordValue &height)
 }
 
 bool CStateViewCache::GetNameData(const uint256 &id, NameDataValues &data) {
-    NameDataMap::const_iterator it = FetchNameData(id);
-    if (it != cacheNameData.end() && it->second.size() > 0) {
-        data = it->second;
+    ReadNameData(id, data);
+    return data.size() > 0;
+}
+
+bool CStateViewCache::GetNameState(const uint256 &id, NameDataState &state) const {
+    NameStateMap::const_iterator it = FetchNameState(id);
+    if (it != cacheNameStates.end() && !it->second.IsNull()) {
+        state = it->second;
         return true;
     }
     return false;
@@ -467,6 +762,22 @@ bool CStateViewCache::SetExcludeVotes(int count) {
     return true;
 }
 
+bool CStateViewCache::GetStateStats(CStateStats& stats) const {
+    if (!fCacheStats) {
+        if (!base->GetStateStats(cacheStats))
+            cacheStats.SetNull();
+        fCacheStats = true;
+    }
+    stats = cacheStats;
+    return cacheStats.fValid;
+}
+
+bool CStateViewCache::SetStateStats(const CStateStats& stats) {
+    cacheStats = stats;
+    fCacheStats = true;
+    return true;
+}
+
 bool CStateViewCache::GetAllPaymentRequests(CPaymentRequestMap& mapPaymentRequests) {
     mapPaymentRequests.clear();
     mapPaymentRequests.insert(cachePaymentRequests.begin(), cachePaymentRequests.end());
@@ -599,6 +910,7 @@ CCoinsModifier CStateViewCache::ModifyCoins(const uint256 &txid) {
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    ret.first->second.nLastUsed = ++nAccessClock;
     return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
@@ -609,6 +921,7 @@ CProposalModifier CStateViewCache::ModifyProposal(const uint256 &pid, int nHeigh
         if (!base->GetProposal(pid, ret.first->second)) {
             ret.first->second.SetNull();
         }
+        cachedStateUsage[STATE_CACHE_PROPOSALS] += StateEntryUsage(cacheProposals, *ret.first);
     }
     return CProposalModifier(*this, ret.first, nHeight);
 }
@@ -620,6 +933,7 @@ CVoteModifier CStateViewCache::ModifyVote(const CVoteMapKey &voter, int nHeight)
         if (!base->GetCachedVoter(voter, ret.first->second)) {
             ret.first->second.SetNull();
         }
+        cachedStateUsage[STATE_CACHE_VOTES] += StateEntryUsage(cacheVotes, *ret.first);
     }
     return CVoteModifier(*this, ret.first, nHeight);
 }
@@ -631,6 +945,7 @@ CConsensusParameterModifier CStateViewCache::ModifyConsensusParameter(const int
         if (!base->GetConsensusParameter(pid, ret.first->second)) {
             ret.first->second.SetNull();
         }
+        cachedStateUsage[STATE_CACHE_CONSENSUS] += StateEntryUsage(cacheConsensus, *ret.first);
     }
     return CConsensusParameterModifier(*this, ret.first, nHeight);
 }
@@ -642,21 +957,11 @@ TokenModifier CStateViewCache::ModifyToken(const uint256 &id, int nHeight) {
         if (!base->GetToken(id, ret.first->second)) {
             ret.first->second.SetNull();
         }
+        cachedStateUsage[STATE_CACHE_TOKENS] += StateEntryUsage(cacheTokens, *ret.first);
     }
     return TokenModifier(*this, ret.first, nHeight);
 }
 
-TokenUtxosModifier CStateViewCache::ModifyTokenUtxos(const uint256 &id, int blockHeight) {
-    assert(!hasModifier);
-    std::pair<TokenUtxoMap::iterator, bool> ret = cacheTokenUtxos.insert(std::make_pair(id, TokenUtxoValues()));
-    if (ret.second) {
-        if (!base->GetTokenUtxos(id, ret.first->second)) {
-            ret.first->second.clear();
-        }
-    }
-    return TokenUtxosModifier(*this, ret.first, blockHeight);
-}
-
 NameRecordModifier CStateViewCache::ModifyNameRecord(const uint256 &id, int nHeight) {
     assert(!hasModifier);
     std::pair<NameRecordMap::iterator, bool> ret = cacheNameRecords.insert(std::make_pair(id, 0));
@@ -664,18 +969,17 @@ NameRecordModifier CStateViewCache::ModifyNameRecord(const uint256 &id, int nHei
         if (!base->GetNameRecord(id, ret.first->second)) {
             ret.first->second = 0;
         }
+        cachedStateUsage[STATE_CACHE_NAME_RECORDS] += StateEntryUsage(cacheNameRecords, *ret.first);
     }
     return NameRecordModifier(*this, ret.first, nHeight);
 }
 
 NameDataModifier CStateViewCache::ModifyNameData(const uint256 &id, int nHeight) {
     assert(!hasModifier);
+    // The entry only holds the changes of this cache, not the history in the base.
     std::pair<NameDataMap::iterator, bool> ret = cacheNameData.insert(std::make_pair(id, NameDataValues()));
-    if (ret.second) {
-        if (!base->GetNameData(id, ret.first->second)) {
-            ret.first->second.clear();
-        }
-    }
+    if (ret.second)
+        cachedStateUsage[STATE_CACHE_NAME_DATA] += StateEntryUsage(cacheNameData, *ret.first);
     return NameDataModifier(*this, ret.first, nHeight);
 }
 
@@ -686,6 +990,7 @@ CPaymentRequestModifier CStateViewCache::ModifyPaymentRequest(const uint256 &pri
         if (!base->GetPaymentRequest(prid, ret.first->second)) {
             ret.first->second.SetNull();
         }
+        cachedStateUsage[STATE_CACHE_PAYMENT_REQUESTS] += StateEntryUsage(cachePaymentRequests, *ret.first);
     }
     return CPaymentRequestModifier(*this, ret.first, nHeight);
 }
@@ -697,6 +1002,7 @@ CConsultationModifier CStateViewCache::ModifyConsultation(const uint256 &cid, in
         if (!base->GetConsultation(cid, ret.first->second)) {
             ret.first->second.SetNull();
         }
+        cachedStateUsage[STATE_CACHE_CONSULTATIONS] += StateEntryUsage(cacheConsultations, *ret.first);
     }
     return CConsultationModifier(*this, ret.first, nHeight);
 }
@@ -708,6 +1014,7 @@ CConsultationAnswerModifier CStateViewCache::ModifyConsultationAnswer(const uint
         if (!base->GetConsultationAnswer(cid, ret.first->second)) {
             ret.first->second.SetNull();
         }
+        cachedStateUsage[STATE_CACHE_ANSWERS] += StateEntryUsage(cacheAnswers, *ret.first);
     }
     return CConsultationAnswerModifier(*this, ret.first, nHeight);
 }
@@ -724,6 +1031,7 @@ CCoinsModifier CStateViewCache::ModifyNewCoins(const uint256 &txid, bool coinbas
         ret.first->second.flags = CCoinsCacheEntry::FRESH;
     }
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    ret.first->second.nLastUsed = ++nAccessClock;
     return CCoinsModifier(*this, ret.first, 0);
 }
 
@@ -731,6 +1039,8 @@ bool CStateViewCache::AddProposal(const CProposal& proposal) const {
     if (HaveProposal(proposal.hash))
         return false;
 
+    CStateUsageGuard<CProposalMap> usage(cacheProposals, proposal.hash, cachedStateUsage[STATE_CACHE_PROPOSALS]);
+
     assert(proposal.fDirty == true);
 
     if (cacheProposals.count(proposal.hash))
@@ -745,6 +1055,8 @@ bool CStateViewCache::AddCachedVoter(const CVoteMapKey &voter, CVoteMapValue& vo
     if (HaveCachedVoter(voter))
         return false;
 
+    CStateUsageGuard<CVoteMap> usage(cacheVotes, voter, cachedStateUsage[STATE_CACHE_VOTES]);
+
     assert(vote.fDirty == true);
 
     if (cacheVotes.count(voter))
@@ -759,6 +1071,8 @@ bool CStateViewCache::AddPaymentRequest(const CPaymentRequest& prequest) const {
     if (HavePaymentRequest(prequest.hash))
         return false;
 
+    CStateUsageGuard<CPaymentRequestMap> usage(cachePaymentRequests, prequest.hash, cachedStateUsage[STATE_CACHE_PAYMENT_REQUESTS]);
+
     assert(prequest.fDirty == true);
 
     if (cachePaymentRequests.count(prequest.hash))
@@ -773,6 +1087,8 @@ bool CStateViewCache::AddConsultation(const CConsultation& consultation) const {
     if (HaveConsultation(consultation.hash))
         return false;
 
+    CStateUsageGuard<CConsultationMap> usage(cacheConsultations, consultation.hash, cachedStateUsage[STATE_CACHE_CONSULTATIONS]);
+
     assert(consultation.fDirty == true);
 
     if (cacheConsultations.count(consultation.hash))
@@ -787,6 +1103,8 @@ bool CStateViewCache::AddConsultationAnswer(const CConsultationAnswer& answer) {
     if (HaveConsultationAnswer(answer.hash))
         return false;
 
+    CStateUsageGuard<CConsultationAnswerMap> usage(cacheAnswers, answer.hash, cachedStateUsage[STATE_CACHE_ANSWERS]);
+
     CConsultationModifier mConsultation = ModifyConsultation(answer.parent);
     mConsultation->vAnswers.push_back(answer.hash);
 
@@ -804,6 +1122,8 @@ bool CStateViewCache::AddToken(const Token& token) const {
     if (HaveToken(token.first))
         return false;
 
+    CStateUsageGuard<TokenMap> usage(cacheTokens, token.first, cachedStateUsage[STATE_CACHE_TOKENS]);
+
     assert(token.second.fDirty == true);
 
     if (cacheTokens.count(token.first))
@@ -814,17 +1134,13 @@ bool CStateViewCache::AddToken(const Token& token) const {
     return true;
 }
 
-bool CStateViewCache::AddTokenUtxo(const uint256 &id, const TokenUtxoEntry& utxo) const {
-    if (cacheTokenUtxos.count(id)) {
-        cacheTokenUtxos[id].erase(
-            std::remove_if(cacheTokenUtxos[id].begin(), cacheTokenUtxos[id].end(),
-                [&utxo](const TokenUtxoEntry & o) { return o.first == utxo.first && o.second.IsNull(); }),
-            cacheTokenUtxos[id].end());
-        cacheTokenUtxos[id].push_back(utxo);
-    } else {
-        cacheTokenUtxos.insert(std::make_pair(id, TokenUtxoValues()));
-        cacheTokenUtxos[id].push_back(utxo);
-    }
+bool CStateViewCache::AddTokenUtxo(const TokenUtxoKey &key, const TokenUtxoValue& utxo) const {
+    if (utxo.IsNull())
+        return false;
+
+    CStateUsageGuard<TokenUtxoMap> usage(cacheTokenUtxos, key, cachedStateUsage[STATE_CACHE_TOKEN_UTXOS]);
+
+    cacheTokenUtxos[key] = utxo;
 
     return true;
 }
@@ -833,6 +1149,8 @@ bool CStateViewCache::AddNameRecord(const NameRecord& namerecord) const {
     if (HaveNameRecord(namerecord.first))
         return false;
 
+    CStateUsageGuard<NameRecordMap> usage(cacheNameRecords, namerecord.first, cachedStateUsage[STATE_CACHE_NAME_RECORDS]);
+
     if (cacheNameRecords.count(namerecord.first))
         cacheNameRecords[namerecord.first]=namerecord.second;
     else
@@ -842,19 +1160,22 @@ bool CStateViewCache::AddNameRecord(const NameRecord& namerecord) const {
 }
 
 bool CStateViewCache::AddNameData(const uint256& id, const NameDataEntry& namerecord) const {
-    if (cacheNameData.count(id)) {
-        cacheNameData[id].erase(
-            std::remove_if(cacheNameData[id].begin(), cacheNameData[id].end(),
-                [&namerecord](const NameDataEntry & o) { return o.first == namerecord.first && o.second.IsNull(); }),
-            cacheNameData[id].end());
-        cacheNameData[id].push_back(namerecord);
-    }
-    else
+    // Only the new record is kept and written, not the history of the name.
     {
-        cacheNameData.insert(std::make_pair(id, NameDataValues()));
-        cacheNameData[id].push_back(namerecord);
+        CStateUsageGuard<NameDataMap> usage(cacheNameData, id, cachedStateUsage[STATE_CACHE_NAME_DATA]);
+        AppendNameDataChange(cacheNameData[id], namerecord);
     }
 
+    // The state is changed in place, so it has to start from what the base has.
+    FetchNameState(id);
+
+    CStateUsageGuard<NameStateMap> usage(cacheNameStates, id, cachedStateUsage[STATE_CACHE_NAME_STATES]);
+
+    NameDataState& state = cacheNameStates[id];
+    state.Apply(namerecord.first, namerecord.second);
+    if (namerecord.first > (uint64_t)NAME_DATA_UNDO_DEPTH)
+        state.CompactUndo(namerecord.first - NAME_DATA_UNDO_DEPTH);
+
     return true;
 }
 
@@ -862,6 +1183,8 @@ bool CStateViewCache::RemoveProposal(const uint256 &pid) const {
     if (!HaveProposal(pid))
         return false;
 
+    CStateUsageGuard<CProposalMap> usage(cacheProposals, pid, cachedStateUsage[STATE_CACHE_PROPOSALS]);
+
     cacheProposals[pid] = CProposal();
     cacheProposals[pid].SetNull();
 
@@ -874,6 +1197,8 @@ bool CStateViewCache::RemoveToken(const uint256 &id) const {
     if (!HaveToken(id))
         return false;
 
+    CStateUsageGuard<TokenMap> usage(cacheTokens, id, cachedStateUsage[STATE_CACHE_TOKENS]);
+
     cacheTokens[id] = TokenInfo();
     cacheTokens[id].SetNull();
 
@@ -883,23 +1208,10 @@ bool CStateViewCache::RemoveToken(const uint256 &id) const {
 }
 
 bool CStateViewCache::RemoveTokenUtxo(const TokenUtxoKey &key) const {
-    if (!HaveTokenUtxos(key.id))
-        return false;
+    CStateUsageGuard<TokenUtxoMap> usage(cacheTokenUtxos, key, cachedStateUsage[STATE_CACHE_TOKEN_UTXOS]);
 
-    if (cacheTokenUtxos.count(key.id))
-    {
-        TokenUtxoValues temp;
-
-        for (auto& it: cacheTokenUtxos[key.id]) {
-            if (it.first == key.blockHeight) {
-                temp.push_back(TokenUtxoEntry(key.blockHeight, TokenUtxoValue()));
-            } else {
-                temp.push_back(it);
-            }
-        }
-
-        cacheTokenUtxos[key.id] = temp;
-    }
+    // Recorded even when the base does not have it, it only costs an erase on flush.
+    cacheTokenUtxos[key].SetNull();
 
     return true;
 }
@@ -908,6 +1220,8 @@ bool CStateViewCache::RemoveNameRecord(const uint256 &id) const {
     if (!HaveNameRecord(id))
         return false;
 
+    CStateUsageGuard<NameRecordMap> usage(cacheNameRecords, id, cachedStateUsage[STATE_CACHE_NAME_RECORDS]);
+
     cacheNameRecords[id] = NameRecordValue();
 
     assert(cacheNameRecords[id].IsNull());
@@ -919,20 +1233,26 @@ bool CStateViewCache::RemoveNameData(const NameDataKey &id) const {
     if (!HaveNameData(id.id))
         return false;
 
-    if (cacheNameData.count(id.id))
     {
-        NameDataValues temp;
+        CStateUsageGuard<NameDataMap> usage(cacheNameData, id.id, cachedStateUsage[STATE_CACHE_NAME_DATA]);
+        AppendNameDataChange(cacheNameData[id.id], NameDataEntry(id.height, NameDataValue()));
+    }
 
-        for (auto& it: cacheNameData[id.id]) {
-            if (it.first == id.height) {
-                temp.push_back(NameDataEntry(id.height, NameDataValue()));
-            }
-            else {
-                temp.push_back(it);
-            }
-        }
+    FetchNameState(id.id);
+
+    CStateUsageGuard<NameStateMap> stateUsage(cacheNameStates, id.id, cachedStateUsage[STATE_CACHE_NAME_STATES]);
 
-        cacheNameData[id.id] = temp;
+    NameDataState& state = cacheNameStates[id.id];
+    if (!state.Undo(id.height))
+    {
+        // Too deep for the undo data kept, replay the history left below this height.
+        NameDataValues data;
+        ReadNameData(id.id, data);
+        data.erase(
+            std::remove_if(data.begin(), data.end(),
+                [&id](const NameDataEntry & o) { return o.first >= id.height; }),
+            data.end());
+        state.Rebuild(data);
     }
 
     return true;
@@ -942,6 +1262,8 @@ bool CStateViewCache::RemovePaymentRequest(const uint256 &prid) const {
     if (!HavePaymentRequest(prid))
         return false;
 
+    CStateUsageGuard<CPaymentRequestMap> usage(cachePaymentRequests, prid, cachedStateUsage[STATE_CACHE_PAYMENT_REQUESTS]);
+
     cachePaymentRequests[prid] = CPaymentRequest();
     cachePaymentRequests[prid].SetNull();
 
@@ -954,6 +1276,8 @@ bool CStateViewCache::RemoveCachedVoter(const CVoteMapKey &voter) const {
     if (!HaveCachedVoter(voter))
         return false;
 
+    CStateUsageGuard<CVoteMap> usage(cacheVotes, voter, cachedStateUsage[STATE_CACHE_VOTES]);
+
     cacheVotes[voter] = CVoteList();
     cacheVotes[voter].SetNull();
 
@@ -973,10 +1297,12 @@ bool CStateViewCache::RemoveConsultation(const uint256 &cid) {
         RemoveConsultationAnswer(it);
     }
 
+    CStateUsageGuard<CConsultationMap> usage(cacheConsultations, cid, cachedStateUsage[STATE_CACHE_CONSULTATIONS]);
+
     cacheConsultations[cid] = CConsultation();
     cacheConsultations[cid].SetNull();
 
-    assert(cachePaymentRequests[cid].IsNull());
+    assert(cacheConsultations[cid].IsNull());
 
     return true;
 }
@@ -992,6 +1318,8 @@ bool CStateViewCache::RemoveConsultationAnswer(const uint256 &cid) {
         if (*it == cid)
             mConsultation->vAnswers.erase(it);
 
+    CStateUsageGuard<CConsultationAnswerMap> usage(cacheAnswers, cid, cachedStateUsage[STATE_CACHE_ANSWERS]);
+
     cacheAnswers[cid] = CConsultationAnswer();
     cacheAnswers[cid].SetNull();
 
@@ -1038,19 +1366,15 @@ bool CStateViewCache::HaveToken(const uint256 &id) const {
     return (it != cacheTokens.end() && !it->second.IsNull());
 }
 
-bool CStateViewCache::HaveTokenUtxos(const uint256 &id) const {
-    TokenUtxoMap::const_iterator it = FetchTokenUtxos(id);
-    return (it != cacheTokenUtxos.end() && it->second.size());
-}
-
 bool CStateViewCache::HaveNameRecord(const uint256 &id) const {
     NameRecordMap::const_iterator it = FetchNameRecord(id);
     return (it != cacheNameRecords.end() && !it->second.IsNull());
 }
 
 bool CStateViewCache::HaveNameData(const uint256 &id) const {
-    NameDataMap::const_iterator it = FetchNameData(id);
-    return (it != cacheNameData.end() && it->second.size());
+    // Every name with a history has a state.
+    NameStateMap::const_iterator it = FetchNameState(id);
+    return (it != cacheNameStates.end() && !it->second.IsNull());
 }
 
 bool CStateViewCache::HaveCachedVoter(const CVoteMapKey &voter) const {
@@ -1100,7 +1424,8 @@ void CStateViewCache::SetBestBlock(const uint256 &hashBlockIn) {
 bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals, CPaymentRequestMap &mapPaymentRequests,
                                  CVoteMap& mapVotes, CConsultationMap& mapConsultations, CConsultationAnswerMap& mapAnswers,
                                  CConsensusParameterMap& mapConsensus, TokenMap& mapTokens, TokenUtxoMap& mapTokenUtxos, NameRecordMap& mapNameRecords,
-                                 NameDataMap& mapNameData, const uint256 &hashBlockIn, const int &nCacheExcludeVotesIn) {
+                                 NameDataMap& mapNameData, NameStateMap& mapNameStates, const uint256 &hashBlockIn, const int &nCacheExcludeVotesIn,
+                                 const CStateStats& statsIn) {
     assert(!hasModifier);
     assert(!hasModifierConsensus);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
@@ -1145,8 +1470,7 @@ bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
 
     for (CProposalMap::iterator it = mapProposals.begin(); it != mapProposals.end();) {
         if (it->second.fDirty) { // Ignore non-dirty entries (optimization).
-            CProposal& entry = cacheProposals[it->first];
-            entry.swap(it->second);
+            SwapIntoStateCache(cacheProposals, cachedStateUsage[STATE_CACHE_PROPOSALS], it->first, it->second);
         }
         CProposalMap::iterator itOld = it++;
         mapProposals.erase(itOld);
@@ -1154,8 +1478,7 @@ bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
 
     for (CPaymentRequestMap::iterator it = mapPaymentRequests.begin(); it != mapPaymentRequests.end();) {
         if (it->second.fDirty) { // Ignore non-dirty entries (optimization).
-            CPaymentRequest& entry = cachePaymentRequests[it->first];
-            entry.swap(it->second);
+            SwapIntoStateCache(cachePaymentRequests, cachedStateUsage[STATE_CACHE_PAYMENT_REQUESTS], it->first, it->second);
         }
         CPaymentRequestMap::iterator itOld = it++;
         mapPaymentRequests.erase(itOld);
@@ -1163,8 +1486,7 @@ bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
 
     for (CVoteMap::iterator it = mapVotes.begin(); it != mapVotes.end();){
         if (it->second.fDirty) { // Ignore non-dirty entries (optimization).
-            CVoteList& entry = cacheVotes[it->first];
-            entry.swap(it->second);
+            SwapIntoStateCache(cacheVotes, cachedStateUsage[STATE_CACHE_VOTES], it->first, it->second);
         }
         CVoteMap::iterator itOld = it++;
         mapVotes.erase(itOld);
@@ -1172,8 +1494,7 @@ bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
 
     for (CConsultationMap::iterator it = mapConsultations.begin(); it != mapConsultations.end();) {
         if (it->second.fDirty) { // Ignore non-dirty entries (optimization).
-            CConsultation& entry = cacheConsultations[it->first];
-            entry.swap(it->second);
+            SwapIntoStateCache(cacheConsultations, cachedStateUsage[STATE_CACHE_CONSULTATIONS], it->first, it->second);
         }
         CConsultationMap::iterator itOld = it++;
         mapConsultations.erase(itOld);
@@ -1181,8 +1502,7 @@ bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
 
     for (CConsultationAnswerMap::iterator it = mapAnswers.begin(); it != mapAnswers.end();) {
         if (it->second.fDirty) { // Ignore non-dirty entries (optimization).
-            CConsultationAnswer& entry = cacheAnswers[it->first];
-            entry.swap(it->second);
+            SwapIntoStateCache(cacheAnswers, cachedStateUsage[STATE_CACHE_ANSWERS], it->first, it->second);
         }
         CConsultationAnswerMap::iterator itOld = it++;
         mapAnswers.erase(itOld);
@@ -1190,48 +1510,58 @@ bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
 
     for (CConsensusParameterMap::iterator it = mapConsensus.begin(); it != mapConsensus.end();) {
         if (it->second.fDirty) { // Ignore non-dirty entries (optimization).
-            CConsensusParameter& entry = cacheConsensus[it->first];
-            entry.swap(it->second);
+            SwapIntoStateCache(cacheConsensus, cachedStateUsage[STATE_CACHE_CONSENSUS], it->first, it->second);
         }
         CConsensusParameterMap::iterator itOld = it++;
         mapConsensus.erase(itOld);
     }
 
     for (TokenMap::iterator it = mapTokens.begin(); it != mapTokens.end();) {
-        TokenInfo& entry = cacheTokens[it->first];
-        entry.swap(it->second);
+        SwapIntoStateCache(cacheTokens, cachedStateUsage[STATE_CACHE_TOKENS], it->first, it->second);
         TokenMap::iterator itOld = it++;
         mapTokens.erase(itOld);
     }
 
     for (TokenUtxoMap::iterator it = mapTokenUtxos.begin(); it != mapTokenUtxos.end();) {
-        TokenUtxoValues& entry = cacheTokenUtxos[it->first];
-        entry.swap(it->second);
+        SwapIntoStateCache(cacheTokenUtxos, cachedStateUsage[STATE_CACHE_TOKEN_UTXOS], it->first, it->second);
         TokenUtxoMap::iterator itOld = it++;
         mapTokenUtxos.erase(itOld);
     }
 
     for (NameRecordMap::iterator it = mapNameRecords.begin(); it != mapNameRecords.end();) {
-        NameRecordValue& entry = cacheNameRecords[it->first];
-        entry.swap(it->second);
+        SwapIntoStateCache(cacheNameRecords, cachedStateUsage[STATE_CACHE_NAME_RECORDS], it->first, it->second);
         NameRecordMap::iterator itOld = it++;
         mapNameRecords.erase(itOld);
     }
 
     for (NameDataMap::iterator it = mapNameData.begin(); it != mapNameData.end();) {
-        NameDataValues& entry = cacheNameData[it->first];
-        entry.swap(it->second);
+        {
+            CStateUsageGuard<NameDataMap> usage(cacheNameData, it->first, cachedStateUsage[STATE_CACHE_NAME_DATA]);
+            NameDataValues& changes = cacheNameData[it->first];
+            for (auto& entry: it->second)
+                AppendNameDataChange(changes, entry);
+        }
         NameDataMap::iterator itOld = it++;
         mapNameData.erase(itOld);
     }
 
+    for (NameStateMap::iterator it = mapNameStates.begin(); it != mapNameStates.end();) {
+        SwapIntoStateCache(cacheNameStates, cachedStateUsage[STATE_CACHE_NAME_STATES], it->first, it->second);
+        NameStateMap::iterator itOld = it++;
+        mapNameStates.erase(itOld);
+    }
+
     hashBlock = hashBlockIn;
     nCacheExcludeVotes = nCacheExcludeVotesIn;
+    if (statsIn.fValid) {
+        cacheStats = statsIn;
+        fCacheStats = true;
+    }
     return true;
 }
 
 bool CStateViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, cacheProposals, cachePaymentRequests, cacheVotes, cacheConsultations, cacheAnswers, cacheConsensus, cacheTokens, cacheTokenUtxos, cacheNameRecords, cacheNameData, hashBlock, nCacheExcludeVotes);
+    bool fOk = base->BatchWrite(cacheCoins, cacheProposals, cachePaymentRequests, cacheVotes, cacheConsultations, cacheAnswers, cacheConsensus, cacheTokens, cacheTokenUtxos, cacheNameRecords, cacheNameData, cacheNameStates, hashBlock, nCacheExcludeVotes, cacheStats);
     cacheCoins.clear();
     cacheProposals.clear();
     cachePaymentRequests.clear();
@@ -1243,11 +1573,131 @@ bool CStateViewCache::Flush() {
     cacheTokenUtxos.clear();
     cacheNameRecords.clear();
     cacheNameData.clear();
+    cacheNameStates.clear();
     cachedCoinsUsage = 0;
+    std::fill(cachedStateUsage, cachedStateUsage + STATE_CACHE_CATEGORIES, 0);
     nCacheExcludeVotes = -1;
+    cacheStats.SetNull();
+    fCacheStats = false;
     return fOk;
 }
 
+template <typename Map>
+static void TakeDirtyEntries(Map& cache, Map& out)
+{
+    for (typename Map::iterator it = cache.begin(); it != cache.end();) {
+        if (it->second.fDirty) {
+            if (it->second.IsNull()) {
+                // The base erases it, so there is nothing left to keep.
+                out[it->first].swap(it->second);
+                cache.erase(it++);
+                continue;
+            }
+            out[it->first] = it->second;
+            it->second.fDirty = false;
+        }
+        ++it;
+    }
+}
+
+bool CStateViewCache::Sync() {
+    CCoinsMap mapCoins;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CCoinsCacheEntry& entry = mapCoins[it->first];
+            entry.flags = it->second.flags;
+            if (it->second.coins.IsPruned()) {
+                cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+                entry.coins.swap(it->second.coins);
+                cacheCoins.erase(it++);
+                continue;
+            }
+            entry.coins = it->second.coins;
+            // The base has it now.
+            it->second.flags = 0;
+        }
+        ++it;
+    }
+
+    CProposalMap mapProposals;
+    CPaymentRequestMap mapPaymentRequests;
+    CVoteMap mapVotes;
+    CConsultationMap mapConsultations;
+    CConsultationAnswerMap mapAnswers;
+    CConsensusParameterMap mapConsensus;
+    TakeDirtyEntries(cacheProposals, mapProposals);
+    TakeDirtyEntries(cachePaymentRequests, mapPaymentRequests);
+    TakeDirtyEntries(cacheVotes, mapVotes);
+    TakeDirtyEntries(cacheConsultations, mapConsultations);
+    TakeDirtyEntries(cacheAnswers, mapAnswers);
+    TakeDirtyEntries(cacheConsensus, mapConsensus);
+
+    bool fOk = base->BatchWrite(mapCoins, mapProposals, mapPaymentRequests, mapVotes, mapConsultations, mapAnswers, mapConsensus, cacheTokens, cacheTokenUtxos, cacheNameRecords, cacheNameData, cacheNameStates, hashBlock, nCacheExcludeVotes, cacheStats);
+    cacheTokens.clear();
+    cacheTokenUtxos.clear();
+    cacheNameRecords.clear();
+    cacheNameData.clear();
+    cacheNameStates.clear();
+    nCacheExcludeVotes = -1;
+    cacheStats.SetNull();
+    fCacheStats = false;
+    RecomputeStateUsage();
+    return fOk;
+}
+
+template <typename Map>
+static void UncacheCleanEntries(Map& map)
+{
+    for (typename Map::iterator it = map.begin(); it != map.end();)
+        it->second.fDirty ? ++it : map.erase(it++);
+}
+
+void CStateViewCache::UncacheClean(StateCacheCategory category)
+{
+    assert(!hasModifier);
+    switch (category) {
+    case STATE_CACHE_PROPOSALS: UncacheCleanEntries(cacheProposals); break;
+    case STATE_CACHE_PAYMENT_REQUESTS: UncacheCleanEntries(cachePaymentRequests); break;
+    case STATE_CACHE_VOTES: UncacheCleanEntries(cacheVotes); break;
+    case STATE_CACHE_CONSULTATIONS: UncacheCleanEntries(cacheConsultations); break;
+    case STATE_CACHE_ANSWERS: UncacheCleanEntries(cacheAnswers); break;
+    case STATE_CACHE_CONSENSUS: UncacheCleanEntries(cacheConsensus); break;
+    default: return; // coins are trimmed by Trim(); tokens and names are not dirty-tracked
+    }
+    RecomputeStateUsage();
+}
+
+void CStateViewCache::Trim(size_t nTargetUsage)
+{
+    if (DynamicMemoryUsage() <= nTargetUsage)
+        return;
+
+    std::vector<std::pair<uint64_t, CCoinsMap::iterator> > vClean;
+    vClean.reserve(cacheCoins.size());
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            vClean.push_back(std::make_pair(it->second.nLastUsed, it));
+    }
+
+    // Usually only a small part of the clean entries goes, so pop them off a
+    // heap instead of sorting all of them.
+    auto fnNewer = [](const std::pair<uint64_t, CCoinsMap::iterator>& a, const std::pair<uint64_t, CCoinsMap::iterator>& b) {
+        return a.first > b.first;
+    };
+    std::make_heap(vClean.begin(), vClean.end(), fnNewer);
+
+    size_t nEvicted = 0;
+    while (!vClean.empty() && DynamicMemoryUsage() > nTargetUsage) {
+        std::pop_heap(vClean.begin(), vClean.end(), fnNewer);
+        CCoinsMap::iterator it = vClean.back().second;
+        vClean.pop_back();
+        cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+        cacheCoins.erase(it);
+        nEvicted++;
+    }
+    LogPrint("coindb", "%s: evicted %u clean entries, %u left (%.1fMiB)\n", __func__, nEvicted, cacheCoins.size(), DynamicMemoryUsage() * (1.0 / (1<<20)));
+}
+
 void CStateViewCache::Uncache(const uint256& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -1261,6 +1711,24 @@ unsigned int CStateViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
 
+size_t CStateViewCache::GetCacheSize(StateCacheCategory category) const {
+    switch (category) {
+    case STATE_CACHE_COINS: return cacheCoins.size();
+    case STATE_CACHE_PROPOSALS: return cacheProposals.size();
+    case STATE_CACHE_PAYMENT_REQUESTS: return cachePaymentRequests.size();
+    case STATE_CACHE_VOTES: return cacheVotes.size();
+    case STATE_CACHE_CONSULTATIONS: return cacheConsultations.size();
+    case STATE_CACHE_ANSWERS: return cacheAnswers.size();
+    case STATE_CACHE_CONSENSUS: return cacheConsensus.size();
+    case STATE_CACHE_TOKENS: return cacheTokens.size();
+    case STATE_CACHE_TOKEN_UTXOS: return cacheTokenUtxos.size();
+    case STATE_CACHE_NAME_RECORDS: return cacheNameRecords.size();
+    case STATE_CACHE_NAME_DATA: return cacheNameData.size();
+    case STATE_CACHE_NAME_STATES: return cacheNameStates.size();
+    default: return 0;
+    }
+}
+
 const CTxOut &CStateViewCache::GetOutputFor(const CTxIn& input) const
 {
     const CCoins* coins = AccessCoins(input.prevout.hash);
@@ -1338,6 +1806,7 @@ CProposalModifier::CProposalModifier(CStateViewCache& cache_, CProposalMap::iter
     assert(!cache.hasModifier);
     cache.hasModifier = true;
     prev = it->second;
+    cachedUsage = StateDynamicUsage(it->second);
 }
 
 CProposalModifier::~CProposalModifier()
@@ -1354,12 +1823,15 @@ CProposalModifier::~CProposalModifier()
         it->second.fDirty = true;
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString(), prev.diff(it->second));
     }
+
+    cache.cachedStateUsage[STATE_CACHE_PROPOSALS] += StateDynamicUsage(it->second) - cachedUsage;
 }
 
 CPaymentRequestModifier::CPaymentRequestModifier(CStateViewCache& cache_, CPaymentRequestMap::iterator it_, int height_) : cache(cache_), it(it_), height(height_) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
     prev = it->second;
+    cachedUsage = StateDynamicUsage(it->second);
 }
 
 CPaymentRequestModifier::~CPaymentRequestModifier()
@@ -1376,12 +1848,15 @@ CPaymentRequestModifier::~CPaymentRequestModifier()
         it->second.fDirty = true;
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString(), prev.diff(it->second));
     }
+
+    cache.cachedStateUsage[STATE_CACHE_PAYMENT_REQUESTS] += StateDynamicUsage(it->second) - cachedUsage;
 }
 
 CVoteModifier::CVoteModifier(CStateViewCache& cache_, CVoteMap::iterator it_, int height_) : cache(cache_), it(it_), height(height_) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
     prev = it->second;
+    cachedUsage = StateDynamicUsage(it->second);
 }
 
 CVoteModifier::~CVoteModifier()
@@ -1398,12 +1873,15 @@ CVoteModifier::~CVoteModifier()
         it->second.fDirty = true;
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"", HexStr(it->first), prev.diff(it->second));
     }
+
+    cache.cachedStateUsage[STATE_CACHE_VOTES] += StateDynamicUsage(it->second) - cachedUsage;
 }
 
 CConsultationModifier::CConsultationModifier(CStateViewCache& cache_, CConsultationMap::iterator it_, int height_) : cache(cache_), it(it_), height(height_) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
     prev = it->second;
+    cachedUsage = StateDynamicUsage(it->second);
 }
 
 CConsultationModifier::~CConsultationModifier()
@@ -1420,12 +1898,15 @@ CConsultationModifier::~CConsultationModifier()
         it->second.fDirty = true;
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString(), prev.diff(it->second));
     }
+
+    cache.cachedStateUsage[STATE_CACHE_CONSULTATIONS] += StateDynamicUsage(it->second) - cachedUsage;
 }
 
 CConsultationAnswerModifier::CConsultationAnswerModifier(CStateViewCache& cache_, CConsultationAnswerMap::iterator it_, int height_) : cache(cache_), it(it_), height(height_) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
     prev = it->second;
+    cachedUsage = StateDynamicUsage(it->second);
 }
 
 CConsultationAnswerModifier::~CConsultationAnswerModifier()
@@ -1442,12 +1923,15 @@ CConsultationAnswerModifier::~CConsultationAnswerModifier()
         it->second.fDirty = true;
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString(), prev.diff(it->second));
     }
+
+    cache.cachedStateUsage[STATE_CACHE_ANSWERS] += StateDynamicUsage(it->second) - cachedUsage;
 }
 
 CConsensusParameterModifier::CConsensusParameterModifier(CStateViewCache& cache_, CConsensusParameterMap::iterator it_, int height_) : cache(cache_), it(it_), height(height_) {
     assert(!cache.hasModifierConsensus);
     cache.hasModifierConsensus = true;
     prev = it->second;
+    cachedUsage = StateDynamicUsage(it->second);
 }
 
 CConsensusParameterModifier::~CConsensusParameterModifier()
@@ -1464,12 +1948,15 @@ CConsensusParameterModifier::~CConsensusParameterModifier()
         it->second.fDirty = true;
         LogPrint("daoextra", "%s: Modified %sconsensus parameter %d: %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first, prev.diff(it->second));
     }
+
+    cache.cachedStateUsage[STATE_CACHE_CONSENSUS] += StateDynamicUsage(it->second) - cachedUsage;
 }
 
 TokenModifier::TokenModifier(CStateViewCache& cache_, TokenMap::iterator it_, int height_) : cache(cache_), it(it_), height(height_) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
     prev = it->second;
+    cachedUsage = StateDynamicUsage(it->second);
 }
 
 TokenModifier::~TokenModifier()
@@ -1486,33 +1973,15 @@ TokenModifier::~TokenModifier()
         it->second.fDirty = true;
         LogPrint("daoextra", "%s: Modified %stoken %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString());
     }
-}
 
-TokenUtxosModifier::TokenUtxosModifier(CStateViewCache& cache_, TokenUtxoMap::iterator it_, int blockHeight_) : cache(cache_), it(it_), blockHeight(blockHeight_) {
-    assert(!cache.hasModifier);
-    cache.hasModifier = true;
-    prev = it->second;
-}
-
-TokenUtxosModifier::~TokenUtxosModifier()
-{
-    assert(cache.hasModifier);
-    cache.hasModifier = false;
-
-    if (it->second.size() == 0) {
-        cache.cacheTokenUtxos[it->first].clear();
-    }
-
-    if (!(prev == it->second))
-    {
-        LogPrint("token", "%s: Modified %stoken utxo %s\n", __func__, blockHeight > 0 ? strprintf("at block height %d ", blockHeight) : "", it->first.ToString());
-    }
+    cache.cachedStateUsage[STATE_CACHE_TOKENS] += StateDynamicUsage(it->second) - cachedUsage;
 }
 
 NameRecordModifier::NameRecordModifier(CStateViewCache& cache_, NameRecordMap::iterator it_, int height_) : cache(cache_), it(it_), height(height_) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
     prev = it->second;
+    cachedUsage = StateDynamicUsage(it->second);
 }
 
 NameRecordModifier::~NameRecordModifier()
@@ -1528,12 +1997,15 @@ NameRecordModifier::~NameRecordModifier()
     {
         LogPrint("daoextra", "%s: Modified %sname record %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString());
     }
+
+    cache.cachedStateUsage[STATE_CACHE_NAME_RECORDS] += StateDynamicUsage(it->second) - cachedUsage;
 }
 
 NameDataModifier::NameDataModifier(CStateViewCache& cache_, NameDataMap::iterator it_, int height_) : cache(cache_), it(it_), height(height_) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
     prev = it->second;
+    cachedUsage = StateDynamicUsage(it->second);
 }
 
 NameDataModifier::~NameDataModifier()
@@ -1549,6 +2021,8 @@ NameDataModifier::~NameDataModifier()
     {
         LogPrint("daoextra", "%s: Modified %sname data %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString());
     }
+
+    cache.cachedStateUsage[STATE_CACHE_NAME_DATA] += StateDynamicUsage(it->second) - cachedUsage;
 }
 
 CStateViewCursor::~CStateViewCursor()
@@ -6,8 +6,10 @@
 #ifndef STOCK_COINS_H
 #define STOCK_COINS_H
 
+#include <amount.h>
 #include <compressor.h>
 #include <core_memusage.h>
+#include <crypto/muhash.h>
 #include <hash.h>
 #include <memusage.h>
 #include <serialize.h>
@@ -285,6 +287,72 @@ public:
     }
 };
 
+/**
+ * Running statistics about the unspent output set, maintained incrementally
+ * while blocks are connected and disconnected, so they can be queried in O(1).
+ *
+ * The set hash is a MuHash3072 over the serialized (outpoint, height and
+ * coinbase flag, txout) of every unspent output, so it is independent of the
+ * order in which outputs were added or removed.
+ */
+class CStateStats
+{
+public:
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+    CAmount nTotalColdAmount;
+    CAmount nTotalColdv2Amount;
+    MuHash3072 muhash;
+
+    //! Not serialized; false when the stats have not been computed for the current state.
+    bool fValid;
+
+    CStateStats() { SetNull(); }
+
+    void SetNull() {
+        nTransactions = 0;
+        nTransactionOutputs = 0;
+        nBogoSize = 0;
+        nTotalAmount = 0;
+        nTotalColdAmount = 0;
+        nTotalColdv2Amount = 0;
+        muhash.SetEmpty();
+        fValid = false;
+    }
+
+    void AddOutput(const uint256 &txid, unsigned int n, const CTxOut &out, int nHeight, bool fCoinBase);
+    void RemoveOutput(const uint256 &txid, unsigned int n, const CTxOut &out, int nHeight, bool fCoinBase);
+
+    //! Add every unspent output of a (non-pruned) coins entry, counting it as one transaction.
+    void AddCoins(const uint256 &txid, const CCoins &coins);
+    //! Remove every unspent output of a (non-pruned) coins entry, counting it as one transaction.
+    void RemoveCoins(const uint256 &txid, const CCoins &coins);
+
+    uint256 GetHash() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(VARINT(nTransactions));
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nBogoSize));
+        READWRITE(nTotalAmount);
+        READWRITE(nTotalColdAmount);
+        READWRITE(nTotalColdv2Amount);
+        unsigned char vchSet[MuHash3072::BYTE_SIZE];
+        if (!ser_action.ForRead())
+            muhash.GetBytes(vchSet);
+        READWRITE(FLATDATA(vchSet));
+        if (ser_action.ForRead()) {
+            muhash.SetBytes(vchSet);
+            fValid = true;
+        }
+    }
+};
+
 class SaltedTxidHasher
 {
 private:
@@ -309,13 +377,14 @@ struct CCacheEntry
 {
     T coins; // The actual cached data.
     unsigned char flags;
+    uint64_t nLastUsed; // Access stamp of the owning cache, used to evict the least recently used clean entries.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
     };
 
-    CCacheEntry() : coins(), flags(0) {}
+    CCacheEntry() : coins(), flags(0), nLastUsed(0) {}
 };
 
 typedef CCacheEntry<CCoins> CCoinsCacheEntry;
@@ -388,8 +457,14 @@ public:
     virtual bool GetAllTokens(TokenMap& map);
     virtual bool HaveToken(const uint256 &id) const;
 
-    virtual bool GetTokenUtxos(const uint256 &id, TokenUtxoValues &tokenUtxos);
-    virtual bool HaveTokenUtxos(const uint256 &id) const;
+    /**
+     * Retrieve the utxos of start.id at or above start, in key order, at most
+     * nLimit of them (0 for all). Asking for one more than a page and passing
+     * the key of that extra entry as the next start reads the index page by page.
+     */
+    virtual bool GetTokenUtxos(const TokenUtxoKey &start, size_t nLimit, TokenUtxoValues &tokenUtxos);
+    //! Retrieve the highest utxo of end.id below end, i.e. the newest one for TokenUtxoKey::End(id)
+    virtual bool GetLastTokenUtxo(const TokenUtxoKey &end, TokenUtxoEntry &tokenUtxo);
 
     virtual bool GetNameRecord(const uint256 &id, NameRecordValue& height) const;
     virtual bool GetAllNameRecords(NameRecordMap& map);
@@ -397,10 +472,16 @@ public:
 
     virtual bool GetNameData(const uint256& id, NameDataValues& data);
     virtual bool HaveNameData(const uint256& id) const;
+    //! Retrieve the current data of a name, without going through its history
+    virtual bool GetNameState(const uint256& id, NameDataState& state) const;
 
     virtual int GetExcludeVotes() const;
     virtual bool SetExcludeVotes(int count);
 
+    //! Retrieve the unspent output set statistics for the best block, if they are known
+    virtual bool GetStateStats(CStateStats& stats) const;
+    virtual bool SetStateStats(const CStateStats& stats);
+
     //! Retrieve the block hash whose state this CStateView currently represents
     virtual uint256 GetBestBlock() const;
 
@@ -410,8 +491,9 @@ public:
                             CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                             CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
                             CConsensusParameterMap& mapConsensus, TokenMap& mapTokens, TokenUtxoMap& mapTokenUtxos,
-                            NameRecordMap& mapNameRecords, NameDataMap& mapNameData,
-                            const uint256 &hashBlock, const int &nCacheExcludeVotes);
+                            NameRecordMap& mapNameRecords, NameDataMap& mapNameData, NameStateMap& mapNameStates,
+                            const uint256 &hashBlock, const int &nCacheExcludeVotes,
+                            const CStateStats& stats);
 
     //! Get a cursor to iterate over the whole state
     virtual CStateViewCursor *Cursor() const;
@@ -452,8 +534,8 @@ public:
     bool GetAllTokens(TokenMap& map);
     bool HaveToken(const uint256 &id) const;
 
-    bool GetTokenUtxos(const uint256 &id, TokenUtxoValues &tokenUtxos);
-    bool HaveTokenUtxos(const uint256 &id) const;
+    bool GetTokenUtxos(const TokenUtxoKey &start, size_t nLimit, TokenUtxoValues &tokenUtxos);
+    bool GetLastTokenUtxo(const TokenUtxoKey &end, TokenUtxoEntry &tokenUtxo);
 
     bool GetNameRecord(const uint256 &id, NameRecordValue& height) const;
     bool GetAllNameRecords(NameRecordMap& map);
@@ -461,9 +543,12 @@ public:
 
     bool GetNameData(const uint256 &id, NameDataValues& data);
     bool HaveNameData(const uint256 &id) const;
+    bool GetNameState(const uint256 &id, NameDataState& state) const;
 
     int GetExcludeVotes() const;
     bool SetExcludeVotes(int count);
+    bool GetStateStats(CStateStats& stats) const;
+    bool SetStateStats(const CStateStats& stats);
 
     uint256 GetBestBlock() const;
     void SetBackend(CStateView &viewIn);
@@ -471,8 +556,9 @@ public:
                     CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                     CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
                     CConsensusParameterMap& mapConsensus, TokenMap& mapTokens, TokenUtxoMap& mapTokenUtxos,
-                    NameRecordMap& mapNameRecords, NameDataMap& mapNameData,
-                    const uint256 &hashBlock, const int &nCacheExcludeVotes);
+                    NameRecordMap& mapNameRecords, NameDataMap& mapNameData, NameStateMap& mapNameStates,
+                    const uint256 &hashBlock, const int &nCacheExcludeVotes,
+                    const CStateStats& stats);
     CStateViewCursor *Cursor() const;
 };
 
@@ -506,6 +592,7 @@ private:
     CProposalMap::iterator it;
     CProposalModifier(CStateViewCache& cache_, CProposalMap::iterator it_, int height=0);
     CProposal prev;
+    size_t cachedUsage; // Dynamic memory usage of the entry before modification
     int height;
 
 public:
@@ -523,6 +610,7 @@ private:
     CPaymentRequestMap::iterator it;
     CPaymentRequestModifier(CStateViewCache& cache_, CPaymentRequestMap::iterator it_, int height=0);
     CPaymentRequest prev;
+    size_t cachedUsage; // Dynamic memory usage of the entry before modification
     int height;
 
 public:
@@ -539,6 +627,7 @@ private:
     CVoteMap::iterator it;
     CVoteModifier(CStateViewCache& cache_, CVoteMap::iterator it_, int height=0);
     CVoteList prev;
+    size_t cachedUsage; // Dynamic memory usage of the entry before modification
     int height;
 
 public:
@@ -555,6 +644,7 @@ private:
     CConsultationMap::iterator it;
     CConsultationModifier(CStateViewCache& cache_, CConsultationMap::iterator it_, int height=0);
     CConsultation prev;
+    size_t cachedUsage; // Dynamic memory usage of the entry before modification
     int height;
 
 public:
@@ -571,6 +661,7 @@ private:
     CConsensusParameterMap::iterator it;
     CConsensusParameterModifier(CStateViewCache& cache_, CConsensusParameterMap::iterator it_, int height=0);
     CConsensusParameter prev;
+    size_t cachedUsage; // Dynamic memory usage of the entry before modification
     int height;
 
 public:
@@ -587,6 +678,7 @@ private:
     TokenMap::iterator it;
     TokenModifier(CStateViewCache& cache_, TokenMap::iterator it_, int height=0);
     TokenInfo prev;
+    size_t cachedUsage; // Dynamic memory usage of the entry before modification
     int height;
 
 public:
@@ -596,22 +688,6 @@ public:
     friend class CStateViewCache;
 };
 
-class TokenUtxosModifier
-{
-private:
-    CStateViewCache& cache;
-    TokenUtxoMap::iterator it;
-    TokenUtxosModifier(CStateViewCache& cache_, TokenUtxoMap::iterator it_, int blockHeight=0);
-    TokenUtxoValues prev;
-    int blockHeight;
-
-public:
-    TokenUtxoValues* operator->() { return &it->second; }
-    TokenUtxoValues& operator*() { return it->second; }
-    ~TokenUtxosModifier();
-    friend class CStateViewCache;
-};
-
 class NameRecordModifier
 {
 private:
@@ -619,6 +695,7 @@ private:
     NameRecordMap::iterator it;
     NameRecordModifier(CStateViewCache& cache_, NameRecordMap::iterator it_, int height=0);
     NameRecordValue prev;
+    size_t cachedUsage; // Dynamic memory usage of the entry before modification
     int height;
 
 public:
@@ -635,6 +712,7 @@ private:
     NameDataMap::iterator it;
     NameDataModifier(CStateViewCache& cache_, NameDataMap::iterator it_, int height=0);
     NameDataValues prev;
+    size_t cachedUsage; // Dynamic memory usage of the entry before modification
     int height;
 
 public:
@@ -651,6 +729,7 @@ private:
     CConsultationAnswerMap::iterator it;
     CConsultationAnswerModifier(CStateViewCache& cache_, CConsultationAnswerMap::iterator it_, int height=0);
     CConsultationAnswer prev;
+    size_t cachedUsage; // Dynamic memory usage of the entry before modification
     int height;
 
 public:
@@ -660,6 +739,27 @@ public:
     friend class CStateViewCache;
 };
 
+/** The kinds of state a CStateViewCache holds, for memory accounting and budgets. */
+enum StateCacheCategory
+{
+    STATE_CACHE_COINS,
+    STATE_CACHE_PROPOSALS,
+    STATE_CACHE_PAYMENT_REQUESTS,
+    STATE_CACHE_VOTES,
+    STATE_CACHE_CONSULTATIONS,
+    STATE_CACHE_ANSWERS,
+    STATE_CACHE_CONSENSUS,
+    STATE_CACHE_TOKENS,
+    STATE_CACHE_TOKEN_UTXOS,
+    STATE_CACHE_NAME_RECORDS,
+    STATE_CACHE_NAME_DATA,
+    STATE_CACHE_NAME_STATES,
+    STATE_CACHE_CATEGORIES
+};
+
+/** Name of a category, as used by -statecachebudget and getstatecacheinfo. */
+const char* GetStateCacheCategoryName(StateCacheCategory category);
+
 /** CStateView that adds a memory cache for transactions to another CStateView */
 class CStateViewCache : public CStateViewBacked
 {
@@ -681,14 +781,31 @@ protected:
     mutable CConsultationAnswerMap cacheAnswers;
     mutable CConsensusParameterMap cacheConsensus;
     mutable TokenMap cacheTokens;
+    //! Changed utxo index entries only, reads merge them over the base
     mutable TokenUtxoMap cacheTokenUtxos;
     mutable NameRecordMap cacheNameRecords;
+    //! Changed name history entries only, reads merge them over the base
     mutable NameDataMap cacheNameData;
+    mutable NameStateMap cacheNameStates;
     mutable int nCacheExcludeVotes;
+    mutable CStateStats cacheStats;
+    mutable bool fCacheStats;
 
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Incremented on every coins lookup, to stamp the entries it touches. */
+    mutable uint64_t nAccessClock;
+
+    /*
+     * Dynamic memory usage of the other caches, map nodes included, by
+     * category (the coins slot is unused). Kept up to date entry by entry and
+     * recomputed from scratch on every Sync().
+     */
+    mutable size_t cachedStateUsage[STATE_CACHE_CATEGORIES];
+
+    void RecomputeStateUsage() const;
+
 public:
     CStateViewCache(CStateView *baseIn);
     ~CStateViewCache();
@@ -703,7 +820,6 @@ public:
     bool HaveConsultationAnswer(const uint256 &cid) const;
     bool HaveConsensusParameter(const int& pid) const;
     bool HaveToken(const uint256& id) const;
-    bool HaveTokenUtxos(const uint256 &id) const;
     bool HaveNameRecord(const uint256& id) const;
     bool HaveNameData(const uint256& id) const;
     bool GetProposal(const uint256 &txid, CProposal &proposal) const;
@@ -713,9 +829,13 @@ public:
     bool GetConsultationAnswer(const uint256 &cid, CConsultationAnswer& answer) const;
     bool GetConsensusParameter(const int& pid, CConsensusParameter& cparameter) const;
     bool GetToken(const uint256& pid, TokenInfo& token) const;
-    bool GetTokenUtxos(const uint256 &id, TokenUtxoValues &tokenUtxos);
+    bool GetTokenUtxos(const TokenUtxoKey &start, size_t nLimit, TokenUtxoValues &tokenUtxos);
+    bool GetLastTokenUtxo(const TokenUtxoKey &end, TokenUtxoEntry &tokenUtxo);
+    //! Retrieve the output holding token id now, see GetLastTokenUtxo for the index order
+    bool GetCurrentTokenUtxo(const uint256 &id, TokenUtxoEntry &tokenUtxo);
     bool GetNameRecord(const uint256& pid, NameRecordValue& height) const;
     bool GetNameData(const uint256& pid, NameDataValues& data);
+    bool GetNameState(const uint256& id, NameDataState& state) const;
     bool GetAllProposals(CProposalMap& map);
     bool GetAllPaymentRequests(CPaymentRequestMap& map);
     bool GetAllVotes(CVoteMap& map);
@@ -730,14 +850,15 @@ public:
                     CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                     CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
                     CConsensusParameterMap& mapConsensus, TokenMap& mapTokens, TokenUtxoMap& mapTokenUtxos,
-                    NameRecordMap& mapNameRecords, NameDataMap& mapNameData,
-                    const uint256 &hashBlockIn, const int &nCacheExcludeVotes);
+                    NameRecordMap& mapNameRecords, NameDataMap& mapNameData, NameStateMap& mapNameStates,
+                    const uint256 &hashBlockIn, const int &nCacheExcludeVotes,
+                    const CStateStats& stats);
     bool AddProposal(const CProposal& proposal) const;
     bool AddPaymentRequest(const CPaymentRequest& prequest) const;
     bool AddCachedVoter(const CVoteMapKey &voter, CVoteMapValue& vote) const;
     bool AddConsultation(const CConsultation& consultation) const;
     bool AddToken(const Token& token) const;
-    bool AddTokenUtxo(const uint256 &id, const TokenUtxoEntry& utxo) const;
+    bool AddTokenUtxo(const TokenUtxoKey &key, const TokenUtxoValue& utxo) const;
     bool AddNameRecord(const NameRecord& record) const;
     bool AddNameData(const uint256& id, const NameDataEntry& record) const;
     bool AddConsultationAnswer(const CConsultationAnswer& answer);
@@ -753,6 +874,8 @@ public:
 
     int GetExcludeVotes() const;
     bool SetExcludeVotes(int count);
+    bool GetStateStats(CStateStats& stats) const;
+    bool SetStateStats(const CStateStats& stats);
 
     /**
      * Check if we have the given tx already loaded in this cache.
@@ -784,7 +907,6 @@ public:
     CConsultationAnswerModifier ModifyConsultationAnswer(const uint256 &cid, int nHeight = 0);
     CConsensusParameterModifier ModifyConsensusParameter(const int &pid, int nHeight = 0);
     TokenModifier ModifyToken(const uint256 &id, int nHeight = 0);
-    TokenUtxosModifier ModifyTokenUtxos(const uint256 &id, int blockHeight = 0);
     NameRecordModifier ModifyNameRecord(const uint256 &id, int nHeight = 0);
     NameDataModifier ModifyNameData(const uint256& id, int nHeight = 0);
 
@@ -806,6 +928,20 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push only the modified entries to the base, leaving the cache warm: the
+     * written entries stay resident and are marked clean, and erased ones are
+     * dropped. Token and name entries are not dirty-tracked and are pushed and
+     * dropped as in Flush(). Same failure semantics as Flush().
+     */
+    bool Sync();
+
+    /**
+     * Evict clean coins, least recently used first, until the whole cache uses
+     * no more than nTargetUsage bytes. Modified entries are never evicted.
+     */
+    void Trim(size_t nTargetUsage);
+
     /**
      * Removes the transaction with the given hash from the cache, if it is
      * not modified.
@@ -815,9 +951,21 @@ public:
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
-    //! Calculate the size of the cache (in bytes)
+    //! Calculate the number of entries of one category
+    size_t GetCacheSize(StateCacheCategory category) const;
+
+    //! Calculate the size of the cache, all categories included (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Calculate the size of one category of the cache (in bytes)
+    size_t DynamicMemoryUsage(StateCacheCategory category) const;
+
+    /**
+     * Drop the unmodified entries of one non-coin category, e.g. after a
+     * Sync() when it is over its budget.
+     */
+    void UncacheClean(StateCacheCategory category);
+
     /**
      * Amount of stocks coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -848,7 +996,6 @@ public:
     friend class CConsultationAnswerModifier;
     friend class CConsensusParameterModifier;
     friend class TokenModifier;
-    friend class TokenUtxosModifier;
     friend class NameRecordModifier;
     friend class NameDataModifier;
 
@@ -862,9 +1009,10 @@ private:
     CConsultationAnswerMap::const_iterator FetchConsultationAnswer(const uint256 &cid) const;
     CConsensusParameterMap::const_iterator FetchConsensusParameter(const int &pid) const;
     TokenMap::const_iterator FetchToken(const uint256 &id) const;
-    TokenUtxoMap::const_iterator FetchTokenUtxos(const uint256 &id) const;
     NameRecordMap::const_iterator FetchNameRecord(const uint256 &id) const;
-    NameDataMap::const_iterator FetchNameData(const uint256 &id) const;
+    //! The history of a name in the base with the changes of this cache applied
+    void ReadNameData(const uint256 &id, NameDataValues &data) const;
+    NameStateMap::const_iterator FetchNameState(const uint256 &id) const;
 
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on top of a base cache.
@@ -81,6 +81,11 @@ typedef u_int SOCKET;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// Linux: wait for socket events with epoll instead of select()
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+#define USE_EPOLL 1
+#endif
+
 bool static inline IsSelectableSocket(SOCKET s) {
 #ifdef WIN32
     return true;
@@ -5,6 +5,7 @@
 #include "consensus/dao.h"
 #include "base58.h"
 #include "main.h"
+#include "memusage.h"
 #include "rpc/server.h"
 #include "utilmoneystr.h"
 
@@ -349,201 +350,527 @@ std::map<std::pair<uint256, int64_t>, int> mapCacheConsultationToUpdate;
 int nCacheExclude = 0;
 uint256 lastConsensusStateHash;
 
-bool VoteStep(const CValidationState& state, CBlockIndex *pindexNew, const bool fUndo, CStateViewCache& view)
+// Number of blocks which added an entry to the proposal and payment request vote
+// caches, so the votes of a disconnected block can be taken out again.
+std::map<uint256, int> mapCacheProposalsRefs;
+std::map<uint256, int> mapCachePaymentRequestRefs;
+// Block the vote caches were counted up to.
+uint256 hashCacheBlock;
+
+// Entries VoteStep still has to visit. Entries which reached a state VoteStep
+// does not change anymore are parked under the block which set that state and
+// are only visited again when that block is disconnected or when they are
+// marked for update.
+std::set<uint256> setActiveProposals;
+std::set<uint256> setActivePaymentRequests;
+std::set<uint256> setActiveConsultations;
+std::set<uint256> setActiveConsultationAnswers;
+std::map<uint256, std::vector<std::pair<DAOEntryType, uint256>>> mapFinishedDAOEntries;
+std::set<std::pair<DAOEntryType, uint256>> setDAOEntriesToUpdate;
+// Block and consensus parameters the index of active entries describes.
+uint256 hashActiveIndexBlock;
+uint256 hashActiveIndexConsensus;
+
+void MarkDAOEntryForUpdate(DAOEntryType type, const uint256& hash)
 {
     AssertLockHeld(cs_main);
 
-    const CBlockIndex* pindexDelete;
-    if (fUndo)
-    {
-        pindexDelete = pindexNew;
-        pindexNew = pindexNew->pprev;
-        assert(pindexNew);
-    }
+    setDAOEntriesToUpdate.insert(std::make_pair(type, hash));
+}
 
-    int64_t nTimeStart = GetTimeMicros();
-    auto nCycleLength = GetConsensusParameter(Consensus::CONSENSUS_PARAM_VOTING_CYCLE_LENGTH, view);
-    int nBlocks = (pindexNew->nHeight % nCycleLength) + 1;
-    const CBlockIndex* pindexblock = pindexNew;
+void ResetDAOVoteCaches()
+{
+    AssertLockHeld(cs_main);
 
-    bool fCFund = IsCommunityFundEnabled(pindexNew->pprev, Params().GetConsensus());
-    bool fDAOConsultations = IsDAOEnabled(pindexNew->pprev, Params().GetConsensus());
+    mapCacheProposalsToUpdate.clear();
+    mapCachePaymentRequestToUpdate.clear();
+    mapCacheSupportToUpdate.clear();
+    mapCacheConsultationToUpdate.clear();
+    mapCacheProposalsRefs.clear();
+    mapCachePaymentRequestRefs.clear();
+    nCacheExclude = 0;
+    lastConsensusStateHash = uint256();
+    hashCacheBlock = uint256();
+
+    setActiveProposals.clear();
+    setActivePaymentRequests.clear();
+    setActiveConsultations.clear();
+    setActiveConsultationAnswers.clear();
+    mapFinishedDAOEntries.clear();
+    setDAOEntriesToUpdate.clear();
+    hashActiveIndexBlock = uint256();
+    hashActiveIndexConsensus = uint256();
+}
 
-    if (!fCFund && !fDAOConsultations)
-        return true;
+static std::set<uint256>& GetActiveDAOEntries(DAOEntryType type)
+{
+    if (type == DAO_PROPOSAL)
+        return setActiveProposals;
+    else if (type == DAO_PAYMENT_REQUEST)
+        return setActivePaymentRequests;
+    else if (type == DAO_CONSULTATION)
+        return setActiveConsultations;
+    return setActiveConsultationAnswers;
+}
 
-    bool fScanningWholeCycle = false;
+// The Get*FinalBlock functions return the block which moved an entry into a state
+// VoteStep does not change anymore under the current consensus parameters, or
+// nullptr while the entry still has to be visited on every step.
 
-    std::map<uint256, bool> mapSeen;
-    std::map<uint256, bool> mapSeenSupport;
+static const CBlockIndex* GetProposalFinalBlock(const CProposal& proposal, const CStateViewCache& view)
+{
+    flags fState = proposal.GetLastState();
 
-    uint256 consensusStateHash = GetConsensusStateHash(view);
+    // Proposals without BASE_VERSION expire by block time, which is not monotonic, and
+    // expired accepted proposals are still rejected when their votes turn against them.
+    if (fState == DAOFlags::REJECTED ||
+            (fState == DAOFlags::EXPIRED && (proposal.nVersion & CProposal::BASE_VERSION)) ||
+            (fState == DAOFlags::ACCEPTED_EXPIRED && !proposal.HasRejectionMajority(view)))
+        return proposal.GetLastStateBlockIndex();
 
-    if (fUndo || lastConsensusStateHash != consensusStateHash || nBlocks == 1 ||
-            (mapCacheProposalsToUpdate.empty() && mapCachePaymentRequestToUpdate.empty() && mapCacheSupportToUpdate.empty() && mapCacheConsultationToUpdate.empty())) {
-        mapCacheProposalsToUpdate.clear();
-        mapCachePaymentRequestToUpdate.clear();
-        mapCacheSupportToUpdate.clear();
-        mapCacheConsultationToUpdate.clear();
-        nCacheExclude = 0;
-        fScanningWholeCycle = true;
-    } else {
-        nBlocks = 1;
-    }
+    return nullptr;
+}
 
-    int64_t nTimeStart2 = GetTimeMicros();
+static const CBlockIndex* GetPaymentRequestFinalBlock(const CPaymentRequest& prequest, const CStateViewCache& view)
+{
+    flags fState = prequest.GetLastState();
 
-    LogPrint("dao", "%s: Scanning %d block(s) starting at %d (fUndo=%d fScanningWholeCycle=%d consensusChanged=%d). We are in block %d inside of the cycle.\n",
-             __func__, nBlocks, pindexblock->nHeight, fUndo, fScanningWholeCycle, lastConsensusStateHash != consensusStateHash,
-             (pindexNew->nHeight % nCycleLength) + 1);
+    // Accepted and paid requests are still rejected when their votes turn against them.
+    if (fState == DAOFlags::REJECTED ||
+            (fState == DAOFlags::EXPIRED && prequest.IsExpired(view)) ||
+            ((fState == DAOFlags::ACCEPTED || fState == DAOFlags::PAID) && !prequest.HasRejectionMajority(view)))
+        return prequest.GetLastStateBlockIndex();
 
-    lastConsensusStateHash = consensusStateHash;
+    return nullptr;
+}
 
-    while(nBlocks > 0 && pindexblock != NULL)
+static const CBlockIndex* GetConsultationFinalBlock(const CConsultation& consultation)
+{
+    if (consultation.IsFinished())
+        return consultation.GetLastStateBlockIndex();
+
+    return nullptr;
+}
+
+static const CBlockIndex* GetConsultationAnswerFinalBlock(const CConsultationAnswer& answer, const CStateViewCache& view)
+{
+    CConsultation parent;
+
+    if (!view.GetConsultation(answer.parent, parent) || !parent.IsFinished())
+        return nullptr;
+
+    flags fState = answer.GetLastState();
+
+    // Answers of a consensus parameter consultation can still pass after the consultation
+    // finished, and supported answers are still accepted at the end of the cycle.
+    if (fState != DAOFlags::PASSED && (parent.IsAboutConsensusParameter() || (fState == DAOFlags::NIL && answer.IsSupported(view))))
+        return nullptr;
+
+    const CBlockIndex* pindexParent = parent.GetLastStateBlockIndex();
+    const CBlockIndex* pindexAnswer = answer.GetLastStateBlockIndex();
+
+    if (!pindexParent)
+        return nullptr;
+
+    return (pindexAnswer && pindexAnswer->nHeight > pindexParent->nHeight) ? pindexAnswer : pindexParent;
+}
+
+/** Mark every DAO entry of the view as active. */
+static bool RebuildActiveDAOIndex(CStateViewCache& view)
+{
+    CProposalMap mapProposals;
+    CPaymentRequestMap mapPaymentRequests;
+    CConsultationMap mapConsultations;
+    CConsultationAnswerMap mapConsultationAnswers;
+
+    if (!view.GetAllProposals(mapProposals) || !view.GetAllPaymentRequests(mapPaymentRequests) ||
+            !view.GetAllConsultations(mapConsultations) || !view.GetAllConsultationAnswers(mapConsultationAnswers))
+        return false;
+
+    setActiveProposals.clear();
+    setActivePaymentRequests.clear();
+    setActiveConsultations.clear();
+    setActiveConsultationAnswers.clear();
+    mapFinishedDAOEntries.clear();
+    setDAOEntriesToUpdate.clear();
+
+    for (auto& it: mapProposals)
+        setActiveProposals.insert(it.first);
+
+    for (auto& it: mapPaymentRequests)
+        setActivePaymentRequests.insert(it.first);
+
+    for (auto& it: mapConsultations)
+        setActiveConsultations.insert(it.first);
+
+    for (auto& it: mapConsultationAnswers)
+        setActiveConsultationAnswers.insert(it.first);
+
+    return true;
+}
+
+/** Park the active entries which reached a final state and forget the ones which do not exist anymore. */
+static void UpdateActiveDAOIndex(const CStateViewCache& view)
+{
+    for (auto it = setActiveProposals.begin(); it != setActiveProposals.end();)
     {
         CProposal proposal;
+
+        if (view.GetProposal(*it, proposal))
+        {
+            const CBlockIndex* pindexFinal = GetProposalFinalBlock(proposal, view);
+
+            if (!pindexFinal)
+            {
+                ++it;
+                continue;
+            }
+
+            mapFinishedDAOEntries[pindexFinal->GetBlockHash()].push_back(std::make_pair(DAO_PROPOSAL, *it));
+        }
+
+        it = setActiveProposals.erase(it);
+    }
+
+    for (auto it = setActivePaymentRequests.begin(); it != setActivePaymentRequests.end();)
+    {
         CPaymentRequest prequest;
-        CConsultation consultation;
-        CConsultationAnswer answer;
 
-        mapSeen.clear();
-        mapSeenSupport.clear();
+        if (view.GetPaymentRequest(*it, prequest))
+        {
+            const CBlockIndex* pindexFinal = GetPaymentRequestFinalBlock(prequest, view);
+
+            if (!pindexFinal)
+            {
+                ++it;
+                continue;
+            }
+
+            mapFinishedDAOEntries[pindexFinal->GetBlockHash()].push_back(std::make_pair(DAO_PAYMENT_REQUEST, *it));
+        }
+
+        it = setActivePaymentRequests.erase(it);
+    }
+
+    for (auto it = setActiveConsultations.begin(); it != setActiveConsultations.end();)
+    {
+        CConsultation consultation;
 
-        if (pindexblock->nNonce & 1 && !pindexblock->IsColdStakeV2())
+        if (view.GetConsultation(*it, consultation))
         {
-            nCacheExclude++;
+            const CBlockIndex* pindexFinal = GetConsultationFinalBlock(consultation);
+
+            if (!pindexFinal)
+            {
+                ++it;
+                continue;
+            }
+
+            mapFinishedDAOEntries[pindexFinal->GetBlockHash()].push_back(std::make_pair(DAO_CONSULTATION, *it));
         }
-        else
+
+        it = setActiveConsultations.erase(it);
+    }
+
+    for (auto it = setActiveConsultationAnswers.begin(); it != setActiveConsultationAnswers.end();)
+    {
+        CConsultationAnswer answer;
+
+        if (view.GetConsultationAnswer(*it, answer))
         {
-            if (fCFund)
+            const CBlockIndex* pindexFinal = GetConsultationAnswerFinalBlock(answer, view);
+
+            if (!pindexFinal)
             {
-                auto pVotes = GetProposalVotes(pindexblock->GetBlockHash());
-                if (pVotes != nullptr)
-                {
-                    for(unsigned int i = 0; i < pVotes->size(); i++)
-                    {
-                        if(mapSeen.count((*pVotes)[i].first) == 0)
-                        {
-                            LogPrint("daoextra", "%s: Found vote %d for proposal %s at block height %d\n", __func__,
-                                     (*pVotes)[i].second, (*pVotes)[i].first.ToString(),
-                                     pindexblock->nHeight);
+                ++it;
+                continue;
+            }
 
-                            if(mapCacheProposalsToUpdate.count((*pVotes)[i].first) == 0)
-                                mapCacheProposalsToUpdate[(*pVotes)[i].first] = std::make_pair(std::make_pair(0, 0), 0);
+            mapFinishedDAOEntries[pindexFinal->GetBlockHash()].push_back(std::make_pair(DAO_CONSULTATION_ANSWER, *it));
+        }
 
-                            if((*pVotes)[i].second == VoteFlags::VOTE_YES)
-                                mapCacheProposalsToUpdate[(*pVotes)[i].first].first.first += 1;
-                            else if((*pVotes)[i].second == VoteFlags::VOTE_ABSTAIN)
-                                mapCacheProposalsToUpdate[(*pVotes)[i].first].second += 1;
-                            else if((*pVotes)[i].second == VoteFlags::VOTE_NO)
-                                mapCacheProposalsToUpdate[(*pVotes)[i].first].first.second += 1;
+        it = setActiveConsultationAnswers.erase(it);
+    }
+}
 
-                            mapSeen[(*pVotes)[i].first]=true;
-                        }
-                    }
-                }
+// Entries which are not active are not loaded by VoteStep, but they are still
+// needed as parents of the active ones.
+
+static bool GetLoadedProposal(const CProposalMap& mapProposals, const CStateViewCache& view, const uint256& hash, CProposal& proposal)
+{
+    auto it = mapProposals.find(hash);
+
+    if (it != mapProposals.end())
+    {
+        proposal = it->second;
+        return true;
+    }
+
+    return view.GetProposal(hash, proposal);
+}
+
+static bool GetLoadedConsultation(const CConsultationMap& mapConsultations, const CStateViewCache& view, const uint256& hash, CConsultation& consultation)
+{
+    auto it = mapConsultations.find(hash);
+
+    if (it != mapConsultations.end())
+    {
+        consultation = it->second;
+        return true;
+    }
+
+    return view.GetConsultation(hash, consultation);
+}
+
+/** Add (nSign = 1) or take out (nSign = -1) the votes of a block to the vote caches.
+ *  Returns false when votes to take out are not found in the caches. */
+static bool CountBlockVotes(const CBlockIndex* pindexblock, CStateViewCache& view, bool fCFund, bool fDAOConsultations, int nSign)
+{
+    std::map<uint256, bool> mapSeen;
+    std::map<uint256, bool> mapSeenSupport;
+
+    CConsultationAnswer answer;
+
+    if (pindexblock->nNonce & 1 && !pindexblock->IsColdStakeV2())
+    {
+        nCacheExclude += nSign;
+        return true;
+    }
+
+    if (fCFund)
+    {
+        auto pVotes = GetProposalVotes(pindexblock->GetBlockHash());
+        if (pVotes != nullptr)
+        {
+            for(unsigned int i = 0; i < pVotes->size(); i++)
+            {
+                const uint256& hash = (*pVotes)[i].first;
 
-                auto prVotes = GetPaymentRequestVotes(pindexblock->GetBlockHash());
-                if (prVotes != nullptr)
+                if(mapSeen.count(hash) == 0)
                 {
-                    for(unsigned int i = 0; i < prVotes->size(); i++)
-                    {
-                        if(mapSeen.count((*prVotes)[i].first) == 0)
-                        {
-                            LogPrint("daoextra", "%s: Found vote %d for payment request %s at block height %d\n", __func__,
-                                     (*prVotes)[i].second, (*prVotes)[i].first.ToString(),
-                                     pindexblock->nHeight);
+                    LogPrint("daoextra", "%s: Found vote %d for proposal %s at block height %d\n", __func__,
+                             (*pVotes)[i].second, hash.ToString(),
+                             pindexblock->nHeight);
 
-                            if(mapCachePaymentRequestToUpdate.count((*prVotes)[i].first) == 0)
-                                mapCachePaymentRequestToUpdate[(*prVotes)[i].first] = std::make_pair(std::make_pair(0, 0), 0);
+                    if (nSign < 0 && mapCacheProposalsRefs.count(hash) == 0)
+                        return false;
 
-                            if((*prVotes)[i].second == VoteFlags::VOTE_YES)
-                                mapCachePaymentRequestToUpdate[(*prVotes)[i].first].first.first += 1;
-                            else if((*prVotes)[i].second == VoteFlags::VOTE_ABSTAIN)
-                                mapCachePaymentRequestToUpdate[(*prVotes)[i].first].second += 1;
-                            else if((*prVotes)[i].second == VoteFlags::VOTE_NO)
-                                mapCachePaymentRequestToUpdate[(*prVotes)[i].first].first.second += 1;
+                    if(mapCacheProposalsToUpdate.count(hash) == 0)
+                        mapCacheProposalsToUpdate[hash] = std::make_pair(std::make_pair(0, 0), 0);
 
-                            mapSeen[(*prVotes)[i].first]=true;
-                        }
+                    if((*pVotes)[i].second == VoteFlags::VOTE_YES)
+                        mapCacheProposalsToUpdate[hash].first.first += nSign;
+                    else if((*pVotes)[i].second == VoteFlags::VOTE_ABSTAIN)
+                        mapCacheProposalsToUpdate[hash].second += nSign;
+                    else if((*pVotes)[i].second == VoteFlags::VOTE_NO)
+                        mapCacheProposalsToUpdate[hash].first.second += nSign;
+
+                    if ((mapCacheProposalsRefs[hash] += nSign) == 0)
+                    {
+                        mapCacheProposalsToUpdate.erase(hash);
+                        mapCacheProposalsRefs.erase(hash);
                     }
+
+                    mapSeen[hash]=true;
                 }
             }
+        }
 
-            if (fDAOConsultations)
+        auto prVotes = GetPaymentRequestVotes(pindexblock->GetBlockHash());
+        if (prVotes != nullptr)
+        {
+            for(unsigned int i = 0; i < prVotes->size(); i++)
             {
-                auto supp = GetSupport(pindexblock->GetBlockHash());
+                const uint256& hash = (*prVotes)[i].first;
 
-                if (supp != nullptr)
+                if(mapSeen.count(hash) == 0)
                 {
-                    for (auto& it: *supp)
-                    {
-                        if (!it.second)
-                            continue;
+                    LogPrint("daoextra", "%s: Found vote %d for payment request %s at block height %d\n", __func__,
+                             (*prVotes)[i].second, hash.ToString(),
+                             pindexblock->nHeight);
 
-                        if (!mapSeenSupport.count(it.first))
-                        {
-                            LogPrint("daoextra", "%s: Found support vote for %s at block height %d\n", __func__,
-                                     it.first.ToString(),
-                                     pindexblock->nHeight);
+                    if (nSign < 0 && mapCachePaymentRequestRefs.count(hash) == 0)
+                        return false;
 
-                            if(mapCacheSupportToUpdate.count(it.first) == 0)
-                                mapCacheSupportToUpdate[it.first] = 0;
+                    if(mapCachePaymentRequestToUpdate.count(hash) == 0)
+                        mapCachePaymentRequestToUpdate[hash] = std::make_pair(std::make_pair(0, 0), 0);
 
-                            mapCacheSupportToUpdate[it.first] += 1;
-                            mapSeenSupport[it.first]=true;
-                        }
+                    if((*prVotes)[i].second == VoteFlags::VOTE_YES)
+                        mapCachePaymentRequestToUpdate[hash].first.first += nSign;
+                    else if((*prVotes)[i].second == VoteFlags::VOTE_ABSTAIN)
+                        mapCachePaymentRequestToUpdate[hash].second += nSign;
+                    else if((*prVotes)[i].second == VoteFlags::VOTE_NO)
+                        mapCachePaymentRequestToUpdate[hash].first.second += nSign;
+
+                    if ((mapCachePaymentRequestRefs[hash] += nSign) == 0)
+                    {
+                        mapCachePaymentRequestToUpdate.erase(hash);
+                        mapCachePaymentRequestRefs.erase(hash);
                     }
+
+                    mapSeen[hash]=true;
                 }
+            }
+        }
+    }
 
-                auto cVotes = GetConsultationVotes(pindexblock->GetBlockHash());
+    if (fDAOConsultations)
+    {
+        auto supp = GetSupport(pindexblock->GetBlockHash());
+
+        if (supp != nullptr)
+        {
+            for (auto& it: *supp)
+            {
+                if (!it.second)
+                    continue;
 
-                if (cVotes != nullptr)
+                if (!mapSeenSupport.count(it.first))
                 {
-                    for (auto&it: *cVotes)
-                    {
-                        if (mapSeen.count(it.first))
-                            continue;
+                    LogPrint("daoextra", "%s: Found support vote for %s at block height %d\n", __func__,
+                             it.first.ToString(),
+                             pindexblock->nHeight);
 
-                        if (view.HaveConsultation(it.first) || view.HaveConsultationAnswer(it.first))
-                        {
+                    if (nSign < 0 && mapCacheSupportToUpdate.count(it.first) == 0)
+                        return false;
 
-                            if (it.second == VoteFlags::VOTE_ABSTAIN && view.GetConsultationAnswer(it.first, answer))
-                            {
-                                if(mapCacheConsultationToUpdate.count(std::make_pair(answer.parent,it.second)) == 0)
-                                    mapCacheConsultationToUpdate[std::make_pair(answer.parent,it.second)] = 0;
+                    if ((mapCacheSupportToUpdate[it.first] += nSign) == 0)
+                        mapCacheSupportToUpdate.erase(it.first);
 
-                                mapCacheConsultationToUpdate[std::make_pair(answer.parent,it.second)] += 1;
+                    mapSeenSupport[it.first]=true;
+                }
+            }
+        }
 
-                                mapSeen[it.first]=true;
+        auto cVotes = GetConsultationVotes(pindexblock->GetBlockHash());
 
-                                LogPrint("daoextra", "%s: Found consultation answer vote %d for %s at block height %d (total %d)\n", __func__,
-                                         it.second, answer.parent.ToString(), pindexblock->nHeight, mapCacheConsultationToUpdate[std::make_pair(answer.parent,it.second)]);
-                            }
-                            else
-                            {
-                                if(mapCacheConsultationToUpdate.count(std::make_pair(it.first,it.second)) == 0)
-                                    mapCacheConsultationToUpdate[std::make_pair(it.first,it.second)] = 0;
+        if (cVotes != nullptr)
+        {
+            for (auto&it: *cVotes)
+            {
+                if (mapSeen.count(it.first))
+                    continue;
 
-                                mapCacheConsultationToUpdate[std::make_pair(it.first,it.second)] += 1;
+                if (view.HaveConsultation(it.first) || view.HaveConsultationAnswer(it.first))
+                {
+                    bool fAnswer = it.second == VoteFlags::VOTE_ABSTAIN && view.GetConsultationAnswer(it.first, answer);
+                    std::pair<uint256, int64_t> key = std::make_pair(fAnswer ? answer.parent : it.first, it.second);
 
-                                mapSeen[it.first]=true;
+                    if (nSign < 0 && mapCacheConsultationToUpdate.count(key) == 0)
+                        return false;
 
-                                LogPrint("daoextra", "%s: Found consultation vote %d for %s at block height %d (total %d)\n", __func__,
-                                         it.second, it.first.ToString(), pindexblock->nHeight, mapCacheConsultationToUpdate[std::make_pair(it.first,it.second)]);
-                            }
-                        }
-                    }
+                    mapCacheConsultationToUpdate[key] += nSign;
+
+                    mapSeen[it.first]=true;
+
+                    if (fAnswer)
+                        LogPrint("daoextra", "%s: Found consultation answer vote %d for %s at block height %d (total %d)\n", __func__,
+                                 it.second, answer.parent.ToString(), pindexblock->nHeight, mapCacheConsultationToUpdate[key]);
+                    else
+                        LogPrint("daoextra", "%s: Found consultation vote %d for %s at block height %d (total %d)\n", __func__,
+                                 it.second, it.first.ToString(), pindexblock->nHeight, mapCacheConsultationToUpdate[key]);
+
+                    if (mapCacheConsultationToUpdate[key] == 0)
+                        mapCacheConsultationToUpdate.erase(key);
+                }
+                else if (nSign < 0)
+                {
+                    // The entry was removed together with the block, so it is not known what was counted for it.
+                    return false;
                 }
             }
         }
+    }
+
+    return true;
+}
+
+bool VoteStep(const CValidationState& state, CBlockIndex *pindexNew, const bool fUndo, CStateViewCache& view)
+{
+    AssertLockHeld(cs_main);
+
+    const CBlockIndex* pindexDelete;
+    if (fUndo)
+    {
+        pindexDelete = pindexNew;
+        pindexNew = pindexNew->pprev;
+        assert(pindexNew);
+    }
+
+    int64_t nTimeStart = GetTimeMicros();
+    auto nCycleLength = GetConsensusParameter(Consensus::CONSENSUS_PARAM_VOTING_CYCLE_LENGTH, view);
+    int nBlocks = (pindexNew->nHeight % nCycleLength) + 1;
+    const CBlockIndex* pindexblock = pindexNew;
+
+    bool fCFund = IsCommunityFundEnabled(pindexNew->pprev, Params().GetConsensus());
+    bool fDAOConsultations = IsDAOEnabled(pindexNew->pprev, Params().GetConsensus());
+
+    if (!fCFund && !fDAOConsultations)
+        return true;
+
+    bool fScanningWholeCycle = false;
+
+    std::map<uint256, bool> mapSeen;
+    std::map<uint256, bool> mapSeenSupport;
+
+    uint256 consensusStateHash = GetConsensusStateHash(view);
+    uint256 hashParent = fUndo ? pindexDelete->GetBlockHash() : (pindexNew->pprev ? pindexNew->pprev->GetBlockHash() : uint256());
+    bool fConsensusChanged = lastConsensusStateHash != consensusStateHash;
+    bool fEmptyCache = mapCacheProposalsToUpdate.empty() && mapCachePaymentRequestToUpdate.empty() && mapCacheSupportToUpdate.empty() && mapCacheConsultationToUpdate.empty();
+
+    int64_t nTimeStart2 = GetTimeMicros();
+
+    // Disconnecting a block which did not open a new cycle leaves the caches with the
+    // same counts a scan of the rest of the cycle would produce, as long as every
+    // block of the cycle was counted with the same activation flags.
+    bool fTakeOutBlock = fUndo && !fConsensusChanged && !fEmptyCache && hashCacheBlock == hashParent &&
+            pindexDelete->nHeight % nCycleLength != 0;
+
+    if (fTakeOutBlock)
+    {
+        const CBlockIndex* pindexCycleStart = pindexNew->GetAncestor(pindexNew->nHeight - (pindexNew->nHeight % nCycleLength));
+
+        fTakeOutBlock = pindexCycleStart && pindexCycleStart->pprev &&
+                IsCommunityFundEnabled(pindexCycleStart->pprev, Params().GetConsensus()) == IsCommunityFundEnabled(pindexNew, Params().GetConsensus()) &&
+                IsDAOEnabled(pindexCycleStart->pprev, Params().GetConsensus()) == IsDAOEnabled(pindexNew, Params().GetConsensus()) &&
+                CountBlockVotes(pindexDelete, view, fCFund, fDAOConsultations, -1);
+    }
+
+    if (fTakeOutBlock)
+    {
+        // The counts are complete for the cycle, so the counters of entries without
+        // votes left are restarted below like after a scan of the whole cycle.
+        nBlocks = 0;
+        fScanningWholeCycle = true;
+    }
+    else if (fUndo || fConsensusChanged || nBlocks == 1 || fEmptyCache || hashCacheBlock != hashParent) {
+        mapCacheProposalsToUpdate.clear();
+        mapCachePaymentRequestToUpdate.clear();
+        mapCacheSupportToUpdate.clear();
+        mapCacheConsultationToUpdate.clear();
+        mapCacheProposalsRefs.clear();
+        mapCachePaymentRequestRefs.clear();
+        nCacheExclude = 0;
+        fScanningWholeCycle = true;
+    } else {
+        nBlocks = 1;
+    }
+
+    LogPrint("dao", "%s: Scanning %d block(s) starting at %d (fUndo=%d fScanningWholeCycle=%d fTakeOutBlock=%d consensusChanged=%d). We are in block %d inside of the cycle.\n",
+             __func__, nBlocks, pindexblock->nHeight, fUndo, fScanningWholeCycle, fTakeOutBlock, fConsensusChanged,
+             (pindexNew->nHeight % nCycleLength) + 1);
+
+    lastConsensusStateHash = consensusStateHash;
+
+    while(nBlocks > 0 && pindexblock != NULL)
+    {
+        CountBlockVotes(pindexblock, view, fCFund, fDAOConsultations, 1);
 
         pindexblock = pindexblock->pprev;
         nBlocks--;
     }
 
-    mapSeen.clear();
-    mapSeenSupport.clear();
+    hashCacheBlock = pindexNew->GetBlockHash();
 
     int64_t nTimeEnd2 = GetTimeMicros();
     LogPrint("bench", "   - CFund count votes from headers: %.2fms\n", (nTimeEnd2 - nTimeStart2) * 0.001);
@@ -562,16 +889,61 @@ bool VoteStep(const CValidationState& state, CBlockIndex *pindexNew, const bool
     CConsultationMap updateMapConsultations;
     CConsultationAnswerMap updateMapConsultationAnswers;
 
-    if (fCFund)
+    // Only the entries whose state can still change are loaded. Entries parked by
+    // the disconnected block become active again.
+    if (hashActiveIndexBlock != hashParent || hashActiveIndexConsensus != consensusStateHash)
     {
-        if (!view.GetAllProposals(mapProposals) || !view.GetAllPaymentRequests(mapPaymentRequests))
+        if (!RebuildActiveDAOIndex(view))
             return false;
     }
+    else
+    {
+        for (auto& it: setDAOEntriesToUpdate)
+            GetActiveDAOEntries(it.first).insert(it.second);
+
+        setDAOEntriesToUpdate.clear();
+
+        if (fUndo && mapFinishedDAOEntries.count(pindexDelete->GetBlockHash()))
+        {
+            for (auto& it: mapFinishedDAOEntries[pindexDelete->GetBlockHash()])
+                GetActiveDAOEntries(it.first).insert(it.second);
+
+            mapFinishedDAOEntries.erase(pindexDelete->GetBlockHash());
+        }
+    }
+
+    if (fCFund)
+    {
+        for (auto& it: setActiveProposals)
+        {
+            CProposal proposal;
+            if (view.GetProposal(it, proposal))
+                mapProposals.insert(std::make_pair(it, proposal));
+        }
+
+        for (auto& it: setActivePaymentRequests)
+        {
+            CPaymentRequest prequest;
+            if (view.GetPaymentRequest(it, prequest))
+                mapPaymentRequests.insert(std::make_pair(it, prequest));
+        }
+    }
 
     if (fDAOConsultations)
     {
-        if(!view.GetAllConsultationAnswers(mapConsultationAnswers) || !view.GetAllConsultations(mapConsultations))
-            return false;
+        for (auto& it: setActiveConsultationAnswers)
+        {
+            CConsultationAnswer answer;
+            if (view.GetConsultationAnswer(it, answer))
+                mapConsultationAnswers.insert(std::make_pair(it, answer));
+        }
+
+        for (auto& it: setActiveConsultations)
+        {
+            CConsultation consultation;
+            if (view.GetConsultation(it, consultation))
+                mapConsultations.insert(std::make_pair(it, consultation));
+        }
     }
 
     if (fCFund)
@@ -1159,22 +1531,22 @@ bool VoteStep(const CValidationState& state, CBlockIndex *pindexNew, const bool
                     }
                     else if(oldState == DAOFlags::NIL)
                     {
-                        if (!mapProposals.count(it->second.proposalhash))
-                            continue;
+                        CProposal proposal;
 
-                        CProposal proposal = mapProposals[it->second.proposalhash];
+                        if (!GetLoadedProposal(mapProposals, view, it->second.proposalhash, proposal))
+                            continue;
 
                         flags proposalOldState = proposal.GetLastState();
                         if((proposalOldState == DAOFlags::ACCEPTED || proposalOldState == DAOFlags::PENDING_VOTING_PREQ) && fIsAccepted)
                         {
-                            if((proposal.nVersion & CProposal::SUPER_VERSION || (it->second.nAmount <= pindexNew->nCFLocked && !(proposal.nVersion & CProposal::SUPER_VERSION))) && it->second.nAmount <= proposal.GetAvailable(view))
+                            if((proposal.nVersion & CProposal::SUPER_VERSION || (it->second.nAmount <= pindexNew->GetCold().nCFLocked && !(proposal.nVersion & CProposal::SUPER_VERSION))) && it->second.nAmount <= proposal.GetAvailable(view))
                             {
                                 CPaymentRequestModifier prequest = view.ModifyPaymentRequest(it->first, pindexNew->nHeight);
 
                                 if (!(proposal.nVersion & CProposal::SUPER_VERSION))
                                 {
-                                    pindexNew->nCFLocked -= prequest->nAmount;
-                                    LogPrint("daoextra", "%s: Updated nCFSupply %s nCFLocked %s\n", __func__, FormatMoney(pindexNew->nCFSupply), FormatMoney(pindexNew->nCFLocked));
+                                    pindexNew->Cold().nCFLocked -= prequest->nAmount;
+                                    LogPrint("daoextra", "%s: Updated nCFSupply %s nCFLocked %s\n", __func__, FormatMoney(pindexNew->GetCold().nCFSupply), FormatMoney(pindexNew->GetCold().nCFLocked));
                                 }
                                 prequest->SetState(pindexNew, DAOFlags::ACCEPTED);
                                 prequest->fDirty = true;
@@ -1277,9 +1649,9 @@ bool VoteStep(const CValidationState& state, CBlockIndex *pindexNew, const bool
 
                                     if (!(proposal->nVersion & CProposal::SUPER_VERSION))
                                     {
-                                        pindexNew->nCFSupply += proposal->GetAvailable(view);
-                                        pindexNew->nCFLocked -= proposal->GetAvailable(view);
-                                        LogPrint("daoextra", "%s: Updated nCFSupply %s nCFLocked %s\n", __func__, FormatMoney(pindexNew->nCFSupply), FormatMoney(pindexNew->nCFLocked));
+                                        pindexNew->Cold().nCFSupply += proposal->GetAvailable(view);
+                                        pindexNew->Cold().nCFLocked -= proposal->GetAvailable(view);
+                                        LogPrint("daoextra", "%s: Updated nCFSupply %s nCFLocked %s\n", __func__, FormatMoney(pindexNew->GetCold().nCFSupply), FormatMoney(pindexNew->GetCold().nCFLocked));
                                     }
 
                                     proposal->SetState(pindexNew, DAOFlags::ACCEPTED_EXPIRED);
@@ -1313,14 +1685,14 @@ bool VoteStep(const CValidationState& state, CBlockIndex *pindexNew, const bool
                     {
                         if((oldState == DAOFlags::NIL || oldState == DAOFlags::PENDING_FUNDS))
                         {
-                            if((!(it->second.nVersion & CProposal::SUPER_VERSION) && pindexNew->nCFSupply >= it->second.GetAvailable(view)) || (it->second.nVersion & CProposal::SUPER_VERSION))
+                            if((!(it->second.nVersion & CProposal::SUPER_VERSION) && pindexNew->GetCold().nCFSupply >= it->second.GetAvailable(view)) || (it->second.nVersion & CProposal::SUPER_VERSION))
                             {
                                 CProposalModifier proposal = view.ModifyProposal(it->first, pindexNew->nHeight);
 
                                 if (!(it->second.nVersion & CProposal::SUPER_VERSION)) {
-                                    pindexNew->nCFSupply -= proposal->GetAvailable(view);
-                                    pindexNew->nCFLocked += proposal->GetAvailable(view);
-                                    LogPrint("daoextra", "%s: Updated nCFSupply %s nCFLocked %s\n", __func__, FormatMoney(pindexNew->nCFSupply), FormatMoney(pindexNew->nCFLocked));
+                                    pindexNew->Cold().nCFSupply -= proposal->GetAvailable(view);
+                                    pindexNew->Cold().nCFLocked += proposal->GetAvailable(view);
+                                    LogPrint("daoextra", "%s: Updated nCFSupply %s nCFLocked %s\n", __func__, FormatMoney(pindexNew->GetCold().nCFSupply), FormatMoney(pindexNew->GetCold().nCFLocked));
                                 }
 
                                 proposal->SetState(pindexNew, DAOFlags::ACCEPTED);
@@ -1409,10 +1781,10 @@ bool VoteStep(const CValidationState& state, CBlockIndex *pindexNew, const bool
 
                 if (fIsConsensusAccepted && oldState != DAOFlags::PASSED)
                 {
-                    if (mapConsultations.count(it->second.parent))
-                    {
-                        CConsultation parent = mapConsultations[it->second.parent];
+                    CConsultation parent;
 
+                    if (GetLoadedConsultation(mapConsultations, view, it->second.parent, parent))
+                    {
                         if (parent.IsAboutConsensusParameter())
                         {
                             CConsultationAnswerModifier answer = view.ModifyConsultationAnswer(it->first, pindexNew->nHeight);
@@ -1690,6 +2062,17 @@ bool VoteStep(const CValidationState& state, CBlockIndex *pindexNew, const bool
     int64_t nTimeEnd8 = GetTimeMicros();
     LogPrint("bench", "   - CFund update consensus parameter status: %.2fms\n", (nTimeEnd8 - nTimeStart8) * 0.001);
 
+    int64_t nTimeStart9 = GetTimeMicros();
+
+    UpdateActiveDAOIndex(view);
+
+    hashActiveIndexBlock = pindexNew->GetBlockHash();
+    hashActiveIndexConsensus = mapConsensusToChange.empty() ? consensusStateHash : GetConsensusStateHash(view);
+
+    int64_t nTimeEnd9 = GetTimeMicros();
+    LogPrint("bench", "   - CFund update active entries: %.2fms (%d proposals, %d payment requests, %d consultations, %d answers)\n", (nTimeEnd9 - nTimeStart9) * 0.001,
+             setActiveProposals.size(), setActivePaymentRequests.size(), setActiveConsultations.size(), setActiveConsultationAnswers.size());
+
     int64_t nTimeEnd = GetTimeMicros();
     LogPrint("bench", "  - CFund total VoteStep() function: %.2fms\n", (nTimeEnd - nTimeStart) * 0.001);
 
@@ -1766,6 +2149,11 @@ std::map<int, uint64_t>* CConsensusParameter::GetFullList()
     return &list;
 }
 
+size_t CConsensusParameter::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(list);
+}
+
 std::string CConsensusParameter::ToString() const
 {
     std::string sList;
@@ -1842,6 +2230,49 @@ bool CVoteList::Clear(const int& height)
     return true;
 }
 
+/** Collapse the history up to height into a single entry holding the votes in
+ *  effect at that point. Entries at height 0 are ignored by Get and GetList
+ *  and are left untouched. Returns true if the list changed, the collapsed
+ *  entries are then copied to pmapRemoved so Uncompact can restore them. */
+bool CVoteList::Compact(const int& height, std::map<int, std::map<uint256, int64_t>>* pmapRemoved)
+{
+    auto itBegin = list.upper_bound(0);
+    auto itEnd = list.upper_bound(height);
+
+    if (itBegin == itEnd || std::next(itBegin) == itEnd)
+        return false;
+
+    std::map<uint256, int64_t> mapEffective;
+    int nLastHeight = 0;
+
+    for (auto it = itBegin; it != itEnd; ++it)
+    {
+        for (auto& it2: it->second)
+            mapEffective[it2.first] = it2.second;
+        nLastHeight = it->first;
+    }
+
+    if (pmapRemoved)
+        pmapRemoved->insert(itBegin, itEnd);
+
+    list.erase(itBegin, itEnd);
+    list.insert(std::make_pair(nLastHeight, mapEffective));
+
+    return true;
+}
+
+/** Undo Compact, replacing the merged entry with the entries it was built from. */
+void CVoteList::Uncompact(const std::map<int, std::map<uint256, int64_t>>& mapRemoved)
+{
+    if (mapRemoved.empty())
+        return;
+
+    list.erase(mapRemoved.rbegin()->first);
+
+    for (auto& it: mapRemoved)
+        list[it.first] = it.second;
+}
+
 std::map<uint256, int64_t> CVoteList::GetList()
 {
     std::map<uint256, int64_t> ret;
@@ -1868,6 +2299,14 @@ std::map<int, std::map<uint256, int64_t>>* CVoteList::GetFullList()
     return &list;
 }
 
+size_t CVoteList::DynamicMemoryUsage() const
+{
+    size_t ret = memusage::DynamicUsage(list);
+    for (auto& it: list)
+        ret += memusage::DynamicUsage(it.second);
+    return ret;
+}
+
 std::string CVoteList::ToString() const
 {
     std::string sList;
@@ -2459,6 +2898,12 @@ bool CConsultation::CanMoveInReflection(const CStateViewCache& view) const
     return nVotingCycle >= GetConsensusParameter(Consensus::CONSENSUS_PARAM_CONSULTATION_MIN_CYCLES, view);
 }
 
+size_t CConsultation::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(mapState) + memusage::DynamicUsage(strDZeel) + memusage::DynamicUsage(vParameters) +
+           memusage::DynamicUsage(mapVotes) + memusage::DynamicUsage(vAnswers);
+}
+
 std::string CConsultation::ToString(const CBlockIndex* pindex, const CStateViewCache& view) const {
     AssertLockHeld(cs_main);
 
@@ -2863,6 +3308,14 @@ bool CConsultationAnswer::IsConsensusAccepted(const CStateViewCache& view) const
 
 }
 
+size_t CConsultationAnswer::DynamicMemoryUsage() const
+{
+    size_t ret = memusage::DynamicUsage(mapState) + memusage::DynamicUsage(sAnswer) + memusage::DynamicUsage(vAnswer);
+    for (auto& it: vAnswer)
+        ret += memusage::DynamicUsage(it);
+    return ret;
+}
+
 std::string CConsultationAnswer::ToString() const {
     flags fState = GetLastState();
     return strprintf("CConsultationAnswer(hash=%s, fState=%u, sAnswer=\"%s\", nVotes=%u, nSupport=%u)", hash.ToString(), fState, sAnswer, nVotes, nSupport);
@@ -3197,10 +3650,19 @@ bool CPaymentRequest::IsRejected(const CStateViewCache& view) const {
     if (nVersion & CPaymentRequest::EXCLUDE_VERSION)
         exclude = view.GetExcludeVotes();
 
+    return nTotalVotes > ((GetConsensusParameter(Consensus::CONSENSUS_PARAM_VOTING_CYCLE_LENGTH, view) - exclude) * nMinimumQuorum)
+            && HasRejectionMajority(view);
+}
+
+bool CPaymentRequest::HasRejectionMajority(const CStateViewCache& view) const {
+    int nTotalVotes = nVotesYes + nVotesNo;
+
+    if (nVersion & ABSTAIN_VOTE_VERSION)
+        nTotalVotes += nVotesAbs;
+
     auto nMinRejection = (IsSuper() ? 9000 : GetConsensusParameter(Consensus::CONSENSUS_PARAM_PAYMENT_REQUEST_MIN_REJECT, view)) / 10000.0;
 
-    return nTotalVotes > ((GetConsensusParameter(Consensus::CONSENSUS_PARAM_VOTING_CYCLE_LENGTH, view) - exclude) * nMinimumQuorum)
-            && ((float)nVotesNo > ((float)(nTotalVotes) * nMinRejection));
+    return ((float)nVotesNo > ((float)(nTotalVotes) * nMinRejection));
 }
 
 bool CPaymentRequest::ExceededMaxVotingCycles(const CStateViewCache& view) const {
@@ -3243,10 +3705,20 @@ bool CProposal::IsRejected(const CStateViewCache& view) const
     if (nVersion & CProposal::EXCLUDE_VERSION)
         exclude = view.GetExcludeVotes();
 
+    return nTotalVotes > ((GetConsensusParameter(Consensus::CONSENSUS_PARAM_VOTING_CYCLE_LENGTH, view) - exclude)  * nMinimumQuorum)
+            && HasRejectionMajority(view);
+}
+
+bool CProposal::HasRejectionMajority(const CStateViewCache& view) const
+{
+    int nTotalVotes = nVotesYes + nVotesNo;
+
+    if (nVersion & ABSTAIN_VOTE_VERSION)
+        nTotalVotes += nVotesAbs;
+
     auto minRejection = (IsSuper() ? 9000 : GetConsensusParameter(Consensus::CONSENSUS_PARAM_PROPOSAL_MIN_REJECT, view)) / 10000.0;
 
-    return nTotalVotes > ((GetConsensusParameter(Consensus::CONSENSUS_PARAM_VOTING_CYCLE_LENGTH, view) - exclude)  * nMinimumQuorum)
-            && ((float)nVotesNo > ((float)(nTotalVotes) * minRejection ));
+    return ((float)nVotesNo > ((float)(nTotalVotes) * minRejection ));
 }
 
 std::string CProposal::GetOwnerAddress() const {
@@ -3321,6 +3793,12 @@ CAmount CProposal::GetAvailable(CStateViewCache& coins, bool fIncludeRequests) c
     return initial;
 }
 
+size_t CProposal::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(mapState) + memusage::DynamicUsage(ownerAddress) + memusage::DynamicUsage(paymentAddress) +
+           memusage::DynamicUsage(strDZeel);
+}
+
 std::string CProposal::ToString(CStateViewCache& coins, uint32_t currentTime) const {
     AssertLockHeld(cs_main);
 
@@ -3538,6 +4016,11 @@ void CProposal::ToJson(UniValue& ret, CStateViewCache& coins) const {
     }
 }
 
+size_t CPaymentRequest::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(mapState) + memusage::DynamicUsage(strDZeel);
+}
+
 std::string CPaymentRequest::ToString(const CStateViewCache& view) const {
     uint256 blockhash = uint256();
     CBlockIndex* pblockindex = GetLastStateBlockIndex();
@@ -147,12 +147,18 @@ public:
 
     bool Clear(const int& height);
 
+    bool Compact(const int& height, std::map<int, std::map<uint256, int64_t>>* pmapRemoved = nullptr);
+
+    void Uncompact(const std::map<int, std::map<uint256, int64_t>>& mapRemoved);
+
     std::map<uint256, int64_t> GetList();
 
     std::map<int, std::map<uint256, int64_t>>* GetFullList();
 
     std::string ToString() const;
 
+    size_t DynamicMemoryUsage() const;
+
     void swap(CVoteList &to) {
         std::swap(to.fDirty, fDirty);
         std::swap(to.list, list);
@@ -232,6 +238,8 @@ public:
 
     std::string ToString() const;
 
+    size_t DynamicMemoryUsage() const;
+
     void swap(CConsensusParameter &to) {
         std::swap(to.fDirty, fDirty);
         std::swap(to.list, list);
@@ -252,6 +260,20 @@ bool IsBeginningCycle(const CBlockIndex* pindex, const CStateViewCache& coins);
 bool IsEndCycle(const CBlockIndex* pindex, CChainParams params);
 bool VoteStep(const CValidationState& state, CBlockIndex *pindexNew, const bool fUndo, CStateViewCache& coins);
 
+/** Kinds of entries tracked by the index of DAO entries VoteStep still has to visit. */
+enum DAOEntryType
+{
+    DAO_PROPOSAL,
+    DAO_PAYMENT_REQUEST,
+    DAO_CONSULTATION,
+    DAO_CONSULTATION_ANSWER
+};
+
+/** Mark an entry which was created or modified outside of VoteStep, so the next VoteStep visits it again. */
+void MarkDAOEntryForUpdate(DAOEntryType type, const uint256& hash);
+/** Forget the vote counts and the index of active entries, so the next VoteStep scans its whole cycle again. */
+void ResetDAOVoteCaches();
+
 bool IsValidPaymentRequest(CTransaction tx, CStateViewCache& coins, uint64_t nMaxVersion);
 bool IsValidProposal(CTransaction tx, const CStateViewCache& view, uint64_t nMaxVersion);
 bool IsValidConsultation(CTransaction tx, CStateViewCache& coins, uint64_t nMaskVersion, CBlockIndex* pindex);
@@ -308,6 +330,8 @@ public:
         fDirty = true;
     }
 
+    size_t DynamicMemoryUsage() const;
+
     void swap(CPaymentRequest &to) {
         std::swap(to.nAmount, nAmount);
         std::swap(to.mapState, mapState);
@@ -419,6 +443,8 @@ public:
 
     bool IsRejected(const CStateViewCache& view) const;
 
+    bool HasRejectionMajority(const CStateViewCache& view) const;
+
     bool IsExpired(const CStateViewCache& view) const;
 
     bool ExceededMaxVotingCycles(const CStateViewCache& view) const;
@@ -523,6 +549,8 @@ public:
         fDirty = true;
     }
 
+    size_t DynamicMemoryUsage() const;
+
     void swap(CProposal &to) {
         std::swap(to.nAmount, nAmount);
         std::swap(to.nFee, nFee);
@@ -627,6 +655,8 @@ public:
 
     bool IsRejected(const CStateViewCache& view) const;
 
+    bool HasRejectionMajority(const CStateViewCache& view) const;
+
     bool IsExpired(uint32_t currentTime, const CStateViewCache& view) const;
 
     bool ExceededMaxVotingCycles(const CStateViewCache& view) const;
@@ -733,6 +763,8 @@ public:
 
     CConsultationAnswer() { SetNull(); }
 
+    size_t DynamicMemoryUsage() const;
+
     void swap(CConsultationAnswer &to) {
         std::swap(to.nVersion, nVersion);
         std::swap(to.sAnswer, sAnswer);
@@ -905,6 +937,8 @@ public:
 
     CConsultation() { SetNull(); }
 
+    size_t DynamicMemoryUsage() const;
+
     void swap(CConsultation &to) {
         std::swap(to.mapState, mapState);
         std::swap(to.hash, hash);
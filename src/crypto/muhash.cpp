@@ -0,0 +1,157 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/sha256.h>
+
+#include <string.h>
+
+namespace {
+
+/** The prime 2^3072 - 1103717, the largest 3072-bit safe prime. */
+class MuHashModulus
+{
+public:
+    mpz_t p;
+
+    MuHashModulus()
+    {
+        mpz_init_set_ui(p, 1);
+        mpz_mul_2exp(p, p, 3072);
+        mpz_sub_ui(p, p, 1103717);
+    }
+
+    ~MuHashModulus() { mpz_clear(p); }
+};
+
+const mpz_t& Modulus()
+{
+    static const MuHashModulus modulus;
+    return modulus.p;
+}
+
+/** Map arbitrary data to a number modulo the MuHash prime. */
+void ToNum3072(mpz_t out, const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    unsigned char tmp[MuHash3072::BYTE_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    ChaCha20(hash, sizeof(hash)).Keystream(tmp, sizeof(tmp));
+    mpz_import(out, sizeof(tmp), -1, 1, -1, 0, tmp);
+    mpz_mod(out, out, Modulus());
+}
+
+} // namespace
+
+MuHash3072::MuHash3072()
+{
+    mpz_init_set_ui(numerator, 1);
+    mpz_init_set_ui(denominator, 1);
+}
+
+MuHash3072::MuHash3072(const unsigned char* data, size_t len)
+{
+    mpz_init(numerator);
+    mpz_init_set_ui(denominator, 1);
+    ToNum3072(numerator, data, len);
+}
+
+MuHash3072::MuHash3072(const MuHash3072& other)
+{
+    mpz_init_set(numerator, other.numerator);
+    mpz_init_set(denominator, other.denominator);
+}
+
+MuHash3072& MuHash3072::operator=(const MuHash3072& other)
+{
+    if (this != &other) {
+        mpz_set(numerator, other.numerator);
+        mpz_set(denominator, other.denominator);
+    }
+    return *this;
+}
+
+MuHash3072::~MuHash3072()
+{
+    mpz_clear(numerator);
+    mpz_clear(denominator);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    mpz_t elem;
+    mpz_init(elem);
+    ToNum3072(elem, data, len);
+    mpz_mul(numerator, numerator, elem);
+    mpz_mod(numerator, numerator, Modulus());
+    mpz_clear(elem);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    mpz_t elem;
+    mpz_init(elem);
+    ToNum3072(elem, data, len);
+    mpz_mul(denominator, denominator, elem);
+    mpz_mod(denominator, denominator, Modulus());
+    mpz_clear(elem);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    mpz_mul(numerator, numerator, mul.numerator);
+    mpz_mod(numerator, numerator, Modulus());
+    mpz_mul(denominator, denominator, mul.denominator);
+    mpz_mod(denominator, denominator, Modulus());
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    mpz_mul(numerator, numerator, div.denominator);
+    mpz_mod(numerator, numerator, Modulus());
+    mpz_mul(denominator, denominator, div.numerator);
+    mpz_mod(denominator, denominator, Modulus());
+    return *this;
+}
+
+void MuHash3072::SetEmpty()
+{
+    mpz_set_ui(numerator, 1);
+    mpz_set_ui(denominator, 1);
+}
+
+void MuHash3072::GetBytes(unsigned char out[BYTE_SIZE]) const
+{
+    mpz_t value;
+    mpz_init(value);
+    // The modulus is prime and no element maps to zero (with overwhelming
+    // probability), so the denominator is always invertible.
+    mpz_invert(value, denominator, Modulus());
+    mpz_mul(value, numerator, value);
+    mpz_mod(value, value, Modulus());
+
+    size_t count = 0;
+    memset(out, 0, BYTE_SIZE);
+    mpz_export(out, &count, -1, 1, -1, 0, value);
+    mpz_clear(value);
+}
+
+void MuHash3072::SetBytes(const unsigned char in[BYTE_SIZE])
+{
+    mpz_import(numerator, BYTE_SIZE, -1, 1, -1, 0, in);
+    mpz_mod(numerator, numerator, Modulus());
+    mpz_set_ui(denominator, 1);
+}
+
+void MuHash3072::Finalize(unsigned char out[OUTPUT_SIZE]) const
+{
+    unsigned char data[BYTE_SIZE];
+    GetBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out);
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STOCK_CRYPTO_MUHASH_H
+#define STOCK_CRYPTO_MUHASH_H
+
+#include <gmp.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A class representing MuHash sets
+ *
+ * MuHash is a hashing algorithm that supports adding set elements in any
+ * order but also deleting in any order. As a result, it can maintain a
+ * running sum for a set of data as a whole, and add/remove when data
+ * is added to or removed from it. A downside of MuHash is that computing
+ * an inverse is relatively expensive. This is solved by representing
+ * the running value as a fraction, and multiplying added elements into
+ * the numerator and removed elements into the denominator. Only when the
+ * final hash is desired, a single modular inverse is computed.
+ *
+ * Elements are mapped to numbers modulo 2^3072 - 1103717 by keying ChaCha20
+ * with the SHA256 of the element and taking 384 bytes of keystream.
+ *
+ * See https://cseweb.ucsd.edu/~mihir/papers/inchash.pdf
+ */
+class MuHash3072
+{
+private:
+    mpz_t numerator;
+    mpz_t denominator;
+
+public:
+    static const size_t BYTE_SIZE = 384;
+    static const size_t OUTPUT_SIZE = 32;
+
+    /* The empty set. */
+    MuHash3072();
+
+    /* A singleton with variable sized data in it. */
+    MuHash3072(const unsigned char* data, size_t len);
+
+    MuHash3072(const MuHash3072& other);
+    MuHash3072& operator=(const MuHash3072& other);
+    ~MuHash3072();
+
+    /* Insert a single piece of data into the set. */
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+
+    /* Remove a single piece of data from the set. */
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    /* Multiply (resulting in a hash for the union of the sets) */
+    MuHash3072& operator*=(const MuHash3072& mul);
+
+    /* Divide (resulting in a hash for the difference of the sets) */
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    /* Reset to the empty set. */
+    void SetEmpty();
+
+    /* Write the normalized 384 byte little endian representation of the set. */
+    void GetBytes(unsigned char out[BYTE_SIZE]) const;
+
+    /* Replace the set by the normalized representation produced by GetBytes. */
+    void SetBytes(const unsigned char in[BYTE_SIZE]);
+
+    /* Finalize into a 32-byte hash. Does not change this object's value. */
+    void Finalize(unsigned char out[OUTPUT_SIZE]) const;
+};
+
+#endif // STOCK_CRYPTO_MUHASH_H
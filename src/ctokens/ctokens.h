@@ -12,6 +12,7 @@
 
 #include <uint256.h>
 #include <amount.h>
+#include <memusage.h>
 
 class TokenInfo {
 public:
@@ -121,6 +122,13 @@ public:
                 mapMetadata == other.mapMetadata);
     }
 
+    size_t DynamicMemoryUsage() const {
+        size_t ret = memusage::DynamicUsage(sName) + memusage::DynamicUsage(sDesc) + memusage::DynamicUsage(mapMetadata);
+        for (auto& it: mapMetadata)
+            ret += memusage::DynamicUsage(it.second);
+        return ret;
+    }
+
     void swap(TokenInfo &to) {
         std::swap(to.nVersion, nVersion);
         std::swap(to.sName, sName);
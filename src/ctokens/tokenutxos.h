@@ -6,29 +6,51 @@
 #ifndef STOCK_TOKENUTXOS_H
 #define STOCK_TOKENUTXOS_H
 
+#include <memusage.h>
 #include <uint256.h>
 
+#include <limits>
+#include <string.h>
+
+/** Location of one output of a token in the utxo index: the token, the height it was created at and the outpoint. */
 struct TokenUtxoKey {
     uint256 id;
     uint64_t blockHeight;
+    uint256 hash;
+    uint32_t n;
 
     size_t GetSerializeSize(int nType, int nVersion) const {
-        return 32 + 8;
+        return 32 + 4 + 32 + 4;
     }
+    // Big endian numbers, so leveldb iterates in the order of operator<
     template<typename Stream>
     void Serialize(Stream& s, int nType, int nVersion) const {
         id.Serialize(s, nType, nVersion);
         ser_writedata32be(s, blockHeight);
+        hash.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, n);
     }
     template<typename Stream>
     void Unserialize(Stream& s, int nType, int nVersion) {
         id.Unserialize(s, nType, nVersion);
         blockHeight = ser_readdata32be(s);
+        hash.Unserialize(s, nType, nVersion);
+        n = ser_readdata32be(s);
+    }
+
+    TokenUtxoKey(uint256 t, int h, uint256 _hash, uint32_t _n) {
+        id = t;
+        blockHeight = h;
+        hash = _hash;
+        n = _n;
     }
 
+    /** The lowest key of a token at or above a height. */
     TokenUtxoKey(uint256 t, int h) {
         id = t;
         blockHeight = h;
+        hash.SetNull();
+        n = 0;
     }
 
     TokenUtxoKey() {
@@ -38,27 +60,44 @@ struct TokenUtxoKey {
     void SetNull() {
         id.SetNull();
         blockHeight = 0;
+        hash.SetNull();
+        n = 0;
     }
 
     bool IsNull() const {
         return id.IsNull();
     }
 
+    /** A key above every utxo of token t. */
+    static TokenUtxoKey End(const uint256& t) {
+        TokenUtxoKey key(t, 0);
+        key.blockHeight = std::numeric_limits<uint32_t>::max();
+        memset(key.hash.begin(), 0xff, key.hash.size());
+        key.n = std::numeric_limits<uint32_t>::max();
+        return key;
+    }
+
     bool operator==(const TokenUtxoKey& other) const {
-        return (id == other.id && blockHeight == other.blockHeight);
+        return (id == other.id && blockHeight == other.blockHeight && hash == other.hash && n == other.n);
     }
 
     bool operator<(const TokenUtxoKey& b) const {
-        if (id == b.id) {
+        int cmp = id.Compare(b.id);
+        if (cmp != 0)
+            return cmp < 0;
+        if (blockHeight != b.blockHeight)
             return blockHeight < b.blockHeight;
-        } else {
-            return id < b.id;
-        }
+        cmp = hash.Compare(b.hash);
+        if (cmp != 0)
+            return cmp < 0;
+        return n < b.n;
     }
 
     void swap(TokenUtxoKey &to) {
         std::swap(to.id, id);
         std::swap(to.blockHeight, blockHeight);
+        std::swap(to.hash, hash);
+        std::swap(to.n, n);
     }
 };
 
@@ -91,6 +130,10 @@ struct TokenUtxoValue {
         return (hash == other.hash && spendingKey == other.spendingKey && n == other.n);
     }
 
+    size_t DynamicMemoryUsage() const {
+        return memusage::DynamicUsage(spendingKey);
+    }
+
     void swap(TokenUtxoValue &to) {
         std::swap(to.hash, hash);
         std::swap(to.spendingKey, spendingKey);
@@ -109,6 +152,12 @@ struct TokenUtxoValue {
 
 typedef std::pair<uint64_t, TokenUtxoValue> TokenUtxoEntry;
 typedef std::vector<TokenUtxoEntry> TokenUtxoValues;
-typedef std::map<uint256, TokenUtxoValues> TokenUtxoMap;
+/** Utxo index entries changed in a cache, each under its own key; a null value erases the entry. */
+typedef std::map<TokenUtxoKey, TokenUtxoValue> TokenUtxoMap;
+
+/** Key of an entry returned by a token utxo query, e.g. to continue a query from it. */
+inline TokenUtxoKey MakeTokenUtxoKey(const uint256& id, const TokenUtxoEntry& entry) {
+    return TokenUtxoKey(id, entry.first, entry.second.hash, entry.second.n);
+}
 
 #endif // STOCK_TOKENUTXOS_H
@@ -8,6 +8,8 @@
 #include <util.h>
 #include <random.h>
 
+#include <boost/bind.hpp>
+
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
@@ -77,6 +79,7 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
 
 CDBWrapper::~CDBWrapper()
 {
+    WaitForPendingWrite();
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -89,11 +92,104 @@ CDBWrapper::~CDBWrapper()
 
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
+    CheckPendingWrite();
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     dbwrapper_private::HandleError(status);
     return true;
 }
 
+namespace {
+
+/** Indexes the records of a batch by key, pointing into the batch's own buffer. */
+class PendingIndexer : public leveldb::WriteBatch::Handler
+{
+public:
+    dbwrapper_private::PendingMap& map;
+
+    PendingIndexer(dbwrapper_private::PendingMap& mapIn) : map(mapIn) {}
+
+    void Put(const leveldb::Slice& key, const leveldb::Slice& value)
+    {
+        map[key] = std::make_pair(true, value);
+    }
+
+    void Delete(const leveldb::Slice& key)
+    {
+        map[key] = std::make_pair(false, leveldb::Slice());
+    }
+};
+
+}
+
+bool CDBWrapper::WriteBatchAsync(std::unique_ptr<CDBBatch> batch)
+{
+    LOCK(cs_writebehind);
+    CheckPendingWrite();
+    {
+        LOCK(cs_pending);
+        mapPending.clear();
+        // leveldb only rewrites the sequence number in the batch header while
+        // committing it, so the key and value slices stay valid until we drop it.
+        PendingIndexer indexer(mapPending);
+        dbwrapper_private::HandleError(batch->batch.Iterate(&indexer));
+        pbatchPending = std::move(batch);
+    }
+    threadWriteBehind = boost::thread(boost::bind(&CDBWrapper::CommitPendingBatch, this));
+    return true;
+}
+
+void CDBWrapper::CommitPendingBatch()
+{
+    RenameThread("stock-dbwrite");
+    int64_t nStart = GetTimeMillis();
+    leveldb::Status status = pdb->Write(writeoptions, &pbatchPending->batch);
+    LOCK(cs_pending);
+    if (status.ok()) {
+        LogPrint("bench", "%s: committed %u records in %dms\n", __func__, mapPending.size(), GetTimeMillis() - nStart);
+        mapPending.clear();
+        pbatchPending.reset();
+    } else {
+        // The batch stays in place, so reads keep seeing its records. The
+        // failure is reported by the next write, which is a flush.
+        LogPrintf("LevelDB background write failure: %s\n", status.ToString());
+        statusPending = status;
+    }
+}
+
+void CDBWrapper::WaitForPendingWrite()
+{
+    LOCK(cs_writebehind);
+    if (threadWriteBehind.joinable())
+        threadWriteBehind.join();
+}
+
+void CDBWrapper::CheckPendingWrite()
+{
+    LOCK(cs_writebehind);
+    WaitForPendingWrite();
+
+    leveldb::Status status;
+    {
+        LOCK(cs_pending);
+        status = statusPending;
+    }
+    dbwrapper_private::HandleError(status);
+}
+
+bool CDBWrapper::ReadPending(const leveldb::Slice& slKey, std::string& strValue, bool& fErased) const
+{
+    LOCK(cs_pending);
+    if (mapPending.empty())
+        return false;
+    auto it = mapPending.find(slKey);
+    if (it == mapPending.end())
+        return false;
+    fErased = !it->second.first;
+    if (!fErased)
+        strValue = it->second.second.ToString();
+    return true;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -125,6 +221,8 @@ CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
 void CDBIterator::Next() { piter->Next(); }
+void CDBIterator::SeekToLast() { piter->SeekToLast(); }
+void CDBIterator::Prev() { piter->Prev(); }
 
 namespace dbwrapper_private {
 
@@ -9,10 +9,16 @@
 #include <clientversion.h>
 #include <serialize.h>
 #include <streams.h>
+#include <sync.h>
 #include <util.h>
 #include <utilstrencodings.h>
 #include <version.h>
 
+#include <map>
+#include <memory>
+
+#include <boost/thread/thread.hpp>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -38,6 +44,15 @@ void HandleError(const leveldb::Status& status);
  */
 const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w);
 
+/** Bytewise ordering of keys, matching leveldb's default comparator. */
+struct SliceLess
+{
+    bool operator()(const leveldb::Slice& a, const leveldb::Slice& b) const { return a.compare(b) < 0; }
+};
+
+/** Records of a batch by key; erasures map to false. */
+typedef std::map<leveldb::Slice, std::pair<bool, leveldb::Slice>, SliceLess> PendingMap;
+
 };
 
 /** Batch of changes queued to be written to a CDBWrapper */
@@ -82,6 +97,11 @@ public:
 
         batch.Delete(slKey);
     }
+
+    void Clear()
+    {
+        batch.Clear();
+    }
 };
 
 class CDBIterator
@@ -114,6 +134,10 @@ public:
 
     void Next();
 
+    void SeekToLast();
+
+    void Prev();
+
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
@@ -183,6 +207,27 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! batch being committed by threadWriteBehind, if any
+    std::unique_ptr<CDBBatch> pbatchPending;
+
+    //! the records of pbatchPending, served to reads until it is committed
+    dbwrapper_private::PendingMap mapPending;
+
+    //! failure of a background write, reported by every later write
+    leveldb::Status statusPending;
+
+    mutable CCriticalSection cs_pending;
+    CCriticalSection cs_writebehind;
+    boost::thread threadWriteBehind;
+
+    void CommitPendingBatch();
+
+    /**
+     * Look a key up in the batch being written in the background.
+     * Returns true if that batch touches the key, setting fErased if it erases it.
+     */
+    bool ReadPending(const leveldb::Slice& slKey, std::string& strValue, bool& fErased) const;
+
 public:
     /**
      * @param[in] path          Location in the filesystem where leveldb data will be stored.
@@ -206,12 +251,18 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
-        if (!status.ok()) {
-            if (status.IsNotFound())
+        bool fErased = false;
+        if (ReadPending(slKey, strValue, fErased)) {
+            if (fErased)
                 return false;
-            LogPrintf("LevelDB read failure: %s\n", status.ToString());
-            dbwrapper_private::HandleError(status);
+        } else {
+            leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+            if (!status.ok()) {
+                if (status.IsNotFound())
+                    return false;
+                LogPrintf("LevelDB read failure: %s\n", status.ToString());
+                dbwrapper_private::HandleError(status);
+            }
         }
         try {
             CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
@@ -240,12 +291,18 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
-        if (!status.ok()) {
-            if (status.IsNotFound())
+        bool fErased = false;
+        if (ReadPending(slKey, strValue, fErased)) {
+            if (fErased)
                 return false;
-            LogPrintf("LevelDB read failure: %s\n", status.ToString());
-            dbwrapper_private::HandleError(status);
+        } else {
+            leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+            if (!status.ok()) {
+                if (status.IsNotFound())
+                    return false;
+                LogPrintf("LevelDB read failure: %s\n", status.ToString());
+                dbwrapper_private::HandleError(status);
+            }
         }
         return true;
     }
@@ -260,6 +317,24 @@ public:
 
     bool WriteBatch(CDBBatch& batch, bool fSync = false);
 
+    /**
+     * Commit a batch on a background thread and return immediately. Until the
+     * write completes, reads of the keys it touches are answered from the batch.
+     * Only one such write is in flight at a time: any other write or iteration
+     * first waits for it to finish.
+     */
+    bool WriteBatchAsync(std::unique_ptr<CDBBatch> batch);
+
+    //! Block until the background write (if any) is done. A failure is not reported here.
+    void WaitForPendingWrite();
+
+    /**
+     * Block until the background write (if any) is done and throw if any of them
+     * failed. Only the write paths call this, so a failure surfaces as a flush
+     * error and not in whichever reader happens to come next.
+     */
+    void CheckPendingWrite();
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush()
     {
@@ -274,6 +349,7 @@ public:
 
     CDBIterator *NewIterator()
     {
+        WaitForPendingWrite();
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
@@ -0,0 +1,799 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dnsserver.h>
+
+#include <chain.h>
+#include <compat.h>
+#include <consensus/programs.h>
+#include <dotstock/names.h>
+#include <main.h>
+#include <netbase.h>
+#include <scheduler.h>
+#include <ui_interface.h>
+#include <util.h>
+#include <validationinterface.h>
+
+#include <algorithm>
+#include <memory>
+#include <set>
+
+#include <string.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/signals2/connection.hpp>
+#include <boost/thread.hpp>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+static const uint16_t DNS_TYPE_A = 1;
+static const uint16_t DNS_TYPE_TXT = 16;
+static const uint16_t DNS_TYPE_AAAA = 28;
+static const uint16_t DNS_TYPE_ANY = 255;
+static const uint16_t DNS_CLASS_IN = 1;
+
+static const int DNS_RCODE_NOERROR = 0;
+static const int DNS_RCODE_FORMERR = 1;
+static const int DNS_RCODE_NXDOMAIN = 3;
+static const int DNS_RCODE_NOTIMP = 4;
+static const int DNS_RCODE_REFUSED = 5;
+
+static const uint16_t DNS_FLAG_QR = 0x8000;
+static const uint16_t DNS_FLAG_AA = 0x0400;
+static const uint16_t DNS_FLAG_TC = 0x0200;
+static const uint16_t DNS_FLAG_RD = 0x0100;
+
+static const size_t DNS_HEADER_SIZE = 12;
+static const size_t DNS_MAX_NAME_SIZE = 255;
+static const size_t DNS_MAX_STRING_SIZE = 255;
+
+/** Seconds a TCP client may stay idle before it is disconnected */
+static const int DNS_TCP_TIMEOUT = 10;
+/** Queries read from a UDP socket per wakeup, so one socket can not starve the others */
+static const int DNS_UDP_BATCH = 64;
+/** Bytes of answers queued for a TCP client before its further queries wait */
+static const size_t DNS_MAX_TCP_OUTPUT = 4 * (DNS_MAX_TCP_SIZE + 2);
+/** Queries kept while the data of their names is fetched */
+static const size_t DNS_MAX_PENDING_QUERIES = 1024;
+
+static const std::string DNS_SUFFIX = ".0dyns";
+
+static void WriteBE16(std::vector<unsigned char>& v, uint16_t n)
+{
+    v.push_back(n >> 8);
+    v.push_back(n & 0xff);
+}
+
+static void WriteBE32(std::vector<unsigned char>& v, uint32_t n)
+{
+    WriteBE16(v, n >> 16);
+    WriteBE16(v, n & 0xffff);
+}
+
+static uint16_t ReadBE16(const unsigned char* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+/** Append a record for the name of the question, which always sits right after the header. */
+static void WriteRecord(std::vector<unsigned char>& v, uint16_t type, uint32_t ttl, const std::vector<unsigned char>& data)
+{
+    WriteBE16(v, 0xc000 | DNS_HEADER_SIZE);
+    WriteBE16(v, type);
+    WriteBE16(v, DNS_CLASS_IN);
+    WriteBE32(v, ttl);
+    WriteBE16(v, data.size());
+    v.insert(v.end(), data.begin(), data.end());
+}
+
+CDNSResponder::CDNSResponder(const LookupFunction& lookupIn, size_t nMaxEntriesIn, uint32_t nTTLIn) :
+    lookup(lookupIn), nMaxEntries(nMaxEntriesIn), nTTL(nTTLIn), nGeneration(0)
+{
+}
+
+void CDNSResponder::Resolve(const std::string& qname, uint16_t qtype, Answer& answer)
+{
+    answer.nRcode = DNS_RCODE_NOERROR;
+    answer.fPending = false;
+    answer.nCount = 0;
+    answer.vRecords.clear();
+
+    // We are only authoritative for the names of the chain, and do not recurse.
+    size_t nDots = std::count(qname.begin(), qname.end(), '.');
+    if (qname.size() <= DNS_SUFFIX.size() || qname.compare(qname.size() - DNS_SUFFIX.size(), DNS_SUFFIX.size(), DNS_SUFFIX) != 0 || nDots > 2) {
+        answer.nRcode = DNS_RCODE_REFUSED;
+        return;
+    }
+
+    std::string name = qname;
+    std::string subdomain = "";
+    if (nDots == 2) {
+        subdomain = qname.substr(0, qname.find('.'));
+        name = qname.substr(qname.find('.') + 1);
+    }
+
+    // Names not in the index simply miss in the lookup, only subdomains need checking.
+    std::map<std::string, std::string> data;
+    LookupResult result = (subdomain != "" && !DotStock::IsValidKey(subdomain)) ? LOOKUP_NOT_FOUND : lookup(name, subdomain, data);
+    if (result == LOOKUP_PENDING) {
+        answer.fPending = true;
+        return;
+    }
+    if (result == LOOKUP_NOT_FOUND) {
+        answer.nRcode = DNS_RCODE_NXDOMAIN;
+        return;
+    }
+
+    for (const std::string& key: {std::string("a"), std::string("aaaa")}) {
+        uint16_t type = key == "a" ? DNS_TYPE_A : DNS_TYPE_AAAA;
+        if ((qtype != type && qtype != DNS_TYPE_ANY) || !data.count(key))
+            continue;
+
+        std::vector<std::string> vAddr;
+        boost::split(vAddr, data[key], boost::is_any_of(", "), boost::token_compress_on);
+        for (const std::string& strAddr: vAddr) {
+            std::vector<CNetAddr> vIP;
+            if (strAddr.empty() || !LookupHost(strAddr.c_str(), vIP, 1, false))
+                continue;
+            std::vector<unsigned char> rdata;
+            if (type == DNS_TYPE_A && vIP[0].IsIPv4()) {
+                struct in_addr addr;
+                vIP[0].GetInAddr(&addr);
+                rdata.assign((unsigned char*)&addr, (unsigned char*)&addr + sizeof(addr));
+            } else if (type == DNS_TYPE_AAAA && vIP[0].IsIPv6()) {
+                struct in6_addr addr;
+                vIP[0].GetIn6Addr(&addr);
+                rdata.assign((unsigned char*)&addr, (unsigned char*)&addr + sizeof(addr));
+            } else {
+                continue;
+            }
+            WriteRecord(answer.vRecords, type, nTTL, rdata);
+            answer.nCount++;
+        }
+    }
+
+    if (qtype == DNS_TYPE_TXT || qtype == DNS_TYPE_ANY) {
+        for (auto &it: data) {
+            if (it.first.substr(0, 1) == "_")
+                continue;
+            // A TXT record is a sequence of strings of at most 255 bytes each.
+            std::string str = it.first + "=" + it.second;
+            std::vector<unsigned char> rdata;
+            for (size_t nPos = 0; nPos < str.size(); nPos += DNS_MAX_STRING_SIZE) {
+                std::string chunk = str.substr(nPos, DNS_MAX_STRING_SIZE);
+                rdata.push_back(chunk.size());
+                rdata.insert(rdata.end(), chunk.begin(), chunk.end());
+            }
+            WriteRecord(answer.vRecords, DNS_TYPE_TXT, nTTL, rdata);
+            answer.nCount++;
+        }
+    }
+}
+
+CDNSResponder::QueryResult CDNSResponder::HandleQuery(const unsigned char* data, size_t size, size_t nMaxSize, std::vector<unsigned char>& response)
+{
+    if (size < DNS_HEADER_SIZE)
+        return QUERY_IGNORED;
+
+    uint16_t flags = ReadBE16(data + 2);
+    // Never answer responses, they could be ours bouncing back.
+    if (flags & DNS_FLAG_QR)
+        return QUERY_IGNORED;
+
+    int nRcode = DNS_RCODE_NOERROR;
+    uint16_t opcode = (flags >> 11) & 0xf;
+    std::string qname;
+    uint16_t qtype = 0, qclass = 0;
+    size_t nPos = DNS_HEADER_SIZE;
+
+    if (opcode != 0) {
+        nRcode = DNS_RCODE_NOTIMP;
+    } else if (ReadBE16(data + 4) != 1) {
+        nRcode = DNS_RCODE_FORMERR;
+    } else {
+        while (true) {
+            if (nPos >= size) {
+                nRcode = DNS_RCODE_FORMERR;
+                break;
+            }
+            size_t nLabel = data[nPos++];
+            if (nLabel == 0)
+                break;
+            // Compression pointers have no place in the only question of a query, and
+            // a dot inside a label would move the label boundaries of the name looked up.
+            if (nLabel > 63 || nPos + nLabel > size || qname.size() + nLabel + 1 > DNS_MAX_NAME_SIZE ||
+                    std::find(data + nPos, data + nPos + nLabel, '.') != data + nPos + nLabel) {
+                nRcode = DNS_RCODE_FORMERR;
+                break;
+            }
+            if (!qname.empty())
+                qname += ".";
+            qname.append((const char*)data + nPos, nLabel);
+            nPos += nLabel;
+        }
+        if (nRcode == DNS_RCODE_NOERROR) {
+            if (nPos + 4 > size) {
+                nRcode = DNS_RCODE_FORMERR;
+            } else {
+                qtype = ReadBE16(data + nPos);
+                qclass = ReadBE16(data + nPos + 2);
+                nPos += 4;
+                if (qclass != DNS_CLASS_IN)
+                    nRcode = DNS_RCODE_REFUSED;
+            }
+        }
+    }
+
+    response.clear();
+    response.reserve(nMaxSize);
+    response.insert(response.end(), data, data + 2);
+
+    if (nRcode != DNS_RCODE_NOERROR) {
+        WriteBE16(response, DNS_FLAG_QR | (opcode << 11) | (flags & DNS_FLAG_RD) | nRcode);
+        WriteBE16(response, 0);
+        WriteBE16(response, 0);
+        WriteBE16(response, 0);
+        WriteBE16(response, 0);
+        return QUERY_ANSWERED;
+    }
+
+    std::string key = boost::algorithm::to_lower_copy(qname);
+    key.push_back('\0');
+    key.push_back(qtype >> 8);
+    key.push_back(qtype & 0xff);
+
+    Answer answer;
+    bool fCached = false;
+    uint64_t nGenerationBefore;
+    {
+        LOCK(cs);
+        auto it = mapAnswers.find(key);
+        if (it != mapAnswers.end()) {
+            answer = it->second;
+            fCached = true;
+        }
+        nGenerationBefore = nGeneration;
+    }
+
+    if (!fCached) {
+        Resolve(boost::algorithm::to_lower_copy(qname), qtype, answer);
+        if (answer.fPending) {
+            response.clear();
+            return QUERY_PENDING;
+        }
+
+        LOCK(cs);
+        // Do not keep what was resolved against a tip that is gone already.
+        if (nGeneration == nGenerationBefore) {
+            if (mapAnswers.size() >= nMaxEntries && !mapAnswers.empty())
+                mapAnswers.erase(mapAnswers.begin());
+            if (nMaxEntries > 0)
+                mapAnswers[key] = answer;
+        }
+    }
+
+    uint16_t nCount = answer.nCount;
+    uint16_t nTruncated = 0;
+    if (DNS_HEADER_SIZE + (nPos - DNS_HEADER_SIZE) + answer.vRecords.size() > nMaxSize) {
+        nCount = 0;
+        nTruncated = DNS_FLAG_TC;
+    }
+
+    WriteBE16(response, DNS_FLAG_QR | DNS_FLAG_AA | nTruncated | (flags & DNS_FLAG_RD) | answer.nRcode);
+    WriteBE16(response, 1);
+    WriteBE16(response, nCount);
+    WriteBE16(response, 0);
+    WriteBE16(response, 0);
+    // The question as it was asked, the records point to its name.
+    response.insert(response.end(), data + DNS_HEADER_SIZE, data + nPos);
+    if (!nTruncated)
+        response.insert(response.end(), answer.vRecords.begin(), answer.vRecords.end());
+
+    return QUERY_ANSWERED;
+}
+
+void CDNSResponder::Clear()
+{
+    LOCK(cs);
+    mapAnswers.clear();
+    nGeneration++;
+}
+
+size_t CDNSResponder::GetCacheSize() const
+{
+    LOCK(cs);
+    return mapAnswers.size();
+}
+
+static struct event_base* eventBaseDNS = nullptr;
+static std::vector<struct event*> vUDPEvents;
+static std::vector<struct evconnlistener*> vTCPListeners;
+static std::set<struct bufferevent*> setTCPClients;
+static boost::thread threadDNS;
+static CDNSResponder* pdnsResponder = nullptr;
+static boost::signals2::connection connBlockTip;
+static boost::signals2::connection connSyncTransaction;
+
+/** A query waiting for the data of its name, only touched by the event loop. */
+struct DNSPendingQuery
+{
+    //! TCP client which sent it, nullptr for UDP
+    struct bufferevent* bev;
+    evutil_socket_t fd;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    std::vector<unsigned char> query;
+};
+
+static std::vector<DNSPendingQuery> vPendingQueries;
+//! Activated from other threads when names were added to the snapshot
+static struct event* evNamesUpdated = nullptr;
+
+/**
+ * Snapshot of the data of the names asked for, as of hashDNSNamesTip, so the
+ * event loop never waits for cs_main. Names which are not registered map to
+ * nullptr. The validation side refreshes the names which blocks connected or
+ * disconnected since then touched when the tip changes, and names missing from
+ * it are fetched on the scheduler thread.
+ */
+static CCriticalSection cs_dnsnames;
+static std::map<uint256, std::shared_ptr<const NameDataState>> mapDNSNames;
+static std::set<uint256> setDNSNamesWanted;
+static std::set<uint256> setDNSNamesTouched;
+static uint256 hashDNSNamesTip;
+static int nDNSNamesHeight = 0;
+static size_t nMaxDNSNames = 0;
+static CScheduler* pdnsScheduler = nullptr;
+static bool fDNSNamesUpdateScheduled = false;
+
+/** Bring the snapshot to the current tip and fetch the names asked for since the last update. */
+static void UpdateDNSNames()
+{
+    LOCK(cs_main);
+
+    if (!pcoinsTip || !chainActive.Tip())
+        return;
+
+    uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    std::set<uint256> setIds;
+    {
+        LOCK(cs_dnsnames);
+        // Blocks only reach the tip under cs_main, so the touched names cover
+        // every change since hashDNSNamesTip.
+        setIds.swap(setDNSNamesTouched);
+        setIds.insert(setDNSNamesWanted.begin(), setDNSNamesWanted.end());
+        setDNSNamesWanted.clear();
+        fDNSNamesUpdateScheduled = false;
+    }
+
+    std::map<uint256, std::shared_ptr<const NameDataState>> mapNames;
+    for (const uint256& id: setIds) {
+        NameDataState state;
+        if (pcoinsTip->GetNameState(id, state))
+            mapNames[id] = std::make_shared<const NameDataState>(state);
+        else
+            mapNames[id] = nullptr;
+    }
+
+    LOCK(cs_dnsnames);
+    // Make room for the names just fetched, they have queries waiting for them.
+    for (auto it = mapDNSNames.begin(); it != mapDNSNames.end() && mapDNSNames.size() + mapNames.size() > nMaxDNSNames;) {
+        if (mapNames.count(it->first))
+            ++it;
+        else
+            it = mapDNSNames.erase(it);
+    }
+    for (auto& it: mapNames)
+        mapDNSNames[it.first] = it.second;
+    hashDNSNamesTip = hashTip;
+    nDNSNamesHeight = chainActive.Height();
+}
+
+/** Have the event loop hand in the queries which waited for names again. */
+static void NotifyDNSNamesUpdated()
+{
+    LOCK(cs_dnsnames);
+    if (evNamesUpdated)
+        event_active(evNamesUpdated, 0, 0);
+}
+
+static void FetchDNSNames()
+{
+    UpdateDNSNames();
+    NotifyDNSNamesUpdated();
+}
+
+static CDNSResponder::LookupResult LookupNameData(const std::string& name, const std::string& subdomain, std::map<std::string, std::string>& data)
+{
+    uint256 id = DotStock::GetHashName(name);
+
+    LOCK(cs_dnsnames);
+
+    auto it = mapDNSNames.find(id);
+    if (it == mapDNSNames.end()) {
+        setDNSNamesWanted.insert(id);
+        if (!fDNSNamesUpdateScheduled && pdnsScheduler) {
+            fDNSNamesUpdateScheduled = true;
+            pdnsScheduler->scheduleFromNow(FetchDNSNames, 0);
+        }
+        return CDNSResponder::LOOKUP_PENDING;
+    }
+
+    if (!it->second)
+        return CDNSResponder::LOOKUP_NOT_FOUND;
+
+    // Expired names resolve to nothing at all.
+    data = it->second->Get(nDNSNamesHeight, subdomain);
+    return data.empty() ? CDNSResponder::LOOKUP_NOT_FOUND : CDNSResponder::LOOKUP_FOUND;
+}
+
+/** Remember the cached names a transaction of a connected or disconnected block updates. */
+static void DNSSyncTransaction(const CTransaction& tx, const CBlockIndex* pindex, const CBlock* pblock, const bool fConnect, const std::vector<RangeproofEncodedData>* blsctData)
+{
+    // Transactions entering the mempool do not change any name.
+    if (!pindex)
+        return;
+
+    for (const CTxOut& out: tx.vout) {
+        if (out.vData.empty())
+            continue;
+
+        try {
+            Predicate program(out.vData);
+
+            if (program.action != UPDATE_NAME_FIRST && program.action != UPDATE_NAME && program.action != RENEW_NAME)
+                continue;
+
+            uint256 id = DotStock::GetHashName(program.sParameters[0]);
+
+            LOCK(cs_dnsnames);
+            if (mapDNSNames.count(id))
+                setDNSNamesTouched.insert(id);
+        } catch(...) {
+        }
+    }
+}
+
+static void DNSBlockTip(bool fInitialDownload, const CBlockIndex* pindexNew)
+{
+    if (fInitialDownload) {
+        // Answers would be stale a block later anyway, so rather than
+        // refreshing the snapshot drop it and fetch names again on demand.
+        {
+            LOCK(cs_dnsnames);
+            if (hashDNSNamesTip.IsNull())
+                return;
+            mapDNSNames.clear();
+            setDNSNamesTouched.clear();
+            hashDNSNamesTip.SetNull();
+        }
+        if (pdnsResponder)
+            pdnsResponder->Clear();
+        return;
+    }
+
+    UpdateDNSNames();
+    if (pdnsResponder)
+        pdnsResponder->Clear();
+    NotifyDNSNamesUpdated();
+}
+
+static void dns_tcp_close(struct bufferevent* bev)
+{
+    vPendingQueries.erase(std::remove_if(vPendingQueries.begin(), vPendingQueries.end(),
+                                         [bev](const DNSPendingQuery& pending) { return pending.bev == bev; }),
+                          vPendingQueries.end());
+    setTCPClients.erase(bev);
+    bufferevent_free(bev);
+}
+
+/**
+ * Answer a query from a TCP client (bev) or from addr over the UDP socket fd,
+ * or keep it until the data of its name is fetched. Returns false if the
+ * TCP client was disconnected.
+ */
+static bool HandleDNSQuery(struct bufferevent* bev, evutil_socket_t fd, const struct sockaddr_storage* addr, socklen_t addrlen,
+                           const unsigned char* data, size_t size)
+{
+    std::vector<unsigned char> response;
+
+    switch (pdnsResponder->HandleQuery(data, size, bev ? DNS_MAX_TCP_SIZE : DNS_MAX_UDP_SIZE, response)) {
+    case CDNSResponder::QUERY_IGNORED:
+        if (bev) {
+            dns_tcp_close(bev);
+            return false;
+        }
+        break;
+    case CDNSResponder::QUERY_ANSWERED:
+        if (bev) {
+            unsigned char length[2] = {(unsigned char)(response.size() >> 8), (unsigned char)(response.size() & 0xff)};
+            bufferevent_write(bev, length, 2);
+            bufferevent_write(bev, response.data(), response.size());
+        } else {
+            sendto(fd, (const char*)response.data(), response.size(), 0, (const struct sockaddr*)addr, addrlen);
+        }
+        break;
+    case CDNSResponder::QUERY_PENDING:
+        // Over the limit the query is dropped, UDP clients ask again on their own.
+        if (vPendingQueries.size() < DNS_MAX_PENDING_QUERIES) {
+            DNSPendingQuery pending;
+            pending.bev = bev;
+            pending.fd = fd;
+            pending.addrlen = addr ? addrlen : 0;
+            if (addr)
+                memcpy(&pending.addr, addr, addrlen);
+            pending.query.assign(data, data + size);
+            vPendingQueries.push_back(std::move(pending));
+        }
+        break;
+    }
+
+    return true;
+}
+
+static void dns_names_updated_cb(evutil_socket_t fd, short what, void* arg)
+{
+    std::vector<DNSPendingQuery> vQueries;
+    vQueries.swap(vPendingQueries);
+
+    for (DNSPendingQuery& pending: vQueries) {
+        // Skip the queries of clients which were disconnected meanwhile.
+        if (pending.bev && !setTCPClients.count(pending.bev))
+            continue;
+        HandleDNSQuery(pending.bev, pending.fd, pending.bev ? nullptr : &pending.addr, pending.addrlen,
+                       pending.query.data(), pending.query.size());
+    }
+}
+
+static void dns_udp_cb(evutil_socket_t fd, short what, void* arg)
+{
+    static unsigned char buf[DNS_MAX_TCP_SIZE];
+
+    for (int i = 0; i < DNS_UDP_BATCH; i++) {
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        int nBytes = recvfrom(fd, (char*)buf, sizeof(buf), 0, (struct sockaddr*)&addr, &addrlen);
+        if (nBytes <= 0)
+            break;
+        HandleDNSQuery(nullptr, fd, &addr, addrlen, buf, nBytes);
+    }
+}
+
+static void dns_tcp_read_cb(struct bufferevent* bev, void* ctx)
+{
+    struct evbuffer* input = bufferevent_get_input(bev);
+
+    // Each message is preceded by its length on two bytes.
+    while (evbuffer_get_length(input) >= 2) {
+        // A client which does not read its answers only gets more once it did,
+        // see dns_tcp_write_cb.
+        if (evbuffer_get_length(bufferevent_get_output(bev)) >= DNS_MAX_TCP_OUTPUT) {
+            bufferevent_disable(bev, EV_READ);
+            return;
+        }
+
+        unsigned char prefix[2];
+        evbuffer_copyout(input, prefix, 2);
+        size_t nSize = ReadBE16(prefix);
+        if (evbuffer_get_length(input) < 2 + nSize)
+            return;
+
+        std::vector<unsigned char> query(nSize);
+        evbuffer_drain(input, 2);
+        evbuffer_remove(input, query.data(), nSize);
+
+        if (!HandleDNSQuery(bev, -1, nullptr, 0, query.data(), nSize))
+            return;
+    }
+}
+
+static void dns_tcp_write_cb(struct bufferevent* bev, void* ctx)
+{
+    // The answers were sent, go on with the queries left in the input.
+    if (!(bufferevent_get_enabled(bev) & EV_READ)) {
+        bufferevent_enable(bev, EV_READ);
+        dns_tcp_read_cb(bev, ctx);
+    }
+}
+
+static void dns_tcp_event_cb(struct bufferevent* bev, short what, void* ctx)
+{
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR | BEV_EVENT_TIMEOUT))
+        dns_tcp_close(bev);
+}
+
+static void dns_tcp_accept_cb(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx)
+{
+    struct bufferevent* bev = bufferevent_socket_new(eventBaseDNS, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+    struct timeval tv = {DNS_TCP_TIMEOUT, 0};
+    bufferevent_set_timeouts(bev, &tv, &tv);
+    bufferevent_setcb(bev, dns_tcp_read_cb, dns_tcp_write_cb, dns_tcp_event_cb, nullptr);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    setTCPClients.insert(bev);
+}
+
+/** Create a non-blocking socket of type bound to addrBind, INVALID_SOCKET on failure */
+static SOCKET BindDNSSocket(const CService& addrBind, int type)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addrBind.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+        return INVALID_SOCKET;
+
+    SOCKET hSocket = socket(((struct sockaddr*)&sockaddr)->sa_family, type, type == SOCK_DGRAM ? IPPROTO_UDP : IPPROTO_TCP);
+    if (hSocket == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    // Bind ::1 and 127.0.0.1 side by side.
+    if (addrBind.IsIPv6()) {
+#ifdef IPV6_V6ONLY
+        int nOne = 1;
+        setsockopt(hSocket, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&nOne, sizeof(int));
+#endif
+    }
+    if (type == SOCK_STREAM)
+        evutil_make_listen_socket_reuseable(hSocket);
+
+    if (evutil_make_socket_nonblocking(hSocket) != 0 || ::bind(hSocket, (struct sockaddr*)&sockaddr, len) == SOCKET_ERROR) {
+        LogPrintf("DNS: unable to bind to %s: %s\n", addrBind.ToString(), NetworkErrorString(WSAGetLastError()));
+        CloseSocket(hSocket);
+        return INVALID_SOCKET;
+    }
+
+    return hSocket;
+}
+
+static bool DNSBindAddresses()
+{
+    int nPort = GetArg("-dnsport", DEFAULT_DNS_PORT);
+    std::vector<std::string> vBind;
+
+    if (mapArgs.count("-dnsbind")) {
+        vBind = mapMultiArgs["-dnsbind"];
+    } else { // Only local services are meant to use it
+        vBind.push_back("::1");
+        vBind.push_back("127.0.0.1");
+    }
+
+    for (const std::string& strBind: vBind) {
+        CService addrBind;
+        if (!Lookup(strBind.c_str(), addrBind, nPort, false)) {
+            LogPrintf("DNS: invalid bind address %s\n", strBind);
+            continue;
+        }
+
+        SOCKET hSocket = BindDNSSocket(addrBind, SOCK_DGRAM);
+        if (hSocket != INVALID_SOCKET) {
+            struct event* ev = event_new(eventBaseDNS, hSocket, EV_READ | EV_PERSIST, dns_udp_cb, nullptr);
+            if (ev && event_add(ev, nullptr) == 0) {
+                vUDPEvents.push_back(ev);
+            } else {
+                if (ev)
+                    event_free(ev);
+                CloseSocket(hSocket);
+            }
+        }
+
+        hSocket = BindDNSSocket(addrBind, SOCK_STREAM);
+        if (hSocket != INVALID_SOCKET) {
+            struct evconnlistener* listener = evconnlistener_new(eventBaseDNS, dns_tcp_accept_cb, nullptr, LEV_OPT_CLOSE_ON_FREE, -1, hSocket);
+            if (listener)
+                vTCPListeners.push_back(listener);
+            else
+                CloseSocket(hSocket);
+        }
+
+        LogPrint("dns", "Binding DNS server on address %s\n", addrBind.ToString());
+    }
+
+    return !vUDPEvents.empty() || !vTCPListeners.empty();
+}
+
+static void ThreadDNS(struct event_base* base)
+{
+    RenameThread("stock-dns");
+    LogPrint("dns", "Entering DNS event loop\n");
+    event_base_dispatch(base);
+    LogPrint("dns", "Exited DNS event loop\n");
+}
+
+bool StartDNSServer(CScheduler& scheduler)
+{
+    if (!GetBoolArg("-dns", DEFAULT_DNS_SERVER))
+        return true;
+
+    // The scheduler thread wakes the event loop up when it fetched names.
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+
+    eventBaseDNS = event_base_new();
+    if (!eventBaseDNS) {
+        LogPrintf("DNS: unable to create event_base\n");
+        return false;
+    }
+
+    size_t nCacheSize = (size_t)std::max((int64_t)0, GetArg("-dnscachesize", DEFAULT_DNS_CACHE_SIZE));
+    pdnsResponder = new CDNSResponder(LookupNameData, nCacheSize);
+
+    {
+        LOCK(cs_dnsnames);
+        evNamesUpdated = event_new(eventBaseDNS, -1, 0, dns_names_updated_cb, nullptr);
+        pdnsScheduler = &scheduler;
+        // Every pending query must find its name in the snapshot.
+        nMaxDNSNames = std::max(nCacheSize, DNS_MAX_PENDING_QUERIES);
+    }
+
+    if (!DNSBindAddresses()) {
+        LogPrintf("Unable to bind any endpoint for DNS server\n");
+        StopDNSServer();
+        return false;
+    }
+
+    connSyncTransaction = GetMainSignals().SyncTransaction.connect(DNSSyncTransaction);
+    connBlockTip = uiInterface.NotifyBlockTip.connect(DNSBlockTip);
+
+    threadDNS = boost::thread(boost::bind(&ThreadDNS, eventBaseDNS));
+    LogPrintf("DNS: answering for dotodyns names on port %d\n", GetArg("-dnsport", DEFAULT_DNS_PORT));
+    return true;
+}
+
+void InterruptDNSServer()
+{
+    if (eventBaseDNS)
+        event_base_loopbreak(eventBaseDNS);
+}
+
+void StopDNSServer()
+{
+    connBlockTip.disconnect();
+    connSyncTransaction.disconnect();
+    if (threadDNS.joinable()) {
+        event_base_loopbreak(eventBaseDNS);
+        threadDNS.join();
+    }
+    {
+        LOCK(cs_dnsnames);
+        if (evNamesUpdated)
+            event_free(evNamesUpdated);
+        evNamesUpdated = nullptr;
+        pdnsScheduler = nullptr;
+        fDNSNamesUpdateScheduled = false;
+        mapDNSNames.clear();
+        setDNSNamesWanted.clear();
+        setDNSNamesTouched.clear();
+        hashDNSNamesTip.SetNull();
+    }
+    vPendingQueries.clear();
+    for (struct event* ev: vUDPEvents) {
+        SOCKET hSocket = event_get_fd(ev);
+        event_free(ev);
+        CloseSocket(hSocket);
+    }
+    vUDPEvents.clear();
+    for (struct evconnlistener* listener: vTCPListeners)
+        evconnlistener_free(listener);
+    vTCPListeners.clear();
+    for (struct bufferevent* bev: setTCPClients)
+        bufferevent_free(bev);
+    setTCPClients.clear();
+    if (eventBaseDNS) {
+        event_base_free(eventBaseDNS);
+        eventBaseDNS = nullptr;
+    }
+    delete pdnsResponder;
+    pdnsResponder = nullptr;
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STOCK_DNSSERVER_H
+#define STOCK_DNSSERVER_H
+
+#include <sync.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+class CScheduler;
+
+static const bool DEFAULT_DNS_SERVER = false;
+static const int DEFAULT_DNS_PORT = 5335;
+static const unsigned int DEFAULT_DNS_CACHE_SIZE = 10000;
+//! Answers can change with every block, so they are not meant to be kept long by clients
+static const uint32_t DEFAULT_DNS_TTL = 60;
+
+/** Largest answer sent over UDP, clients retry over TCP when it is truncated. */
+static const size_t DNS_MAX_UDP_SIZE = 512;
+static const size_t DNS_MAX_TCP_SIZE = 65535;
+
+/**
+ * Answers DNS queries for dotodyns names from their data: "a" and "aaaa" keys
+ * hold comma separated addresses, the other keys are served as "key=value"
+ * TXT strings. Only queries for names under .0dyns are answered.
+ *
+ * Answers are cached by name and type until Clear() is called, which the
+ * server does whenever the tip changes.
+ */
+class CDNSResponder
+{
+public:
+    enum LookupResult
+    {
+        LOOKUP_NOT_FOUND,
+        LOOKUP_FOUND,
+        //! the data of the name is being fetched, ask again later
+        LOOKUP_PENDING
+    };
+
+    enum QueryResult
+    {
+        //! not a query that can be replied to at all
+        QUERY_IGNORED,
+        QUERY_ANSWERED,
+        //! the answer depends on a pending lookup, hand the query in again later
+        QUERY_PENDING
+    };
+
+    /** Fetch the data of name (or of one of its subdomains) as of the tip. */
+    typedef std::function<LookupResult(const std::string& name, const std::string& subdomain, std::map<std::string, std::string>& data)> LookupFunction;
+
+    CDNSResponder(const LookupFunction& lookupIn, size_t nMaxEntriesIn = DEFAULT_DNS_CACHE_SIZE, uint32_t nTTLIn = DEFAULT_DNS_TTL);
+
+    /** Answer the query in data, with a response of at most nMaxSize bytes. */
+    QueryResult HandleQuery(const unsigned char* data, size_t size, size_t nMaxSize, std::vector<unsigned char>& response);
+
+    void Clear();
+
+    size_t GetCacheSize() const;
+
+private:
+    struct Answer
+    {
+        int nRcode;
+        bool fPending;
+        uint16_t nCount;
+        //! answer section, names pointing to the question
+        std::vector<unsigned char> vRecords;
+    };
+
+    LookupFunction lookup;
+    size_t nMaxEntries;
+    uint32_t nTTL;
+
+    mutable CCriticalSection cs;
+    //! lower case name and type of the question -> answer
+    std::unordered_map<std::string, Answer> mapAnswers;
+    //! bumped by Clear(), so that answers resolved before it are not cached after it
+    uint64_t nGeneration;
+
+    void Resolve(const std::string& qname, uint16_t qtype, Answer& answer);
+};
+
+/**
+ * Start the DNS server, if enabled by -dns. Call after the chainstate is loaded.
+ * Name data missing from the server's snapshot is fetched on the scheduler thread.
+ */
+bool StartDNSServer(CScheduler& scheduler);
+/** Stop accepting queries */
+void InterruptDNSServer();
+/** Stop the DNS server */
+void StopDNSServer();
+
+#endif // STOCK_DNSSERVER_H
@@ -0,0 +1,157 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dotstock/namedata.h>
+
+#include <algorithm>
+
+static bool IsReservedKey(const std::string& key)
+{
+    return key.substr(0, 1) == "_";
+}
+
+static size_t StringMapUsage(const std::map<std::string, std::string>& map)
+{
+    size_t ret = memusage::DynamicUsage(map);
+    for (auto &it: map)
+        ret += memusage::DynamicUsage(it.first) + memusage::DynamicUsage(it.second);
+    return ret;
+}
+
+void NameDataState::Apply(const uint64_t& height, const NameDataValue& data)
+{
+    // Disconnected heights are marked in the history by null entries.
+    if (data.IsNull())
+        return;
+
+    for (size_t i = vUndo.size(); i > 0 && vUndo[i - 1].first == height; i--) {
+        const NameDataUndo& prev = vUndo[i - 1].second;
+        if (prev.key == data.key && prev.subdomain != data.subdomain) {
+            Revert(prev);
+            vUndo.erase(vUndo.begin() + i - 1);
+        }
+    }
+
+    bool fReserved = IsReservedKey(data.key);
+    std::map<std::string, std::string>& map = fReserved ? mapReserved : mapSubdomains[data.subdomain];
+
+    NameDataUndo undo(data.subdomain, data.key);
+    auto it = map.find(data.key);
+    if (it != map.end()) {
+        undo.fHad = true;
+        undo.value = it->second;
+    }
+    vUndo.push_back(std::make_pair(height, undo));
+
+    if (data.value != "")
+        map[data.key] = data.value;
+    else if (it != map.end())
+        map.erase(it);
+
+    if (!fReserved && map.empty())
+        mapSubdomains.erase(data.subdomain);
+}
+
+bool NameDataState::Undo(const uint64_t& height)
+{
+    if (height < nUndoFrom)
+        return false;
+
+    while (!vUndo.empty() && vUndo.back().first >= height) {
+        Revert(vUndo.back().second);
+        vUndo.pop_back();
+    }
+
+    return true;
+}
+
+void NameDataState::Revert(const NameDataUndo& undo)
+{
+    bool fReserved = IsReservedKey(undo.key);
+    std::map<std::string, std::string>& map = fReserved ? mapReserved : mapSubdomains[undo.subdomain];
+
+    if (undo.fHad)
+        map[undo.key] = undo.value;
+    else
+        map.erase(undo.key);
+
+    if (!fReserved && map.empty())
+        mapSubdomains.erase(undo.subdomain);
+}
+
+void NameDataState::CompactUndo(const uint64_t& height)
+{
+    if (height <= nUndoFrom)
+        return;
+
+    auto itEnd = std::find_if(vUndo.begin(), vUndo.end(),
+        [&height](const std::pair<uint64_t, NameDataUndo>& o) { return o.first >= height; });
+    vUndo.erase(vUndo.begin(), itEnd);
+    nUndoFrom = height;
+}
+
+void NameDataState::Rebuild(const NameDataValues& data)
+{
+    SetNull();
+
+    NameDataValues sorted(data);
+    std::stable_sort(sorted.begin(), sorted.end(),
+        [](const NameDataEntry& a, const NameDataEntry& b) { return a.first < b.first; });
+
+    for (auto &it: sorted)
+        Apply(it.first, it.second);
+
+    vUndo.clear();
+    if (!sorted.empty())
+        nUndoFrom = sorted.back().first + 1;
+}
+
+uint64_t NameDataState::GetExpiry() const
+{
+    auto it = mapReserved.find("_expiry");
+    if (it == mapReserved.end())
+        return ~(uint64_t)0;
+    return stoll(it->second);
+}
+
+std::map<std::string, std::string> NameDataState::Get(const uint64_t& height, const std::string& subdomain) const
+{
+    std::map<std::string, std::string> ret;
+
+    if (GetExpiry() <= height)
+        return ret;
+
+    ret = mapReserved;
+
+    auto it = mapSubdomains.find(subdomain);
+    if (it != mapSubdomains.end())
+        ret.insert(it->second.begin(), it->second.end());
+
+    return ret;
+}
+
+std::map<std::string, std::map<std::string, std::string>> NameDataState::GetSubdomains(const uint64_t& height) const
+{
+    std::map<std::string, std::map<std::string, std::string>> ret;
+
+    if (GetExpiry() <= height)
+        return ret;
+
+    for (auto &it: mapSubdomains) {
+        if (it.first != "")
+            ret.insert(it);
+    }
+
+    return ret;
+}
+
+size_t NameDataState::DynamicMemoryUsage() const
+{
+    size_t ret = StringMapUsage(mapReserved) + memusage::DynamicUsage(mapSubdomains) + memusage::DynamicUsage(vUndo);
+    for (auto &it: mapSubdomains)
+        ret += memusage::DynamicUsage(it.first) + StringMapUsage(it.second);
+    for (auto &it: vUndo)
+        ret += it.second.DynamicMemoryUsage();
+    return ret;
+}
@@ -9,6 +9,7 @@
 
 #include <uint256.h>
 #include <hash.h>
+#include <memusage.h>
 
 class NameDataKey {
 public:
@@ -102,6 +103,10 @@ public:
         return (key == other.key && value == other.value && subdomain == other.subdomain);
     }
 
+    size_t DynamicMemoryUsage() const {
+        return memusage::DynamicUsage(subdomain) + memusage::DynamicUsage(key) + memusage::DynamicUsage(value);
+    }
+
     void swap(NameDataValue &to) {
         std::swap(to.key, key);
         std::swap(to.subdomain, subdomain);
@@ -122,4 +127,115 @@ typedef std::pair<uint64_t, NameDataValue> NameDataEntry;
 typedef std::vector<NameDataEntry> NameDataValues;
 typedef std::map<uint256, NameDataValues> NameDataMap;
 
+/** What a key of a name held before an update, to revert it when its block is disconnected. */
+class NameDataUndo {
+public:
+    std::string subdomain;
+    std::string key;
+    bool fHad;
+    std::string value;
+
+    NameDataUndo() : fHad(false) {}
+
+    NameDataUndo(const std::string& subdomain_, const std::string& key_) : subdomain(subdomain_), key(key_), fHad(false) {}
+
+    size_t DynamicMemoryUsage() const {
+        return memusage::DynamicUsage(subdomain) + memusage::DynamicUsage(key) + memusage::DynamicUsage(value);
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(subdomain);
+        READWRITE(key);
+        READWRITE(fHad);
+        READWRITE(value);
+    }
+};
+
+/**
+ * The data of a name as it stands at the tip: the result of folding all of its
+ * NameDataValues in the order they were connected. Keys starting with "_" are
+ * shared by all the subdomains. The updates of the recent blocks keep what they
+ * replaced so they can be disconnected without going through the history.
+ */
+class NameDataState {
+public:
+    std::map<std::string, std::string> mapReserved;
+    //! subdomain ("" for the name itself) -> key -> value
+    std::map<std::string, std::map<std::string, std::string>> mapSubdomains;
+    //! undo data of the updates, in the order they were applied
+    std::vector<std::pair<uint64_t, NameDataUndo>> vUndo;
+    //! the updates of heights below this one can not be undone anymore
+    uint64_t nUndoFrom;
+
+    NameDataState() {
+        SetNull();
+    }
+
+    void SetNull() {
+        mapReserved.clear();
+        mapSubdomains.clear();
+        vUndo.clear();
+        nUndoFrom = 0;
+    }
+
+    bool IsNull() const {
+        return mapReserved.empty() && mapSubdomains.empty() && vUndo.empty() && nUndoFrom == 0;
+    }
+
+    bool operator==(const NameDataState& other) const {
+        return mapReserved == other.mapReserved && mapSubdomains == other.mapSubdomains && nUndoFrom == other.nUndoFrom;
+    }
+
+    void swap(NameDataState &to) {
+        std::swap(to.mapReserved, mapReserved);
+        std::swap(to.mapSubdomains, mapSubdomains);
+        std::swap(to.vUndo, vUndo);
+        std::swap(to.nUndoFrom, nUndoFrom);
+    }
+
+    /**
+     * Apply an update connected at height, recording what it replaces. The
+     * history is keyed by name, height and key, so an update replaces the
+     * updates of the same key at the same height in other subdomains.
+     */
+    void Apply(const uint64_t& height, const NameDataValue& data);
+
+    /** Put back what an update replaced. */
+    void Revert(const NameDataUndo& undo);
+
+    /** Revert the updates of height and above. Returns false if they are older than the undo data kept. */
+    bool Undo(const uint64_t& height);
+
+    /** Forget the undo data of the updates below height. */
+    void CompactUndo(const uint64_t& height);
+
+    /** Rebuild the state from the history of the name, without undo data for it. */
+    void Rebuild(const NameDataValues& data);
+
+    uint64_t GetExpiry() const;
+
+    /** Same as DotStock::Consolidate over the full history of the name, as of height. */
+    std::map<std::string, std::string> Get(const uint64_t& height, const std::string& subdomain="") const;
+
+    /** The keys of every subdomain of the name, as of height. */
+    std::map<std::string, std::map<std::string, std::string>> GetSubdomains(const uint64_t& height) const;
+
+    size_t DynamicMemoryUsage() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(mapReserved);
+        READWRITE(mapSubdomains);
+        READWRITE(vUndo);
+        READWRITE(nUndoFrom);
+    }
+};
+
+typedef std::map<uint256, NameDataState> NameStateMap;
+
 #endif
@@ -36,6 +36,10 @@ public:
         return (height == other.height && nVersion == other.nVersion);
     }
 
+    size_t DynamicMemoryUsage() const {
+        return 0;
+    }
+
     void swap(NameRecordValue &to) {
         std::swap(to.nVersion, nVersion);
         std::swap(to.height, height);
@@ -172,34 +172,57 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     }
 
     JSONRequest jreq;
+    // Large replies are sent in chunks while they are being written
+    bool fHeaderSent = false;
+    JSONStreamWriter writer([req, &fHeaderSent](const std::string& strChunk) {
+        if (!fHeaderSent) {
+            req->WriteHeader("Content-Type", "application/json");
+            fHeaderSent = true;
+        }
+        req->WriteReplyChunk(HTTP_OK, strChunk);
+    });
     try {
         // Parse request
         UniValue valRequest;
         if (!valRequest.read(req->ReadBody()))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
-        std::string strReply;
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            writer.BeginObject();
+            writer.Key("result");
+            tableRPC.execute(jreq.strMethod, jreq.params, writer);
+            writer.Pair("error", NullUniValue);
+            writer.Pair("id", jreq.id);
+            writer.EndObject();
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            JSONRPCExecBatch(valRequest.get_array(), writer, QueueHTTPWork);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
+        // Send reply
+        if (!fHeaderSent)
+            req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, writer.Release() + "\n");
     } catch (const UniValue& objError) {
+        if (writer.Started()) {
+            // Too late for an error reply, cut the reply short instead
+            LogPrintf("%s: %s failed after its reply was started: %s\n", __func__, jreq.strMethod, find_value(objError, "message").getValStr());
+            req->WriteReply(HTTP_OK);
+            return false;
+        }
         JSONErrorReply(req, objError, jreq.id);
         return false;
     } catch (const std::exception& e) {
+        if (writer.Started()) {
+            LogPrintf("%s: %s failed after its reply was started: %s\n", __func__, jreq.strMethod, e.what());
+            req->WriteReply(HTTP_OK);
+            return false;
+        }
         JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
@@ -61,6 +61,22 @@ private:
     HTTPRequestHandler func;
 };
 
+/** Work item that is not tied to a request, see QueueHTTPWork */
+class HTTPFunctionWorkItem : public HTTPClosure
+{
+public:
+    HTTPFunctionWorkItem(const std::function<void(void)>& func): func(func)
+    {
+    }
+    void operator()()
+    {
+        func();
+    }
+
+private:
+    std::function<void(void)> func;
+};
+
 /** Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
  */
@@ -509,6 +525,17 @@ struct event_base* EventBase()
     return eventBase;
 }
 
+bool QueueHTTPWork(const std::function<void(void)>& func)
+{
+    if (!workQueue)
+        return false;
+    std::unique_ptr<HTTPFunctionWorkItem> item(new HTTPFunctionWorkItem(func));
+    if (!workQueue->Enqueue(item.get()))
+        return false;
+    item.release(); /* queue took ownership */
+    return true;
+}
+
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
 {
     // Static handler: simply call inner handler
@@ -536,7 +563,8 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyStarted(false)
 {
 }
 HTTPRequest::~HTTPRequest()
@@ -592,9 +620,41 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  * Replies must be sent in the main loop in the main http thread,
  * this cannot be done from worker threads.
  */
+void HTTPRequest::WriteReplyChunk(int nStatus, const std::string& strChunk)
+{
+    assert(!replySent && req);
+    if (!replyStarted) {
+        HTTPEvent* ev = new HTTPEvent(eventBase, true,
+            boost::bind(evhttp_send_reply_start, req, nStatus, (const char*)NULL));
+        ev->trigger(0);
+        replyStarted = true;
+    }
+    if (strChunk.empty())
+        return;
+    // Events are run in the order they are triggered, so chunks go out in order.
+    // evhttp drops them itself if the client has gone away in the meantime.
+    struct evhttp_request* r = req;
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [r, evb]() {
+        evhttp_send_reply_chunk(r, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(0);
+}
+
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
     assert(!replySent && req);
+    if (replyStarted) {
+        WriteReplyChunk(nStatus, strReply);
+        HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(evhttp_send_reply_end, req));
+        ev->trigger(0);
+        replySent = true;
+        req = 0; // transferred back to main thread
+        return;
+    }
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
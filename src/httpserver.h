@@ -48,6 +48,11 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Run func on one of the HTTP worker threads.
+ * Returns false if the work queue is full or the server is not running.
+ */
+bool QueueHTTPWork(const std::function<void(void)>& func);
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -56,6 +61,8 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    //! a chunked reply has been started with WriteReplyChunk
+    bool replyStarted;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -102,6 +109,16 @@ public:
      */
     void WriteHeader(const std::string& hdr, const std::string& value);
 
+    /**
+     * Write part of a chunked HTTP reply.
+     * The first call sends the headers and nStatus; nStatus is ignored afterwards.
+     * Finish the reply by calling WriteReply, which sends its strReply as the
+     * last chunk.
+     *
+     * @note Call WriteHeader before the first chunk.
+     */
+    void WriteReplyChunk(int nStatus, const std::string& strChunk);
+
     /**
      * Write HTTP reply.
      * nStatus is the HTTP status code to send.
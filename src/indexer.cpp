@@ -0,0 +1,830 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <indexer.h>
+
+#include <base58.h>
+#include <chainparams.h>
+#include <init.h>
+#include <main.h>
+#include <script/standard.h>
+#include <txdb.h>
+#include <ui_interface.h>
+#include <util.h>
+
+CAsyncIndexer asyncIndexer;
+
+void GetConnectIndexUpdate(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CIndexUpdate& update)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::map<CAddressHistoryKey, CAddressHistoryValue> addressHistoryMap;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction &tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+
+        // The outputs spent by the transaction are those recorded in its undo data
+        if (!tx.IsCoinBase())
+        {
+            if (fAddressIndex || fSpentIndex)
+            {
+                for (size_t j = 0; j < tx.vin.size(); j++) {
+                    const CTxIn input = tx.vin[j];
+                    const CTxOut &prevout = blockundo.vtxundo[i-1].vprevout[j].txout;
+                    uint160 hashBytes;
+                    int addressType, dummyType;
+
+                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
+                        std::vector<unsigned char> hashBytes_(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
+                        uint160 hashBytes(hashBytes_);
+                        addressType = 2;
+
+                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, txhash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKey) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKey].stakable += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKey].voting_weight += prevout.nValue * -1;
+                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash() || prevout.scriptPubKey.IsPayToPublicKey()) {
+                        CTxDestination destination;
+                        ExtractDestination(prevout.scriptPubKey, destination);
+                        CStockAddress address(destination);
+                        address.GetIndexKey(hashBytes, addressType);
+
+                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, txhash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKey) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKey].stakable += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKey].voting_weight += prevout.nValue * -1;
+                    } else if (prevout.scriptPubKey.IsColdStaking())
+                    {
+                        CTxDestination destination;
+                        uint160 hashBytesSpending, hashBytesStaking;
+                        CStockAddress addressStaking, addresssSpending;
+
+                        ExtractDestination(prevout.scriptPubKey, destination);
+                        CStockAddress address(destination);
+                        address.GetSpendingAddress(addresssSpending);
+                        address.GetIndexKey(hashBytes, addressType);
+                        addresssSpending.GetIndexKey(hashBytesSpending, addressType);
+
+                        CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, txhash, tx.nTime);
+                        CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, nHeight, i, txhash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKey) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        if (addressHistoryMap.count(addressHistoryKey2) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKey2].spendable += prevout.nValue * -1;
+
+                        address.GetStakingAddress(addressStaking);
+                        addressStaking.GetIndexKey(hashBytesStaking, dummyType);
+
+                        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, txhash, tx.nTime);
+                        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, txhash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        addressHistoryMap[addressHistoryKeyStaking].stakable += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKeyStaking].voting_weight += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKeyStaking2].stakable += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKeyStaking2].voting_weight += prevout.nValue * -1;
+
+                        hashBytes = hashBytesSpending;
+                    }
+                    else if (prevout.scriptPubKey.IsColdStakingv2())
+                    {
+                        CTxDestination destination;
+                        uint160 hashBytesStaking, hashBytesVoting, hashBytesSpending;
+                        CStockAddress addressStaking, addressVoting, addresssSpending;
+
+                        ExtractDestination(prevout.scriptPubKey, destination);
+                        CStockAddress address(destination);
+                        address.GetSpendingAddress(addresssSpending);
+                        address.GetIndexKey(hashBytes, addressType);
+                        addresssSpending.GetIndexKey(hashBytesSpending, addressType);
+
+                        CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, txhash, tx.nTime);
+                        CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, nHeight, i, txhash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKey) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        if (addressHistoryMap.count(addressHistoryKey2) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKey2].spendable += prevout.nValue * -1;
+
+                        address.GetStakingAddress(addressStaking);
+                        addressStaking.GetIndexKey(hashBytesStaking, dummyType);
+
+                        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, txhash, tx.nTime);
+                        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, txhash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        addressHistoryMap[addressHistoryKeyStaking].stakable += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKeyStaking2].stakable += prevout.nValue * -1;
+
+                        address.GetVotingAddress(addressVoting);
+                        addressVoting.GetIndexKey(hashBytesVoting, dummyType);
+
+                        CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), nHeight, i, txhash, tx.nTime);
+                        CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, nHeight, i, txhash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                        addressHistoryMap[addressHistoryKeyVoting].voting_weight += prevout.nValue * -1;
+                        addressHistoryMap[addressHistoryKeyVoting2].voting_weight += prevout.nValue * -1;
+
+                        hashBytes = hashBytesSpending;
+                    }
+                    else
+                    {
+                        hashBytes.SetNull();
+                        addressType = 0;
+                    }
+
+                    if (fAddressIndex && addressType > 0) {
+                        // record spending activity
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, j, true), prevout.nValue * -1));
+
+                        // remove address from unspent index
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                    }
+
+                    if (fSpentIndex) {
+                        // add the spent index to determine the txid and input that spent an output
+                        // and to find the amount and address from an input
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, nHeight, prevout.nValue, addressType, hashBytes)));
+                    }
+                }
+            }
+        }
+
+        if (fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut &out = tx.vout[k];
+
+                if (out.scriptPubKey.IsPayToScriptHash()) {
+                    std::vector<unsigned char> hashBytes_(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
+                    uint160 hashBytes(hashBytes_);
+
+                    // record receiving activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+                    // record unspent output
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+
+                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, txhash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKey) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
+
+                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
+                    addressHistoryMap[addressHistoryKey].stakable += out.nValue;
+                    addressHistoryMap[addressHistoryKey].voting_weight += out.nValue;
+                } else if (out.scriptPubKey.IsColdStaking())
+                {
+                    uint160 hashBytes, hashBytesStaking, hashBytesSpending;
+                    CStockAddress addressSpending, addressStaking;
+                    int type = 0;
+                    CTxDestination destination;
+                    ExtractDestination(out.scriptPubKey, destination);
+                    CStockAddress address(destination);
+                    address.GetSpendingAddress(addressSpending);
+                    address.GetIndexKey(hashBytes, type);
+                    addressSpending.GetIndexKey(hashBytesSpending, type);
+
+                    // record spending activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+                    // record unspent output
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+                    CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, txhash, tx.nTime);
+                    CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, nHeight, i, txhash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKey) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    if (addressHistoryMap.count(addressHistoryKey2) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
+                    addressHistoryMap[addressHistoryKey2].spendable += out.nValue;
+
+                    address.GetStakingAddress(addressStaking);
+                    addressStaking.GetIndexKey(hashBytesStaking, type);
+
+                    CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, txhash, tx.nTime);
+                    CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, txhash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    addressHistoryMap[addressHistoryKeyStaking].stakable += out.nValue;
+                    addressHistoryMap[addressHistoryKeyStaking].voting_weight += out.nValue;
+
+                    addressHistoryMap[addressHistoryKeyStaking2].stakable += out.nValue;
+                    addressHistoryMap[addressHistoryKeyStaking2].voting_weight += out.nValue;
+                }
+                else if (out.scriptPubKey.IsColdStakingv2())
+                {
+                    uint160 hashBytes, hashBytesStaking, hashBytesVoting, hashBytesSpending;
+                    CStockAddress addressSpending, addressStaking, addressVoting;
+
+                    int type = 0;
+                    CTxDestination destination;
+                    ExtractDestination(out.scriptPubKey, destination);
+                    CStockAddress address(destination);
+                    address.GetSpendingAddress(addressSpending);
+                    addressSpending.GetIndexKey(hashBytesSpending, type);
+                    address.GetIndexKey(hashBytes, type);
+
+                    // record spending activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+                    // record unspent output
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+                    CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, txhash, tx.nTime);
+                    CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, nHeight, i, txhash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKey) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
+
+                    if (addressHistoryMap.count(addressHistoryKey2) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    addressHistoryMap[addressHistoryKey2].spendable += out.nValue;
+
+                    address.GetVotingAddress(addressVoting);
+                    addressVoting.GetIndexKey(hashBytesVoting, type);
+
+                    CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), nHeight, i, txhash, tx.nTime);
+                    CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, nHeight, i, txhash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    addressHistoryMap[addressHistoryKeyVoting].voting_weight += out.nValue;
+
+                    if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    addressHistoryMap[addressHistoryKeyVoting2].voting_weight += out.nValue;
+
+                    address.GetStakingAddress(addressStaking);
+                    addressStaking.GetIndexKey(hashBytesStaking, type);
+
+                    CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, txhash, tx.nTime);
+                    CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, txhash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    addressHistoryMap[addressHistoryKeyStaking].stakable += out.nValue;
+
+                    if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    addressHistoryMap[addressHistoryKeyStaking2].stakable += out.nValue;
+                }
+                else if (out.scriptPubKey.IsPayToPublicKey() || out.scriptPubKey.IsPayToPublicKeyHash())
+                {
+                    uint160 hashBytes;
+                    int type = 0;
+                    CTxDestination destination;
+                    ExtractDestination(out.scriptPubKey, destination);
+                    CStockAddress address(destination);
+                    address.GetIndexKey(hashBytes, type);
+
+                    // record spending activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+                    // record unspent output
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, txhash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKey) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
+                    addressHistoryMap[addressHistoryKey].stakable += out.nValue;
+                    addressHistoryMap[addressHistoryKey].voting_weight += out.nValue;
+                } else {
+                    continue;
+                }
+
+            }
+        }
+    }
+
+    update.fConnect = true;
+    update.addressIndex.swap(addressIndex);
+    for (auto &it: addressHistoryMap)
+    {
+        update.addressHistory.push_back(std::make_pair(it.first, it.second));
+    }
+    update.addressUnspentIndex.swap(addressUnspentIndex);
+    update.spentIndex.swap(spentIndex);
+}
+
+void GetDisconnectIndexUpdate(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CIndexUpdate& update)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::map<CAddressHistoryKey, CAddressHistoryValue> addressHistoryMap;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
+    // undo transactions in reverse order
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction &tx = block.vtx[i];
+        uint256 hash = tx.GetHash();
+
+        if (fAddressIndex)
+        {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut &out = tx.vout[k];
+
+                if (out.scriptPubKey.IsPayToScriptHash()) {
+                    std::vector<unsigned char> hashBytes_(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
+
+                    uint160 hashBytes(hashBytes_);
+
+                    // undo receiving activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, hashBytes, nHeight, i, hash, k, false), out.nValue));
+
+                    // undo unspent index
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, hashBytes, hash, k), CAddressUnspentValue()));
+
+                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, hash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKey) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
+
+                }  else if (out.scriptPubKey.IsPayToPublicKey() || out.scriptPubKey.IsPayToPublicKeyHash()) {
+                    uint160 hashBytes;
+                    uint160 hashBytesStaking;
+                    uint160 hashBytesVoting;
+                    int type = 0;
+                    CTxDestination destination;
+                    ExtractDestination(out.scriptPubKey, destination);
+                    CStockAddress address(destination);
+                    address.GetIndexKey(hashBytes, type);
+
+                    // undo spending activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashBytes, nHeight, i, hash, k, false), out.nValue));
+
+                    // restore unspent index
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, hashBytes, hash, k), CAddressUnspentValue()));
+
+                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, hash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKey) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
+
+                } else if (out.scriptPubKey.IsColdStaking() || out.scriptPubKey.IsColdStakingv2()) {
+                    CStockAddress addressStaking, addressVoting, addressSpending;
+                    uint160 hashBytes, hashBytesSpending, hashBytesStaking, hashBytesVoting;
+                    int type = 0;
+
+                    CTxDestination destination;
+                    ExtractDestination(out.scriptPubKey, destination);
+                    CStockAddress address(destination);
+                    address.GetIndexKey(hashBytes, type);
+                    address.GetSpendingAddress(addressSpending);
+                    addressSpending.GetIndexKey(hashBytesSpending, type);
+
+                    // undo spending activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashBytes, nHeight, i, hash, k, false), out.nValue));
+
+                    // restore unspent index
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, hashBytesSpending, hash, k), CAddressUnspentValue()));
+
+                    CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, hash, tx.nTime);
+                    CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, nHeight, i, hash, tx.nTime);
+
+                    if (addressHistoryMap.count(addressHistoryKey) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
+
+                    if (addressHistoryMap.count(addressHistoryKey2) == 0)
+                        addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue()));
+
+                    if (out.scriptPubKey.IsColdStaking() || out.scriptPubKey.IsColdStakingv2())
+                    {
+                        address.GetStakingAddress(addressStaking);
+                        addressStaking.GetIndexKey(hashBytesStaking, type);
+                        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, hash, tx.nTime);
+                        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, hash, tx.nTime);
+                        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue()));
+                        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue()));
+                    }
+
+                    if (out.scriptPubKey.IsColdStakingv2())
+                    {
+                        address.GetVotingAddress(addressVoting);
+                        addressVoting.GetIndexKey(hashBytesVoting, type);
+                        CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), nHeight, i, hash, tx.nTime);
+                        CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, nHeight, i, hash, tx.nTime);
+                        if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue()));
+                        if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue()));
+                    }
+                } else {
+                    continue;
+                }
+
+            }
+
+        }
+
+        // restore inputs
+        if (i > 0) { // not coinbases
+            const CTxUndo &txundo = blockundo.vtxundo[i-1];
+            for (unsigned int j = tx.vin.size(); j-- > 0;) {
+                const CTxInUndo &undo = txundo.vprevout[j];
+                const CTxIn input = tx.vin[j];
+
+                if (fSpentIndex) {
+                    // undo and delete the spent index
+                    spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
+                }
+
+                if (fAddressIndex) {
+                    const CTxOut &prevout = undo.txout;
+                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
+                        std::vector<unsigned char> hashBytes_(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
+                        uint160 hashBytes(hashBytes_);
+
+                        // undo spending activity
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), nHeight, i, hash, j, true), prevout.nValue * -1));
+
+                        // restore unspent index
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
+
+                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, hash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKey) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
+                    }
+                    else if (prevout.scriptPubKey.IsPayToPublicKey() || prevout.scriptPubKey.IsPayToPublicKeyHash())
+                    {
+                        uint160 hashBytes;
+                        int type = 0;
+                        CTxDestination destination;
+                        ExtractDestination(prevout.scriptPubKey, destination);
+                        CStockAddress address(destination);
+                        address.GetIndexKey(hashBytes, type);
+
+                        // undo spending activity
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), nHeight, i, hash, j, true), prevout.nValue * -1));
+
+                        // restore unspent index
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
+
+                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, hash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKey) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
+                    }
+                    else if (prevout.scriptPubKey.IsColdStaking() || prevout.scriptPubKey.IsColdStakingv2())
+                    {
+                        CStockAddress addressStaking, addressVoting, addressSpending;
+
+                        uint160 hashBytes, hashBytesSpending, hashBytesStaking, hashBytesVoting;
+
+                        int type = 0;
+                        CTxDestination destination;
+
+                        ExtractDestination(prevout.scriptPubKey, destination);
+                        CStockAddress address(destination);
+
+                        if (prevout.scriptPubKey.IsColdStaking() || prevout.scriptPubKey.IsColdStakingv2())
+                            address.GetSpendingAddress(addressSpending);
+                        address.GetIndexKey(hashBytes, type);
+                        addressSpending.GetIndexKey(hashBytesSpending, type);
+
+                        // undo spending activity
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), nHeight, i, hash, j, true), prevout.nValue * -1));
+
+                        // restore unspent index
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
+
+                        CAddressHistoryKey addressHistoryKey(hashBytesSpending, hashBytesSpending, nHeight, i, hash, tx.nTime);
+                        CAddressHistoryKey addressHistoryKey2(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, hash, tx.nTime);
+
+                        if (addressHistoryMap.count(addressHistoryKey) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
+
+                        if (addressHistoryMap.count(addressHistoryKey2) == 0)
+                            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue()));
+
+                        if (prevout.scriptPubKey.IsColdStaking() || prevout.scriptPubKey.IsColdStakingv2())
+                        {
+                            address.GetStakingAddress(addressStaking);
+                            addressStaking.GetIndexKey(hashBytesStaking, type);
+                            CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, hash, tx.nTime);
+                            CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, hash, tx.nTime);
+                            if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+                                addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue()));
+                            if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+                                addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue()));
+                        }
+
+                        if (prevout.scriptPubKey.IsColdStakingv2())
+                        {
+                            address.GetVotingAddress(addressVoting);
+                            addressVoting.GetIndexKey(hashBytesVoting, type);
+                            CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), nHeight, i, hash, tx.nTime);
+                            CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, nHeight, i, hash, tx.nTime);
+                            if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
+                                addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue()));
+                            if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
+                                addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue()));
+                        }
+                    } else {
+                        continue;
+                    }
+                }
+            }
+        }
+    }
+
+    update.fConnect = false;
+    update.addressIndex.swap(addressIndex);
+    for (auto &it: addressHistoryMap)
+    {
+        update.addressHistory.push_back(std::make_pair(it.first, it.second));
+    }
+    update.addressUnspentIndex.swap(addressUnspentIndex);
+    update.spentIndex.swap(spentIndex);
+}
+
+CAsyncIndexer::CAsyncIndexer() : nQueued(0), nDone(0), fRunning(false), fStop(false), fFailed(false)
+{
+}
+
+CAsyncIndexer::~CAsyncIndexer()
+{
+    Stop();
+}
+
+CAsyncIndexer::Item CAsyncIndexer::MakeItem(const CBlockIndex* pindex, bool fConnect)
+{
+    Item item;
+    item.fConnect = fConnect;
+    item.posBlock = pindex->GetBlockPos();
+    item.posUndo = pindex->GetUndoPos();
+    item.hashBlock = pindex->GetBlockHash();
+    item.hashPrevBlock = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+    item.nHeight = pindex->nHeight;
+    item.nTime = pindex->nTime;
+    return item;
+}
+
+void CAsyncIndexer::Push(Item&& item)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // Do not let the blocks pile up in memory when indexing falls behind
+    while (fRunning && !fStop && queue.size() >= MAX_INDEX_QUEUE_BLOCKS)
+        condDone.wait(lock);
+    queue.push_back(std::move(item));
+    nQueued++;
+    condQueue.notify_one();
+}
+
+void CAsyncIndexer::BlockConnected(const CBlock& block, CBlockUndo&& blockundo, const CBlockIndex* pindex)
+{
+    Item item = MakeItem(pindex, true);
+    item.block = std::make_shared<const CBlock>(block);
+    item.blockundo = std::make_shared<const CBlockUndo>(std::move(blockundo));
+    Push(std::move(item));
+}
+
+void CAsyncIndexer::BlockDisconnected(const CBlock& block, CBlockUndo&& blockundo, const CBlockIndex* pindex)
+{
+    Item item = MakeItem(pindex, false);
+    item.block = std::make_shared<const CBlock>(block);
+    item.blockundo = std::make_shared<const CBlockUndo>(std::move(blockundo));
+    Push(std::move(item));
+}
+
+bool CAsyncIndexer::Process(std::vector<Item>& vItems)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    std::vector<CIndexUpdate> vUpdates(vItems.size());
+    // logical timestamps of this batch, not readable from the database yet
+    std::map<uint256, unsigned int> mapLogicalTS;
+
+    for (unsigned int n = 0; n < vItems.size(); n++) {
+        Item& item = vItems[n];
+        CIndexUpdate& update = vUpdates[n];
+
+        if (!item.block) {
+            std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+            std::shared_ptr<CBlockUndo> blockundo = std::make_shared<CBlockUndo>();
+            if (!ReadBlockFromDisk(*block, item.posBlock, consensusParams))
+                return error("%s: failed to read block %s", __func__, item.hashBlock.ToString());
+            if (item.posUndo.IsNull() || !UndoReadFromDisk(*blockundo, item.posUndo, item.hashPrevBlock))
+                return error("%s: failed to read undo data of block %s", __func__, item.hashBlock.ToString());
+            item.block = block;
+            item.blockundo = blockundo;
+        }
+
+        if (item.blockundo->vtxundo.size() + 1 != item.block->vtx.size())
+            return error("%s: block %s and undo data inconsistent", __func__, item.hashBlock.ToString());
+
+        if (item.fConnect)
+            GetConnectIndexUpdate(*item.block, *item.blockundo, item.nHeight, update);
+        else
+            GetDisconnectIndexUpdate(*item.block, *item.blockundo, item.nHeight, update);
+        update.hashBlock = item.hashBlock;
+
+        if (fTimestampIndex && item.fConnect) {
+            unsigned int logicalTS = item.nTime;
+            unsigned int prevLogicalTS = 0;
+
+            // retrieve logical timestamp of the previous block
+            if (mapLogicalTS.count(item.hashPrevBlock))
+                prevLogicalTS = mapLogicalTS[item.hashPrevBlock];
+            else if (!pblocktree->ReadTimestampBlockIndex(item.hashPrevBlock, prevLogicalTS))
+                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+            if (logicalTS <= prevLogicalTS) {
+                logicalTS = prevLogicalTS + 1;
+                LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, item.nTime, prevLogicalTS, logicalTS);
+            }
+
+            update.nLogicalTS = logicalTS;
+            mapLogicalTS[item.hashBlock] = logicalTS;
+        }
+
+        item.block.reset();
+        item.blockundo.reset();
+    }
+
+    if (!pblocktree->WriteIndexUpdates(vUpdates))
+        return error("%s: failed to write index updates", __func__);
+
+    LogPrint("bench", "    - Indexed %u blocks up to %s\n", vItems.size(), vItems.back().hashBlock.ToString());
+    return true;
+}
+
+void CAsyncIndexer::ThreadIndexer()
+{
+    RenameThread("stock-indexer");
+
+    while (true) {
+        std::vector<Item> vItems;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty() && !fStop)
+                condQueue.wait(lock);
+            if (queue.empty())
+                break;
+            while (!queue.empty() && vItems.size() < MAX_INDEX_BATCH_BLOCKS) {
+                vItems.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+
+        bool fOk = Process(vItems);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fOk) {
+            // Nothing more can be indexed without leaving a gap
+            fRunning = false;
+            fFailed = true;
+            condDone.notify_all();
+            strMiscWarning = _("Error: Failed to update the address index, restart with -reindex");
+            uiInterface.ThreadSafeMessageBox(strMiscWarning, "", CClientUIInterface::MSG_ERROR);
+            StartShutdown();
+            return;
+        }
+        const Item& last = vItems.back();
+        hashIndexed = last.fConnect ? last.hashBlock : last.hashPrevBlock;
+        nDone += vItems.size();
+        condDone.notify_all();
+    }
+}
+
+bool CAsyncIndexer::Start()
+{
+    AssertLockHeld(cs_main);
+
+    if (!fAddressIndex && !fSpentIndex && !fTimestampIndex)
+        return true;
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    uint256 hashBestIndexed;
+
+    std::vector<Item> vCatchUp;
+    if (!pblocktree->ReadIndexBestBlock(hashBestIndexed)) {
+        // Indexes written along with the blocks are as recent as the chain state
+        hashBestIndexed = pindexTip ? pindexTip->GetBlockHash() : uint256();
+        if (pindexTip && !pblocktree->WriteIndexBestBlock(hashBestIndexed))
+            return error("%s: failed to write the last indexed block", __func__);
+    } else if (pindexTip) {
+        // Without a tip the chain state is rebuilt, and the indexes with it
+        BlockMap::iterator mi = mapBlockIndex.find(hashBestIndexed);
+        if (mi == mapBlockIndex.end())
+            return error("%s: last indexed block %s is unknown", __func__, hashBestIndexed.ToString());
+
+        // Roll back the blocks indexed off the active chain, then index the missing ones
+        const CBlockIndex* pindexFork = chainActive.FindFork(mi->second);
+        for (const CBlockIndex* pindex = mi->second; pindex != pindexFork; pindex = pindex->pprev)
+            vCatchUp.push_back(MakeItem(pindex, false));
+        for (const CBlockIndex* pindex = chainActive.Next(pindexFork); pindex; pindex = chainActive.Next(pindex))
+            vCatchUp.push_back(MakeItem(pindex, true));
+
+        for (const Item& item: vCatchUp) {
+            const CBlockIndex* pindex = mapBlockIndex[item.hashBlock];
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !(pindex->nStatus & BLOCK_HAVE_UNDO))
+                return error("%s: block %s is missing to update the indexes", __func__, item.hashBlock.ToString());
+        }
+
+        if (!vCatchUp.empty())
+            LogPrintf("%s: indexes are %d blocks behind the chain, catching up from %s\n", __func__, vCatchUp.size(), hashBestIndexed.ToString());
+    }
+
+    // A thread which gave up has returned already
+    if (thread.joinable())
+        thread.join();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // The blocks queued before starting are on the active chain, hence in the catch-up already,
+    // and so are the ones of a batch which failed.
+    queue.assign(vCatchUp.begin(), vCatchUp.end());
+    nDone = nQueued;
+    nQueued += vCatchUp.size();
+    fStop = false;
+    fFailed = false;
+    fRunning = true;
+    hashIndexed = hashBestIndexed;
+    thread = boost::thread(&CAsyncIndexer::ThreadIndexer, this);
+    return true;
+}
+
+void CAsyncIndexer::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+        condQueue.notify_all();
+        condDone.notify_all();
+    }
+    if (thread.joinable())
+        thread.join();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fRunning = false;
+    condDone.notify_all();
+}
+
+bool CAsyncIndexer::Sync()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    uint64_t nTarget = nQueued;
+    while (fRunning && nDone < nTarget)
+        condDone.wait(lock);
+    return !fFailed;
+}
+
+uint256 CAsyncIndexer::GetIndexedBlock()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return hashIndexed;
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STOCK_INDEXER_H
+#define STOCK_INDEXER_H
+
+#include <chain.h>
+#include <primitives/block.h>
+#include <undo.h>
+#include <uint256.h>
+
+#include <deque>
+#include <memory>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+struct CIndexUpdate;
+
+/** Most blocks whose index entries are committed in a single batch */
+static const unsigned int MAX_INDEX_BATCH_BLOCKS = 1000;
+/** Blocks waiting to be indexed before connecting more blocks waits for the indexer */
+static const unsigned int MAX_INDEX_QUEUE_BLOCKS = 2 * MAX_INDEX_BATCH_BLOCKS;
+
+/** Compute the address and spent index entries added by connecting block. */
+void GetConnectIndexUpdate(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CIndexUpdate& update);
+/** Compute the address and spent index entries removed by disconnecting block. The address
+ *  history entries only carry their keys, their stored values are reversed when written. */
+void GetDisconnectIndexUpdate(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CIndexUpdate& update);
+
+/**
+ * Maintains the address, spent and timestamp indexes in the background.
+ *
+ * Connected and disconnected blocks are queued with their undo data and a
+ * thread turns them into index entries. The hash of the last block indexed
+ * is only recorded once the block index has been flushed with it, so after a
+ * crash it never points past the blocks and undo data on disk. Blocks indexed
+ * or connected after it are (re)indexed by the catch-up on Start().
+ */
+class CAsyncIndexer
+{
+private:
+    struct Item
+    {
+        bool fConnect;
+        //! null while it still has to be read from disk
+        std::shared_ptr<const CBlock> block;
+        std::shared_ptr<const CBlockUndo> blockundo;
+        CDiskBlockPos posBlock;
+        CDiskBlockPos posUndo;
+        uint256 hashBlock;
+        uint256 hashPrevBlock;
+        int nHeight;
+        unsigned int nTime;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable condQueue;
+    boost::condition_variable condDone;
+    std::deque<Item> queue;
+    //! items ever queued and ever committed, to wait for a given point of the queue
+    uint64_t nQueued;
+    uint64_t nDone;
+    bool fRunning;
+    bool fStop;
+    //! the thread gave up on a batch, the indexes miss the blocks after it
+    bool fFailed;
+    //! last block the committed index entries reflect
+    uint256 hashIndexed;
+    boost::thread thread;
+
+    void Push(Item&& item);
+    bool Process(std::vector<Item>& vItems);
+    void ThreadIndexer();
+
+    static Item MakeItem(const CBlockIndex* pindex, bool fConnect);
+
+public:
+    CAsyncIndexer();
+    ~CAsyncIndexer();
+
+    void BlockConnected(const CBlock& block, CBlockUndo&& blockundo, const CBlockIndex* pindex);
+    void BlockDisconnected(const CBlock& block, CBlockUndo&& blockundo, const CBlockIndex* pindex);
+
+    /**
+     * Queue the blocks needed to bring the indexes from their last indexed
+     * block to the active tip and start the thread. Blocks queued before are
+     * dropped, the catch-up covers them. Requires cs_main.
+     */
+    bool Start();
+    //! Write everything queued so far and stop the thread
+    void Stop();
+    //! Wait until everything queued so far is written, false if the indexer failed to write it
+    bool Sync();
+    //! The last block whose index entries are committed, null if the indexer never ran
+    uint256 GetIndexedBlock();
+};
+
+extern CAsyncIndexer asyncIndexer;
+
+#endif // STOCK_INDEXER_H
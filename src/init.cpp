@@ -21,12 +21,15 @@
 #include <blsct/aggregationsession.h>
 #include <blsct/rpc.h>
 #include <httpserver.h>
+#include <dnsserver.h>
 #include <httprpc.h>
+#include <indexer.h>
 #include <kernel.h>
 #include <key.h>
 #include <main.h>
 #include <miner.h>
 #include <net.h>
+#include <netpreprocess.h>
 #include <ntpclient.h>
 #include <policy/policy.h>
 #include <rpc/server.h>
@@ -226,6 +229,7 @@ void Interrupt(boost::thread_group& threadGroup)
     InterruptHTTPRPC();
     InterruptRPC();
     InterruptREST();
+    InterruptDNSServer();
     torController.Interrupt();
     threadGroup.interrupt_all();
 }
@@ -254,11 +258,13 @@ void PrepareShutdown()
     StopREST();
     StopRPC();
     StopHTTPServer();
+    StopDNSServer();
 #ifdef ENABLE_WALLET
     if (pwalletMain)
         pwalletMain->Flush(false);
 #endif
     StopNode();
+    msgPreprocessor.Stop();
     torController.Stop();
     UnregisterNodeSignals(GetNodeSignals());
 
@@ -273,6 +279,8 @@ void PrepareShutdown()
         fFeeEstimatesInitialized = false;
     }
 
+    asyncIndexer.Stop();
+
     {
         LOCK(cs_main);
         if (pcoinsTip != nullptr) {
@@ -389,6 +397,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
+    strUsage += HelpMessageOpt("-blockvotescache=<n>", strprintf(_("Keep the DAO votes of up to <n> blocks in memory (default: %u)"), DEFAULT_BLOCK_VOTES_CACHE));
     strUsage += HelpMessageOpt("-bootstrap=<url>", _("Specifies an URL from where a bootstrapped copy of the blockchain would be downloaded"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
@@ -401,6 +410,9 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-statecachebudget=<category>:<n>", _("Limit the in-memory cache of one kind of chain state (e.g. proposals, votes, consultations) to <n> megabytes, within the -dbcache total. Can be specified multiple times"));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-dbwritebehind", strprintf("Write the chainstate to disk on a background thread, serving reads from the pending batch meanwhile (default: %u)", DEFAULT_DB_WRITE_BEHIND));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
@@ -411,6 +423,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mininputvalue=<n>", strprintf(_("Sets the minimum value for an output to be considered as a coinstake kernel candidate")));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
                                                      -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-preprocthreads=<n>", strprintf(_("Set the number of threads decoding received transactions and blocks ahead of the message handler (0 to %d, default: %d)"),
+                                                                MAX_PREPROCESS_THREADS, DEFAULT_PREPROCESS_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), STOCK_PID_FILENAME));
 #endif
@@ -491,6 +505,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += CWallet::GetWalletHelpString(showDebug);
 #endif
 
+    strUsage += HelpMessageGroup(_("DNS server options:"));
+    strUsage += HelpMessageOpt("-dns", strprintf(_("Answer DNS queries for dotodyns names (default: %u)"), DEFAULT_DNS_SERVER));
+    strUsage += HelpMessageOpt("-dnsbind=<addr>", _("Bind the DNS server to given address. Use [host]:port notation for IPv6. This option can be specified multiple times (default: ::1 and 127.0.0.1)"));
+    strUsage += HelpMessageOpt("-dnsport=<port>", strprintf(_("Listen for DNS queries on <port> (default: %u)"), DEFAULT_DNS_PORT));
+    strUsage += HelpMessageOpt("-dnscachesize=<n>", strprintf(_("Keep at most <n> DNS answers cached until the next block (default: %u)"), DEFAULT_DNS_CACHE_SIZE));
+
 #if ENABLE_ZMQ
     strUsage += HelpMessageGroup(_("ZeroMQ notification options:"));
     strUsage += HelpMessageOpt("-zmqpubhashblock=<address>", _("Enable publish hash block in <address>"));
@@ -586,6 +606,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
+        strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf("Set the number of requests of a JSON-RPC batch that may run at the same time (default: %d)", DEFAULT_RPC_BATCH_THREADS));
     }
     strUsage += HelpMessageOpt("-headerspamfilter=<n>", strprintf(_("Use header spam filter (default: %u)"), DEFAULT_HEADER_SPAM_FILTER));
     strUsage += HelpMessageOpt("-headerspamfiltermaxsize=<n>", strprintf(_("Maximum size of the list of indexes in the header spam filter (default: %u)"), DEFAULT_HEADER_SPAM_FILTER_MAX_SIZE));
@@ -1112,12 +1133,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     nMinerSleep = GetArg("-minersleep", 500);
 
     // Make sure enough file descriptors are available
-    int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
     // Trim requested connection counts, to fit into system limitations
+#ifndef USE_EPOLL
+    // select() only handles sockets below FD_SETSIZE
+    int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+#endif
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1569,6 +1593,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    nBlockVotesCacheSize = std::max((int64_t)1, GetArg("-blockvotescache", DEFAULT_BLOCK_VOTES_CACHE));
+    for (const std::string& strBudget : mapMultiArgs["-statecachebudget"]) {
+        size_t nPos = strBudget.find(':');
+        int nCategory = STATE_CACHE_COINS + 1;
+        while (nPos != std::string::npos && nCategory < STATE_CACHE_CATEGORIES && strBudget.substr(0, nPos) != GetStateCacheCategoryName((StateCacheCategory)nCategory))
+            nCategory++;
+        int64_t nBudget;
+        if (nPos == std::string::npos || nCategory == STATE_CACHE_CATEGORIES || !ParseInt64(strBudget.substr(nPos + 1), &nBudget) || nBudget < 0 || nBudget > (std::numeric_limits<int64_t>::max() >> 20))
+            return InitError(strprintf(_("Invalid -statecachebudget '%s': expected <category>:<n> with a non-coin category and <n> in megabytes"), strBudget));
+        nStateCacheBudget[nCategory] = (size_t)nBudget << 20;
+    }
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     if (GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
@@ -1576,6 +1611,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    for (int c = STATE_CACHE_COINS + 1; c < STATE_CACHE_CATEGORIES; c++) {
+        if (nStateCacheBudget[c])
+            LogPrintf("* Using at most %.1fMiB for cached %s\n", nStateCacheBudget[c] * (1.0 / 1024 / 1024), GetStateCacheCategoryName((StateCacheCategory)c));
+    }
 
     bool fLoaded = false;
 
@@ -1596,7 +1635,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                 delete pblocktree;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
-                pcoinsdbview = new CStateViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
+                pcoinsdbview = new CStateViewDB(nCoinDBCache, false, fReindex || fReindexChainState, GetBoolArg("-dbwritebehind", DEFAULT_DB_WRITE_BEHIND));
 
                 pcoinscatcher = new CStateViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CStateViewCache(pcoinscatcher);
@@ -1636,12 +1675,22 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                     break;
                 }
 
+                if (!pcoinsdbview->UpgradeTokenUtxos() || !pcoinsdbview->UpgradeNameStates()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+
                 // Check for changed -addressindex state
                 if (fAddressIndex != GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
                     strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -addressindex");
                     break;
                 }
 
+                if (fAddressIndex && !pblocktree->UpgradeAddressSummaries()) {
+                    strLoadError = _("Error upgrading block database");
+                    break;
+                }
+
                 // Check for changed -spentindex state
                 if (fSpentIndex != GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
                     strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -spentindex");
@@ -1696,6 +1745,24 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                     break;
                 }
 
+                // Chainstates written before the unspent output statistics were
+                // tracked need a single full pass to seed them.
+                CStateStats stateStats;
+                if (!pcoinsTip->GetStateStats(stateStats)) {
+                    uiInterface.InitMessage(_("Computing UTXO set statistics..."));
+                    if (!ComputeStateStats(pcoinsdbview, stateStats)) {
+                        strLoadError = _("Error reading from database");
+                        break;
+                    }
+                    pcoinsTip->SetStateStats(stateStats);
+                    // Load the best block so the flush records which state the stats belong to.
+                    pcoinsTip->GetBestBlock();
+                    if (!pcoinsTip->Flush()) {
+                        strLoadError = _("Error writing to database");
+                        break;
+                    }
+                }
+
                 std::vector<CProposal> vProposals;
                 CProposalMap mapProposals;
 
@@ -1790,6 +1857,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    {
+        LOCK(cs_main);
+        if (!asyncIndexer.Start())
+            return InitError(_("Unable to bring the address, spent and timestamp indexes up to date. You need to rebuild the database using -reindex."));
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1884,6 +1957,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         torController.Start();
 
+    if (!StartDNSServer(scheduler))
+        return InitError(_("Unable to start DNS server. See debug log for details."));
+
+    msgPreprocessor.Start(std::max(0, std::min<int>(GetArg("-preprocthreads", DEFAULT_PREPROCESS_THREADS), MAX_PREPROCESS_THREADS)));
     StartNode(threadGroup, scheduler);
 
     // ********************************************************* Step 12: finished
@@ -19,9 +19,11 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
+#include <indexer.h>
 #include <init.h>
 #include <merkleblock.h>
 #include <net.h>
+#include <netpreprocess.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <pow.h>
@@ -45,6 +47,7 @@
 #include <wallet/wallet.h>
 
 #include <atomic>
+#include <list>
 #include <sstream>
 
 #include <boost/algorithm/string/join.hpp>
@@ -64,10 +67,10 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
-std::map<uint256,std::vector<std::pair<uint256, int>>> vProposalVotes;
-std::map<uint256,std::vector<std::pair<uint256, int>>> vPaymentRequestVotes;
-std::map<uint256,std::map<uint256, bool>> mapSupport;
-std::map<uint256,std::map<uint256, uint64_t>> mapConsultationVotes;
+unsigned int nBlockVotesCacheSize = DEFAULT_BLOCK_VOTES_CACHE;
+static void GetDirtyBlockVotes(std::vector<std::pair<CBlockVotesKey, std::shared_ptr<const CBlockVotes>>>& vVotes);
+static void ClearDirtyBlockVotes();
+static void UnloadBlockVotes();
 CChain chainActive;
 CBlockIndex *pindexBestHeader = nullptr;
 int64_t nTimeBestReceived = 0;
@@ -89,6 +92,7 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+size_t nStateCacheBudget[STATE_CACHE_CATEGORIES] = {};
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
@@ -239,6 +243,7 @@ struct QueuedBlock {
     CBlockIndex* pindex;                                     //!< Optional.
     bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
     std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+    int64_t nTime;                                           //!< When the block was requested (in microseconds).
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -251,12 +256,18 @@ int nPreferredDownload = 0;
 /** Dirty block index entries. */
 std::set<CBlockIndex*> setDirtyBlockIndex;
 
+/** Block index entries whose cold part may be in memory, see EvictBlockIndexCold. */
+std::set<uint256> setBlockIndexColdLoaded;
+
 /** Dirty block file entries. */
 std::set<int> setDirtyFileInfo;
 
 /** Number of peers from which we're downloading blocks. */
 int nPeersWithValidatedDownloads = 0;
 
+/** Moving average of the size of the full blocks received from peers, protected by cs_main. */
+int64_t nAvgBlockDownloadSize = 0;
+
 /** Relay map, protected by cs_main. */
 typedef std::map<uint256, std::shared_ptr<const CTransaction>> MapRelay;
 MapRelay mapRelay;
@@ -367,6 +378,8 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! How fast this peer sends us the blocks we request.
+    CBlockDownloadStats blockDownload;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -527,7 +540,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool, &stempool) : nullptr), GetTimeMicros()});
 
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
@@ -544,6 +557,97 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     return true;
 }
 
+static int64_t UpdateDownloadAverage(int64_t nAverage, int64_t nSample) {
+    return nAverage == 0 ? nSample : nAverage + (nSample - nAverage) / 4;
+}
+
+} // anon namespace
+
+void UpdateBlockDownloadStats(CBlockDownloadStats& stats, int64_t& nAvgBlockSize, unsigned int nBytes, int64_t nTimeRequested, int64_t nTimeReceived) {
+    nAvgBlockSize = UpdateDownloadAverage(nAvgBlockSize, nBytes);
+
+    if (stats.nLastReceived > nTimeRequested) {
+        // The peer was still sending us earlier blocks when this one was requested,
+        // so it has been sending this one since the previous one arrived.
+        stats.nSampleBytes += nBytes;
+        stats.nSampleTime += std::max<int64_t>(0, nTimeReceived - stats.nLastReceived);
+        if (stats.nSampleTime >= BLOCK_DOWNLOAD_RATE_SAMPLE_TIME) {
+            int64_t nRate = stats.nSampleBytes * 1000000 / stats.nSampleTime;
+            stats.nRate = UpdateDownloadAverage(stats.nRate, std::max<int64_t>(1, nRate));
+            stats.nSampleBytes = 0;
+            stats.nSampleTime = 0;
+        }
+    } else {
+        // The peer had nothing left to send, so the block took a round trip to arrive.
+        int64_t nLatency = nTimeReceived - nTimeRequested;
+        if (stats.nRate > 0)
+            nLatency -= (int64_t)nBytes * 1000000 / stats.nRate;
+        stats.nLatency = UpdateDownloadAverage(stats.nLatency, std::max<int64_t>(1, nLatency));
+    }
+    stats.nLastReceived = nTimeReceived;
+}
+
+int GetBlocksInTransitLimit(int64_t nRate, int64_t nLatency, int64_t nAvgBlockSize) {
+    if (nRate <= 0 || nAvgBlockSize <= 0)
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nBytes = nRate * (nLatency + BLOCK_DOWNLOAD_PIPELINE_TIME * 1000000) / 1000000;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER, nBytes / nAvgBlockSize));
+}
+
+int64_t GetExpectedBlockDownloadTime(int64_t nRate, int64_t nLatency, int nBlocksInFlight, int64_t nAvgBlockSize) {
+    if (nRate <= 0 || nAvgBlockSize <= 0)
+        return 0;
+    return nLatency + nBlocksInFlight * nAvgBlockSize * 1000000 / nRate;
+}
+
+int GetBlockDownloadWindow(int64_t nTotalRate, int64_t nAvgBlockSize) {
+    if (nAvgBlockSize <= 0)
+        return BLOCK_DOWNLOAD_WINDOW;
+    int64_t nWindow = nTotalRate * BLOCK_DOWNLOAD_WINDOW_TIME / nAvgBlockSize;
+    return std::max<int64_t>(BLOCK_DOWNLOAD_WINDOW, std::min<int64_t>(MAX_BLOCK_DOWNLOAD_WINDOW, nWindow));
+}
+
+int64_t GetBlockStallingTimeout(int64_t nExpectedTime) {
+    // A peer sending large blocks slowly is given the time it is expected to take.
+    return std::max<int64_t>(1000000 * BLOCK_STALLING_TIMEOUT, BLOCK_STALLING_EXPECTED_FACTOR * nExpectedTime);
+}
+
+int64_t GetBlockDownloadTimeout(int64_t nPowTargetSpacing, int nOtherPeersWithValidatedDownloads, int64_t nRate, int64_t nLatency, int64_t nAvgBlockSize) {
+    int64_t nTimeout = nPowTargetSpacing * (BLOCK_DOWNLOAD_TIMEOUT_BASE + BLOCK_DOWNLOAD_TIMEOUT_PER_PEER * nOtherPeersWithValidatedDownloads);
+    // Peers whose download rate is known are given a multiple of the time the first block should take.
+    if (nRate > 0 && nAvgBlockSize > 0) {
+        int64_t nExpected = nLatency + nAvgBlockSize * 1000000 / nRate;
+        nTimeout = std::min(nTimeout, std::max(BLOCK_DOWNLOAD_TIMEOUT_MIN * 1000000, BLOCK_DOWNLOAD_TIMEOUT_EXPECTED_FACTOR * nExpected));
+    }
+    return nTimeout;
+}
+
+namespace {
+
+// Requires cs_main.
+// Measure how fast a peer sends the blocks we request, before the block is marked as received.
+void UpdateBlockDownloadStats(NodeId nodeid, const uint256& hash, unsigned int nBytes, int64_t nTimeReceived) {
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    ::UpdateBlockDownloadStats(state->blockDownload, nAvgBlockDownloadSize, nBytes, itInFlight->second.second->nTime, nTimeReceived);
+}
+
+// Requires cs_main.
+int GetBlocksInTransitLimit(const CNodeState* state) {
+    return ::GetBlocksInTransitLimit(state->blockDownload.nRate, state->blockDownload.nLatency, nAvgBlockDownloadSize);
+}
+
+// Requires cs_main.
+int GetBlockDownloadWindow() {
+    int64_t nTotalRate = 0;
+    for (const std::pair<const NodeId, CNodeState>& item: mapNodeState)
+        nTotalRate += item.second.blockDownload.nRate;
+    return ::GetBlockDownloadWindow(nTotalRate, nAvgBlockDownloadSize);
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -672,10 +776,10 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
 
     std::vector<CBlockIndex*> vToFetch;
     CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
+    // Never fetch further than the best block we know the peer has, or more than the block download window + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + GetBlockDownloadWindow();
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
@@ -738,6 +842,9 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlockDownloadRate = state->blockDownload.nRate;
+    stats.nBlockDownloadLatency = state->blockDownload.nLatency;
+    stats.nBlocksInTransitLimit = GetBlocksInTransitLimit(state);
     return true;
 }
 
@@ -1276,13 +1383,13 @@ bool RemoveBLSCTConflicting(CTxMemPool& pool, const COutPoint& outpoint)
 
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCriticalSection *spcs, CValidationState& state, const CTransaction& tx, bool fLimitFree,
                               bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee,
-                              std::vector<uint256>& vHashTxnToUncache)
+                              std::vector<uint256>& vHashTxnToUncache, bool fPrechecked)
 {
     const uint256 hash = tx.GetHash();
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
         *pfMissingInputs = false;
-    if (!CheckTransaction(tx, state))
+    if (!fPrechecked && !CheckTransaction(tx, state))
         return false; // state filled in by CheckTransaction
 
     if (IsCommunityFundEnabled(chainActive.Tip(), Params().GetConsensus()) && tx.nVersion < CTransaction::TXDZEEL_VERSION_V2)
@@ -1513,11 +1620,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
                                 if (chainActive.Tip()->nHeight-recordvalue.height < 6)
                                     return state.DoS(100, false, REJECT_INVALID, "6-block-maturity-not-reached");
 
-                                NameDataValues data;
+                                NameDataState nameState;
 
-                                if (viewMemPool.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                                if (viewMemPool.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                                 {
-                                    auto mapData = DotStock::Consolidate(data, chainActive.Tip()->nHeight);
+                                    auto mapData = nameState.Get(chainActive.Tip()->nHeight);
                                     if (mapData.count("_key"))
                                         return state.DoS(100, false, REJECT_INVALID, strprintf("already-revealed:%s", program.sParameters[0]));
                                 }
@@ -1548,9 +1655,9 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
                                     return state.DoS(100, false, REJECT_INVALID, "name-could-not-update");
                                 if (!viewMemPool.AddNameData(hash, DotStock::GetHashName(program.sParameters[0]), std::make_pair(chainActive.Tip()->nHeight, NameDataValue(program.sParameters[2], program.sParameters[3], program.sParameters[1]))))
                                     return state.DoS(100, false, REJECT_INVALID, "name-could-not-update");
-                                if (viewMemPool.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                                if (viewMemPool.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                                 {
-                                    auto mapData = DotStock::Consolidate(data, chainActive.Tip()->nHeight);
+                                    auto mapData = nameState.Get(chainActive.Tip()->nHeight);
                                     if (!(txout.scriptPubKey.IsCommunityFundContribution() && txout.nValue >= std::floor(DotStock::CalculateSize(mapData)/GetConsensusParameter(Consensus::CONSENSUS_PARAMS_DOTSTOCK_MAXDATA, view))*GetConsensusParameter(Consensus::CONSENSUS_PARAMS_DOTSTOCK_FEE_EXTRADATA, view)))
                                         return state.DoS(100, false, REJECT_INVALID, "register-name-missing-contribution");
                                 } else {
@@ -1559,10 +1666,10 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
 
                                 LogPrint("dotstock", "%s: updated name first %s %s %s %s\n", __func__, program.sParameters[1], program.sParameters[0], program.sParameters[2], program.sParameters[3]);
                             } else if (program.action == UPDATE_NAME) {
-                                NameDataValues data;
-                                if (!view.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                                NameDataState nameState;
+                                if (!view.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                                     return state.DoS(100, false, REJECT_INVALID, strprintf("error-name:%s", program.sParameters[0]));
-                                auto mapData = DotStock::Consolidate(data, chainActive.Tip()->nHeight);
+                                auto mapData = nameState.Get(chainActive.Tip()->nHeight);
                                 if (!mapData.count("_key"))
                                     return state.DoS(100, false, REJECT_INVALID, "name-has-no-key");
                                 try {
@@ -1591,9 +1698,9 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
                                 if (!viewMemPool.AddNameData(hash, DotStock::GetHashName(program.sParameters[0]), std::make_pair(chainActive.Tip()->nHeight, NameDataValue(program.sParameters[2], program.sParameters[3], program.sParameters[1]))))
                                     return state.DoS(100, false, REJECT_INVALID, "name-could-not-update");
 
-                                if (viewMemPool.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                                if (viewMemPool.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                                 {
-                                    auto mapData = DotStock::Consolidate(data, chainActive.Tip()->nHeight);
+                                    auto mapData = nameState.Get(chainActive.Tip()->nHeight);
 
                                     if (!(txout.scriptPubKey.IsCommunityFundContribution() && txout.nValue >= std::floor(DotStock::CalculateSize(mapData)/GetConsensusParameter(Consensus::CONSENSUS_PARAMS_DOTSTOCK_MAXDATA, view))*GetConsensusParameter(Consensus::CONSENSUS_PARAMS_DOTSTOCK_FEE_EXTRADATA, view)))
                                         return state.DoS(100, false, REJECT_INVALID, "register-name-missing-contribution");
@@ -1605,11 +1712,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
                             } else if (program.action == RENEW_NAME) {
                                 if (!(txout.scriptPubKey.IsCommunityFundContribution() && txout.nValue >= GetConsensusParameter(Consensus::CONSENSUS_PARAM_STOCKNS_FEE, view)))
                                     return state.DoS(100, false, REJECT_INVALID, "renew-name-missing-contribution");
-                                NameDataValues data;
+                                NameDataState nameState;
 
-                                if (view.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                                if (view.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                                 {
-                                    auto mapData = DotStock::Consolidate(data, chainActive.Tip()->nHeight);
+                                    auto mapData = nameState.Get(chainActive.Tip()->nHeight);
                                     if (!mapData.count("_key"))
                                         return state.DoS(100, false, REJECT_INVALID, "name-not-active");
                                 } else {
@@ -2127,10 +2234,10 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
 }
 
 bool AcceptToMemoryPool(CTxMemPool& pool, CCriticalSection *mpcs, CCriticalSection *spcs, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount nAbsurdFee, bool fPrechecked)
 {
     std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, mpcs, spcs, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    bool res = AcceptToMemoryPoolWorker(pool, mpcs, spcs, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache, fPrechecked);
     if (res)
         LogPrintf("%s: Successfully added txn %s to %s.\n", __func__, tx.ToString(), (&pool == &mempool) ? "mempool" : "stempool");
     else
@@ -2147,6 +2254,8 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
 
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
     if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
@@ -2161,6 +2270,8 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
     if (!pblocktree->ReadSpentIndex(key, value))
         return false;
 
@@ -2185,30 +2296,105 @@ bool GetAddressHistory(uint160 addressHash, uint160 addressHash2,
     if (!fAddressIndex)
         return error("address index not enabled");
 
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
     if (!pblocktree->ReadAddressHistory(addressHash, addressHash2, addressHistory, filter, start, end))
         return error("unable to get history for address");
 
     return true;
 }
 
+bool GetAddressHistory(const CAddressHistoryKey &start, int end, size_t nLimit, AddressHistoryFilter filter,
+                       std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &addressHistory)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
+    if (!pblocktree->ReadAddressHistory(start, end, nLimit, filter, addressHistory))
+        return error("unable to get history for address");
+
+    return true;
+}
+
+bool GetAddressHistoryTotal(uint160 addressHash, uint160 addressHash2, AddressHistoryFilter filter, int nBelowHeight,
+                            CAddressHistoryValue &total)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
+    if (!pblocktree->SumAddressHistory(addressHash, addressHash2, filter, nBelowHeight, total))
+        return error("unable to get history for address");
+
+    return true;
+}
+
+bool GetAddressSummary(uint160 addressHash, uint160 addressHash2, CAddressSummaryValue &summary)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
+    if (!pblocktree->ReadAddressSummary(addressHash, addressHash2, summary))
+        return error("unable to get summary for address");
+
+    return true;
+}
+
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
     if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
 
     return true;
 }
 
+bool GetAddressIndex(const CAddressIndexKey &start, int end, size_t nLimit,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
+    if (!pblocktree->ReadAddressIndex(start, end, nLimit, addressIndex))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetAddressUnspent(const CAddressUnspentKey &start, size_t nLimit,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
+    if (!pblocktree->ReadAddressUnspentIndex(start, nLimit, unspentOutputs))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
+    if (!asyncIndexer.Sync())
+        return error("%s: the indexes are not up to date", __func__);
     if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
         return error("unable to get txids for address");
 
@@ -2339,6 +2525,56 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // Start at the index header written by WriteBlockToDisk in front of the block
+    CDiskBlockPos hpos = pos;
+    if (hpos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s: invalid block position %s", __func__, pos.ToString());
+    hpos.nPos -= MESSAGE_START_SIZE + sizeof(unsigned int);
+
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+        filein >> FLATDATA(blk_start) >> blk_size;
+
+        if (memcmp(blk_start, messageStart, MESSAGE_START_SIZE))
+            return error("%s: block magic mismatch at %s", __func__, pos.ToString());
+        if (blk_size > MAX_BLOCK_SERIALIZED_SIZE)
+            return error("%s: block size %u too large at %s", __func__, blk_size, pos.ToString());
+
+        block.resize(blk_size);
+        filein.read((char*)block.data(), blk_size);
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (!ReadRawBlockFromDisk(block, pindex->GetBlockPos(), messageStart))
+        return false;
+
+    // Only the header is decoded, to check the block is the one of the index
+    CBlockHeader header;
+    size_t nHeaderSize = ::GetSerializeSize(header, SER_DISK, CLIENT_VERSION);
+    if (block.size() < nHeaderSize)
+        return error("%s: block too short for %s at %s", __func__, pindex->ToString(), pindex->GetBlockPos().ToString());
+    CDataStream ssHeader((const char*)block.data(), (const char*)block.data() + nHeaderSize, SER_DISK, CLIENT_VERSION);
+    ssHeader >> header;
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__,
+                     pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
 
@@ -2519,7 +2755,7 @@ void static InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state
     }
 }
 
-void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, CTxUndo &txundo, int nHeight)
+void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, CTxUndo &txundo, int nHeight, CStateStats* pstats)
 {
     // mark inputs spent
     if (!tx.IsCoinBase()) {
@@ -2530,6 +2766,8 @@ void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, CTxUndo &txund
 
             if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
                 assert(false);
+            if (pstats)
+                pstats->RemoveOutput(txin.prevout.hash, nPos, coins->vout[nPos], coins->nHeight, coins->fCoinBase);
             // mark an outpoint spent, and construct undo information
             txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
             coins->Spend(nPos);
@@ -2538,11 +2776,16 @@ void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, CTxUndo &txund
                 undo.nHeight = coins->nHeight;
                 undo.fCoinBase = coins->fCoinBase;
                 undo.nVersion = coins->nVersion;
+                if (pstats)
+                    pstats->nTransactions--;
             }
         }
     }
     // add outputs
-    inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase())->FromTx(tx, nHeight);
+    CCoinsModifier outs = inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase());
+    outs->FromTx(tx, nHeight);
+    if (pstats)
+        pstats->AddCoins(tx.GetHash(), *outs);
 }
 
 void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, int nHeight)
@@ -2568,6 +2811,25 @@ int GetSpendHeight(const CStateViewCache& inputs)
     return pindexPrev->nHeight + 1;
 }
 
+/** View key the range proofs of BLSCT transactions are verified and recovered with */
+static bls::PrivateKey GetBLSCTVerifyViewKey()
+{
+    blsctKey v;
+    if (pwalletMain && pwalletMain->GetBLSCTViewKey(v))
+        return v.GetKey();
+
+    // Nothing is recovered without a wallet; keep the same key so prechecks can be reused
+    static const bls::PrivateKey dummyViewKey = bls::PrivateKey::FromBN(Scalar::Rand().bn);
+    return dummyViewKey;
+}
+
+bool PrecheckBLSCTTransaction(const CTransaction& tx, CValidationState& state)
+{
+    if (!tx.IsBLSCT() || tx.IsCoinStake())
+        return true;
+    return PrecheckBLSCT(tx, GetBLSCTVerifyViewKey(), state);
+}
+
 namespace Consensus {
 bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CStateViewCache& inputs, int nSpendHeight, std::vector<RangeproofEncodedData>& blsctData, const bool &fXStockSer, CAmount allowedInPrivate = 0)
 {
@@ -2639,12 +2901,7 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CState
     {
         try
         {
-            blsctKey v;
-
-            if (!(pwalletMain && pwalletMain->GetBLSCTViewKey(v)))
-                v = blsctKey(bls::PrivateKey::FromBN(Scalar::Rand().bn));
-
-            if (!tx.IsCoinStake() && !VerifyBLSCT(tx, v.GetKey(), blsctData, inputs, state, false, allowedInPrivate))
+            if (!tx.IsCoinStake() && !VerifyBLSCT(tx, GetBLSCTVerifyViewKey(), blsctData, inputs, state, false, allowedInPrivate))
                 return false;
         }
         catch(...)
@@ -2740,8 +2997,6 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CStateVi
     return true;
 }
 
-namespace {
-
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
@@ -2796,6 +3051,8 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -2823,11 +3080,13 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-static bool ApplyTxInUndo(const CTxInUndo& undo, CStateViewCache& view, const COutPoint& out)
+bool ApplyTxInUndo(const CTxInUndo& undo, CStateViewCache& view, const COutPoint& out, CStateStats* pstats)
 {
     bool fClean = true;
 
     CCoinsModifier coins = view.ModifyCoins(out.hash);
+    if (pstats && coins->IsPruned())
+        pstats->nTransactions++;
     if (undo.nHeight != 0) {
         // undo data contains height: this is the last output of the prevout tx being spent
         if (!coins->IsPruned())
@@ -2845,11 +3104,14 @@ static bool ApplyTxInUndo(const CTxInUndo& undo, CStateViewCache& view, const CO
     if (coins->vout.size() < out.n+1)
         coins->vout.resize(out.n+1);
     coins->vout[out.n] = undo.txout;
+    if (pstats)
+        pstats->AddOutput(out.hash, out.n, undo.txout, coins->nHeight, coins->fCoinBase);
 
     return fClean;
 }
 
-bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CStateViewCache& view, bool* pfClean)
+bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CStateViewCache& view, bool* pfClean,
+                     CBlockUndo* pblockundo)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -2868,12 +3130,10 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > addressHistory;
-    std::map<CAddressHistoryKey, CAddressHistoryValue> addressHistoryMap;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    CStateStats stats;
+    bool fStats = view.GetStateStats(stats);
+
     std::vector<std::pair<TokenUtxoKey, TokenUtxoValue> > tokenUtxoIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
 
     bool fCFund = IsCommunityFundEnabled(pindex->pprev, Params().GetConsensus());
     bool fDAOConsultations = IsDAOEnabled(pindex->pprev, Params().GetConsensus());
@@ -2916,7 +3176,9 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
             }
         }
 
-        for (auto& txout: tx.vout) {
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            const CTxOut &txout = tx.vout[j];
+
             if (txout.vData.size() > 0)
             {
                 try {
@@ -3011,112 +3273,11 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 
                     // Check if we have an nft
                     if (token->nVersion == 1) {
-                        if (view.HaveTokenUtxos(tokenIdHash))
-                            if (!view.RemoveTokenUtxo(TokenUtxoKey(tokenIdHash, pindex->nHeight)))
-                                return AbortNode(state, "Failed to remove token utxo from index");
-                    }
-                }
-            }
-        }
-
-        if (fAddressIndex)
-        {
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    std::vector<unsigned char> hashBytes_(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-
-                    uint160 hashBytes(hashBytes_);
-
-                    // undo receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, hashBytes, hash, k), CAddressUnspentValue()));
-
-                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, hash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
-
-                }  else if (out.scriptPubKey.IsPayToPublicKey() || out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    uint160 hashBytes;
-                    uint160 hashBytesStaking;
-                    uint160 hashBytesVoting;
-                    int type = 0;
-                    CTxDestination destination;
-                    ExtractDestination(out.scriptPubKey, destination);
-                    CStockAddress address(destination);
-                    address.GetIndexKey(hashBytes, type);
-
-                    // undo spending activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
-
-                    // restore unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, hashBytes, hash, k), CAddressUnspentValue()));
-
-                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, hash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
-
-                } else if (out.scriptPubKey.IsColdStaking() || out.scriptPubKey.IsColdStakingv2()) {
-                    CStockAddress addressStaking, addressVoting, addressSpending;
-                    uint160 hashBytes, hashBytesSpending, hashBytesStaking, hashBytesVoting;
-                    int type = 0;
-
-                    CTxDestination destination;
-                    ExtractDestination(out.scriptPubKey, destination);
-                    CStockAddress address(destination);
-                    address.GetIndexKey(hashBytes, type);
-                    address.GetSpendingAddress(addressSpending);
-                    addressSpending.GetIndexKey(hashBytesSpending, type);
-
-                    // undo spending activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
-
-                    // restore unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, hashBytesSpending, hash, k), CAddressUnspentValue()));
-
-                    CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, hash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, hash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
-
-                    if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue()));
-
-                    if (out.scriptPubKey.IsColdStaking() || out.scriptPubKey.IsColdStakingv2())
-                    {
-                        address.GetStakingAddress(addressStaking);
-                        addressStaking.GetIndexKey(hashBytesStaking, type);
-                        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, hash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, hash, tx.nTime);
-                        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue()));
-                        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue()));
-                    }
-
-                    if (out.scriptPubKey.IsColdStakingv2())
-                    {
-                        address.GetVotingAddress(addressVoting);
-                        addressVoting.GetIndexKey(hashBytesVoting, type);
-                        CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), pindex->nHeight, i, hash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, pindex->nHeight, i, hash, tx.nTime);
-                        if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue()));
-                        if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue()));
+                        if (!view.RemoveTokenUtxo(TokenUtxoKey(tokenIdHash, pindex->nHeight, hash, j)))
+                            return AbortNode(state, "Failed to remove token utxo from index");
                     }
-                } else {
-                    continue;
                 }
-
             }
-
         }
 
         // Check that all outputs are available and match the outputs in the block itself
@@ -3139,6 +3300,8 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                 fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted %d", *outs != outsBlock);
 
             // remove outputs
+            if (fStats)
+                stats.RemoveCoins(hash, *outs);
             outs->Clear();
         }
 
@@ -3150,113 +3313,9 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
                 const CTxInUndo &undo = txundo.vprevout[j];
-                if (!ApplyTxInUndo(undo, view, out))
+                if (!ApplyTxInUndo(undo, view, out, fStats ? &stats : nullptr))
                     fClean = false;
 
-                const CTxIn input = tx.vin[j];
-
-                if (fSpentIndex) {
-                    // undo and delete the spent index
-                    spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
-                }
-
-                if (fAddressIndex) {
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        std::vector<unsigned char> hashBytes_(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
-                        uint160 hashBytes(hashBytes_);
-
-                        // undo spending activity
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-
-                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, hash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
-                    }
-                    else if (prevout.scriptPubKey.IsPayToPublicKey() || prevout.scriptPubKey.IsPayToPublicKeyHash())
-                    {
-                        uint160 hashBytes;
-                        int type = 0;
-                        CTxDestination destination;
-                        ExtractDestination(prevout.scriptPubKey, destination);
-                        CStockAddress address(destination);
-                        address.GetIndexKey(hashBytes, type);
-
-                        // undo spending activity
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-
-                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, hash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
-                    }
-                    else if (prevout.scriptPubKey.IsColdStaking() || prevout.scriptPubKey.IsColdStakingv2())
-                    {
-                        CStockAddress addressStaking, addressVoting, addressSpending;
-
-                        uint160 hashBytes, hashBytesSpending, hashBytesStaking, hashBytesVoting;
-
-                        int type = 0;
-                        CTxDestination destination;
-
-                        ExtractDestination(prevout.scriptPubKey, destination);
-                        CStockAddress address(destination);
-
-                        if (prevout.scriptPubKey.IsColdStaking() || prevout.scriptPubKey.IsColdStakingv2())
-                            address.GetSpendingAddress(addressSpending);
-                        address.GetIndexKey(hashBytes, type);
-                        addressSpending.GetIndexKey(hashBytesSpending, type);
-
-                        // undo spending activity
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-
-                        CAddressHistoryKey addressHistoryKey(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, hash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKey2(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, hash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
-
-                        if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue()));
-
-                        if (prevout.scriptPubKey.IsColdStaking() || prevout.scriptPubKey.IsColdStakingv2())
-                        {
-                            address.GetStakingAddress(addressStaking);
-                            addressStaking.GetIndexKey(hashBytesStaking, type);
-                            CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, hash, tx.nTime);
-                            CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, hash, tx.nTime);
-                            if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                                addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue()));
-                            if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                                addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue()));
-                        }
-
-                        if (prevout.scriptPubKey.IsColdStakingv2())
-                        {
-                            address.GetVotingAddress(addressVoting);
-                            addressVoting.GetIndexKey(hashBytesVoting, type);
-                            CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), pindex->nHeight, i, hash, tx.nTime);
-                            CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, pindex->nHeight, i, hash, tx.nTime);
-                            if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
-                                addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue()));
-                            if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
-                                addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue()));
-                        }
-                    } else {
-                        continue;
-                    }
-                }
-
             }
         }
     }
@@ -3288,6 +3347,8 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 
                 proposal->fDirty = true;
 
+                MarkDAOEntryForUpdate(DAO_PROPOSAL, proposal->hash);
+
                 vSeen[(*pVotes)[i].first]=true;
             }
         }
@@ -3313,6 +3374,8 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 
                 prequest->fDirty = true;
 
+                MarkDAOEntryForUpdate(DAO_PAYMENT_REQUEST, prequest->hash);
+
                 vSeen[(*prVotes)[i].first]=true;
             }
         }
@@ -3329,6 +3392,7 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                     CConsultationModifier consultation = view.ModifyConsultation(it.first, pindex->nHeight);
                     consultation->nSupport = std::max(consultation->nSupport - 1, 0);
                     consultation->fDirty = true;
+                    MarkDAOEntryForUpdate(DAO_CONSULTATION, it.first);
                     vSeen[it.first] = true;
                 }
             }
@@ -3339,6 +3403,7 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                     CConsultationAnswerModifier answer = view.ModifyConsultationAnswer(it.first, pindex->nHeight);
                     answer->nSupport = std::max(answer->nSupport - 1, 0);
                     answer->fDirty = true;
+                    MarkDAOEntryForUpdate(DAO_CONSULTATION_ANSWER, it.first);
                     vSeen[it.first] = true;
                 }
             }
@@ -3357,12 +3422,14 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                 else
                     mConsultation->mapVotes[it.second] = std::max(mConsultation->mapVotes[it.second] - (uint64_t)1, (uint64_t)0);
                 mConsultation->fDirty = true;
+                MarkDAOEntryForUpdate(DAO_CONSULTATION, it.first);
             }
             else if (view.HaveConsultationAnswer(it.first))
             {
                 CConsultationAnswerModifier mConsultationAnswer = view.ModifyConsultationAnswer(it.first, pindex->nHeight);
                 mConsultationAnswer->nVotes = std::max(mConsultationAnswer->nVotes - (uint64_t)1, (uint64_t)0);
                 mConsultationAnswer->fDirty = true;
+                MarkDAOEntryForUpdate(DAO_CONSULTATION_ANSWER, it.first);
             }
         }
     }
@@ -3375,20 +3442,45 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 
     if (fStake && fVoteCacheState && fCFund && !(pindex->nNonce & 1 && !fStakerIsColdStakingv2))
     {
-        CVoteMap baseMap;
+        LogPrint("daoextra", "%s: Clearing votes at height %d\n", __func__, pindex->nHeight);
 
-        if (!view.GetAllVotes(baseMap))
-            return AbortNode(state, "Failed to get voters list");
+        auto pVoters = GetBlockVoters(block.GetHash());
 
-        LogPrint("daoextra", "%s: Clearing votes at height %d\n", __func__, pindex->nHeight);
+        if (pVoters != nullptr)
+        {
+            for (const CVoteMapKey& voter: *pVoters)
+            {
+                CVoteModifier mVote = view.ModifyVote(voter, pindex->nHeight);
+                mVote->Clear(pindex->nHeight);
+            }
+
+            // Restore the history merged while this block was connected, so
+            // deeper blocks can be disconnected next.
+            auto pCompacted = GetBlockCompactedVotes(block.GetHash());
 
-        for (auto&it: baseMap)
+            if (pCompacted != nullptr)
+            {
+                for (auto& it: *pCompacted)
+                {
+                    CVoteModifier mVote = view.ModifyVote(it.first, pindex->nHeight);
+                    mVote->Uncompact(it.second);
+                }
+            }
+        }
+        else
         {
-            CVoteList pVoteList;
-            view.GetCachedVoter(it.first, pVoteList);
-            CVoteModifier mVote = view.ModifyVote(it.first, pindex->nHeight);
-            mVote->Clear(pindex->nHeight);
-            mVote->fDirty = true;
+            // Blocks connected before voters were indexed
+            CVoteMap baseMap;
+
+            if (!view.GetAllVotes(baseMap))
+                return AbortNode(state, "Failed to get voters list");
+
+            for (auto&it: baseMap)
+            {
+                CVoteModifier mVote = view.ModifyVote(it.first, pindex->nHeight);
+                mVote->Clear(pindex->nHeight);
+                mVote->fDirty = true;
+            }
         }
     }
 
@@ -3399,29 +3491,18 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     }
 
     // move best block pointer to prevout block
+    if (fStats)
+        view.SetStateStats(stats);
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
+    if (pblockundo)
+        *pblockundo = std::move(blockUndo);
+
     if (pfClean) {
         *pfClean = fClean;
         return true;
     }
 
-    if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to delete address index");
-        }
-        for (auto &it: addressHistoryMap)
-        {
-            addressHistory.push_back(std::make_pair(it.first, it.second));
-        }
-        if (!pblocktree->EraseAddressHistory(addressHistory)) {
-            return AbortNode(state, "Failed to delete address history");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
     return fClean;
 }
 
@@ -3872,15 +3953,15 @@ static int64_t nTimeTotal = 0;
 
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
                   CStateViewCache& view, const CChainParams& chainparams, std::map<int, std::vector<RangeproofEncodedData>>& blsctData,
-                  bool fJustCheck, bool fProofOfStake)
+                  bool fJustCheck, bool fProofOfStake, CBlockUndo* pblockundo)
 {
 
     AssertLockHeld(cs_main);
 
-    pindex->nCFSupply = pindex->pprev != NULL ? pindex->pprev->nCFSupply : 0;
-    pindex->nCFLocked = pindex->pprev != NULL ? pindex->pprev->nCFLocked : 0;
-    pindex->nPrivateMoneySupply = pindex->pprev != NULL ? pindex->pprev->nPrivateMoneySupply : 0;
-    pindex->nPublicMoneySupply = pindex->pprev != NULL ? pindex->pprev->nPublicMoneySupply : 0;
+    pindex->Cold().nCFSupply = pindex->pprev != NULL ? pindex->pprev->GetCold().nCFSupply : 0;
+    pindex->Cold().nCFLocked = pindex->pprev != NULL ? pindex->pprev->GetCold().nCFLocked : 0;
+    pindex->Cold().nPrivateMoneySupply = pindex->pprev != NULL ? pindex->pprev->GetCold().nPrivateMoneySupply : 0;
+    pindex->Cold().nPublicMoneySupply = pindex->pprev != NULL ? pindex->pprev->GetCold().nPublicMoneySupply : 0;
 
     CAmount nCreated = 0;
     CAmount nMovedToPublic = 0;
@@ -3949,7 +4030,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(1,error("ContextualCheckBlock() : SetStakeEntropyBit() failed"), REJECT_INVALID, "bad-entropy-bit");
 
     // Record proof hash value
-    pindex->hashProof = hashProof;
+    pindex->Cold().hashProof = hashProof;
     uint64_t nStakeModifier = 0;
     bool fGeneratedStakeModifier = false;
     if (!ComputeNextStakeModifier(pindex->pprev, nStakeModifier, fGeneratedStakeModifier))
@@ -4049,12 +4130,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > addressHistory;
-    std::map<CAddressHistoryKey, CAddressHistoryValue> addressHistoryMap;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<TokenUtxoKey, TokenUtxoValue> > tokenUtxoIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
     std::vector<PrecomputedTransactionData> txdata;
@@ -4069,6 +4145,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     bool fDAOConsultations = IsDAOEnabled(pindex->pprev, Params().GetConsensus());
     bool fColdStakingv2 = IsColdStakingv2Enabled(pindex->pprev, Params().GetConsensus());
 
+    // Index the voters changed by this block, even if there are none, so
+    // DisconnectBlock only has to revisit those.
+    if (fStake && fVoteCacheState)
+        IndexBlockVoters(block.GetHash());
+
     CAmount nFundContributionPerBlock = GetFundContributionPerBlock(view);
 
     std::vector<unsigned char> stakerScript;
@@ -4098,6 +4179,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     std::map<std::pair<std::vector<unsigned char>, uint256>, int> votes;
 
+    // Keep the running unspent output set statistics in step with the view.
+    CStateStats stats;
+    bool fStats = !fJustCheck && view.GetStateStats(stats);
+
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
@@ -4206,7 +4291,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                 {
                                     CVoteModifier mVote = view.ModifyVote(voterScript, pindex->nHeight);
                                     mVote->Set(pindex->nHeight, hash, vote);
+                                    std::map<int, std::map<uint256, int64_t>> mapCompacted;
+                                    if (mVote->Compact(pindex->nHeight - VOTE_HISTORY_COMPACTION_DEPTH, &mapCompacted))
+                                        AddBlockCompactedVotes(block.GetHash(), voterScript, mapCompacted);
                                     mVote->fDirty = true;
+                                    AddBlockVoter(block.GetHash(), voterScript);
                                     LogPrint("daoextra", "%s: Setting consultation vote for voter %s at height %d - hash: %s vote: %d\n", __func__, HexStr(voterScript), pindex->nHeight, hash.ToString(), vote);
                                 }
                                 else
@@ -4224,7 +4313,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                 votes[std::make_pair(voterScript, hash)] = vote;
                                 CVoteModifier mVote = view.ModifyVote(voterScript, pindex->nHeight);
                                 mVote->Set(pindex->nHeight, hash, vote);
+                                std::map<int, std::map<uint256, int64_t>> mapCompacted;
+                                if (mVote->Compact(pindex->nHeight - VOTE_HISTORY_COMPACTION_DEPTH, &mapCompacted))
+                                    AddBlockCompactedVotes(block.GetHash(), voterScript, mapCompacted);
                                 mVote->fDirty = true;
+                                AddBlockVoter(block.GetHash(), voterScript);
                                 LogPrint("daoextra", "%s: Setting vote for voter %s at height %d - hash: %s vote: %d\n", __func__, HexStr(voterScript), pindex->nHeight, hash.ToString(), vote);
                             } else if (fDAOConsultations && fSupport) {
                                 LogPrint("daoextra", "%s: did not add support vote for %s because %d %d %d %d\n", __func__,  hash.ToString(),
@@ -4241,26 +4334,26 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             if (fCFund && (fProposal && view.GetProposal(hash, proposal) && proposal.CanVote(view)))
                             {
                                 LogPrint("daoextra", "%s: Adding vote at height %d - hash: %s vote: %d\n", __func__, pindex->nHeight, hash.ToString(), vote);
-                                InsertProposalVotes(block.GetHash())->push_back(std::make_pair(hash, vote));
+                                AddProposalVote(block.GetHash(), hash, vote);
                             }
                             else if (fCFund && (fPaymentRequest && view.GetPaymentRequest(hash, prequest) && prequest.CanVote(view)))
                             {
                                 LogPrint("daoextra", "%s: Adding vote at height %d - hash: %s vote: %d\n", __func__, pindex->nHeight, hash.ToString(), vote);
-                                InsertPaymentRequestVotes(block.GetHash())->push_back(std::make_pair(hash, vote));
+                                AddPaymentRequestVote(block.GetHash(), hash, vote);
                             }
                             else if(fDAOConsultations && fSupport &&
                                     ((view.GetConsultation(hash, consultation) && consultation.CanBeSupported()) ||
                                      (view.GetConsultationAnswer(hash, answer) && answer.CanBeSupported(view))))
                             {
                                 LogPrint("daoextra", "%s: Adding support vote at height %d - hash: %s\n", __func__, pindex->nHeight, hash.ToString());
-                                InsertSupport(block.GetHash())->insert(std::make_pair(hash, true));
+                                AddSupport(block.GetHash(), hash);
                             }
                             else if (fDAOConsultations && fConsultation && !fSupport && vote != VoteFlags::VOTE_REMOVE)
                             {
                                 if ((view.GetConsultation(hash, consultation) && (consultation.CanBeVoted(vote) && consultation.IsValidVote(vote))))
                                 {
                                     LogPrint("daoextra", "%s: Adding consultation vote at height %d - hash: %s vote: %d\n", __func__, pindex->nHeight, hash.ToString(), vote);
-                                    InsertConsultationVotes(block.GetHash())->insert(std::make_pair(hash, vote));
+                                    AddConsultationVote(block.GetHash(), hash, vote);
                                 }
                                 else
                                 {
@@ -4273,7 +4366,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                         if (mapCountAnswers[answer.parent] > mapCacheMaxAnswers[answer.parent])
                                             continue;
                                         LogPrint("daoextra", "%s: Adding consultation answer vote at height %d - hash: %s vote: %d\n", __func__, pindex->nHeight, hash.ToString(), vote);
-                                        InsertConsultationVotes(block.GetHash())->insert(std::make_pair(hash, vote));
+                                        AddConsultationVote(block.GetHash(), hash, vote);
                                     }
                                     else
                                     {
@@ -4355,162 +4448,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 return state.DoS(100, error("%s: contains a non-BIP68-final transaction", __func__),
                                  REJECT_INVALID, "bad-txns-nonfinal");
             }
-
-            if (fAddressIndex || fSpentIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-                    uint160 hashBytes;
-                    int addressType, dummyType;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        std::vector<unsigned char> hashBytes_(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
-                        uint160 hashBytes(hashBytes_);
-                        addressType = 2;
-
-                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey].voting_weight += prevout.nValue * -1;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash() || prevout.scriptPubKey.IsPayToPublicKey()) {
-                        CTxDestination destination;
-                        ExtractDestination(prevout.scriptPubKey, destination);
-                        CStockAddress address(destination);
-                        address.GetIndexKey(hashBytes, addressType);
-
-                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey].voting_weight += prevout.nValue * -1;
-                    } else if (prevout.scriptPubKey.IsColdStaking())
-                    {
-                        CTxDestination destination;
-                        uint160 hashBytesSpending, hashBytesStaking;
-                        CStockAddress addressStaking, addresssSpending;
-
-                        ExtractDestination(prevout.scriptPubKey, destination);
-                        CStockAddress address(destination);
-                        address.GetSpendingAddress(addresssSpending);
-                        address.GetIndexKey(hashBytes, addressType);
-                        addresssSpending.GetIndexKey(hashBytesSpending, addressType);
-
-                        CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey2].spendable += prevout.nValue * -1;
-
-                        address.GetStakingAddress(addressStaking);
-                        addressStaking.GetIndexKey(hashBytesStaking, dummyType);
-
-                        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKeyStaking].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyStaking].voting_weight += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyStaking2].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyStaking2].voting_weight += prevout.nValue * -1;
-
-                        hashBytes = hashBytesSpending;
-                    }
-                    else if (prevout.scriptPubKey.IsColdStakingv2())
-                    {
-                        CTxDestination destination;
-                        uint160 hashBytesStaking, hashBytesVoting, hashBytesSpending;
-                        CStockAddress addressStaking, addressVoting, addresssSpending;
-
-                        ExtractDestination(prevout.scriptPubKey, destination);
-                        CStockAddress address(destination);
-                        address.GetSpendingAddress(addresssSpending);
-                        address.GetIndexKey(hashBytes, addressType);
-                        addresssSpending.GetIndexKey(hashBytesSpending, addressType);
-
-                        CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey2].spendable += prevout.nValue * -1;
-
-                        address.GetStakingAddress(addressStaking);
-                        addressStaking.GetIndexKey(hashBytesStaking, dummyType);
-
-                        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKeyStaking].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyStaking2].stakable += prevout.nValue * -1;
-
-                        address.GetVotingAddress(addressVoting);
-                        addressVoting.GetIndexKey(hashBytesVoting, dummyType);
-
-                        CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKeyVoting].voting_weight += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyVoting2].voting_weight += prevout.nValue * -1;
-
-                        hashBytes = hashBytesSpending;
-                    }
-                    else
-                    {
-                        hashBytes.SetNull();
-                        addressType = 0;
-                    }
-
-                    if (fAddressIndex && addressType > 0) {
-                        // record spending activity
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
-
-                        // remove address from unspent index
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                    }
-
-                    if (fSpentIndex) {
-                        // add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input
-                        spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
-                    }
-                }
-            }
         }
 
         // GetTransactionSigOpCost counts 3 types of sigops:
@@ -4545,7 +4482,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if (tx.IsCoinStake())
             {
                 nStakeReward = tx.GetValueOut() - view.GetValueIn(tx);
-                pindex->strDZeel = tx.strDZeel;
+                pindex->Cold().strDZeel = tx.strDZeel;
 
                 if(IsCommunityFundAccumulationEnabled(pindex->pprev, Params().GetConsensus(), false))
                 {
@@ -4564,198 +4501,37 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             return state.DoS(100, error("ConnectBlock(): block pays incorrect amount to community fund (actual=%d vs consensus=%d)",
                                                         tx.vout[tx.vout.size() - 1].nValue, nFundContributionPerBlock * nMultiplier),
                                     REJECT_INVALID, "bad-cf-amount");
-                    } else {
-                        if(tx.vout[tx.vout.size() - 1].nValue != Params().GetConsensus().nCommunityFundAmount * nMultiplier && nMultiplier > 0)
-                            return state.DoS(100, error("ConnectBlock(): block pays incorrect amount to community fund (actual=%d vs consensus=%d)",
-                                                        tx.vout[tx.vout.size() - 1].nValue, Params().GetConsensus().nCommunityFundAmount * nMultiplier),
-                                    REJECT_INVALID, "bad-cf-amount");
-                    }
-
-
-                    if(IsCommunityFundAmountV2Enabled(pindex->pprev, Params().GetConsensus()))
-                    {
-                        nStakeReward -= nFundContributionPerBlock * nMultiplier;
-                    } else {
-                        nStakeReward -= Params().GetConsensus().nCommunityFundAmount * nMultiplier;
-                    }
-                }
-            }
-
-            bool fXStockSer = IsXStockSerEnabled(pindex->pprev, Params().GetConsensus());
-
-            std::vector<CScriptCheck> vChecks;
-            std::vector<RangeproofEncodedData> dummyData;
-            bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, tx.IsCTOutput()?blsctData[i]:dummyData, txdata[i], fXStockSer, nScriptCheckThreads ? &vChecks : nullptr))
-                return error("ConnectBlock(): CheckInputs on %s failed with %s",
-                             tx.GetHash().ToString(), FormatStateMessage(state));
-            control.Add(vChecks);
-
-        } else {
-            if (tx.nTime < block.nTime && pindex->nHeight > Params().GetConsensus().nCoinbaseTimeActivationHeight)
-                return error("ConnectBlock(): Coinbase timestamp doesn't meet protocol (tx=%d vs block=%d)",
-                             tx.nTime, block.nTime);
-        }
-
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    std::vector<unsigned char> hashBytes_(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-                    uint160 hashBytes(hashBytes_);
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
-
-                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
-                    addressHistoryMap[addressHistoryKey].stakable += out.nValue;
-                    addressHistoryMap[addressHistoryKey].voting_weight += out.nValue;
-                } else if (out.scriptPubKey.IsColdStaking())
-                {
-                    uint160 hashBytes, hashBytesStaking, hashBytesSpending;
-                    CStockAddress addressSpending, addressStaking;
-                    int type = 0;
-                    CTxDestination destination;
-                    ExtractDestination(out.scriptPubKey, destination);
-                    CStockAddress address(destination);
-                    address.GetSpendingAddress(addressSpending);
-                    address.GetIndexKey(hashBytes, type);
-                    addressSpending.GetIndexKey(hashBytesSpending, type);
-
-                    // record spending activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                    CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
-                    addressHistoryMap[addressHistoryKey2].spendable += out.nValue;
-
-                    address.GetStakingAddress(addressStaking);
-                    addressStaking.GetIndexKey(hashBytesStaking, type);
-
-                    CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKeyStaking].stakable += out.nValue;
-                    addressHistoryMap[addressHistoryKeyStaking].voting_weight += out.nValue;
-
-                    addressHistoryMap[addressHistoryKeyStaking2].stakable += out.nValue;
-                    addressHistoryMap[addressHistoryKeyStaking2].voting_weight += out.nValue;
-                }
-                else if (out.scriptPubKey.IsColdStakingv2())
-                {
-                    uint160 hashBytes, hashBytesStaking, hashBytesVoting, hashBytesSpending;
-                    CStockAddress addressSpending, addressStaking, addressVoting;
-
-                    int type = 0;
-                    CTxDestination destination;
-                    ExtractDestination(out.scriptPubKey, destination);
-                    CStockAddress address(destination);
-                    address.GetSpendingAddress(addressSpending);
-                    addressSpending.GetIndexKey(hashBytesSpending, type);
-                    address.GetIndexKey(hashBytes, type);
-
-                    // record spending activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                    CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
-
-                    if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKey2].spendable += out.nValue;
-
-                    address.GetVotingAddress(addressVoting);
-                    addressVoting.GetIndexKey(hashBytesVoting, type);
-
-                    CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKeyVoting].voting_weight += out.nValue;
-
-                    if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKeyVoting2].voting_weight += out.nValue;
-
-                    address.GetStakingAddress(addressStaking);
-                    addressStaking.GetIndexKey(hashBytesStaking, type);
-
-                    CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, txhash, tx.nTime);
+                    } else {
+                        if(tx.vout[tx.vout.size() - 1].nValue != Params().GetConsensus().nCommunityFundAmount * nMultiplier && nMultiplier > 0)
+                            return state.DoS(100, error("ConnectBlock(): block pays incorrect amount to community fund (actual=%d vs consensus=%d)",
+                                                        tx.vout[tx.vout.size() - 1].nValue, Params().GetConsensus().nCommunityFundAmount * nMultiplier),
+                                    REJECT_INVALID, "bad-cf-amount");
+                    }
 
-                    if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
 
-                    addressHistoryMap[addressHistoryKeyStaking].stakable += out.nValue;
+                    if(IsCommunityFundAmountV2Enabled(pindex->pprev, Params().GetConsensus()))
+                    {
+                        nStakeReward -= nFundContributionPerBlock * nMultiplier;
+                    } else {
+                        nStakeReward -= Params().GetConsensus().nCommunityFundAmount * nMultiplier;
+                    }
+                }
+            }
 
-                    if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+            bool fXStockSer = IsXStockSerEnabled(pindex->pprev, Params().GetConsensus());
 
-                    addressHistoryMap[addressHistoryKeyStaking2].stakable += out.nValue;
-                }
-                else if (out.scriptPubKey.IsPayToPublicKey() || out.scriptPubKey.IsPayToPublicKeyHash())
-                {
-                    uint160 hashBytes;
-                    int type = 0;
-                    CTxDestination destination;
-                    ExtractDestination(out.scriptPubKey, destination);
-                    CStockAddress address(destination);
-                    address.GetIndexKey(hashBytes, type);
-
-                    // record spending activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(type, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
-                    addressHistoryMap[addressHistoryKey].stakable += out.nValue;
-                    addressHistoryMap[addressHistoryKey].voting_weight += out.nValue;
-                } else {
-                    continue;
-                }
+            std::vector<CScriptCheck> vChecks;
+            std::vector<RangeproofEncodedData> dummyData;
+            bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, tx.IsCTOutput()?blsctData[i]:dummyData, txdata[i], fXStockSer, nScriptCheckThreads ? &vChecks : nullptr))
+                return error("ConnectBlock(): CheckInputs on %s failed with %s",
+                             tx.GetHash().ToString(), FormatStateMessage(state));
+            control.Add(vChecks);
 
-            }
+        } else {
+            if (tx.nTime < block.nTime && pindex->nHeight > Params().GetConsensus().nCoinbaseTimeActivationHeight)
+                return error("ConnectBlock(): Coinbase timestamp doesn't meet protocol (tx=%d vs block=%d)",
+                             tx.nTime, block.nTime);
         }
 
         bool fContribution = false;
@@ -4776,10 +4552,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if(vout.IsCommunityFundContribution())
             {
                 fContribution=true;
-                pindex->nCFSupply += vout.nValue;
+                pindex->Cold().nCFSupply += vout.nValue;
                 nProposalFee += vout.nValue;
                 nCreated -= vout.nValue;
-                LogPrint("daoextra", "%s: Updated DAO Fund supply to %d\n", __func__, pindex->nCFSupply);
+                LogPrint("daoextra", "%s: Updated DAO Fund supply to %d\n", __func__, pindex->GetCold().nCFSupply);
             }
 
             if (vout.vData.size() > 0)
@@ -4894,11 +4670,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             if (pindex->nHeight-recordvalue.height < 6)
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("6-block-maturity-not-reached:%s", program.sParameters[0]));
 
-                            NameDataValues data;
+                            NameDataState nameState;
 
-                            if (view.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                            if (view.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                             {
-                                auto mapData = DotStock::Consolidate(data, pindex->nHeight);
+                                auto mapData = nameState.Get(pindex->nHeight);
                                 if (mapData.count("_key"))
                                     return state.DoS(100, false, REJECT_INVALID, strprintf("already-revealed:%s", program.sParameters[0]));
                             }
@@ -4923,9 +4699,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("name-could-not-update:%s", program.sParameters[0]));
                             if (!view.AddNameData(DotStock::GetHashName(program.sParameters[0]), std::make_pair(pindex->nHeight, NameDataValue(program.sParameters[2], program.sParameters[3], program.sParameters[1]))))
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("name-could-not-update:%s", program.sParameters[0]));
-                            if (view.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                            if (view.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                             {
-                                auto mapData = DotStock::Consolidate(data, pindex->nHeight);
+                                auto mapData = nameState.Get(pindex->nHeight);
 
                                 if (!(vout.scriptPubKey.IsCommunityFundContribution() && vout.nValue >= std::floor(DotStock::CalculateSize(mapData)/GetConsensusParameter(Consensus::CONSENSUS_PARAMS_DOTSTOCK_MAXDATA, view))*GetConsensusParameter(Consensus::CONSENSUS_PARAMS_DOTSTOCK_FEE_EXTRADATA, view)))
                                     return state.DoS(100, false, REJECT_INVALID, strprintf("register-name-missing-contribution:%s", program.sParameters[0]));
@@ -4937,11 +4713,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                         } else if (program.action == RENEW_NAME) {
                             if (!(vout.scriptPubKey.IsCommunityFundContribution() && vout.nValue >= GetConsensusParameter(Consensus::CONSENSUS_PARAM_STOCKNS_FEE, view)))
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("register-name-missing-contribution:%s", program.sParameters[0]));
-                            NameDataValues data;
+                            NameDataState nameState;
 
-                            if (view.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                            if (view.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                             {
-                                auto mapData = DotStock::Consolidate(data, pindex->nHeight);
+                                auto mapData = nameState.Get(pindex->nHeight);
                                 if (!mapData.count("_key"))
                                     return state.DoS(100, false, REJECT_INVALID, strprintf("name-not-active:%s", program.sParameters[0]));
                             } else {
@@ -4952,8 +4728,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
                             LogPrint("dotstock", "%s: renewed name %s\n", __func__, program.sParameters[0]);
                         } else if (program.action == UPDATE_NAME) {
-                            NameDataValues data;
-                            if (!view.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                            NameDataState nameState;
+                            if (!view.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("error-name:%s", program.sParameters[0]));
                             if (!(DotStock::IsValidKey(program.sParameters[1]) || program.sParameters[1] == ""))
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("invalid-subdomain:%s", program.sParameters[0]));
@@ -4961,7 +4737,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("invalid-name:%s", program.sParameters[0]));
                             if (program.sParameters[3].size() > GetConsensusParameter(Consensus::CONSENSUS_PARAMS_DOTSTOCK_MAXDATA, view))
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("too-long-value:%s", program.sParameters[0]));
-                            auto mapData = DotStock::Consolidate(data, pindex->nHeight);
+                            auto mapData = nameState.Get(pindex->nHeight);
                             if (!mapData.count("_key"))
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("name-has-no-key:%s", program.sParameters[0]));
                             try {
@@ -4984,9 +4760,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             if (!view.AddNameData(DotStock::GetHashName(program.sParameters[0]), std::make_pair(pindex->nHeight, NameDataValue(program.sParameters[2], program.sParameters[3], program.sParameters[1]))))
                                 return state.DoS(100, false, REJECT_INVALID, strprintf("name-could-not-update:%s", program.sParameters[0]));
 
-                            if (view.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                            if (view.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                             {
-                                auto mapData = DotStock::Consolidate(data, pindex->nHeight);
+                                auto mapData = nameState.Get(pindex->nHeight);
                                 if (!(vout.scriptPubKey.IsCommunityFundContribution() && vout.nValue >= std::floor(DotStock::CalculateSize(mapData)/GetConsensusParameter(Consensus::CONSENSUS_PARAMS_DOTSTOCK_MAXDATA, view))*GetConsensusParameter(Consensus::CONSENSUS_PARAMS_DOTSTOCK_FEE_EXTRADATA, view)))
                                     return state.DoS(100, false, REJECT_INVALID, strprintf("register-name-missing-contribution:%s", program.sParameters[0]));
                             } else {
@@ -5014,12 +4790,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     if (token->nVersion == 1) {
                         auto op = COutPoint(tx.GetHash(), i);
 
-                        if (view.HaveTokenUtxos(tokenIdHash))
-                            LogPrint("token", "%s: We have an old utxo set for token");
-                        else
-                            LogPrint("token", "%s: Fresh utxo set for token");
-
-                        if (!view.AddTokenUtxo(tokenIdHash, std::make_pair(pindex->nHeight, TokenUtxoValue(op.hash, vout.spendingKey, op.n))))
+                        if (!view.AddTokenUtxo(TokenUtxoKey(tokenIdHash, pindex->nHeight, op.hash, op.n), TokenUtxoValue(op.hash, vout.spendingKey, op.n)))
                             return AbortNode(state, "Failed to add token utxo to index");
                     }
                 }
@@ -5040,7 +4811,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 if (TxToProposal(tx.strDZeel, tx.GetHash(), block.GetHash(), nProposalFee, proposal))
                 {
                     if (view.AddProposal(proposal))
+                    {
+                        MarkDAOEntryForUpdate(DAO_PROPOSAL, proposal.hash);
                         LogPrint("dao","%s: New proposal %s\n", __func__, proposal.ToString(view, block.nTime));
+                    }
                 }
                 else
                 {
@@ -5056,7 +4830,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     if (view.GetProposal(prequest.proposalhash, proposal) && proposal.GetLastState() == DAOFlags::ACCEPTED)
                     {
                         if (view.AddPaymentRequest(prequest))
+                        {
+                            MarkDAOEntryForUpdate(DAO_PAYMENT_REQUEST, prequest.hash);
                             LogPrint("dao","%s: New payment request %s\n", __func__, prequest.ToString(view));
+                        }
                     }
                 }
                 else
@@ -5072,13 +4849,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 {
                     if (view.AddConsultation(consultation))
                     {
+                        MarkDAOEntryForUpdate(DAO_CONSULTATION, consultation.hash);
                         LogPrint("dao","%s: New consultation %s\n", __func__, consultation.ToString(pindex, view));
                         if (!consultation.IsRange())
                         {
                             for (CConsultationAnswer& ans: vAnswers)
                             {
                                 if (view.AddConsultationAnswer(ans))
+                                {
+                                    MarkDAOEntryForUpdate(DAO_CONSULTATION_ANSWER, ans.hash);
                                     LogPrint("dao","%s: New child consultation answer %s\n", __func__, ans.ToString());
+                                }
                             }
                         }
                     }
@@ -5099,7 +4880,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                         if (view.GetConsultation(answer.parent, consultation) && consultation.CanHaveNewAnswers() && !view.HaveConsultationAnswer(answer.hash))
                         {
                             if (view.AddConsultationAnswer(answer))
+                            {
+                                MarkDAOEntryForUpdate(DAO_CONSULTATION_ANSWER, answer.hash);
                                 LogPrint("dao","%s: New consultation answer %s\n", __func__, answer.ToString());
+                            }
                         }
                     }
                     else
@@ -5126,7 +4910,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
-        UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight, fStats ? &stats : nullptr);
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
@@ -5159,12 +4943,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
                 if (fCFund && view.GetProposal(it.first, proposal) && proposal.CanVote(view))
                 {
-                    InsertProposalVotes(block.GetHash())->push_back(std::make_pair(it.first, val));
+                    AddProposalVote(block.GetHash(), it.first, val);
                     LogPrint("daoextra", "%s: Inserting vote for staker %s in block index %d - proposal hash: %s vote: %d\n", __func__, HexStr(stakerScript), pindex->nHeight, it.first.ToString(), val);
                 }
                 else if (fCFund && view.GetPaymentRequest(it.first, prequest) && prequest.CanVote(view))
                 {
-                    InsertPaymentRequestVotes(block.GetHash())->push_back(std::make_pair(it.first, val));
+                    AddPaymentRequestVote(block.GetHash(), it.first, val);
                     LogPrint("daoextra", "%s: Inserting vote for staker %s in block index %d - payment request hash: %s vote: %d\n", __func__, HexStr(stakerScript), pindex->nHeight, it.first.ToString(), val);
                 }
                 else if (val == VoteFlags::SUPPORT)
@@ -5173,7 +4957,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             ((view.GetConsultation(it.first, consultation) && consultation.CanBeSupported()) ||
                              (view.GetConsultationAnswer(it.first, answer) && answer.CanBeSupported(view))))
                     {
-                        InsertSupport(block.GetHash())->insert(std::make_pair(it.first, true));
+                        AddSupport(block.GetHash(), it.first);
                         LogPrint("daoextra", "%s: Inserting vote for staker %s in block index %d - hash: %s vote: support\n", __func__, HexStr(stakerScript), pindex->nHeight, it.first.ToString());
                     }
                 }
@@ -5182,7 +4966,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     if ((view.GetConsultation(it.first, consultation) && (consultation.CanBeVoted(val) && consultation.IsValidVote(val))))
                     {
                         LogPrint("daoextra", "%s: Inserting consultation vote for staker %s in block index %d - hash: %s vote: %d\n", __func__, HexStr(stakerScript), pindex->nHeight, it.first.ToString(), val);
-                        InsertConsultationVotes(block.GetHash())->insert(std::make_pair(it.first, val));
+                        AddConsultationVote(block.GetHash(), it.first, val);
                     }
                     else
                     {
@@ -5198,7 +4982,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                 continue;
                             }
                             LogPrint("daoextra", "%s: Inserting consultation answer vote for staker %s in block index %d - hash: %s vote: %d\n", __func__, HexStr(stakerScript), pindex->nHeight, it.first.ToString(), val);
-                            InsertConsultationVotes(block.GetHash())->insert(std::make_pair(it.first, val));
+                            AddConsultationVote(block.GetHash(), it.first, val);
                         }
                         else
                         {
@@ -5279,6 +5063,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
                 mprequest->SetState(pindex, DAOFlags::PAID);
                 mprequest->fDirty = true;
+
+                MarkDAOEntryForUpdate(DAO_PAYMENT_REQUEST, prid);
             }
             else
             {
@@ -5325,11 +5111,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
-    pindex->nPublicMoneySupply += nCreated + nMovedToPublic - nBLSCTPublicFees;
-    pindex->nPrivateMoneySupply += nMovedToBLS - nBLSCTPrivateFees - nMovedToPublic;
-    pindex->nStatus |= BLOCK_OPT_SUPPLY;
+    pindex->Cold().nPublicMoneySupply += nCreated + nMovedToPublic - nBLSCTPublicFees;
+    pindex->Cold().nPrivateMoneySupply += nMovedToBLS - nBLSCTPrivateFees - nMovedToPublic;
+    pindex->nStatus |= BLOCK_OPT_SUPPLY | BLOCK_OPT_MINT;
 
-    if (pindex->nPrivateMoneySupply < 0)
+    if (pindex->GetCold().nPrivateMoneySupply < 0)
         return state.DoS(100, error("ConnectBlock() : private money supply goes in negative"));
 
     if (!control.Wait()) {
@@ -5364,48 +5150,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-        for (auto &it: addressHistoryMap)
-        {
-            addressHistory.push_back(std::make_pair(it.first, it.second));
-        }
-        if (!pblocktree->WriteAddressHistory(addressHistory)) {
-            return AbortNode(state, "Failed to write address history");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
-    if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-
-    if (fTimestampIndex) {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
-    }
+    if (pblockundo)
+        *pblockundo = std::move(blockundo);
 
     // add this block to the view's block chain
+    if (fStats)
+        view.SetStateStats(stats);
     view.SetBestBlock(pindex->GetBlockHash());
 
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime44;
@@ -5439,6 +5189,90 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     return true;
 }
 
+/** Whether any non-coin category of pcoinsTip has outgrown its own budget. */
+static bool IsStateCacheOverBudget()
+{
+    for (int c = STATE_CACHE_COINS + 1; c < STATE_CACHE_CATEGORIES; c++) {
+        if (nStateCacheBudget[c] && pcoinsTip->DynamicMemoryUsage((StateCacheCategory)c) > nStateCacheBudget[c])
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Bring pcoinsTip back within budget after a Sync(). Categories over their
+ * own budget drop their clean entries, then the largest category gives back
+ * its clean entries until the whole cache fits in nTargetUsage. Coins are
+ * trimmed least recently used first, other categories are dropped at once.
+ */
+static void TrimStateCache(size_t nTargetUsage)
+{
+    for (int c = STATE_CACHE_COINS + 1; c < STATE_CACHE_CATEGORIES; c++) {
+        StateCacheCategory category = (StateCacheCategory)c;
+        if (nStateCacheBudget[c] && pcoinsTip->DynamicMemoryUsage(category) > nStateCacheBudget[c])
+            pcoinsTip->UncacheClean(category);
+    }
+
+    bool fTrimmed[STATE_CACHE_CATEGORIES] = {};
+    while (pcoinsTip->DynamicMemoryUsage() > nTargetUsage) {
+        int nLargest = -1;
+        size_t nLargestUsage = 0;
+        for (int c = 0; c < STATE_CACHE_CATEGORIES; c++) {
+            size_t nUsage = pcoinsTip->DynamicMemoryUsage((StateCacheCategory)c);
+            if (!fTrimmed[c] && nUsage > nLargestUsage) {
+                nLargest = c;
+                nLargestUsage = nUsage;
+            }
+        }
+        if (nLargest < 0)
+            break;
+        fTrimmed[nLargest] = true;
+        if (nLargest == STATE_CACHE_COINS)
+            pcoinsTip->Trim(nTargetUsage);
+        else
+            pcoinsTip->UncacheClean((StateCacheCategory)nLargest);
+    }
+}
+
+/**
+ * Drop the cold fields of the block index entries deeper than
+ * BLOCK_INDEX_COLD_KEEP_DEPTH below the tip which are already on disk. The
+ * fields of deep entries are only used with cs_main held, so no reference to
+ * them outlives this. Only the entries created or loaded since they were last
+ * evicted are looked at, not the whole block index.
+ */
+static void EvictBlockIndexCold()
+{
+    AssertLockHeld(cs_main);
+
+    std::vector<uint256> vLoaded;
+    TakeBlockIndexColdLoaded(vLoaded);
+    setBlockIndexColdLoaded.insert(vLoaded.begin(), vLoaded.end());
+
+    if (chainActive.Tip() == nullptr)
+        return;
+
+    int nEvictHeight = chainActive.Height() - BLOCK_INDEX_COLD_KEEP_DEPTH;
+    int nEvicted = 0;
+
+    for (std::set<uint256>::iterator it = setBlockIndexColdLoaded.begin(); it != setBlockIndexColdLoaded.end(); ) {
+        BlockMap::iterator mi = mapBlockIndex.find(*it);
+        if (mi == mapBlockIndex.end() || !mi->second->HaveCold()) {
+            setBlockIndexColdLoaded.erase(it++);
+            continue;
+        }
+        CBlockIndex* pindex = mi->second;
+        if (pindex->nHeight < nEvictHeight && !setDirtyBlockIndex.count(pindex)) {
+            pindex->EvictCold();
+            setBlockIndexColdLoaded.erase(it++);
+            nEvicted++;
+        } else {
+            ++it;
+        }
+    }
+
+    LogPrint("bench", "    - Evicted cold fields of %d block index entries\n", nEvicted);
+}
 
 /**
  * Update the on-disk chain state.
@@ -5486,7 +5320,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::min(std::max(nTotalSpace / 2, nTotalSpace - MIN_BLOCK_COINSDB_USAGE * 1024 * 1024),
                                                                                 std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024));
         // The cache is over the limit, we have to write now.
-        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > (int64_t)nCoinCacheUsage;
+        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && (cacheSize > (int64_t)nCoinCacheUsage || IsStateCacheOverBudget());
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
@@ -5514,9 +5348,18 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                     vBlocks.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
-                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+                std::vector<std::pair<CBlockVotesKey, std::shared_ptr<const CBlockVotes>> > vVotes;
+                GetDirtyBlockVotes(vVotes);
+                // Every block indexed so far was connected before, so its entry is written here
+                uint256 hashIndexed = asyncIndexer.GetIndexedBlock();
+                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks, vVotes)) {
                     return AbortNode(state, "Files to write to block index database");
                 }
+                if (!hashIndexed.IsNull() && !pblocktree->WriteIndexBestBlock(hashIndexed)) {
+                    return AbortNode(state, "Failed to write the last indexed block");
+                }
+                ClearDirtyBlockVotes();
+                EvictBlockIndexCold();
             }
             // Finally remove any pruned files
             if (fFlushForPrune)
@@ -5533,8 +5376,13 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // Only modified entries are written; the rest stay cached so the
+            // next blocks are not connected against a cold cache.
+            if (!pcoinsTip->Sync())
                 return AbortNode(state, "Failed to write to coin database");
+            // Keep half of the budget for the clean entries, so we are not
+            // back over the limit a few blocks later.
+            TrimStateCache(nCoinCacheUsage / DB_PEAK_USAGE_FACTOR / 2);
             nLastFlush = nNow;
         }
         if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -5606,8 +5454,8 @@ void static UpdateTip(CBlockIndex *pindexNew, uint256 statehash, const CChainPar
         for (int i = 0; i < 1000 && pindex != nullptr; i++)
         {
             int32_t nExpectedVersion = CLIENT_VERSION;
-            if (atoi(pindex->strDZeel.substr(pindex->strDZeel.find(";") + 1).c_str()) > nExpectedVersion
-                    && pindex->strDZeel.find(';') != std::string::npos)
+            if (atoi(pindex->GetCold().strDZeel.substr(pindex->GetCold().strDZeel.find(";") + 1).c_str()) > nExpectedVersion
+                    && pindex->GetCold().strDZeel.find(';') != std::string::npos)
                 ++nUpgraded;
             pindex = pindex->pprev;
         }
@@ -5654,13 +5502,17 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     uint256 statehash;
     {
         CStateViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        CBlockUndo blockundo;
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, &blockundo))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         if (!VoteStep(state, pindexDelete, true, view))
             return error("DisconnectTip(): VoteStep failed");
         assert(view.Flush());
+        // The address and spent indexes are rolled back by the indexer, off the critical path
+        if (fAddressIndex || fSpentIndex || fTimestampIndex)
+            asyncIndexer.BlockDisconnected(block, std::move(blockundo), pindexDelete);
         if (GetBoolArg("-debugstatehash", false))
-            statehash = GetDAOStateHash(view, pindexDelete->pprev->nCFLocked, pindexDelete->pprev->nCFSupply);
+            statehash = GetDAOStateHash(view, pindexDelete->pprev->GetCold().nCFLocked, pindexDelete->pprev->GetCold().nCFSupply);
     }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
 
@@ -5743,8 +5595,9 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     std::map<int, std::vector<RangeproofEncodedData>> blsctData;
     {
         CStateViewCache view(pcoinsTip);
+        CBlockUndo blockundo;
 
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, chainparams, blsctData);
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, chainparams, blsctData, false, false, &blockundo);
 
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
@@ -5759,8 +5612,12 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
             return error("ConnectTip(): VoteStep failed");
         nTime4 = GetTimeMicros(); nTimeConnectTotal += nTime4 - nTime3;
         if (GetBoolArg("-debugstatehash", false))
-            statehash = GetDAOStateHash(view, pindexNew->nCFLocked, pindexNew->nCFSupply);
+            statehash = GetDAOStateHash(view, pindexNew->GetCold().nCFLocked, pindexNew->GetCold().nCFSupply);
         assert(view.Flush());
+        // The address, spent and timestamp indexes are written by the indexer, in batches of blocks.
+        // Only blocks which made it to the active chain are queued, unlike the ones checked by VerifyDB.
+        if (fAddressIndex || fSpentIndex || fTimestampIndex)
+            asyncIndexer.BlockConnected(*pblock, std::move(blockundo), pindexNew);
     }
     int64_t nTime5 = GetTimeMicros(); nTimeFlush += nTime5 - nTime4;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeFlush * 0.000001);
@@ -6149,6 +6006,7 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     pindexNew->nSequenceId = 0;
     BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
+    setBlockIndexColdLoaded.insert(hash);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
@@ -7245,7 +7103,7 @@ bool static LoadBlockIndexDB()
 {
     uiInterface.InitMessage(_("Loading block guts..."));
     const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, InsertProposalVotes, InsertPaymentRequestVotes, InsertSupport, InsertConsultationVotes))
+    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
         return false;
 
     boost::this_thread::interruption_point();
@@ -7382,6 +7240,32 @@ bool static LoadBlockIndexDB()
     return true;
 }
 
+bool ComputeStateStats(CStateView *view, CStateStats &stats)
+{
+    boost::scoped_ptr<CStateViewCursor> pcursor(view->Cursor());
+    if (!pcursor)
+        return error("%s: unable to open cursor", __func__);
+
+    int64_t nStart = GetTimeMillis();
+    stats.SetNull();
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        uint256 key;
+        CCoins coins;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coins)) {
+            stats.AddCoins(key, coins);
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    stats.fValid = true;
+
+    LogPrintf("%s: %u transactions, %u outputs at %s (%dms)\n", __func__, stats.nTransactions, stats.nTransactionOutputs,
+              pcursor->GetBestBlock().ToString(), GetTimeMillis() - nStart);
+    return true;
+}
+
 bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CStateView *coinsview, int nCheckLevel, int nCheckDepth)
 {
     LOCK(cs_main);
@@ -7397,11 +7281,11 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CStateView *coinsview,
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
     CStateViewCache coins(coinsview);
     uint256 prevStateHash;
-    if (nCheckLevel >= 4) prevStateHash = GetDAOStateHash(coins, chainActive.Tip()->nCFLocked, chainActive.Tip()->nCFSupply);
+    if (nCheckLevel >= 4) prevStateHash = GetDAOStateHash(coins, chainActive.Tip()->GetCold().nCFLocked, chainActive.Tip()->GetCold().nCFSupply);
     std::string sBefore = "";
     if (LogAcceptCategory("dao"))
     {
-        sBefore += strprintf("Height -> %d\nnCFLocked -> %d\nnCFSupply -> %d\n\n", chainActive.Tip()->nHeight, chainActive.Tip()->nCFLocked, chainActive.Tip()->nCFSupply);
+        sBefore += strprintf("Height -> %d\nnCFLocked -> %d\nnCFSupply -> %d\n\n", chainActive.Tip()->nHeight, chainActive.Tip()->GetCold().nCFLocked, chainActive.Tip()->GetCold().nCFSupply);
         CProposalMap proposalMap;
         CPaymentRequestMap paymentRequestMap;
         CConsultationMap mapConsultations;
@@ -7533,14 +7417,14 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CStateView *coinsview,
             if (!VoteStep(state, pindex, false, coins))
                 return error("VerifyDB(): *** VoteStep failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         }
-        uint256 nowStateHash = GetDAOStateHash(coins, pindex->nCFLocked, pindex->nCFSupply);
+        uint256 nowStateHash = GetDAOStateHash(coins, pindex->GetCold().nCFLocked, pindex->GetCold().nCFSupply);
         if (prevStateHash != nowStateHash)
         {
             std::string sExtra = "";
             std::string sAfter = "";
             if (LogAcceptCategory("dao"))
             {
-                sAfter += strprintf("Height -> %d\nnCFLocked -> %d\nnCFSupply -> %d\n\n", pindex->nHeight, pindex->nCFLocked, pindex->nCFSupply);
+                sAfter += strprintf("Height -> %d\nnCFLocked -> %d\nnCFSupply -> %d\n\n", pindex->nHeight, pindex->GetCold().nCFLocked, pindex->GetCold().nCFSupply);
                 CProposalMap proposalMap;
                 CPaymentRequestMap paymentRequestMap;
                 CConsultationMap mapConsultations;
@@ -7740,6 +7624,11 @@ void UnloadBlockIndex()
     nPreferredDownload = 0;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
+    std::vector<uint256> vColdLoaded;
+    TakeBlockIndexColdLoaded(vColdLoaded);
+    setBlockIndexColdLoaded.clear();
+    UnloadBlockVotes();
+    ResetDAOVoteCaches();
     mapNodeState.clear();
     recentRejects.reset(NULL);
     versionbitscache.Clear();
@@ -8321,45 +8210,72 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_WITNESS_BLOCK)
-                        pfrom->PushMessage(NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_FILTERED_BLOCK)
+                    // Full blocks are sent as the bytes stored on disk, which include
+                    // the witness data. Blocks from before witness activation have none,
+                    // so their bytes are also the serialization without witness.
+                    bool fRawBlock = inv.type == MSG_WITNESS_BLOCK ||
+                            ((inv.type == MSG_BLOCK || inv.type == MSG_CMPCT_BLOCK) && !(mi->second->nStatus & BLOCK_OPT_WITNESS));
+                    // A new block is requested by many peers at once, so the message is
+                    // built once and shared through netMessageCache
+                    int nBlockSendVersion = pfrom->ssSend.GetVersion() | (inv.type == MSG_WITNESS_BLOCK ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS);
+                    CSharedNetMsg msgBlock;
+                    if (inv.type != MSG_FILTERED_BLOCK)
+                        msgBlock = netMessageCache.Get(NetMsgType::BLOCK, inv.hash, nBlockSendVersion);
+                    if (msgBlock)
                     {
-                        LOCK(pfrom->cs_filter);
-                        if (pfrom->pfilter)
-                        {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                            pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            for(PairType& pair: merkleBlock.vMatchedTxn)
-                                pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
-                        }
-                        // else
-                        // no response
+                        pfrom->PushSharedMessage(NetMsgType::BLOCK, msgBlock);
+                    }
+                    else if (fRawBlock)
+                    {
+                        std::vector<unsigned char> vBlock;
+                        if (!ReadRawBlockFromDisk(vBlock, (*mi).second, Params().MessageStart()))
+                            assert(!"cannot load block from disk");
+                        msgBlock = MakeSharedNetMsg(NetMsgType::BLOCK, nBlockSendVersion, CFlatData(vBlock));
+                        netMessageCache.Add(NetMsgType::BLOCK, inv.hash, nBlockSendVersion, msgBlock);
+                        pfrom->PushSharedMessage(NetMsgType::BLOCK, msgBlock);
                     }
-                    else if (inv.type == MSG_CMPCT_BLOCK)
+                    else
                     {
-                        // If a peer is asking for old blocks, we're almost guaranteed
-                        // they wont have a useful mempool to match against a compact block,
-                        // and we dont feel like constructing the object for them, so
-                        // instead we respond with the full, non-compact block.
-                        //                        if (mi->second->nHeight >= chainActive.Height() - 10) {
-                        //                            CBlockHeaderAndShortTxIDs cmpctblock(block);
-                        //                            pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpctblock);
-                        //                        } else
-                        pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                            assert(!"cannot load block from disk");
+                        if (inv.type == MSG_BLOCK)
+                            pfrom->PushCachedMessage(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, inv.hash, block);
+                        else if (inv.type == MSG_WITNESS_BLOCK)
+                            pfrom->PushCachedMessage(0, NetMsgType::BLOCK, inv.hash, block);
+                        else if (inv.type == MSG_FILTERED_BLOCK)
+                        {
+                            LOCK(pfrom->cs_filter);
+                            if (pfrom->pfilter)
+                            {
+                                CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                                pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                for(PairType& pair: merkleBlock.vMatchedTxn)
+                                    pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
+                            }
+                            // else
+                            // no response
+                        }
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            // If a peer is asking for old blocks, we're almost guaranteed
+                            // they wont have a useful mempool to match against a compact block,
+                            // and we dont feel like constructing the object for them, so
+                            // instead we respond with the full, non-compact block.
+                            //                        if (mi->second->nHeight >= chainActive.Height() - 10) {
+                            //                            CBlockHeaderAndShortTxIDs cmpctblock(block);
+                            //                            pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpctblock);
+                            //                        } else
+                            pfrom->PushCachedMessage(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, inv.hash, block);
+                        }
                     }
 
                     // Trigger the peer node to send a getblocks request for the next batch of inventory
@@ -8385,7 +8301,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     uint256 dandelionServiceDiscoveryHash;
                     dandelionServiceDiscoveryHash.SetHex("0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
                     if (txinfo.tx && !IsDandelionInbound(pfrom) && pfrom->setDandelionInventoryKnown.count(inv.hash)!=0) {
-                        pfrom->PushMessageWithFlag(nSendFlags, NetMsgType::DANDELIONTX, *txinfo.tx);
+                        pfrom->PushCachedMessage(nSendFlags, NetMsgType::DANDELIONTX, txinfo.tx->GetWitnessHash(), *txinfo.tx);
                         push = true;
                     } else if (inv.hash==dandelionServiceDiscoveryHash && pfrom->setDandelionInventoryKnown.count(inv.hash)!=0) {
                         LogPrint("dandelion", "Peer %d supports Dandelion\n", pfrom->GetId());
@@ -8398,18 +8314,18 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     if (!pfrom->fSupportsDandelion && !IsDandelionInbound(pfrom) && pfrom->setDandelionInventoryKnown.count(inv.hash)!=0) {
                         auto txinfo = stempool.info(inv.hash);
                         if (txinfo.tx) {
-                            pfrom->PushMessageWithFlag(nSendFlags, NetMsgType::TX, *txinfo.tx);
+                            pfrom->PushCachedMessage(nSendFlags, NetMsgType::TX, txinfo.tx->GetWitnessHash(), *txinfo.tx);
                             push = true;
                         }
                     } else if (mi != mapRelay.end()) {
-                        pfrom->PushMessageWithFlag(nSendFlags, NetMsgType::TX, *mi->second);
+                        pfrom->PushCachedMessage(nSendFlags, NetMsgType::TX, mi->second->GetWitnessHash(), *mi->second);
                         push = true;
                     } else if (pfrom->timeLastMempoolReq) {
                         auto txinfo = mempool.info(inv.hash);
                         // To protect privacy, do not answer getdata using the mempool when
                         // that TX couldn't have been INVed in reply to a MEMPOOL request.
                         if (txinfo.tx && txinfo.nTime <= pfrom->timeLastMempoolReq) {
-                            pfrom->PushMessageWithFlag(nSendFlags, NetMsgType::TX, *txinfo.tx);
+                            pfrom->PushCachedMessage(nSendFlags, NetMsgType::TX, txinfo.tx->GetWitnessHash(), *txinfo.tx);
                             push = true;
                         }
                     }
@@ -8426,7 +8342,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 {
                     AggregationSession ms(pcoinsTip);
                     if (stempool.GetAggregationSession(inv.hash, ms) && !IsDandelionInbound(pfrom) && pfrom->setDandelionInventoryKnown.count(inv.hash)!=0) {
-                        pfrom->PushMessage(NetMsgType::DANDELIONAGGREGATIONSESSION, ms);
+                        pfrom->PushCachedMessage(0, NetMsgType::DANDELIONAGGREGATIONSESSION, inv.hash, ms);
                         push = true;
                     }
                 }
@@ -8435,7 +8351,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     AggregationSession ms(pcoinsTip);
 
                     if (mempool.GetAggregationSession(inv.hash, ms)) {
-                        pfrom->PushMessage(NetMsgType::AGGREGATIONSESSION, ms);
+                        pfrom->PushCachedMessage(0, NetMsgType::AGGREGATIONSESSION, inv.hash, ms);
                         push = true;
                     }
                 }
@@ -8443,7 +8359,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 {
                     EncryptedCandidateTransaction ec;
                     if (stempool.GetEncryptedCandidateTransaction(inv.hash, ec) && !IsDandelionInbound(pfrom) && pfrom->setDandelionInventoryKnown.count(inv.hash)!=0) {
-                        pfrom->PushMessage(NetMsgType::DANDELIONENCRYPTEDCANDIDATE, ec);
+                        pfrom->PushCachedMessage(0, NetMsgType::DANDELIONENCRYPTEDCANDIDATE, inv.hash, ec);
                         push = true;
                     }
                 }
@@ -8451,7 +8367,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 {
                     EncryptedCandidateTransaction ec;
                     if (mempool.GetEncryptedCandidateTransaction(inv.hash, ec)) {
-                        pfrom->PushMessage(NetMsgType::ENCRYPTEDCANDIDATE, ec);
+                        pfrom->PushCachedMessage(0, NetMsgType::ENCRYPTEDCANDIDATE, inv.hash, ec);
                         push = true;
                     }
                 }
@@ -8490,9 +8406,19 @@ uint32_t GetFetchFlags(CNode* pfrom, CBlockIndex* pprev, const Consensus::Params
     return nFetchFlags;
 }
 
-bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams)
+/** Read a message object, from its pre-processed form when there is one */
+template<typename T>
+static void ReadMessage(CDataStream& vRecv, CPreprocessedMessage* pmsg, T& obj)
+{
+    if (pmsg)
+        pmsg->Take(obj);
+    else
+        vRecv >> obj;
+}
+
+bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CPreprocessedMessage* pmsg)
 {
-    LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
+    LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), pmsg ? pmsg->nMessageSize : vRecv.size(), pfrom->id);
 
     if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0)
     {
@@ -8920,7 +8846,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                     pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (CanDirectFetch(chainparams.GetConsensus()) &&
-                            nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER &&
+                            nodestate->nBlocksInFlight < GetBlocksInTransitLimit(nodestate) &&
                             (!IsWitnessEnabled(chainActive.Tip(), chainparams.GetConsensus()) || State(pfrom->GetId())->fHaveWitness)) {
                         inv.type |= nFetchFlags;
                         //                        if (nodestate->fProvidesHeaderAndIDs && !(nLocalServices & NODE_WITNESS))
@@ -9129,7 +9055,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         std::deque<COutPoint> vWorkQueue;
         std::vector<uint256> vEraseQueue;
         CTransaction tx;
-        vRecv >> tx;
+        ReadMessage(vRecv, pmsg, tx);
 
         LogPrint("net", "Received tx %s peer=%d\n%s\n", tx.GetHash().ToString(), pfrom->id, tx.ToString());
 
@@ -9145,9 +9071,16 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         pfrom->setAskFor.erase(inv.hash);
         mapAlreadyAskedFor.erase(inv);
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, &mempool.cs, &stempool.cs, state, tx, true, &fMissingInputs)) {
+        // Transactions failing the context-free checks are rejected as AcceptToMemoryPool would,
+        // and the ones passing them are not checked again under cs_main
+        bool fPrechecked = pmsg != nullptr;
+        bool fPrecheckOK = !pmsg || pmsg->fPrecheckOK;
+        if (!fPrecheckOK)
+            state = pmsg->precheckState;
+
+        if (!AlreadyHave(inv) && fPrecheckOK && AcceptToMemoryPool(mempool, &mempool.cs, &stempool.cs, state, tx, true, &fMissingInputs, false, 0, fPrechecked)) {
             // Changes to mempool should also be made to Dandelion stempool
-            AcceptToMemoryPool(stempool, &mempool.cs, &stempool.cs, dummyState, tx, true, nullptr);
+            AcceptToMemoryPool(stempool, &mempool.cs, &stempool.cs, dummyState, tx, true, nullptr, false, 0, fPrechecked);
             if (IsTxDandelionEmbargoed(tx.GetHash())) {
                 LogPrint("dandelion", "Embargoed dandeliontx %s found in mempool; removing from embargo map\n", tx.GetHash().ToString());
                 RemoveDandelionEmbargo(tx.GetHash());
@@ -9348,7 +9281,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     else if (strCommand == NetMsgType::DANDELIONENCRYPTEDCANDIDATE)
     {
         EncryptedCandidateTransaction ec;
-        vRecv >> ec;
+        ReadMessage(vRecv, pmsg, ec);
 
         ec.nTime = GetTimeMillis();
 
@@ -9372,7 +9305,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     else if (strCommand == NetMsgType::ENCRYPTEDCANDIDATE)
     {
         EncryptedCandidateTransaction ec;
-        vRecv >> ec;
+        ReadMessage(vRecv, pmsg, ec);
 
         ec.nTime = GetTimeMillis();
 
@@ -9402,13 +9335,17 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     {
         CValidationState state;
         CTransaction tx;
-        vRecv >> tx;
+        ReadMessage(vRecv, pmsg, tx);
         bool fMissingInputs = false;
         CInv inv(MSG_DANDELION_TX, tx.GetHash());
+        bool fPrechecked = pmsg != nullptr;
+        bool fPrecheckOK = !pmsg || pmsg->fPrecheckOK;
+        if (!fPrecheckOK)
+            state = pmsg->precheckState;
         LOCK(cs_main);
         if (IsDandelionInbound(pfrom)) {
             if (!stempool.exists(inv.hash)) {
-                bool ret = AcceptToMemoryPool(stempool, &mempool.cs, &stempool.cs, state, tx, false, &fMissingInputs, false, 0);
+                bool ret = fPrecheckOK && AcceptToMemoryPool(stempool, &mempool.cs, &stempool.cs, state, tx, false, &fMissingInputs, false, 0, fPrechecked);
                 if (ret) {
                     LogPrint("mempool", "AcceptToStemPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
                              pfrom->GetId(), tx.GetHash().ToString(), stempool.size(), stempool.DynamicMemoryUsage() / 1000);
@@ -9438,7 +9375,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         CBlockHeaderAndShortTxIDs cmpctblock;
-        vRecv >> cmpctblock;
+        ReadMessage(vRecv, pmsg, cmpctblock);
 
         LOCK(cs_main);
 
@@ -9492,12 +9429,12 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         // We want to be a bit conservative just to be extra careful about DoS
         // possibilities in compact block processing...
         if (pindex->nHeight <= chainActive.Height() + 2) {
-            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < GetBlocksInTransitLimit(nodestate)) ||
                     (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
                 std::list<QueuedBlock>::iterator *queuedBlockIt = nullptr;
                 if (!MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex, &queuedBlockIt)) {
                     if (!(*queuedBlockIt)->partialBlock)
-                        (*queuedBlockIt)->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+                        (*queuedBlockIt)->partialBlock.reset(new PartiallyDownloadedBlock(&mempool, &stempool));
                     else {
                         // The block was already in flight using compact blocks from the same peer
                         LogPrint("net", "Peer sent us compact block we were already syncing!\n");
@@ -9531,7 +9468,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                     txn.blockhash = cmpctblock.header.GetHash();
                     CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
                     blockTxnMsg << txn;
-                    return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, chainparams);
+                    return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, chainparams, nullptr);
                 } else {
                     req.blockhash = pindex->GetBlockHash();
                     pfrom->PushMessage(NetMsgType::GETBLOCKTXN, req);
@@ -9552,7 +9489,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 headers.push_back(cmpctblock.header);
                 CDataStream vHeadersMsg(SER_NETWORK, PROTOCOL_VERSION);
                 vHeadersMsg << headers;
-                return ProcessMessage(pfrom, NetMsgType::HEADERS, vHeadersMsg, nTimeReceived, chainparams);
+                return ProcessMessage(pfrom, NetMsgType::HEADERS, vHeadersMsg, nTimeReceived, chainparams, nullptr);
             }
         }
 
@@ -9764,7 +9701,8 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             std::vector<CBlockIndex *> vToFetch;
             CBlockIndex *pindexWalk = pindexLast;
             // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
-            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            int nBlocksInTransitLimit = GetBlocksInTransitLimit(nodestate);
+            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= (unsigned int)nBlocksInTransitLimit) {
                 if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) &&
                         !mapBlocksInFlight.count(pindexWalk->GetBlockHash()) &&
                         (!IsWitnessEnabled(pindexWalk->pprev, chainparams.GetConsensus()) || State(pfrom->GetId())->fHaveWitness)) {
@@ -9785,7 +9723,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 for(CBlockIndex *pindex: boost::adaptors::reverse(vToFetch)) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= nBlocksInTransitLimit) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -9800,11 +9738,17 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
     } else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
+        unsigned int nBlockSize = pmsg ? pmsg->nMessageSize : vRecv.size();
         CBlock block;
-        vRecv >> block;
+        ReadMessage(vRecv, pmsg, block);
 
         LogPrint("net", "received block %s peer=%d\n%s\n", block.GetHash().ToString(), pfrom->id, block.ToString());
 
+        {
+            LOCK(cs_main);
+            UpdateBlockDownloadStats(pfrom->GetId(), block.GetHash(), nBlockSize, nTimeReceived);
+        }
+
         bool ret = true;
 
         if(GetBoolArg("-headerspamfilter", DEFAULT_HEADER_SPAM_FILTER) && !IsInitialBlockDownload())
@@ -10096,6 +10040,24 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    // Hand the messages that are expensive to decode to the pre-processing
+    // threads, so they are ready by the time they reach the front of the queue.
+    // Before the handshake the version they are read with is not known yet.
+    if (pfrom->fSuccessfullyConnected) {
+        for (CNetMessage& msg: pfrom->vRecvMsg) {
+            if (!msg.complete())
+                break;
+            if (msg.preprocessed || !msg.hdr.IsValid(chainparams.MessageStart()))
+                continue;
+            std::string strCommand = msg.hdr.GetCommand();
+            if (!CPreprocessedMessage::IsPreprocessed(strCommand))
+                continue;
+            std::shared_ptr<CPreprocessedMessage> pmsg = std::make_shared<CPreprocessedMessage>(strCommand, msg.vRecv, msg.hdr.nMessageSize);
+            msg.preprocessed = pmsg;
+            msgPreprocessor.Submit(pmsg);
+        }
+    }
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -10110,8 +10072,8 @@ bool ProcessMessages(CNode* pfrom)
         //            msg.hdr.nMessageSize, msg.vRecv.size(),
         //            msg.complete() ? "Y" : "N");
 
-        // end, if an incomplete message is found
-        if (!msg.complete())
+        // end, if an incomplete or not yet pre-processed message is found
+        if (!msg.ready())
             break;
 
         // at this point, any failure means we can delete the current message
@@ -10138,8 +10100,14 @@ bool ProcessMessages(CNode* pfrom)
 
         // Checksum
         CDataStream& vRecv = msg.vRecv;
-        uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
-        unsigned int nChecksum = ReadLE32((unsigned char*)&hash);
+        CPreprocessedMessage* pmsg = static_cast<CPreprocessedMessage*>(msg.preprocessed.get());
+        unsigned int nChecksum;
+        if (pmsg) {
+            nChecksum = pmsg->nChecksum;
+        } else {
+            uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
+            nChecksum = ReadLE32((unsigned char*)&hash);
+        }
         if (nChecksum != hdr.nChecksum)
         {
             LogPrintf("%s(%s, %u bytes): CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n", __func__,
@@ -10151,7 +10119,7 @@ bool ProcessMessages(CNode* pfrom)
         bool fRet = false;
         try
         {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams);
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, pmsg);
             boost::this_thread::interruption_point();
         }
         catch (const std::ios_base::failure& e)
@@ -10199,23 +10167,73 @@ bool ProcessMessages(CNode* pfrom)
     return fOk;
 }
 
+/** An entry of a peer's transaction inventory with its relay order */
+typedef std::pair<std::set<uint256>::iterator, const TxRelayInfo*> InvTxEntry;
+
 class CompareInvMempoolOrder
 {
-    CTxMemPool *mp;
 public:
-    CompareInvMempoolOrder(CTxMemPool *mempool)
+    bool operator()(const InvTxEntry& a, const InvTxEntry& b) const
     {
-        mp = mempool;
+        /* As std::make_heap produces a max-heap, we want the entries with the
+         * fewest ancestors/highest ancestor feerate to sort later. */
+        const TxRelayInfo& infoa = *a.second;
+        const TxRelayInfo& infob = *b.second;
+        if (infoa.nCountWithAncestors != infob.nCountWithAncestors)
+            return infoa.nCountWithAncestors > infob.nCountWithAncestors;
+        double f1 = (double)infoa.nModFeesWithAncestors * infob.nSizeWithAncestors;
+        double f2 = (double)infob.nModFeesWithAncestors * infoa.nSizeWithAncestors;
+        if (f1 == f2)
+            return *a.first < *b.first;
+        return f1 < f2;
     }
+};
+
+/** Most transactions whose relay order is remembered */
+static const size_t MAX_RELAY_ORDER_CACHE_SIZE = 100000;
+
+/**
+ * Relay order of the mempool transactions being announced, shared by the peers
+ * they are announced to so each one is looked up in the mempool once. Entries
+ * are dropped whenever the ancestor state of the mempool entries may have
+ * changed, see CTxMemPool::GetAncestorStateEpoch. Protected by cs_main.
+ */
+class CRelayOrderCache
+{
+private:
+    std::map<uint256, TxRelayInfo> mapInfo;
+    unsigned int nAncestorStateEpoch;
+
+public:
+    CRelayOrderCache() : nAncestorStateEpoch(0) {}
 
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
+    /** Pair each transaction of setHashes with its relay order, or nullptr if it is not in the mempool */
+    void Get(const CTxMemPool& pool, std::set<uint256>& setHashes, std::vector<InvTxEntry>& vEntries)
     {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+        unsigned int nEpoch = pool.GetAncestorStateEpoch();
+        if (nEpoch != nAncestorStateEpoch || mapInfo.size() > MAX_RELAY_ORDER_CACHE_SIZE) {
+            mapInfo.clear();
+            nAncestorStateEpoch = nEpoch;
+        }
+
+        std::vector<uint256> vMissing;
+        for (const uint256& hash: setHashes) {
+            if (!mapInfo.count(hash))
+                vMissing.push_back(hash);
+        }
+        if (!vMissing.empty())
+            pool.relayInfo(vMissing, mapInfo);
+
+        vEntries.reserve(setHashes.size());
+        for (std::set<uint256>::iterator it = setHashes.begin(); it != setHashes.end(); it++) {
+            std::map<uint256, TxRelayInfo>::const_iterator mi = mapInfo.find(*it);
+            vEntries.push_back(std::make_pair(it, mi == mapInfo.end() ? nullptr : &mi->second));
+        }
     }
 };
 
+CRelayOrderCache relayOrderCache;
+
 bool SendMessages(CNode* pto)
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -10421,11 +10439,18 @@ bool SendMessages(CNode* pto)
                     // probably means we're doing an initial-ish-sync or they're slow
                     LogPrint("net", "%s sending header-and-ids %s to peer %d\n", __func__,
                              vHeaders.front().GetHash().ToString(), pto->id);
-                    //TODO: Shouldn't need to reload block from disk, but requires refactor
-                    CBlock block;
-                    assert(ReadBlockFromDisk(block, pBestIndex, consensusParams));
-                    CBlockHeaderAndShortTxIDs cmpctblock(block);
-                    pto->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpctblock);
+                    // The announcement is the same for every peer, only the first one builds it
+                    int nCmpctSendVersion = pto->ssSend.GetVersion() | SERIALIZE_TRANSACTION_NO_WITNESS;
+                    CSharedNetMsg msgCmpctBlock = netMessageCache.Get(NetMsgType::CMPCTBLOCK, pBestIndex->GetBlockHash(), nCmpctSendVersion);
+                    if (!msgCmpctBlock) {
+                        //TODO: Shouldn't need to reload block from disk, but requires refactor
+                        CBlock block;
+                        assert(ReadBlockFromDisk(block, pBestIndex, consensusParams));
+                        CBlockHeaderAndShortTxIDs cmpctblock(block);
+                        msgCmpctBlock = MakeSharedNetMsg(NetMsgType::CMPCTBLOCK, nCmpctSendVersion, cmpctblock);
+                        netMessageCache.Add(NetMsgType::CMPCTBLOCK, pBestIndex->GetBlockHash(), nCmpctSendVersion, msgCmpctBlock);
+                    }
+                    pto->PushSharedMessage(NetMsgType::CMPCTBLOCK, msgCmpctBlock);
                     state.pindexBestHeaderSent = pBestIndex;
                 } else if (state.fPreferHeaders) {
                     if (vHeaders.size() > 1) {
@@ -10588,20 +10613,26 @@ bool SendMessages(CNode* pto)
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
-                }
                 CAmount filterrate = 0;
                 {
                     LOCK(pto->cs_feeFilter);
                     filterrate = pto->minFeeFilter;
                 }
+                // Produce a vector with all candidates for sending, leaving out the ones
+                // not in the mempool anymore or below the peer's feefilter right away
+                std::vector<InvTxEntry> vCandidates;
+                relayOrderCache.Get(mempool, pto->setInventoryTxToSend, vCandidates);
+                std::vector<InvTxEntry> vInvTx;
+                vInvTx.reserve(vCandidates.size());
+                for (const InvTxEntry& entry: vCandidates) {
+                    if (!entry.second || (filterrate && entry.second->feeRate.GetFeePerK() < filterrate))
+                        pto->setInventoryTxToSend.erase(entry.first);
+                    else
+                        vInvTx.push_back(entry);
+                }
                 // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
                 // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
+                CompareInvMempoolOrder compareInvMempoolOrder;
                 std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
@@ -10610,7 +10641,8 @@ bool SendMessages(CNode* pto)
                 while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                     // Fetch the top element from the heap
                     std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
+                    std::set<uint256>::iterator it = vInvTx.back().first;
+                    const TxRelayInfo& txinfo = *vInvTx.back().second;
                     vInvTx.pop_back();
                     uint256 hash = *it;
                     // Remove it from the to-be-sent set
@@ -10619,14 +10651,6 @@ bool SendMessages(CNode* pto)
                     if (pto->filterInventoryKnown.contains(hash)) {
                         continue;
                     }
-                    // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = mempool.info(hash);
-                    if (!txinfo.tx) {
-                        continue;
-                    }
-                    if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
-                        continue;
-                    }
                     if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
                     // Send
                     vInv.push_back(CInv(MSG_TX, hash));
@@ -10639,7 +10663,7 @@ bool SendMessages(CNode* pto)
                             vRelayExpiration.pop_front();
                         }
 
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+                        auto ret = mapRelay.insert(std::make_pair(hash, txinfo.tx));
                         if (ret.second) {
                             vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
                         }
@@ -10678,7 +10702,8 @@ bool SendMessages(CNode* pto)
 
         // Detect whether we're stalling
         nNow = GetTimeMicros();
-        if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
+        int64_t nStallingTimeout = GetBlockStallingTimeout(GetExpectedBlockDownloadTime(state.blockDownload.nRate, state.blockDownload.nLatency, state.nBlocksInFlight, nAvgBlockDownloadSize));
+        if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - nStallingTimeout) {
             // Stalling only triggers when the block download window cannot move. During normal steady state,
             // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
             // should only happen during initial block download.
@@ -10693,7 +10718,9 @@ bool SendMessages(CNode* pto)
         if (!pto->fDisconnect && state.vBlocksInFlight.size() > 0) {
             QueuedBlock &queuedBlock = state.vBlocksInFlight.front();
             int nOtherPeersWithValidatedDownloads = nPeersWithValidatedDownloads - (state.nBlocksInFlightValidHeaders > 0);
-            if (nNow > state.nDownloadingSince + consensusParams.nPowTargetSpacing * (BLOCK_DOWNLOAD_TIMEOUT_BASE + BLOCK_DOWNLOAD_TIMEOUT_PER_PEER * nOtherPeersWithValidatedDownloads)) {
+            int64_t nTimeout = GetBlockDownloadTimeout(consensusParams.nPowTargetSpacing, nOtherPeersWithValidatedDownloads,
+                                                       state.blockDownload.nRate, state.blockDownload.nLatency, nAvgBlockDownloadSize);
+            if (nNow > state.nDownloadingSince + nTimeout) {
                 LogPrintf("Timeout downloading block %s from peer=%d, disconnecting\n", queuedBlock.hash.ToString(), pto->id);
                 pto->fDisconnect = true;
             }
@@ -10705,11 +10732,12 @@ bool SendMessages(CNode* pto)
         std::vector<CInv> vGetData;
 
 
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nBlocksInTransitLimit = GetBlocksInTransitLimit(&state);
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nBlocksInTransitLimit) {
             std::vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
 
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInTransitLimit - state.nBlocksInFlight, vToDownload, staller);
             for(CBlockIndex *pindex: vToDownload) {
                 if (State(pto->GetId())->fHaveWitness || !IsWitnessEnabled(pindex->pprev, consensusParams)) {
                     uint32_t nFetchFlags = GetFetchFlags(pto, pindex->pprev, consensusParams);
@@ -10962,7 +10990,7 @@ static bool SelectBlockFromCandidates(std::vector<std::pair<int64_t, uint256> >&
             return error("SelectBlockFromCandidates: failed to find block index for candidate block %s", item.second.ToString());
         const CBlockIndex* pindex = mapBlockIndex[item.second];
         if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop){
-            //            LogPrint("stakemodifier", "SelectBlockFromCandidates: selection hash=%s index=%d proofhash=%s nStakeModifierPrev=%08x\n", hashBest.ToString(), pindex->nHeight, pindex->hashProof.ToString(), nStakeModifierPrev);
+            //            LogPrint("stakemodifier", "SelectBlockFromCandidates: selection hash=%s index=%d proofhash=%s nStakeModifierPrev=%08x\n", hashBest.ToString(), pindex->nHeight, pindex->GetCold().hashProof.ToString(), nStakeModifierPrev);
             break;
 
         }
@@ -10972,7 +11000,7 @@ static bool SelectBlockFromCandidates(std::vector<std::pair<int64_t, uint256> >&
         // compute the selection hash by hashing its proof-hash and the
         // previous proof-of-stake modifier
         CDataStream ss(SER_GETHASH, 0);
-        ss << ArithToUint256(pindex->hashProof) << nStakeModifierPrev;
+        ss << ArithToUint256(pindex->GetCold().hashProof) << nStakeModifierPrev;
         uint256 hashSelection = Hash(ss.begin(), ss.end());
 
 
@@ -11418,111 +11446,294 @@ void StempoolAddEncryptedCandidateTransaction(const EncryptedCandidateTransactio
 static void CheckDandelionEmbargoes()
 {
     int64_t nCurrTime = GetTimeMicros();
-    for (auto iter=mDandelionAggregationSessionEmbargo.begin(); iter!=mDandelionAggregationSessionEmbargo.end();) {
-        if (iter->second < nCurrTime) {
-            AggregationSession ms(pcoinsTip);
-            if (stempool.GetAggregationSession(iter->first, ms))
-            {
-                mempool.AddAggregationSession(ms);
-                RelayAggregationSession(iter->first);
-            }
-            iter = mDandelionAggregationSessionEmbargo.erase(iter);
-        } else {
-            iter++;
+    std::vector<uint256> vAggregationSessions, vEncryptedCandidates, vTransactions;
+    {
+        LOCK(cs_mapDandelionEmbargo);
+        dandelionAggregationSessionEmbargo.PopExpired(nCurrTime, vAggregationSessions);
+        dandelionEncryptedCandidateEmbargo.PopExpired(nCurrTime, vEncryptedCandidates);
+        dandelionEmbargo.PopExpired(nCurrTime, vTransactions);
+    }
+
+    for (const uint256& hash: vAggregationSessions) {
+        AggregationSession ms(pcoinsTip);
+        if (stempool.GetAggregationSession(hash, ms))
+        {
+            mempool.AddAggregationSession(ms);
+            RelayAggregationSession(hash);
         }
     }
 
-    for (auto iter=mDandelionEncryptedCandidateEmbargo.begin(); iter!=mDandelionEncryptedCandidateEmbargo.end();) {
-        if (iter->second < nCurrTime) {
-            EncryptedCandidateTransaction ec;
-            if (stempool.GetEncryptedCandidateTransaction(iter->first, ec))
-            {
-                mempool.AddEncryptedCandidateTransaction(ec);
-                RelayEncryptedCandidate(iter->first);
-            }
-            iter = mDandelionEncryptedCandidateEmbargo.erase(iter);
-        } else {
-            iter++;
+    for (const uint256& hash: vEncryptedCandidates) {
+        EncryptedCandidateTransaction ec;
+        if (stempool.GetEncryptedCandidateTransaction(hash, ec))
+        {
+            mempool.AddEncryptedCandidateTransaction(ec);
+            RelayEncryptedCandidate(hash);
+        }
+    }
+
+    if (vTransactions.empty())
+        return;
+
+    std::vector<std::shared_ptr<const CTransaction> > vToFluff;
+    for (const uint256& hash: vTransactions) {
+        if (mempool.exists(hash)) {
+            LogPrint("dandelion", "Embargoed dandeliontx %s found in mempool; removing from embargo map\n", hash.ToString());
+            continue;
+        }
+        LogPrint("dandelion", "dandeliontx %s embargo expired\n", hash.ToString());
+        std::shared_ptr<const CTransaction> ptx = stempool.get(hash);
+        // If txn was not found in Stempool, then something went wrong
+        if (!ptx) {
+            LogPrintf("ERROR: dandeliontx %s embargo expired, but not found in stempool.\n", hash.ToString());
+            continue;
         }
+        vToFluff.push_back(ptx);
     }
 
-    for (auto iter=mDandelionEmbargo.begin(); iter!=mDandelionEmbargo.end();) {
-        if (mempool.exists(iter->first)) {
-            LogPrint("dandelion", "Embargoed dandeliontx %s found in mempool; removing from embargo map\n", iter->first.ToString());
-            iter = mDandelionEmbargo.erase(iter);
-        } else if (iter->second < nCurrTime) {
-            LogPrint("dandelion", "dandeliontx %s embargo expired\n", iter->first.ToString());
+    // Transactions expiring together often spend each other, so the ones missing
+    // inputs are tried again once the others are in the mempool
+    std::vector<std::shared_ptr<const CTransaction> > vPending(vToFluff);
+    bool fProgress = true;
+    while (!vPending.empty() && fProgress) {
+        fProgress = false;
+        std::vector<std::shared_ptr<const CTransaction> > vMissingInputs;
+        for (const std::shared_ptr<const CTransaction>& ptx: vPending) {
             CValidationState state;
-            std::shared_ptr<const CTransaction> ptx = stempool.get(iter->first);
-            // If txn was not found in Stempool, then something went wrong,
-            // Keep it embargoed for now.
-            if (!ptx) {
-                LogPrintf(
-                            "ERROR: dandeliontx %s embargo expired, but not found in stempool.\n",
-                            iter->first.ToString());
-                iter = mDandelionEmbargo.erase(iter);
-                continue;
-            }
             bool fMissingInputs = false;
-            AcceptToMemoryPool(mempool, &mempool.cs, &stempool.cs, state, *ptx, false, &fMissingInputs, false, 0);
-            LogPrint("mempool", "AcceptToMemoryPool: accepted %s (poolsz %u txn, %u kB)\n",
-                     iter->first.ToString(), mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-            RelayTransaction(*ptx);
-            iter = mDandelionEmbargo.erase(iter);
-        } else {
-            iter++;
+            if (AcceptToMemoryPool(mempool, &mempool.cs, &stempool.cs, state, *ptx, false, &fMissingInputs, false, 0)) {
+                fProgress = true;
+                LogPrint("mempool", "AcceptToMemoryPool: accepted %s (poolsz %u txn, %u kB)\n",
+                         ptx->GetHash().ToString(), mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+            } else if (fMissingInputs) {
+                vMissingInputs.push_back(ptx);
+            }
         }
+        vPending.swap(vMissingInputs);
+    }
+
+    for (const std::shared_ptr<const CTransaction>& ptx: vToFluff)
+        RelayTransaction(*ptx);
+}
+
+/** Guards the block votes below. Stored votes are never changed in place, so the snapshots handed out stay valid after eviction. */
+static CCriticalSection cs_blockVotes;
+/** Votes of the blocks connected since the last write of the block index. */
+static std::map<uint256, std::shared_ptr<CBlockVotes>> mapBlockVotesDirty;
+/** Votes of blocks already in the block tree database, most recently used first. */
+static std::list<std::pair<uint256, std::shared_ptr<const CBlockVotes>>> listBlockVotesCache;
+static std::map<uint256, std::list<std::pair<uint256, std::shared_ptr<const CBlockVotes>>>::iterator> mapBlockVotesCache;
+
+/**
+ * Return the votes of a block, looking in the unflushed votes first, then in
+ * the cache and finally in the block tree database. Blocks without votes are
+ * cached too so walking a voting cycle does not hit the disk twice.
+ */
+static std::shared_ptr<const CBlockVotes> FetchBlockVotes(const uint256& hash)
+{
+    AssertLockHeld(cs_blockVotes);
+
+    auto itDirty = mapBlockVotesDirty.find(hash);
+    if (itDirty != mapBlockVotesDirty.end())
+        return itDirty->second;
+
+    auto itCache = mapBlockVotesCache.find(hash);
+    if (itCache != mapBlockVotesCache.end())
+    {
+        listBlockVotesCache.splice(listBlockVotesCache.begin(), listBlockVotesCache, itCache->second);
+        return itCache->second->second;
+    }
+
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+        return nullptr;
+
+    std::shared_ptr<CBlockVotes> votes = std::make_shared<CBlockVotes>();
+    if (!pblocktree->ReadBlockVotes(CBlockVotesKey(mi->second->nHeight, hash), *votes))
+        *votes = CBlockVotes();
+
+    while (!listBlockVotesCache.empty() && listBlockVotesCache.size() >= std::max(nBlockVotesCacheSize, 1u))
+    {
+        mapBlockVotesCache.erase(listBlockVotesCache.back().first);
+        listBlockVotesCache.pop_back();
+    }
+
+    listBlockVotesCache.emplace_front(hash, votes);
+    mapBlockVotesCache[hash] = listBlockVotesCache.begin();
+
+    return votes;
+}
+
+/**
+ * Return the votes of a block, moving them to the unflushed set to be modified.
+ * They are copied first when a reader still holds a snapshot of them.
+ */
+static CBlockVotes& ModifyBlockVotes(const uint256& hash)
+{
+    AssertLockHeld(cs_blockVotes);
+
+    auto itDirty = mapBlockVotesDirty.find(hash);
+    if (itDirty != mapBlockVotesDirty.end())
+    {
+        if (!itDirty->second.unique())
+            itDirty->second = std::make_shared<CBlockVotes>(*itDirty->second);
+        return *itDirty->second;
+    }
+
+    std::shared_ptr<CBlockVotes>& votes = mapBlockVotesDirty[hash];
+
+    auto itCache = mapBlockVotesCache.find(hash);
+    if (itCache != mapBlockVotesCache.end())
+    {
+        votes = std::make_shared<CBlockVotes>(*itCache->second->second);
+        listBlockVotesCache.erase(itCache->second);
+        mapBlockVotesCache.erase(itCache);
+    }
+    else
+    {
+        votes = std::make_shared<CBlockVotes>();
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi != mapBlockIndex.end())
+            pblocktree->ReadBlockVotes(CBlockVotesKey(mi->second->nHeight, hash), *votes);
+    }
+
+    return *votes;
+}
+
+/**
+ * Collect the unflushed votes to be written together with the block index.
+ * Votes of blocks which never made it into the block index (e.g. templates
+ * checked by TestBlockValidity) are not written.
+ */
+static void GetDirtyBlockVotes(std::vector<std::pair<CBlockVotesKey, std::shared_ptr<const CBlockVotes>>>& vVotes)
+{
+    LOCK(cs_blockVotes);
+
+    vVotes.reserve(mapBlockVotesDirty.size());
+    for (const auto& it: mapBlockVotesDirty)
+    {
+        BlockMap::iterator mi = mapBlockIndex.find(it.first);
+        if (mi != mapBlockIndex.end())
+            vVotes.push_back(std::make_pair(CBlockVotesKey(mi->second->nHeight, it.first), it.second));
     }
 }
 
-std::vector<std::pair<uint256, int>>* GetProposalVotes(const uint256& hash)
+/** The unflushed votes have been written and are read back from disk when needed. */
+static void ClearDirtyBlockVotes()
+{
+    LOCK(cs_blockVotes);
+    mapBlockVotesDirty.clear();
+}
+
+static void UnloadBlockVotes()
+{
+    LOCK(cs_blockVotes);
+    mapBlockVotesDirty.clear();
+    mapBlockVotesCache.clear();
+    listBlockVotesCache.clear();
+}
+
+std::shared_ptr<const std::vector<std::pair<uint256, int>>> GetProposalVotes(const uint256& hash)
+{
+    LOCK2(cs_main, cs_blockVotes);
+    std::shared_ptr<const CBlockVotes> votes = FetchBlockVotes(hash);
+    if (votes == nullptr || votes->vProposalVotes.empty())
+        return nullptr;
+
+    return std::shared_ptr<const std::vector<std::pair<uint256, int>>>(votes, &votes->vProposalVotes);
+}
+
+std::shared_ptr<const std::vector<std::pair<uint256, int>>> GetPaymentRequestVotes(const uint256& hash)
 {
-    if (vProposalVotes.count(hash) == 0)
+    LOCK2(cs_main, cs_blockVotes);
+    std::shared_ptr<const CBlockVotes> votes = FetchBlockVotes(hash);
+    if (votes == nullptr || votes->vPaymentRequestVotes.empty())
         return nullptr;
 
-    return InsertProposalVotes(hash);
+    return std::shared_ptr<const std::vector<std::pair<uint256, int>>>(votes, &votes->vPaymentRequestVotes);
 }
 
-std::vector<std::pair<uint256, int>>* GetPaymentRequestVotes(const uint256& hash)
+std::shared_ptr<const std::map<uint256, bool>> GetSupport(const uint256& hash)
 {
-    if (vPaymentRequestVotes.count(hash) == 0)
+    LOCK2(cs_main, cs_blockVotes);
+    std::shared_ptr<const CBlockVotes> votes = FetchBlockVotes(hash);
+    if (votes == nullptr || votes->mapSupport.empty())
         return nullptr;
 
-    return InsertPaymentRequestVotes(hash);
+    return std::shared_ptr<const std::map<uint256, bool>>(votes, &votes->mapSupport);
 }
 
-std::map<uint256, bool>* GetSupport(const uint256& hash)
+std::shared_ptr<const std::map<uint256, uint64_t>> GetConsultationVotes(const uint256& hash)
 {
-    if (mapSupport.count(hash) == 0)
+    LOCK2(cs_main, cs_blockVotes);
+    std::shared_ptr<const CBlockVotes> votes = FetchBlockVotes(hash);
+    if (votes == nullptr || votes->mapConsultationVotes.empty())
         return nullptr;
 
-    return InsertSupport(hash);
+    return std::shared_ptr<const std::map<uint256, uint64_t>>(votes, &votes->mapConsultationVotes);
+}
+
+void AddProposalVote(const uint256& hash, const uint256& proposal, int vote)
+{
+    LOCK2(cs_main, cs_blockVotes);
+    ModifyBlockVotes(hash).vProposalVotes.push_back(std::make_pair(proposal, vote));
+}
+
+void AddPaymentRequestVote(const uint256& hash, const uint256& prequest, int vote)
+{
+    LOCK2(cs_main, cs_blockVotes);
+    ModifyBlockVotes(hash).vPaymentRequestVotes.push_back(std::make_pair(prequest, vote));
+}
+
+void AddSupport(const uint256& hash, const uint256& entry)
+{
+    LOCK2(cs_main, cs_blockVotes);
+    ModifyBlockVotes(hash).mapSupport.insert(std::make_pair(entry, true));
+}
+
+void AddConsultationVote(const uint256& hash, const uint256& entry, uint64_t vote)
+{
+    LOCK2(cs_main, cs_blockVotes);
+    ModifyBlockVotes(hash).mapConsultationVotes.insert(std::make_pair(entry, vote));
 }
 
-std::map<uint256, uint64_t>* GetConsultationVotes(const uint256& hash)
+std::shared_ptr<const std::set<std::vector<unsigned char>>> GetBlockVoters(const uint256& hash)
 {
-    if (mapConsultationVotes.count(hash) == 0)
+    LOCK2(cs_main, cs_blockVotes);
+    std::shared_ptr<const CBlockVotes> votes = FetchBlockVotes(hash);
+    if (votes == nullptr || !votes->fVotersIndexed)
         return nullptr;
 
-    return InsertConsultationVotes(hash);
+    return std::shared_ptr<const std::set<std::vector<unsigned char>>>(votes, &votes->setVoters);
 }
 
-std::vector<std::pair<uint256, int>>* InsertProposalVotes(const uint256& hash)
+void IndexBlockVoters(const uint256& hash)
 {
-    return &vProposalVotes[hash];
+    LOCK2(cs_main, cs_blockVotes);
+    ModifyBlockVotes(hash).fVotersIndexed = true;
 }
 
-std::vector<std::pair<uint256, int>>* InsertPaymentRequestVotes(const uint256& hash)
+void AddBlockVoter(const uint256& hash, const std::vector<unsigned char>& voter)
 {
-    return &vPaymentRequestVotes[hash];
+    LOCK2(cs_main, cs_blockVotes);
+    CBlockVotes& votes = ModifyBlockVotes(hash);
+    votes.fVotersIndexed = true;
+    votes.setVoters.insert(voter);
 }
 
-std::map<uint256, bool>* InsertSupport(const uint256& hash)
+std::shared_ptr<const std::map<std::vector<unsigned char>, std::map<int, std::map<uint256, int64_t>>>> GetBlockCompactedVotes(const uint256& hash)
 {
-    return &mapSupport[hash];
+    LOCK2(cs_main, cs_blockVotes);
+    std::shared_ptr<const CBlockVotes> votes = FetchBlockVotes(hash);
+    if (votes == nullptr || votes->mapCompactedVotes.empty())
+        return nullptr;
+
+    return std::shared_ptr<const std::map<std::vector<unsigned char>, std::map<int, std::map<uint256, int64_t>>>>(votes, &votes->mapCompactedVotes);
 }
 
-std::map<uint256, uint64_t>* InsertConsultationVotes(const uint256& hash)
+void AddBlockCompactedVotes(const uint256& hash, const std::vector<unsigned char>& voter, const std::map<int, std::map<uint256, int64_t>>& mapRemoved)
 {
-    return &mapConsultationVotes[hash];
+    LOCK2(cs_main, cs_blockVotes);
+    // Keep the first record if the block is connected again after a disconnect
+    ModifyBlockVotes(hash).mapCompactedVotes.insert(std::make_pair(voter, mapRemoved));
 }
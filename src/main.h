@@ -31,6 +31,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -49,6 +50,9 @@ static const int64_t MAX_MINT_PROOF_OF_STAKE = 0.1 * COIN;
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
+class CTxInUndo;
+class CTxUndo;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -101,10 +105,19 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Number of blocks that can be requested at any given time from a single peer whose download rate is not known yet. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;
-/** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
+/** Bounds of the number of blocks in flight from a single peer once its download rate is measured. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 1024;
+/** Time in seconds of downloading a peer is kept busy with, on top of a round trip. */
+static const unsigned int BLOCK_DOWNLOAD_PIPELINE_TIME = 2;
+/** Shortest time in microseconds a block download rate is measured over, so blocks received together don't skew it. */
+static const int64_t BLOCK_DOWNLOAD_RATE_SAMPLE_TIME = 100000;
+/** Minimum timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** A stalling peer is disconnected once it takes this many times longer than expected to send the blocks in flight. */
+static const int BLOCK_STALLING_EXPECTED_FACTOR = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
@@ -113,6 +126,10 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Largest block download window, used when the peers are fast and the blocks small. */
+static const unsigned int MAX_BLOCK_DOWNLOAD_WINDOW = 16384;
+/** Time in seconds of downloading from all peers the block download window covers. */
+static const unsigned int BLOCK_DOWNLOAD_WINDOW_TIME = 30;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -137,6 +154,10 @@ static const unsigned int MAX_FEEFILTER_CHANGE_DELAY = 5 * 60;
 static const int64_t BLOCK_DOWNLOAD_TIMEOUT_BASE = 1000000;
 /** Additional block download timeout per parallel downloading peer (i.e. 5 min) */
 static const int64_t BLOCK_DOWNLOAD_TIMEOUT_PER_PEER = 500000;
+/** Minimum block download timeout in seconds of a peer whose download rate is known */
+static const int64_t BLOCK_DOWNLOAD_TIMEOUT_MIN = 60;
+/** A peer whose download rate is known times out once a block takes this many times longer than expected */
+static const int64_t BLOCK_DOWNLOAD_TIMEOUT_EXPECTED_FACTOR = 10;
 
 static const unsigned int DEFAULT_LIMITFREERELAY = 15;
 static const bool DEFAULT_RELAYPRIORITY = true;
@@ -154,6 +175,8 @@ static const bool DEFAULT_SPENTINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
+/** Default for -blockvotescache, enough to hold the votes of a default length voting cycle */
+static const unsigned int DEFAULT_BLOCK_VOTES_CACHE = 3000;
 
 static const bool DEFAULT_TESTSAFEMODE = false;
 /** Default for -mempoolreplacement */
@@ -190,10 +213,8 @@ extern CTxMemPool mempool;
 extern CTxMemPool stempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
-extern std::map<uint256,std::vector<std::pair<uint256, int>>> vProposalVotes;
-extern std::map<uint256,std::vector<std::pair<uint256, int>>> vPaymentRequestVotes;
-extern std::map<uint256,std::map<uint256, bool>> mapSupport;
-extern std::map<uint256,std::map<uint256, uint64_t>> mapConsultationVotes;
+/** Number of blocks whose DAO votes are kept in memory once written to disk. */
+extern unsigned int nBlockVotesCacheSize;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern uint64_t nLastBlockWeight;
@@ -214,6 +235,8 @@ extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Per-category memory budgets of the non-coin state caches (bytes, 0 = no own limit) */
+extern size_t nStateCacheBudget[STATE_CACHE_CATEGORIES];
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -240,6 +263,12 @@ extern bool fPruneMode;
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Voter history deeper than this below the connected block is collapsed into the votes in effect at that point. */
+static const int VOTE_HISTORY_COMPACTION_DEPTH = MIN_BLOCKS_TO_KEEP;
+/** Name data updates deeper than this below the connected block lose their undo data and are disconnected by replaying the history. */
+static const int NAME_DATA_UNDO_DEPTH = MIN_BLOCKS_TO_KEEP;
+/** Block index entries deeper than this below the tip drop their cold fields whenever the block index is written. */
+static const int BLOCK_INDEX_COLD_KEEP_DEPTH = MIN_BLOCKS_TO_KEEP;
 
 static const signed int DEFAULT_CHECKBLOCKS = MIN_BLOCKS_TO_KEEP;
 static const unsigned int DEFAULT_CHECKLEVEL = 4;
@@ -356,9 +385,9 @@ void PruneAndFlush();
 
 bool RemoveBLSCTConflicting(CTxMemPool& pool, const COutPoint& outpoint, CCriticalSection* mpcs, CCriticalSection* spcs);
 
-/** (try to) add transaction to memory pool **/
+/** (try to) add transaction to memory pool. fPrechecked skips CheckTransaction, which the message pre-processing ran already **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CCriticalSection *mpcs, CCriticalSection *spcs, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0, bool fPrechecked=false);
 
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
@@ -371,8 +400,46 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int64_t nBlockDownloadRate;
+    int64_t nBlockDownloadLatency;
+    int nBlocksInTransitLimit;
+};
+
+/** How fast a peer sends us the blocks we request. Times are in microseconds. */
+struct CBlockDownloadStats {
+    //! Measured rate (in bytes per second) the peer sends us blocks at, or 0 if unknown.
+    int64_t nRate;
+    //! Measured time between requesting a block and it arriving, less the transfer.
+    int64_t nLatency;
+    //! When the last requested block was received from the peer.
+    int64_t nLastReceived;
+    //! Bytes and time of received blocks not counted in nRate yet.
+    int64_t nSampleBytes;
+    int64_t nSampleTime;
+
+    CBlockDownloadStats() : nRate(0), nLatency(0), nLastReceived(0), nSampleBytes(0), nSampleTime(0) {}
 };
 
+/**
+ * Measure a requested block of nBytes which was received from a peer at nTimeReceived.
+ * Updates the peer's stats and nAvgBlockSize, the average size of downloaded blocks.
+ */
+void UpdateBlockDownloadStats(CBlockDownloadStats& stats, int64_t& nAvgBlockSize, unsigned int nBytes, int64_t nTimeRequested, int64_t nTimeReceived);
+/** Number of blocks to keep in flight from a peer, enough to keep it sending over a round trip. */
+int GetBlocksInTransitLimit(int64_t nRate, int64_t nLatency, int64_t nAvgBlockSize);
+/** Time (in microseconds) a peer is expected to take to send nBlocksInFlight blocks, or 0 if unknown. */
+int64_t GetExpectedBlockDownloadTime(int64_t nRate, int64_t nLatency, int nBlocksInFlight, int64_t nAvgBlockSize);
+/** How far beyond the last common block to fetch: the blocks all peers together send in BLOCK_DOWNLOAD_WINDOW_TIME. */
+int GetBlockDownloadWindow(int64_t nTotalRate, int64_t nAvgBlockSize);
+/** Time (in microseconds) a peer may stall the block download window before it is disconnected. */
+int64_t GetBlockStallingTimeout(int64_t nExpectedTime);
+/**
+ * Time (in microseconds) a peer may take to send the first block in flight. It grows with the
+ * number of other peers we download validated blocks from, and is shortened for a peer whose
+ * download rate is known.
+ */
+int64_t GetBlockDownloadTimeout(int64_t nPowTargetSpacing, int nOtherPeersWithValidatedDownloads, int64_t nRate, int64_t nLatency, int64_t nAvgBlockSize);
+
 /**
  * Count ECDSA signature operations the old-fashioned (pre-0.6) way
  * @return number of sigops this transaction's outputs will produce when spent
@@ -408,9 +475,15 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CStateVi
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, int nHeight);
+/** Same, recording the spent outputs in txundo and keeping pstats (if given) in step with the view */
+void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, CTxUndo &txundo, int nHeight, CStateStats* pstats = nullptr);
+/** Restore an output spent by a disconnected transaction from its undo data, keeping pstats (if given) in step */
+bool ApplyTxInUndo(const CTxInUndo& undo, CStateViewCache& view, const COutPoint& out, CStateStats* pstats = nullptr);
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state);
+/** Context-independent BLSCT checks, kept for when the transaction is verified under cs_main */
+bool PrecheckBLSCTTransaction(const CTransaction& tx, CValidationState& state);
 
 /**
  * Check if transaction is final and can be included in a block with the
@@ -498,13 +571,28 @@ bool GetAddressIndex(uint160 addressHash, int type,
 bool GetAddressHistory(uint160 addressHash, uint160 addressHash2,
                      std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &addressHistory,
                      AddressHistoryFilter filter = AddressHistoryFilter::ALL, int start = 0, int end = 0);
+bool GetAddressSummary(uint160 addressHash, uint160 addressHash2, CAddressSummaryValue &summary);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/** Paged variants: at most nLimit (0 for all) entries of the address of start, in index order from start on */
+bool GetAddressIndex(const CAddressIndexKey &start, int end, size_t nLimit,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+bool GetAddressHistory(const CAddressHistoryKey &start, int end, size_t nLimit, AddressHistoryFilter filter,
+                       std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &addressHistory);
+bool GetAddressUnspent(const CAddressUnspentKey &start, size_t nLimit,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/** Sum of the history of an address below nBelowHeight, the balance a page of history starting there builds on */
+bool GetAddressHistoryTotal(uint160 addressHash, uint160 addressHash2, AddressHistoryFilter filter, int nBelowHeight,
+                            CAddressHistoryValue &total);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the serialized block as stored on disk, with the witness data, without decoding it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -520,16 +608,19 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
+ *  can fail if those validity checks fail (among other reasons). If pblockundo
+ *  is provided, it receives the undo data of the block. */
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CStateViewCache& coins,
                   const CChainParams& chainparams, std::map<int, std::vector<RangeproofEncodedData>>& blsctData,
-                  bool fJustCheck = false, bool fProofOfStake = false);
+                  bool fJustCheck = false, bool fProofOfStake = false, CBlockUndo* pblockundo = NULL);
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CStateViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. If pblockundo is provided, it
+ *  receives the undo data read for the block. */
+bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CStateViewCache& coins, bool* pfClean = NULL,
+                     CBlockUndo* pblockundo = NULL);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
@@ -584,6 +675,9 @@ void UpdateUncommittedBlockStructures(CBlock& block, const CBlockIndex* pindexPr
 /** Produce the necessary coinbase commitment for a block (modifies the hash, don't call for mined blocks). */
 std::vector<unsigned char> GenerateCoinbaseCommitment(CBlock& block, const CBlockIndex* pindexPrev, const Consensus::Params& consensusParams);
 
+/** Compute the unspent output set statistics of a view from scratch by walking its cursor. */
+bool ComputeStateStats(CStateView *view, CStateStats &stats);
+
 /** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
 class CVerifyDB {
 public:
@@ -706,13 +800,23 @@ void StempoolAddAggregationSession(const AggregationSession& ms);
 void MempoolAddEncryptedCandidateTransaction(const EncryptedCandidateTransaction& ms);
 void StempoolAddEncryptedCandidateTransaction(const EncryptedCandidateTransaction& ms);
 
-std::vector<std::pair<uint256, int>>* GetProposalVotes(const uint256& hash);
-std::vector<std::pair<uint256, int>>* GetPaymentRequestVotes(const uint256& hash);
-std::map<uint256, bool>* GetSupport(const uint256& hash);
-std::map<uint256, uint64_t>* GetConsultationVotes(const uint256& hash);
-std::vector<std::pair<uint256, int>>* InsertProposalVotes(const uint256& hash);
-std::vector<std::pair<uint256, int>>* InsertPaymentRequestVotes(const uint256& hash);
-std::map<uint256, bool>* InsertSupport(const uint256& hash);
-std::map<uint256, uint64_t>* InsertConsultationVotes(const uint256& hash);
+/** Votes of the block with the given hash, or null if it has none. The result is a snapshot later changes do not touch. */
+std::shared_ptr<const std::vector<std::pair<uint256, int>>> GetProposalVotes(const uint256& hash);
+std::shared_ptr<const std::vector<std::pair<uint256, int>>> GetPaymentRequestVotes(const uint256& hash);
+std::shared_ptr<const std::map<uint256, bool>> GetSupport(const uint256& hash);
+std::shared_ptr<const std::map<uint256, uint64_t>> GetConsultationVotes(const uint256& hash);
+/** Record a vote of the block with the given hash, written with the block index on the next flush. */
+void AddProposalVote(const uint256& hash, const uint256& proposal, int vote);
+void AddPaymentRequestVote(const uint256& hash, const uint256& prequest, int vote);
+void AddSupport(const uint256& hash, const uint256& entry);
+void AddConsultationVote(const uint256& hash, const uint256& entry, uint64_t vote);
+/** Voters whose vote list was changed by the block, or null if the block was connected before voters were indexed. */
+std::shared_ptr<const std::set<std::vector<unsigned char>>> GetBlockVoters(const uint256& hash);
+/** Mark the voters of the block as indexed, even if it changes none. */
+void IndexBlockVoters(const uint256& hash);
+void AddBlockVoter(const uint256& hash, const std::vector<unsigned char>& voter);
+/** Voter history merged by compaction while connecting the block, keyed by voter. */
+std::shared_ptr<const std::map<std::vector<unsigned char>, std::map<int, std::map<uint256, int64_t>>>> GetBlockCompactedVotes(const uint256& hash);
+void AddBlockCompactedVotes(const uint256& hash, const std::vector<unsigned char>& voter, const std::map<int, std::map<uint256, int64_t>>& mapRemoved);
 
 #endif // STOCK_MAIN_H
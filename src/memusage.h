@@ -11,6 +11,7 @@
 
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <boost/unordered_set.hpp>
@@ -86,6 +87,15 @@ static inline size_t DynamicUsage(const std::vector<X>& v)
     return MallocUsage(v.capacity() * sizeof(X));
 }
 
+static inline size_t DynamicUsage(const std::string& s)
+{
+    // Short strings live in the object itself.
+    const char* p = s.data();
+    if (p >= (const char*)&s && p < (const char*)(&s + 1))
+        return 0;
+    return MallocUsage(s.capacity() + 1);
+}
+
 template<unsigned int N, typename X, typename S, typename D>
 static inline size_t DynamicUsage(const prevector<N, X, S, D>& v)
 {
@@ -8,6 +8,7 @@
 
 #include <amount.h>
 #include <base58.h>
+#include <blockencodings.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <coins.h>
@@ -680,7 +681,7 @@ void BlockAssembler::addCombinedBLSCT(const CStateViewCache& inputs)
 
     CBlockIndex* pindexPrev = chainActive.Tip();
 
-    if (pindexPrev->nPrivateMoneySupply + nMovedToPublic < 0)
+    if (pindexPrev->GetCold().nPrivateMoneySupply + nMovedToPublic < 0)
     {
         setToCombine.clear();
         error("%s: Did not add BLS transactions to block, it would bring the private pool in negative!", __func__);
@@ -704,6 +705,12 @@ void BlockAssembler::addCombinedBLSCT(const CStateViewCache& inputs)
         return;
     }
 
+    // Compact blocks announce the combined transaction by its parts, which peers already have
+    std::vector<uint256> vParts;
+    for (const CTransaction& tx: setToCombine)
+        vParts.push_back(tx.GetHash());
+    AddCombinedBLSCTParts(combinedTx.GetHash(), vParts);
+
     nFees += combinedTx.GetFee();
     pblock->vtx.push_back(combinedTx);
 
@@ -28,6 +28,11 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -60,13 +65,6 @@
 
 namespace {
     const int MAX_OUTBOUND_CONNECTIONS = 8;
-
-    struct ListenSocket {
-        SOCKET socket;
-        bool whitelisted;
-
-        ListenSocket(SOCKET socket, bool whitelisted) : socket(socket), whitelisted(whitelisted) {}
-    };
 }
 
 const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
@@ -111,10 +109,143 @@ CCriticalSection cs_nLastNodeId;
 static CSemaphore *semOutbound = nullptr;
 boost::condition_variable messageHandlerCondition;
 
+//! Longest wait for socket events, the disconnect and timeout checks run at least this often
+static const int SOCKET_EVENTS_TIMEOUT_MS = 50;
+
+#ifdef USE_EPOLL
+//! Most events taken from the epoll instance per wakeup
+static const int MAX_SOCKET_EVENTS = 256;
+//! epoll instance ThreadSocketHandler waits on, -1 when it uses select()
+static int nEpollFd = -1;
+//! eventfd that other threads write to in order to interrupt epoll_wait
+static int nWakeupFd = -1;
+#endif
+
+void CloseSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (nWakeupFd != -1)
+        close(nWakeupFd);
+    if (nEpollFd != -1)
+        close(nEpollFd);
+    nWakeupFd = -1;
+    nEpollFd = -1;
+#endif
+}
+
+void InitSocketEvents()
+{
+#ifdef USE_EPOLL
+    CloseSocketEvents();
+    nEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (nEpollFd == -1) {
+        LogPrintf("epoll_create1 failed, using select(): %s\n", NetworkErrorString(errno));
+        return;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    nWakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (nWakeupFd == -1 || epoll_ctl(nEpollFd, EPOLL_CTL_ADD, nWakeupFd, &event) == -1) {
+        LogPrintf("eventfd setup failed, using select(): %s\n", NetworkErrorString(errno));
+        CloseSocketEvents();
+        return;
+    }
+    // Listening sockets stay level-triggered, one connection is accepted per wakeup
+    for (ListenSocket& hListenSocket: vhListenSocket) {
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(nEpollFd, EPOLL_CTL_ADD, hListenSocket.socket, &event) == -1) {
+            LogPrintf("epoll_ctl failed for listening socket, using select(): %s\n", NetworkErrorString(errno));
+            CloseSocketEvents();
+            return;
+        }
+    }
+    LogPrintf("Using epoll for network sockets\n");
+#endif
+}
+
+bool UsingSocketEvents()
+{
+#ifdef USE_EPOLL
+    return nEpollFd != -1;
+#else
+    return false;
+#endif
+}
+
+void AddSocketEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (nEpollFd == -1)
+        return;
+    // Edge-triggered: readiness is remembered in fRecvReady/fSendReady until acted on
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(nEpollFd, EPOLL_CTL_ADD, pnode->hSocket, &event) == -1) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->id, NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
+void RemoveSocketEvents(SOCKET hSocket)
+{
+#ifdef USE_EPOLL
+    if (nEpollFd == -1)
+        return;
+    struct epoll_event event = {};
+    epoll_ctl(nEpollFd, EPOLL_CTL_DEL, hSocket, &event);
+#endif
+}
+
+void WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (nWakeupFd == -1)
+        return;
+    uint64_t nOne = 1;
+    if (write(nWakeupFd, &nOne, sizeof(nOne)) != sizeof(nOne))
+        LogPrint("net", "eventfd write failed: %s\n", NetworkErrorString(errno));
+#endif
+}
+
+void WakeMessageHandler()
+{
+    messageHandlerCondition.notify_one();
+}
+
+// requires LOCK(cs_vRecvMsg)
+static bool IsRecvFlooded(CNode* pnode)
+{
+    return !pnode->vRecvMsg.empty() && pnode->vRecvMsg.front().complete() &&
+        pnode->GetTotalRecvSize() > ReceiveFloodSize();
+}
+
+bool PauseRecvIfBlocked(CNode* pnode)
+{
+    // Pause before checking, so whoever unblocks the node afterwards also wakes us up.
+    pnode->fRecvPaused = true;
+    bool fSendPending = false;
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        fSendPending = lockSend && !pnode->vSendMsg.empty();
+    }
+    if (!fSendPending && !IsRecvFlooded(pnode))
+        pnode->fRecvPaused = false;
+    return pnode->fRecvPaused;
+}
+
+void ResumeRecv(CNode* pnode)
+{
+    if (pnode->fRecvPaused.exchange(false))
+        WakeSocketHandler();
+}
+
 // Public Dandelion field
-std::map<uint256, int64_t> mDandelionEmbargo;
-std::map<uint256, int64_t> mDandelionAggregationSessionEmbargo;
-std::map<uint256, int64_t> mDandelionEncryptedCandidateEmbargo;
+CDandelionEmbargoQueue dandelionEmbargo;
+CDandelionEmbargoQueue dandelionAggregationSessionEmbargo;
+CDandelionEmbargoQueue dandelionEncryptedCandidateEmbargo;
 // Dandelion fields
 std::vector<CNode*> vDandelionInbound;
 std::vector<CNode*> vDandelionOutbound;
@@ -418,7 +549,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!UsingSocketEvents() && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return nullptr;
@@ -453,6 +584,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            AddSocketEvents(pnode);
             // Dandelion: new outbound connection
             vDandelionOutbound.push_back(pnode);
             if (vDandelionDestination.size()<DANDELION_MAX_DESTINATIONS) {
@@ -505,6 +637,7 @@ void CNode::CloseSocketDisconnect()
     if (hSocket != INVALID_SOCKET)
     {
         LogPrint("net", "disconnecting peer=%d\n", id);
+        RemoveSocketEvents(hSocket);
         CloseSocket(hSocket);
     }
 
@@ -537,12 +670,27 @@ void CNode::PushVersion()
 banmap_t CNode::setBanned;
 CCriticalSection CNode::cs_setBanned;
 bool CNode::setBannedIsDirty;
+CSubNetTrie CNode::setBannedIndex;
+std::set<std::pair<int64_t, CSubNet> > CNode::setBannedExpiry;
+
+void CNode::ReindexBanned()
+{
+    AssertLockHeld(cs_setBanned);
+    setBannedIndex.Clear();
+    setBannedExpiry.clear();
+    for (const banmap_t::value_type& entry : setBanned) {
+        setBannedIndex.Insert(entry.first);
+        setBannedExpiry.insert(std::make_pair(entry.second.nBanUntil, entry.first));
+    }
+}
 
 void CNode::ClearBanned()
 {
     {
         LOCK(cs_setBanned);
         setBanned.clear();
+        setBannedIndex.Clear();
+        setBannedExpiry.clear();
         setBannedIsDirty = true;
     }
     DumpBanlist(); //store banlist to disk
@@ -551,19 +699,16 @@ void CNode::ClearBanned()
 
 bool CNode::IsBanned(CNetAddr ip)
 {
-    bool fResult = false;
-    {
-        LOCK(cs_setBanned);
-        for (banmap_t::iterator it = setBanned.begin(); it != setBanned.end(); it++)
-        {
-            CSubNet subNet = (*it).first;
-            CBanEntry banEntry = (*it).second;
-
-            if(subNet.Match(ip) && GetTime() < banEntry.nBanUntil)
-                fResult = true;
-        }
+    std::vector<CSubNet> vMatches;
+    int64_t now = GetTime();
+    LOCK(cs_setBanned);
+    setBannedIndex.GetMatches(ip, vMatches);
+    for (const CSubNet& subNet : vMatches) {
+        banmap_t::const_iterator it = setBanned.find(subNet);
+        if (it != setBanned.end() && now < it->second.nBanUntil)
+            return true;
     }
-    return fResult;
+    return false;
 }
 
 bool CNode::IsBanned(CSubNet subnet)
@@ -599,12 +744,17 @@ void CNode::Ban(const CSubNet& subNet, const BanReason &banReason, int64_t banti
 
     {
         LOCK(cs_setBanned);
-        if (setBanned[subNet].nBanUntil < banEntry.nBanUntil) {
+        banmap_t::iterator it = setBanned.find(subNet);
+        if (it == setBanned.end()) {
             setBanned[subNet] = banEntry;
-            setBannedIsDirty = true;
-        }
-        else
+            setBannedIndex.Insert(subNet);
+        } else if (it->second.nBanUntil < banEntry.nBanUntil) {
+            setBannedExpiry.erase(std::make_pair(it->second.nBanUntil, subNet));
+            it->second = banEntry;
+        } else
             return;
+        setBannedExpiry.insert(std::make_pair(banEntry.nBanUntil, subNet));
+        setBannedIsDirty = true;
     }
     uiInterface.BannedListChanged();
     {
@@ -626,8 +776,12 @@ bool CNode::Unban(const CNetAddr &addr) {
 bool CNode::Unban(const CSubNet &subNet) {
     {
         LOCK(cs_setBanned);
-        if (!setBanned.erase(subNet))
+        banmap_t::iterator it = setBanned.find(subNet);
+        if (it == setBanned.end())
             return false;
+        setBannedExpiry.erase(std::make_pair(it->second.nBanUntil, subNet));
+        setBannedIndex.Erase(subNet);
+        setBanned.erase(it);
         setBannedIsDirty = true;
     }
     uiInterface.BannedListChanged();
@@ -645,6 +799,7 @@ void CNode::SetBanned(const banmap_t &banMap)
 {
     LOCK(cs_setBanned);
     setBanned = banMap;
+    ReindexBanned();
     setBannedIsDirty = true;
 }
 
@@ -653,19 +808,14 @@ void CNode::SweepBanned()
     int64_t now = GetTime();
 
     LOCK(cs_setBanned);
-    banmap_t::iterator it = setBanned.begin();
-    while(it != setBanned.end())
+    while (!setBannedExpiry.empty() && now > setBannedExpiry.begin()->first)
     {
-        CSubNet subNet = (*it).first;
-        CBanEntry banEntry = (*it).second;
-        if(now > banEntry.nBanUntil)
-        {
-            setBanned.erase(it++);
-            setBannedIsDirty = true;
-            LogPrint("net", "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, subNet.ToString());
-        }
-        else
-            ++it;
+        CSubNet subNet = setBannedExpiry.begin()->second;
+        setBannedExpiry.erase(setBannedExpiry.begin());
+        setBannedIndex.Erase(subNet);
+        setBanned.erase(subNet);
+        setBannedIsDirty = true;
+        LogPrint("net", "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, subNet.ToString());
     }
 }
 
@@ -682,21 +832,17 @@ void CNode::SetBannedSetDirty(bool dirty)
 }
 
 
-std::vector<CSubNet> CNode::vWhitelistedRange;
-CCriticalSection CNode::cs_vWhitelistedRange;
+CSubNetTrie CNode::setWhitelistedRange;
+CCriticalSection CNode::cs_setWhitelistedRange;
 
 bool CNode::IsWhitelistedRange(const CNetAddr &addr) {
-    LOCK(cs_vWhitelistedRange);
-    for(const CSubNet& subnet: vWhitelistedRange) {
-        if (subnet.Match(addr))
-            return true;
-    }
-    return false;
+    LOCK(cs_setWhitelistedRange);
+    return setWhitelistedRange.Match(addr);
 }
 
 void CNode::AddWhitelistedRange(const CSubNet &subnet) {
-    LOCK(cs_vWhitelistedRange);
-    vWhitelistedRange.push_back(subnet);
+    LOCK(cs_setWhitelistedRange);
+    setWhitelistedRange.Insert(subnet);
 }
 
 #undef X
@@ -848,10 +994,10 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSharedNetMsg>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+        const CSerializeData &data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -885,6 +1031,8 @@ void SocketSendData(CNode *pnode)
     if (it == pnode->vSendMsg.end()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
+        // Receiving waits for the send queue to drain
+        ResumeRecv(pnode);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
 }
@@ -1063,7 +1211,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!UsingSocketEvents() && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1105,6 +1253,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        AddSocketEvents(pnode);
         // Dandelion: new inbound connection
         vDandelionInbound.push_back(pnode);
         CNode* pto = SelectFromDandelionDestinations();
@@ -1116,9 +1265,173 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+/**
+ * Wait for socket events with select(). The fd_sets are rebuilt every time
+ * and only sockets below FD_SETSIZE can be watched.
+ */
+static void WaitSocketEventsSelect(int nTimeoutMs, std::vector<const ListenSocket*>& vAccept)
+{
+    struct timeval timeout = MillisToTimeval(nTimeoutMs);
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for(const ListenSocket& hListenSocket: vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for(CNode* pnode: vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, select() for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend &&!pnode->vSendMsg.empty()) {
+                    FD_SET(pnode->hSocket, &fdsetSend);
+                    continue;
+                }
+            }
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && (
+                    pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                    pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(nTimeoutMs);
+    }
+
+    for(const ListenSocket& hListenSocket: vhListenSocket)
+    {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            vAccept.push_back(&hListenSocket);
+    }
+
+    LOCK(cs_vNodes);
+    for(CNode* pnode: vNodes)
+    {
+        pnode->fRecvReady = pnode->hSocket != INVALID_SOCKET &&
+            (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError));
+        pnode->fSendReady = pnode->hSocket != INVALID_SOCKET && FD_ISSET(pnode->hSocket, &fdsetSend);
+    }
+}
+
+#ifdef USE_EPOLL
+/**
+ * Wait for socket events on the epoll instance. Node sockets are registered
+ * edge-triggered, so their readiness is kept in the node until it has been
+ * used up, even if it is not acted on right away.
+ */
+static void WaitSocketEventsEpoll(int nTimeoutMs, std::vector<const ListenSocket*>& vAccept)
+{
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    int nEvents = epoll_wait(nEpollFd, events, MAX_SOCKET_EVENTS, nTimeoutMs);
+    boost::this_thread::interruption_point();
+
+    if (nEvents == -1)
+    {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            MilliSleep(SOCKET_EVENTS_TIMEOUT_MS);
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++)
+    {
+        void* ptr = events[i].data.ptr;
+        if (ptr == nullptr) {
+            // woken up by another thread
+            uint64_t nCount;
+            if (read(nWakeupFd, &nCount, sizeof(nCount)) != sizeof(nCount))
+                LogPrint("net", "eventfd read failed: %s\n", NetworkErrorString(errno));
+            continue;
+        }
+        bool fListen = false;
+        for(const ListenSocket& hListenSocket: vhListenSocket)
+        {
+            if (ptr == &hListenSocket) {
+                vAccept.push_back(&hListenSocket);
+                fListen = true;
+                break;
+            }
+        }
+        if (fListen)
+            continue;
+        // Sockets are unregistered before they are closed, and nodes are only
+        // deleted by this thread after that, so the node is still alive here.
+        CNode* pnode = (CNode*)ptr;
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            pnode->fRecvReady = true;
+        if (events[i].events & EPOLLOUT)
+            pnode->fSendReady = true;
+    }
+}
+#endif
+
+void WaitSocketEvents(int nTimeoutMs, std::vector<const ListenSocket*>& vAccept)
+{
+#ifdef USE_EPOLL
+    if (UsingSocketEvents()) {
+        WaitSocketEventsEpoll(nTimeoutMs, vAccept);
+        return;
+    }
+#endif
+    WaitSocketEventsSelect(nTimeoutMs, vAccept);
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    // some socket was left ready without being used up, do not wait for events
+    bool fMoreWork = false;
     while (true)
     {
         //
@@ -1190,94 +1503,16 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for(const ListenSocket& hListenSocket: vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for(CNode* pnode: vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend &&!pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
-        }
+        std::vector<const ListenSocket*> vAccept;
+        WaitSocketEvents(fMoreWork ? 0 : SOCKET_EVENTS_TIMEOUT_MS, vAccept);
+        fMoreWork = false;
 
         //
         // Accept new connections
         //
-        for(const ListenSocket& hListenSocket: vhListenSocket)
+        for(const ListenSocket* pListenSocket: vAccept)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
-            }
+            AcceptConnection(*pListenSocket);
         }
 
         //
@@ -1299,15 +1534,20 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (pnode->fRecvReady)
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                // Hold back like WaitSocketEventsSelect does
+                if (lockRecv && UsingSocketEvents())
+                    PauseRecvIfBlocked(pnode);
+                if (lockRecv && !pnode->fRecvPaused)
                 {
                     {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
                         int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        // a full buffer may have left more to read
+                        pnode->fRecvReady = nBytes == (int)sizeof(pchBuf);
                         if (nBytes > 0)
                         {
                             if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
@@ -1327,7 +1567,9 @@ void ThreadSocketHandler()
                         {
                             // error
                             int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                            if (nErr == WSAEINTR)
+                                pnode->fRecvReady = true;
+                            else if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINPROGRESS)
                             {
                                 if (!pnode->fDisconnect)
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
@@ -1335,6 +1577,8 @@ void ThreadSocketHandler()
                             }
                         }
                     }
+                    if (pnode->fRecvReady)
+                        fMoreWork = true;
                 }
             }
 
@@ -1343,11 +1587,14 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (pnode->fSendReady)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
+                {
+                    pnode->fSendReady = false;
                     SocketSendData(pnode);
+                }
             }
 
             //
@@ -1559,91 +1806,78 @@ bool LocalDandelionDestinationPushInventory(const CInv& inv) {
     }
 }
 
-bool InsertDandelionEmbargo(const uint256& hash, const int64_t& embargo) {
-    auto pair = mDandelionEmbargo.insert(std::make_pair(hash, embargo));
-    return pair.second;
+bool CDandelionEmbargoQueue::Insert(const uint256& hash, int64_t nEmbargo) {
+    if (!mapEmbargo.insert(std::make_pair(hash, nEmbargo)).second)
+        return false;
+    setByExpiry.insert(std::make_pair(nEmbargo, hash));
+    return true;
 }
 
-bool IsTxDandelionEmbargoed(const uint256& hash) {
-    auto pair = mDandelionEmbargo.find(hash);
-    if (pair != mDandelionEmbargo.end()) {
-        return true;
-    } else {
+bool CDandelionEmbargoQueue::Contains(const uint256& hash) const {
+    return mapEmbargo.count(hash) > 0;
+}
+
+bool CDandelionEmbargoQueue::Remove(const uint256& hash) {
+    auto iter = mapEmbargo.find(hash);
+    if (iter == mapEmbargo.end())
         return false;
+    setByExpiry.erase(std::make_pair(iter->second, hash));
+    mapEmbargo.erase(iter);
+    return true;
+}
+
+void CDandelionEmbargoQueue::PopExpired(int64_t nTime, std::vector<uint256>& vExpired) {
+    auto iter = setByExpiry.begin();
+    for (; iter != setByExpiry.end() && iter->first < nTime; iter++) {
+        vExpired.push_back(iter->second);
+        mapEmbargo.erase(iter->second);
     }
+    setByExpiry.erase(setByExpiry.begin(), iter);
+}
+
+bool InsertDandelionEmbargo(const uint256& hash, const int64_t& embargo) {
+    LOCK(cs_mapDandelionEmbargo);
+    return dandelionEmbargo.Insert(hash, embargo);
+}
+
+bool IsTxDandelionEmbargoed(const uint256& hash) {
+    LOCK(cs_mapDandelionEmbargo);
+    return dandelionEmbargo.Contains(hash);
 }
 
 bool RemoveDandelionEmbargo(const uint256& hash) {
-    bool removed = false;
-    for (auto iter=mDandelionEmbargo.begin(); iter!=mDandelionEmbargo.end();) {
-        if (iter->first==hash) {
-            iter = mDandelionEmbargo.erase(iter);
-            removed = true;
-        } else {
-            iter++;
-        }
-    }
-    return removed;
+    LOCK(cs_mapDandelionEmbargo);
+    return dandelionEmbargo.Remove(hash);
 }
 
 bool InsertDandelionAggregationSessionEmbargo(const uint256& hash, const int64_t& embargo) {
     LOCK(cs_mapDandelionEmbargo);
-    auto pair = mDandelionAggregationSessionEmbargo.insert(std::make_pair(hash, embargo));
-    return pair.second;
+    return dandelionAggregationSessionEmbargo.Insert(hash, embargo);
 }
 
 bool IsDandelionAggregationSessionEmbargoed(const uint256& hash) {
     LOCK(cs_mapDandelionEmbargo);
-    auto pair = mDandelionAggregationSessionEmbargo.find(hash);
-    if (pair != mDandelionAggregationSessionEmbargo.end()) {
-        return true;
-    } else {
-        return false;
-    }
+    return dandelionAggregationSessionEmbargo.Contains(hash);
 }
 
 bool RemoveDandelionAggregationSessionEmbargo(const uint256& hash) {
     LOCK(cs_mapDandelionEmbargo);
-    bool removed = false;
-    for (auto iter=mDandelionAggregationSessionEmbargo.begin(); iter!=mDandelionAggregationSessionEmbargo.end();) {
-        if (iter->first==hash) {
-            iter = mDandelionAggregationSessionEmbargo.erase(iter);
-            removed = true;
-        } else {
-            iter++;
-        }
-    }
-    return removed;
+    return dandelionAggregationSessionEmbargo.Remove(hash);
 }
 
 bool InsertDandelionEncryptedCandidateEmbargo(const uint256 &ec, const int64_t& embargo) {
     LOCK(cs_mapDandelionEmbargo);
-    auto pair = mDandelionEncryptedCandidateEmbargo.insert(std::make_pair(ec, embargo));
-    return pair.second;
+    return dandelionEncryptedCandidateEmbargo.Insert(ec, embargo);
 }
 
 bool IsDandelionEncryptedCandidateEmbargoed(const uint256 &ec) {
     LOCK(cs_mapDandelionEmbargo);
-    auto pair = mDandelionEncryptedCandidateEmbargo.find(ec);
-    if (pair != mDandelionEncryptedCandidateEmbargo.end()) {
-        return true;
-    } else {
-        return false;
-    }
+    return dandelionEncryptedCandidateEmbargo.Contains(ec);
 }
 
 bool RemoveDandelionEncryptedCandidateEmbargo(const uint256 &ec) {
     LOCK(cs_mapDandelionEmbargo);
-    bool removed = false;
-    for (auto iter=mDandelionEncryptedCandidateEmbargo.begin(); iter!=mDandelionEncryptedCandidateEmbargo.end();) {
-        if (iter->first==ec) {
-            iter = mDandelionEncryptedCandidateEmbargo.erase(iter);
-            removed = true;
-        } else {
-            iter++;
-        }
-    }
-    return removed;
+    return dandelionEncryptedCandidateEmbargo.Remove(ec);
 }
 
 CNode* SelectFromDandelionDestinations()
@@ -2219,9 +2453,12 @@ void ThreadMessageHandler()
                     if (!GetNodeSignals().ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
 
+                    if (pnode->fRecvPaused && !IsRecvFlooded(pnode))
+                        ResumeRecv(pnode);
+
                     if (pnode->nSendSize < SendBufferSize())
                     {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
+                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].ready()))
                         {
                             fSleep = false;
                         }
@@ -2464,6 +2701,7 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     MapPort(GetBoolArg("-upnp", DEFAULT_UPNP));
 
     // Send and receive from sockets, accept connections
+    InitSocketEvents();
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
     // Initiate outbound connections from -addnode
@@ -2523,6 +2761,7 @@ public:
         vNodes.clear();
         vNodesDisconnected.clear();
         vhListenSocket.clear();
+        CloseSocketEvents();
         delete semOutbound;
         semOutbound = nullptr;
         delete pnodeLocalHost;
@@ -2860,6 +3099,9 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fNetworkNode = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fRecvReady = false;
+    fSendReady = false;
+    fRecvPaused = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
@@ -3003,17 +3245,113 @@ void CNode::EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    CSerializeData data;
+    ssSend.GetAndClear(data);
+    nSendSize += data.size();
+    vSendMsg.push_back(std::make_shared<const CSerializeData>(std::move(data)));
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::PushSharedMessage(const char* pszCommand, const CSharedNetMsg& msg)
+{
+    assert(msg->size() >= CMessageHeader::HEADER_SIZE);
+
+    // Dropping and fuzzing work on ssSend, so go through it with a copy of the payload
+    if (mapArgs.count("-dropmessagestest") || mapArgs.count("-fuzzmessagestest")) {
+        try {
+            BeginMessage(pszCommand);
+            const char* pchPayload = msg->data() + CMessageHeader::HEADER_SIZE;
+            ssSend.insert(ssSend.end(), pchPayload, msg->data() + msg->size());
+            EndMessage(pszCommand);
+        } catch (...) {
+            AbortMessage();
+            throw;
+        }
+        return;
+    }
+
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: %s (%d bytes, shared) peer=%d\n", SanitizeString(pszCommand), msg->size() - CMessageHeader::HEADER_SIZE, id);
+
+    mapSendBytesPerMsgCmd[std::string(pszCommand)] += msg->size();
+    nSendSize += msg->size();
+    vSendMsg.push_back(msg);
+
+    if (vSendMsg.size() == 1)
+        SocketSendData(this);
+}
+
+CNetMessageCache netMessageCache(MAX_NET_MESSAGE_CACHE_SIZE);
+
+CSharedNetMsg FinalizeSharedNetMsg(const char* pszCommand, CDataStream& ss)
+{
+    assert(ss.size() >= CMessageHeader::HEADER_SIZE);
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, ss.size() - CMessageHeader::HEADER_SIZE);
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ssHeader(SER_NETWORK, INIT_PROTO_VERSION);
+    ssHeader << hdr;
+    assert(ssHeader.size() == CMessageHeader::HEADER_SIZE);
+    std::copy(ssHeader.begin(), ssHeader.end(), ss.begin());
+
+    CSerializeData data;
+    ss.GetAndClear(data);
+    return std::make_shared<const CSerializeData>(std::move(data));
+}
+
+CNetMessageCache::CNetMessageCache(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn), nTotalSize(0)
+{
+}
+
+CSharedNetMsg CNetMessageCache::Get(const std::string& strCommand, const uint256& hash, int nVersion) const
+{
+    LOCK(cs);
+    std::map<MessageKey, CSharedNetMsg>::const_iterator it = mapMessages.find(MessageKey(strCommand, hash, nVersion));
+    if (it == mapMessages.end())
+        return CSharedNetMsg();
+    return it->second;
+}
+
+void CNetMessageCache::Add(const std::string& strCommand, const uint256& hash, int nVersion, const CSharedNetMsg& msg)
+{
+    if (msg->size() > nMaxSize)
+        return;
+
+    LOCK(cs);
+    MessageKey key(strCommand, hash, nVersion);
+    if (!mapMessages.insert(std::make_pair(key, msg)).second)
+        return;
+    queue.push_back(key);
+    nTotalSize += msg->size();
+
+    while (nTotalSize > nMaxSize) {
+        std::map<MessageKey, CSharedNetMsg>::iterator it = mapMessages.find(queue.front());
+        nTotalSize -= it->second->size();
+        mapMessages.erase(it);
+        queue.pop_front();
+    }
+}
+
+void CNetMessageCache::Clear()
+{
+    LOCK(cs);
+    mapMessages.clear();
+    queue.clear();
+    nTotalSize = 0;
+}
+
+size_t CNetMessageCache::GetTotalSize() const
+{
+    LOCK(cs);
+    return nTotalSize;
+}
+
 //
 // CBanDB
 //
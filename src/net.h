@@ -21,7 +21,10 @@
 
 #include <atomic>
 #include <deque>
+#include <map>
+#include <memory>
 #include <stdint.h>
+#include <tuple>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -107,6 +110,47 @@ bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/** Wake the message handler thread, e.g. when a message finished pre-processing */
+void WakeMessageHandler();
+
+struct ListenSocket {
+    SOCKET socket;
+    bool whitelisted;
+
+    ListenSocket(SOCKET socket, bool whitelisted) : socket(socket), whitelisted(whitelisted) {}
+};
+
+/**
+ * Create the epoll instance ThreadSocketHandler waits on and register the
+ * listening sockets with it. Leaves ThreadSocketHandler on select() if that
+ * is not possible.
+ */
+void InitSocketEvents();
+void CloseSocketEvents();
+/** Whether ThreadSocketHandler waits on epoll rather than select() */
+bool UsingSocketEvents();
+/** Start watching the socket of a node that was just added to vNodes */
+void AddSocketEvents(CNode* pnode);
+/**
+ * Stop watching a socket before it is closed. Closing alone is not enough
+ * while a forked child (e.g. -blocknotify) still holds a copy of it.
+ */
+void RemoveSocketEvents(SOCKET hSocket);
+/** Interrupt ThreadSocketHandler's wait for socket events */
+void WakeSocketHandler();
+/**
+ * Wait up to nTimeoutMs for socket events. The nodes ready to receive or send
+ * get fRecvReady/fSendReady set, the listening sockets with connections to
+ * accept are added to vAccept.
+ */
+void WaitSocketEvents(int nTimeoutMs, std::vector<const ListenSocket*>& vAccept);
+/**
+ * Hold back receiving for a node which still has data to send or a flooded
+ * receive buffer, returning whether it is paused. Requires cs_vRecvMsg.
+ */
+bool PauseRecvIfBlocked(CNode* pnode);
+/** Let a paused node receive again, waking ThreadSocketHandler up */
+void ResumeRecv(CNode* pnode);
 
 struct CombinerAll
 {
@@ -185,10 +229,29 @@ extern CCriticalSection cs_vAddedNodes;
 extern NodeId nLastNodeId;
 extern CCriticalSection cs_nLastNodeId;
 
-// Public Dandelion field
-extern std::map<uint256, int64_t> mDandelionEmbargo;
-extern std::map<uint256, int64_t> mDandelionAggregationSessionEmbargo;
-extern std::map<uint256, int64_t> mDandelionEncryptedCandidateEmbargo;
+/**
+ * Embargoes of Dandelion objects, ordered by the time they expire so the
+ * expired ones are found without looking at the others.
+ */
+class CDandelionEmbargoQueue
+{
+private:
+    std::map<uint256, int64_t> mapEmbargo;
+    std::set<std::pair<int64_t, uint256> > setByExpiry;
+
+public:
+    bool Insert(const uint256& hash, int64_t nEmbargo);
+    bool Contains(const uint256& hash) const;
+    bool Remove(const uint256& hash);
+    //! Remove the embargoes which expired before nTime, oldest first
+    void PopExpired(int64_t nTime, std::vector<uint256>& vExpired);
+    size_t size() const { return mapEmbargo.size(); }
+};
+
+// Public Dandelion field, guarded by cs_mapDandelionEmbargo
+extern CDandelionEmbargoQueue dandelionEmbargo;
+extern CDandelionEmbargoQueue dandelionAggregationSessionEmbargo;
+extern CDandelionEmbargoQueue dandelionEncryptedCandidateEmbargo;
 // Dandelion methods
 bool IsDandelionInbound(const CNode* const pnode);
 bool IsDandelionOutbound(const CNode* const pnode);
@@ -259,6 +322,16 @@ public:
 
 
 
+/** Work on a received message done away from the message handler thread */
+class CNetMessagePreprocessing
+{
+public:
+    std::atomic<bool> fDone;
+
+    CNetMessagePreprocessing() : fDone(false) {}
+    virtual ~CNetMessagePreprocessing() {}
+};
+
 class CNetMessage {
 public:
     bool in_data;                   // parsing header (false) or data (true)
@@ -272,6 +345,8 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
+    std::shared_ptr<CNetMessagePreprocessing> preprocessed; // set once handed to the pre-processing threads
+
     CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
@@ -287,6 +362,12 @@ public:
         return (hdr.nMessageSize == nDataPos);
     }
 
+    //! complete and not waiting to be pre-processed
+    bool ready() const
+    {
+        return complete() && (!preprocessed || preprocessed->fDone);
+    }
+
     void SetVersion(int nVersionIn)
     {
         hdrbuf.SetVersion(nVersionIn);
@@ -359,6 +440,56 @@ public:
 
 typedef std::map<CSubNet, CBanEntry> banmap_t;
 
+/** A message ready to go on the wire, header and checksum included, shared by the send queues of any number of peers */
+typedef std::shared_ptr<const CSerializeData> CSharedNetMsg;
+
+/** Maximum total size of the messages kept by netMessageCache */
+static const size_t MAX_NET_MESSAGE_CACHE_SIZE = 32 * 1000 * 1000;
+
+/** Write the header of the message in the first HEADER_SIZE bytes of ss, which hold the payload after them, and take its content */
+CSharedNetMsg FinalizeSharedNetMsg(const char* pszCommand, CDataStream& ss);
+
+/** Serialize obj with nVersion into a complete pszCommand message */
+template<typename T>
+CSharedNetMsg MakeSharedNetMsg(const char* pszCommand, int nVersion, const T& obj)
+{
+    CDataStream ss(SER_NETWORK, nVersion);
+    ss.resize(CMessageHeader::HEADER_SIZE);
+    ss << obj;
+    return FinalizeSharedNetMsg(pszCommand, ss);
+}
+
+/**
+ * Messages recently built for an object, keyed by command, hash of the object
+ * and serialization version, so that a block or transaction requested by many
+ * peers is serialized and checksummed once and the same buffer is queued for
+ * all of them. The oldest messages are dropped beyond nMaxSize bytes; peers
+ * still holding one in their send queue keep it alive until it is sent.
+ */
+class CNetMessageCache
+{
+private:
+    typedef std::tuple<std::string, uint256, int> MessageKey;
+
+    mutable CCriticalSection cs;
+    std::map<MessageKey, CSharedNetMsg> mapMessages;
+    std::deque<MessageKey> queue;
+    size_t nMaxSize;
+    size_t nTotalSize;
+
+public:
+    explicit CNetMessageCache(size_t nMaxSizeIn);
+
+    //! The message cached for the object, or null
+    CSharedNetMsg Get(const std::string& strCommand, const uint256& hash, int nVersion) const;
+    void Add(const std::string& strCommand, const uint256& hash, int nVersion, const CSharedNetMsg& msg);
+    void Clear();
+
+    size_t GetTotalSize() const;
+};
+
+extern CNetMessageCache netMessageCache;
+
 /** Information about a peer */
 class CNode
 {
@@ -371,7 +502,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSharedNetMsg> vSendMsg;
     CCriticalSection cs_vSend;
 
     CCriticalSection cs_sendProcessing;
@@ -402,6 +533,11 @@ public:
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     std::atomic_bool fDisconnect;
+    // socket readiness reported to ThreadSocketHandler and not acted on yet
+    bool fRecvReady;
+    bool fSendReady;
+    // ThreadSocketHandler held back reading, wake it once it may continue
+    std::atomic_bool fRecvPaused;
     bool fSupportsDandelion = false;
     // We use fRelayTxes for two purposes -
     // a) it allows us to not relay tx invs before receiving the peer's version message
@@ -423,11 +559,18 @@ protected:
     static banmap_t setBanned;
     static CCriticalSection cs_setBanned;
     static bool setBannedIsDirty;
+    // Prefix index of the keys of setBanned, for matching addresses against them
+    static CSubNetTrie setBannedIndex;
+    // Entries of setBanned ordered by banned-until-time, for expiring them
+    static std::set<std::pair<int64_t, CSubNet> > setBannedExpiry;
 
     // Whitelisted ranges. Any node connecting from these is automatically
     // whitelisted (as well as those connecting to whitelisted binds).
-    static std::vector<CSubNet> vWhitelistedRange;
-    static CCriticalSection cs_vWhitelistedRange;
+    static CSubNetTrie setWhitelistedRange;
+    static CCriticalSection cs_setWhitelistedRange;
+
+    //! Rebuild setBannedIndex and setBannedExpiry from setBanned
+    static void ReindexBanned();
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
@@ -536,7 +679,7 @@ public:
     {
         unsigned int total = 0;
         for(const CNetMessage &msg: vRecvMsg)
-            total += msg.vRecv.size() + 24;
+            total += (msg.complete() ? msg.hdr.nMessageSize : msg.vRecv.size()) + 24;
         return total;
     }
 
@@ -641,6 +784,22 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend);
 
+    //! Queue a message built by MakeSharedNetMsg without copying it
+    void PushSharedMessage(const char* pszCommand, const CSharedNetMsg& msg);
+
+    //! Push obj as a pszCommand message, sharing the serialization with the other peers sent the object identified by hash
+    template<typename T>
+    void PushCachedMessage(int flag, const char* pszCommand, const uint256& hash, const T& obj)
+    {
+        int nSendVersion = ssSend.GetVersion() | flag;
+        CSharedNetMsg msg = netMessageCache.Get(pszCommand, hash, nSendVersion);
+        if (!msg) {
+            msg = MakeSharedNetMsg(pszCommand, nSendVersion, obj);
+            netMessageCache.Add(pszCommand, hash, nSendVersion, msg);
+        }
+        PushSharedMessage(pszCommand, msg);
+    }
+
     void PushVersion();
 
 
@@ -25,6 +25,7 @@
 #include <arpa/inet.h>
 #endif
 #include <fcntl.h>
+#include <poll.h>
 #endif
 
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
@@ -236,6 +237,22 @@ struct timeval MillisToTimeval(int64_t nTimeout)
     return timeout;
 }
 
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeout)
+{
+#ifdef WIN32
+    struct timeval timeout = MillisToTimeval(nTimeout);
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(hSocket, &fdset);
+    return select(hSocket + 1, fWrite ? nullptr : &fdset, fWrite ? &fdset : nullptr, nullptr, &timeout);
+#else
+    struct pollfd pollfd = {};
+    pollfd.fd = hSocket;
+    pollfd.events = fWrite ? POLLOUT : POLLIN;
+    return poll(&pollfd, 1, nTimeout);
+#endif
+}
+
 /**
  * Read bytes from socket. This will either read the full number of bytes requested
  * or return False on error or timeout.
@@ -251,7 +268,7 @@ bool static InterruptibleRecv(char* data, size_t len, int timeout, SOCKET& hSock
 {
     int64_t curTime = GetTimeMillis();
     int64_t endTime = curTime + timeout;
-    // Maximum time to wait in one select call. It will take up until this time (in millis)
+    // Maximum time to wait in one call. It will take up until this time (in millis)
     // to break off in case of an interruption.
     const int64_t maxWait = 1000;
     while (len > 0 && curTime < endTime) {
@@ -264,14 +281,7 @@ bool static InterruptibleRecv(char* data, size_t len, int timeout, SOCKET& hSock
         } else { // Other error or blocking
             int nErr = WSAGetLastError();
             if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL) {
-                if (!IsSelectableSocket(hSocket)) {
-                    return false;
-                }
-                struct timeval tval = MillisToTimeval(std::min(endTime - curTime, maxWait));
-                fd_set fdset;
-                FD_ZERO(&fdset);
-                FD_SET(hSocket, &fdset);
-                int nRet = select(hSocket + 1, &fdset, nullptr, nullptr, &tval);
+                int nRet = WaitForSocket(hSocket, false, std::min(endTime - curTime, maxWait));
                 if (nRet == SOCKET_ERROR) {
                     return false;
                 }
@@ -472,11 +482,7 @@ bool static ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRe
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL)
         {
-            struct timeval timeout = MillisToTimeval(nTimeout);
-            fd_set fdset;
-            FD_ZERO(&fdset);
-            FD_SET(hSocket, &fdset);
-            int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
+            int nRet = WaitForSocket(hSocket, true, nTimeout);
             if (nRet == 0)
             {
                 LogPrint("net", "connection to %s timeout\n", addrConnect.ToString());
@@ -485,7 +491,7 @@ bool static ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRe
             }
             if (nRet == SOCKET_ERROR)
             {
-                LogPrintf("select() for %s failed: %s\n", addrConnect.ToString(), NetworkErrorString(WSAGetLastError()));
+                LogPrintf("waiting for %s failed: %s\n", addrConnect.ToString(), NetworkErrorString(WSAGetLastError()));
                 CloseSocket(hSocket);
                 return false;
             }
@@ -502,7 +508,7 @@ bool static ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRe
             }
             if (nRet != 0)
             {
-                LogPrintf("connect() to %s failed after select(): %s\n", addrConnect.ToString(), NetworkErrorString(nRet));
+                LogPrintf("connect() to %s failed after waiting: %s\n", addrConnect.ToString(), NetworkErrorString(nRet));
                 CloseSocket(hSocket);
                 return false;
             }
@@ -1344,6 +1350,25 @@ static inline int NetmaskBits(uint8_t x)
     }
 }
 
+int CSubNet::GetPrefixLength() const
+{
+    int nBits = 0;
+    int n = 0;
+    for (; n < 16 && netmask[n] == 0xff; ++n)
+        nBits += 8;
+    if (n < 16) {
+        int bits = NetmaskBits(netmask[n]);
+        if (bits < 0)
+            return -1;
+        nBits += bits;
+        ++n;
+    }
+    for (; n < 16; ++n)
+        if (netmask[n] != 0x00)
+            return -1;
+    return nBits;
+}
+
 std::string CSubNet::ToString() const
 {
     /* Parse binary 1{n}0{N-n} to see if mask can be represented as /n */
@@ -1402,6 +1427,122 @@ bool operator<(const CSubNet& a, const CSubNet& b)
     return (a.network < b.network || (a.network == b.network && memcmp(a.netmask, b.netmask, 16) < 0));
 }
 
+static inline int AddrBit(const unsigned char *ip, int n)
+{
+    return (ip[n / 8] >> (7 - n % 8)) & 1;
+}
+
+CSubNetTrie::CSubNetTrie() : nSize(0)
+{
+}
+
+bool CSubNetTrie::Insert(const CSubNet &subnet)
+{
+    if (!subnet.IsValid())
+        return false;
+    int nBits = subnet.GetPrefixLength();
+    if (nBits < 0) {
+        if (!setIrregular.insert(subnet).second)
+            return false;
+        nSize++;
+        return true;
+    }
+
+    Node *node = &root;
+    for (int n = 0; n < nBits; n++) {
+        std::unique_ptr<Node> &next = node->child[AddrBit(subnet.network.ip, n)];
+        if (!next)
+            next.reset(new Node());
+        node = next.get();
+    }
+    if (node->subnet)
+        return false;
+    node->subnet.reset(new CSubNet(subnet));
+    nSize++;
+    return true;
+}
+
+bool CSubNetTrie::Erase(const CSubNet &subnet)
+{
+    if (!subnet.IsValid())
+        return false;
+    int nBits = subnet.GetPrefixLength();
+    if (nBits < 0) {
+        if (!setIrregular.erase(subnet))
+            return false;
+        nSize--;
+        return true;
+    }
+
+    std::vector<Node*> vPath;
+    vPath.reserve(nBits + 1);
+    Node *node = &root;
+    vPath.push_back(node);
+    for (int n = 0; n < nBits; n++) {
+        node = node->child[AddrBit(subnet.network.ip, n)].get();
+        if (!node)
+            return false;
+        vPath.push_back(node);
+    }
+    if (!node->subnet || *node->subnet != subnet)
+        return false;
+    node->subnet.reset();
+    nSize--;
+
+    // Free the branch leading to the subnet as far up as nothing else hangs from it
+    for (int n = nBits; n > 0; n--) {
+        Node *leaf = vPath[n];
+        if (leaf->subnet || leaf->child[0] || leaf->child[1])
+            break;
+        vPath[n - 1]->child[AddrBit(subnet.network.ip, n - 1)].reset();
+    }
+    return true;
+}
+
+void CSubNetTrie::Clear()
+{
+    root.child[0].reset();
+    root.child[1].reset();
+    root.subnet.reset();
+    setIrregular.clear();
+    nSize = 0;
+}
+
+bool CSubNetTrie::Match(const CNetAddr &addr) const
+{
+    if (!addr.IsValid())
+        return false;
+    const Node *node = &root;
+    for (int n = 0; node; n++) {
+        if (node->subnet)
+            return true;
+        if (n == 128)
+            break;
+        node = node->child[AddrBit(addr.ip, n)].get();
+    }
+    for (const CSubNet& subnet : setIrregular)
+        if (subnet.Match(addr))
+            return true;
+    return false;
+}
+
+void CSubNetTrie::GetMatches(const CNetAddr &addr, std::vector<CSubNet> &vMatches) const
+{
+    if (!addr.IsValid())
+        return;
+    for (const CSubNet& subnet : setIrregular)
+        if (subnet.Match(addr))
+            vMatches.push_back(subnet);
+    const Node *node = &root;
+    for (int n = 0; node; n++) {
+        if (node->subnet)
+            vMatches.push_back(*node->subnet);
+        if (n == 128)
+            break;
+        node = node->child[AddrBit(addr.ip, n)].get();
+    }
+}
+
 #ifdef WIN32
 std::string NetworkErrorString(int err)
 {
@@ -13,6 +13,8 @@
 #include <serialize.h>
 
 #include <stdint.h>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -105,6 +107,7 @@ class CNetAddr
         }
 
         friend class CSubNet;
+        friend class CSubNetTrie;
 };
 
 class CSubNet
@@ -126,6 +129,9 @@ class CSubNet
 
         bool Match(const CNetAddr &addr) const;
 
+        //! Number of leading bits of the netmask over the 128-bit address, -1 if it is not a prefix
+        int GetPrefixLength() const;
+
         std::string ToString() const;
         bool IsValid() const;
 
@@ -141,6 +147,46 @@ class CSubNet
             READWRITE(FLATDATA(netmask));
             READWRITE(FLATDATA(valid));
         }
+
+        friend class CSubNetTrie;
+};
+
+/**
+ * Set of subnets indexed by their network prefix, bit by bit over the 16-byte
+ * address (IPv4 and onion addresses are mapped into it like in CNetAddr), so
+ * finding the subnets that match an address takes at most 128 steps whatever
+ * the number of subnets. Netmasks that are not a prefix are kept aside and
+ * matched one by one.
+ */
+class CSubNetTrie
+{
+    private:
+        struct Node
+        {
+            std::unique_ptr<Node> child[2];
+            //! The subnet ending at this node, if it is in the set
+            std::unique_ptr<CSubNet> subnet;
+        };
+
+        Node root;
+        std::set<CSubNet> setIrregular;
+        size_t nSize;
+
+    public:
+        CSubNetTrie();
+
+        //! Add a subnet, returns false if it was already in the set or is invalid
+        bool Insert(const CSubNet &subnet);
+        //! Remove a subnet, returns false if it was not in the set
+        bool Erase(const CSubNet &subnet);
+        void Clear();
+
+        //! Whether any subnet of the set matches addr
+        bool Match(const CNetAddr &addr) const;
+        //! Append the subnets of the set matching addr: those with irregular netmasks first, then the prefixes from widest to narrowest
+        void GetMatches(const CNetAddr &addr, std::vector<CSubNet> &vMatches) const;
+
+        size_t size() const { return nSize; }
 };
 
 /** A combination of a network address (CNetAddr) and a (TCP) port */
@@ -222,5 +268,12 @@ bool SetSocketNonBlocking(SOCKET& hSocket, bool fNonBlocking);
  * Convert milliseconds to a struct timeval for e.g. select.
  */
 struct timeval MillisToTimeval(int64_t nTimeout);
+/**
+ * Wait up to nTimeout milliseconds for hSocket to become readable, or writable
+ * with fWrite. Returns like select(): 1 when ready, 0 on timeout, SOCKET_ERROR
+ * on failure. Outside of Windows this uses poll(), which unlike select() also
+ * takes sockets at or above FD_SETSIZE, as ThreadSocketHandler allows with epoll.
+ */
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeout);
 
 #endif // STOCK_NETBASE_H
@@ -0,0 +1,156 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netpreprocess.h>
+
+#include <crypto/common.h>
+#include <hash.h>
+#include <main.h>
+#include <protocol.h>
+#include <util.h>
+
+CMessagePreprocessor msgPreprocessor;
+
+CPreprocessedMessage::CPreprocessedMessage(const std::string& strCommandIn, CDataStream& vRecvIn, unsigned int nMessageSizeIn) :
+    strCommand(strCommandIn), vRecv(std::move(vRecvIn)), nMessageSize(nMessageSizeIn), nChecksum(0), fPrecheckOK(true)
+{
+    vRecvIn.clear();
+}
+
+bool CPreprocessedMessage::IsPreprocessed(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::TX ||
+        strCommand == NetMsgType::DANDELIONTX ||
+        strCommand == NetMsgType::BLOCK ||
+        strCommand == NetMsgType::CMPCTBLOCK ||
+        strCommand == NetMsgType::ENCRYPTEDCANDIDATE ||
+        strCommand == NetMsgType::DANDELIONENCRYPTEDCANDIDATE;
+}
+
+void CPreprocessedMessage::Process()
+{
+    uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
+    nChecksum = ReadLE32((unsigned char*)&hash);
+
+    try {
+        if (strCommand == NetMsgType::TX || strCommand == NetMsgType::DANDELIONTX) {
+            vRecv >> tx;
+            fPrecheckOK = CheckTransaction(tx, precheckState);
+            // Verify the range proofs and decode the points of BLSCT transactions now. The result
+            // is cached for AcceptToMemoryPool, which reports failures after its own checks.
+            if (fPrecheckOK) {
+                CValidationState blsctState;
+                PrecheckBLSCTTransaction(tx, blsctState);
+            }
+        } else if (strCommand == NetMsgType::BLOCK) {
+            vRecv >> block;
+        } else if (strCommand == NetMsgType::CMPCTBLOCK) {
+            vRecv >> cmpctblock;
+        } else {
+            vRecv >> ec;
+            // Cache the hash the relay and embargo maps are keyed by
+            ec.GetHash();
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    // The payload was parsed, only the object is needed from now on
+    vRecv.clear();
+    fDone = true;
+    WakeMessageHandler();
+}
+
+void CPreprocessedMessage::Rethrow() const
+{
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void CPreprocessedMessage::Take(CTransaction& txOut)
+{
+    Rethrow();
+    txOut = tx;
+}
+
+void CPreprocessedMessage::Take(CBlock& blockOut)
+{
+    Rethrow();
+    blockOut = std::move(block);
+}
+
+void CPreprocessedMessage::Take(CBlockHeaderAndShortTxIDs& cmpctblockOut)
+{
+    Rethrow();
+    cmpctblockOut = std::move(cmpctblock);
+}
+
+void CPreprocessedMessage::Take(EncryptedCandidateTransaction& ecOut)
+{
+    Rethrow();
+    ecOut = std::move(ec);
+}
+
+CMessagePreprocessor::CMessagePreprocessor() : fStop(false), nThreads(0)
+{
+}
+
+CMessagePreprocessor::~CMessagePreprocessor()
+{
+    Stop();
+}
+
+void CMessagePreprocessor::ThreadPreprocess()
+{
+    RenameThread("stock-msgpreproc");
+
+    while (true) {
+        std::shared_ptr<CPreprocessedMessage> pmsg;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty() && !fStop)
+                condQueue.wait(lock);
+            if (queue.empty())
+                break;
+            pmsg = queue.front();
+            queue.pop_front();
+        }
+        pmsg->Process();
+    }
+}
+
+void CMessagePreprocessor::Start(int nThreadsIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fStop = false;
+    nThreads = nThreadsIn;
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&CMessagePreprocessor::ThreadPreprocess, this));
+}
+
+void CMessagePreprocessor::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+        condQueue.notify_all();
+    }
+    threads.join_all();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nThreads = 0;
+}
+
+void CMessagePreprocessor::Submit(const std::shared_ptr<CPreprocessedMessage>& pmsg)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nThreads > 0 && !fStop) {
+            queue.push_back(pmsg);
+            condQueue.notify_one();
+            return;
+        }
+    }
+    pmsg->Process();
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STOCK_NETPREPROCESS_H
+#define STOCK_NETPREPROCESS_H
+
+#include <blockencodings.h>
+#include <blsct/transaction.h>
+#include <consensus/validation.h>
+#include <net.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+
+#include <deque>
+#include <exception>
+#include <memory>
+#include <string>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** Default for -preprocthreads, the threads decoding received messages ahead of the message handler */
+static const int DEFAULT_PREPROCESS_THREADS = 2;
+/** Maximum number of message pre-processing threads */
+static const int MAX_PREPROCESS_THREADS = 16;
+
+/**
+ * A received message decoded outside of the message handler thread.
+ *
+ * The checksum, the deserialized object and the context-free checks of
+ * transactions (including the stateless BLSCT checks, see PrecheckBLSCT) are
+ * computed without holding cs_main, so ProcessMessage only
+ * has to do the work that depends on the chain state. Deserialization errors
+ * are kept and thrown again when the message handler takes the object, so
+ * they are reported exactly as if the message had been parsed in place.
+ */
+class CPreprocessedMessage : public CNetMessagePreprocessing
+{
+private:
+    std::exception_ptr error;
+
+    CTransaction tx;
+    CBlock block;
+    CBlockHeaderAndShortTxIDs cmpctblock;
+    EncryptedCandidateTransaction ec;
+
+    void Rethrow() const;
+
+public:
+    std::string strCommand;
+    CDataStream vRecv;
+    unsigned int nMessageSize;
+
+    //! checksum of the payload, compared against the header by ProcessMessages
+    unsigned int nChecksum;
+    //! result of CheckTransaction for tx and dandeliontx, which AcceptToMemoryPool then skips
+    bool fPrecheckOK;
+    CValidationState precheckState;
+
+    CPreprocessedMessage(const std::string& strCommandIn, CDataStream& vRecvIn, unsigned int nMessageSizeIn);
+
+    //! Whether messages of this type are worth decoding ahead of the message handler
+    static bool IsPreprocessed(const std::string& strCommand);
+
+    void Process();
+
+    void Take(CTransaction& txOut);
+    void Take(CBlock& blockOut);
+    void Take(CBlockHeaderAndShortTxIDs& cmpctblockOut);
+    void Take(EncryptedCandidateTransaction& ecOut);
+};
+
+/**
+ * Pool of threads running CPreprocessedMessage::Process. When no thread is
+ * running the messages are processed by the caller.
+ */
+class CMessagePreprocessor
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condQueue;
+    std::deque<std::shared_ptr<CPreprocessedMessage> > queue;
+    bool fStop;
+    boost::thread_group threads;
+    int nThreads;
+
+    void ThreadPreprocess();
+
+public:
+    CMessagePreprocessor();
+    ~CMessagePreprocessor();
+
+    void Start(int nThreadsIn);
+    //! Process what is left in the queue and stop the threads
+    void Stop();
+
+    //! Decode the message in the background, or right away if the pool is not running
+    void Submit(const std::shared_ptr<CPreprocessedMessage>& pmsg);
+};
+
+extern CMessagePreprocessor msgPreprocessor;
+
+#endif // STOCK_NETPREPROCESS_H
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <init.h>
+#include <netbase.h>
 #include <ntpclient.h>
 #include <random.h>
 #include <timedata.h>
@@ -41,20 +42,9 @@ bool CNtpClient::getTimestamp(uint64_t &timeRecv)
         try
         {
 
-            fd_set fileDescriptorSet;
-            struct timeval timeStruct;
+            SOCKET nativeSocket = socket.native_handle();
 
-            timeStruct.tv_sec = GetArg("-ntptimeout", DEFAULT_NTP_TIMEOUT);
-            timeStruct.tv_usec = 0;
-            FD_ZERO(&fileDescriptorSet);
-
-            int nativeSocket = socket.native_handle();
-
-            FD_SET(nativeSocket,&fileDescriptorSet);
-
-            select(nativeSocket+1,&fileDescriptorSet,NULL,NULL,&timeStruct);
-
-            if(!FD_ISSET(nativeSocket,&fileDescriptorSet))
+            if(WaitForSocket(nativeSocket, false, GetArg("-ntptimeout", DEFAULT_NTP_TIMEOUT) * 1000) <= 0)
             {
 
                 LogPrint("ntp", "[NTP] Could not read socket from NTP server %s (Read timeout)\n", sHostName);
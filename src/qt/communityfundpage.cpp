@@ -113,12 +113,12 @@ void CommunityFundPage::refresh(bool all, int proposal)
 
     // Format avaliable amount in the community fund
     std::string available;
-    available = wallet->formatDisplayAmount(pindexBestHeader->nCFSupply);
+    available = wallet->formatDisplayAmount(pindexBestHeader->GetCold().nCFSupply);
     ui->labelAvailableAmount->setText(QString::fromStdString(available));
 
     // Format locked amount in the community fund
     std::string locked;
-    locked = wallet->formatDisplayAmount(pindexBestHeader->nCFLocked);
+    locked = wallet->formatDisplayAmount(pindexBestHeader->GetCold().nCFLocked);
     ui->labelLockedAmount->setText(QString::fromStdString(locked));
 
     {
@@ -58,9 +58,11 @@ struct CCoin {
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSON(JSONStreamWriter& result, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 extern UniValue mempoolInfoToJSON();
 extern UniValue stempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void mempoolToJSON(JSONStreamWriter& result);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
@@ -246,10 +248,10 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        std::string strJSON = objBlock.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        JSONStreamWriter writer(std::bind(&HTTPRequest::WriteReplyChunk, req, HTTP_OK, std::placeholders::_1));
+        blockToJSON(writer, block, pblockindex, showTxDetails);
+        req->WriteReply(HTTP_OK, writer.Release() + "\n");
         return true;
     }
 
@@ -334,11 +336,10 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        std::string strJSON = mempoolObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        JSONStreamWriter writer(std::bind(&HTTPRequest::WriteReplyChunk, req, HTTP_OK, std::placeholders::_1));
+        mempoolToJSON(writer);
+        req->WriteReply(HTTP_OK, writer.Release() + "\n");
         return true;
     }
     default: {
@@ -51,17 +51,17 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.pushKV("merkleroot", blockindex->hashMerkleRoot.GetHex());
     result.pushKV("time", (int64_t)blockindex->nTime);
     result.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
-    result.pushKV("mint", ValueFromAmount(blockindex->nMint));
+    result.pushKV("mint", ValueFromAmount(blockindex->GetCold().nMint));
     result.pushKV("nonce", strprintf("%16x", (uint64_t)blockindex->nNonce));
     result.pushKV("bits", strprintf("%08x", blockindex->nBits));
     result.pushKV("difficulty", GetDifficulty(blockindex));
     result.pushKV("chainwork", blockindex->nChainWork.GetHex());
-    result.pushKV("ncfsupply", FormatMoney(blockindex->nCFSupply));
-    result.pushKV("ncflocked", FormatMoney(blockindex->nCFLocked));
-    result.pushKV("publicmoneysupply", FormatMoney(blockindex->nPublicMoneySupply));
-    result.pushKV("privatemoneysupply", FormatMoney(blockindex->nPrivateMoneySupply));
+    result.pushKV("ncfsupply", FormatMoney(blockindex->GetCold().nCFSupply));
+    result.pushKV("ncflocked", FormatMoney(blockindex->GetCold().nCFLocked));
+    result.pushKV("publicmoneysupply", FormatMoney(blockindex->GetCold().nPublicMoneySupply));
+    result.pushKV("privatemoneysupply", FormatMoney(blockindex->GetCold().nPrivateMoneySupply));
     result.pushKV("flags", strprintf("%s%s", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work", blockindex->GeneratedStakeModifier()? " stake-modifier": ""));
-    result.pushKV("proofhash", blockindex->hashProof.GetHex());
+    result.pushKV("proofhash", blockindex->GetCold().hashProof.GetHex());
     result.pushKV("entropybit", (int)blockindex->GetStakeEntropyBit());
     result.pushKV("hasblscttx", (int)blockindex->HasBLSCTTransactions());
     result.pushKV("ispos", (int)blockindex->IsProofOfStake());
@@ -339,6 +339,31 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+void blockToJSON(JSONStreamWriter& result, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue obj = blockToJSON(block, blockindex, false);
+    result.BeginObject();
+    for (size_t i = 0; i < obj.size(); i++)
+    {
+        if (!txDetails || obj.getKeys()[i] != "tx")
+        {
+            result.Pair(obj.getKeys()[i], obj.getValues()[i]);
+            continue;
+        }
+        // Only one decoded transaction is held in memory at a time
+        result.Key("tx");
+        result.BeginArray();
+        for(const CTransaction& tx: block.vtx)
+        {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(tx, uint256(), objTx);
+            result.Value(objTx);
+        }
+        result.EndArray();
+    }
+    result.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -472,6 +497,19 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+void mempoolToJSON(JSONStreamWriter& result)
+{
+    LOCK(mempool.cs);
+    result.BeginObject();
+    for(const CTxMemPoolEntry& e: mempool.mapTx)
+    {
+        UniValue info(UniValue::VOBJ);
+        entryToJSON(info, e);
+        result.Pair(e.GetTx().GetHash().ToString(), info);
+    }
+    result.EndObject();
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -503,6 +541,17 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+void getrawmempool_stream(const UniValue& params, JSONStreamWriter& result)
+{
+    // Only the verbose form is big enough to be worth streaming
+    if (params.size() != 1 || !params[0].isBool() || !params[0].get_bool()) {
+        result.Value(getrawmempool(params, false));
+        return;
+    }
+
+    mempoolToJSON(result);
+}
+
 UniValue getmempoolancestors(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2) {
@@ -941,7 +990,10 @@ static bool GetUTXOStats(CStateView *view, CCoinsStats &stats)
     stats.hashBlock = pcursor->GetBestBlock();
     {
         LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+        BlockMap::iterator it = mapBlockIndex.find(stats.hashBlock);
+        if (it == mapBlockIndex.end())
+            return error("%s: best block %s not found in the block index", __func__, stats.hashBlock.ToString());
+        stats.nHeight = it->second->nHeight;
     }
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
@@ -981,28 +1033,66 @@ static bool GetUTXOStats(CStateView *view, CCoinsStats &stats)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw std::runtime_error(
-                "gettxoutsetinfo\n"
+                "gettxoutsetinfo ( \"hash_type\" )\n"
                 "\nReturns statistics about the unspent transaction output set.\n"
-                "Note this call may take some time.\n"
+                "The default \"muhash\" mode answers from statistics maintained while blocks are connected.\n"
+                "Note the \"legacy\" mode scans the whole set and may take some time.\n"
+                "\nArguments:\n"
+                "1. \"hash_type\"      (string, optional, default=\"muhash\") Which statistics to return: \"muhash\" or \"legacy\"\n"
                 "\nResult:\n"
                 "{\n"
                 "  \"height\":n,     (numeric) The current block height (index)\n"
                 "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
                 "  \"transactions\": n,      (numeric) The number of transactions\n"
                 "  \"txouts\": n,            (numeric) The number of output transactions\n"
-                "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-                "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+                "  \"bogosize\": n,          (numeric, muhash only) A database-independent metric for UTXO set size\n"
+                "  \"muhash\": \"hash\",      (string, muhash only) The rolling MuHash3072 of the unspent output set\n"
+                "  \"bytes_serialized\": n,  (numeric, legacy only) The serialized size\n"
+                "  \"hash_serialized\": \"hash\",   (string, legacy only) The serialized hash\n"
                 "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+                "  \"total_cold_amount\": x.xxx     (numeric) The total amount in cold staking outputs\n"
+                "  \"total_coldv2_amount\": x.xxx   (numeric) The total amount in cold staking v2 outputs\n"
                 "}\n"
                 "\nExamples:\n"
                 + HelpExampleCli("gettxoutsetinfo", "")
+                + HelpExampleCli("gettxoutsetinfo", "\"legacy\"")
                 + HelpExampleRpc("gettxoutsetinfo", "")
                 );
 
+    std::string strHashType = params.size() > 0 ? params[0].get_str() : "muhash";
+    if (strHashType != "muhash" && strHashType != "legacy")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid hash_type, must be \"muhash\" or \"legacy\"");
+
     UniValue ret(UniValue::VOBJ);
 
+    if (strHashType == "muhash") {
+        CStateStats stats;
+        uint256 hashBlock;
+        int nHeight;
+        {
+            LOCK(cs_main);
+            if (!pcoinsTip->GetStateStats(stats))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "UTXO set statistics are not available");
+            hashBlock = pcoinsTip->GetBestBlock();
+            BlockMap::iterator it = mapBlockIndex.find(hashBlock);
+            if (it == mapBlockIndex.end())
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "Best block of the UTXO set not found in the block index");
+            nHeight = it->second->nHeight;
+        }
+        ret.pushKV("height", (int64_t)nHeight);
+        ret.pushKV("bestblock", hashBlock.GetHex());
+        ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
+        ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+        ret.pushKV("muhash", stats.GetHash().GetHex());
+        ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+        ret.pushKV("total_cold_amount", ValueFromAmount(stats.nTotalColdAmount));
+        ret.pushKV("total_coldv2_amount", ValueFromAmount(stats.nTotalColdv2Amount));
+        return ret;
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsTip, stats)) {
@@ -1035,7 +1125,7 @@ UniValue getcfunddbstatehash(const UniValue& params, bool fHelp)
     LOCK(cs_main);
 
     CStateViewCache view(pcoinsTip);
-    return GetDAOStateHash(view, chainActive.Tip()->nCFLocked, chainActive.Tip()->nCFSupply).ToString();
+    return GetDAOStateHash(view, chainActive.Tip()->GetCold().nCFLocked, chainActive.Tip()->GetCold().nCFSupply).ToString();
 }
 
 UniValue listconsultations(const UniValue& params, bool fHelp)
@@ -1229,8 +1319,8 @@ UniValue cfundstats(const UniValue& params, bool fHelp)
     UniValue ret(UniValue::VOBJ);
     UniValue cf(UniValue::VOBJ);
 
-    cf.pushKV("available",      ValueFromAmount(pindexBestHeader->nCFSupply));
-    cf.pushKV("locked",         ValueFromAmount(pindexBestHeader->nCFLocked));
+    cf.pushKV("available",      ValueFromAmount(pindexBestHeader->GetCold().nCFSupply));
+    cf.pushKV("locked",         ValueFromAmount(pindexBestHeader->GetCold().nCFLocked));
     ret.pushKV("funds", cf);
 
     UniValue vp(UniValue::VOBJ);
@@ -1748,6 +1838,49 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue getstatecacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+                "getstatecacheinfo\n"
+                "\nReturns details on the memory used by the in-memory chain state cache.\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"usage\": xxxxx,              (numeric) Total memory usage of the cache\n"
+                "  \"maxusage\": xxxxx,           (numeric) Memory usage that forces a flush (-dbcache share)\n"
+                "  \"categories\": {\n"
+                "    \"name\": {                  (string) Category: coins, proposals, votes, ...\n"
+                "      \"size\": xxxxx,           (numeric) Number of cached entries\n"
+                "      \"usage\": xxxxx,          (numeric) Memory usage of the entries\n"
+                "      \"budget\": xxxxx          (numeric) Own limit set with -statecachebudget, 0 if none\n"
+                "    }, ...\n"
+                "  }\n"
+                "}\n"
+                "\nExamples:\n"
+                + HelpExampleCli("getstatecacheinfo", "")
+                + HelpExampleRpc("getstatecacheinfo", "")
+                );
+
+    LOCK(cs_main);
+
+    UniValue categories(UniValue::VOBJ);
+    for (int c = STATE_CACHE_COINS; c < STATE_CACHE_CATEGORIES; c++) {
+        StateCacheCategory category = (StateCacheCategory)c;
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("size", (int64_t) pcoinsTip->GetCacheSize(category));
+        entry.pushKV("usage", (int64_t) pcoinsTip->DynamicMemoryUsage(category));
+        entry.pushKV("budget", (int64_t) nStateCacheBudget[c]);
+        categories.pushKV(GetStateCacheCategoryName(category), entry);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("usage", (int64_t) pcoinsTip->DynamicMemoryUsage());
+    ret.pushKV("maxusage", (int64_t) nCoinCacheUsage);
+    ret.pushKV("categories", categories);
+
+    return ret;
+}
+
 
 UniValue getstempoolinfo(const UniValue& params, bool fHelp)
 {
@@ -1942,38 +2075,39 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-  { "communityfund",      "cfundstats",             &cfundstats,             true  },
-  { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-  { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-  { "blockchain",         "getblockcount",          &getblockcount,          true  },
-  { "blockchain",         "getblock",               &getblock,               true  },
-  { "blockchain",         "getblockdeltas",         &getblockdeltas,         false },
-  { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
-  { "blockchain",         "getblockhash",           &getblockhash,           true  },
-  { "blockchain",         "getblockheader",         &getblockheader,         true  },
-  { "blockchain",         "getchaintips",           &getchaintips,           true  },
-  { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-  { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true  },
-  { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true  },
-  { "blockchain",         "getmempoolentry",        &getmempoolentry,        true  },
-  { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-  { "blockchain",         "getstempoolinfo",        &getstempoolinfo,        true  },
-  { "communityfund",      "getproposal",            &getproposal,            true  },
-  { "communityfund",      "getpaymentrequest",      &getpaymentrequest,      true  },
-  { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-  { "blockchain",         "gettxout",               &gettxout,               true  },
-  { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-  { "blockchain",         "verifychain",            &verifychain,            true  },
-  { "dao",                "listconsultations",      &listconsultations,      true  },
-  { "dao",                "getconsultation",        &getconsultation,        true  },
-  { "dao",                "getconsultationanswer",  &getconsultationanswer,  true  },
-  { "dao",                "getcfunddbstatehash",    &getcfunddbstatehash,    true  },
+{ //  category              name                      actor (function)         okSafeMode threadSafe
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
+  { "communityfund",      "cfundstats",             &cfundstats,             true,  false },
+  { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  true  },
+  { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  true  },
+  { "blockchain",         "getblockcount",          &getblockcount,          true,  true  },
+  { "blockchain",         "getblock",               &getblock,               true,  true  },
+  { "blockchain",         "getblockdeltas",         &getblockdeltas,         false, true  },
+  { "blockchain",         "getblockhashes",         &getblockhashes,         true,  true  },
+  { "blockchain",         "getblockhash",           &getblockhash,           true,  true  },
+  { "blockchain",         "getblockheader",         &getblockheader,         true,  true  },
+  { "blockchain",         "getchaintips",           &getchaintips,           true,  true  },
+  { "blockchain",         "getdifficulty",          &getdifficulty,          true,  true  },
+  { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  true  },
+  { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  true  },
+  { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  true  },
+  { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  true  },
+  { "blockchain",         "getstatecacheinfo",      &getstatecacheinfo,      true,  false },
+  { "blockchain",         "getstempoolinfo",        &getstempoolinfo,        true,  false },
+  { "communityfund",      "getproposal",            &getproposal,            true,  true  },
+  { "communityfund",      "getpaymentrequest",      &getpaymentrequest,      true,  true  },
+  { "blockchain",         "getrawmempool",          &getrawmempool,          true,  true,  &getrawmempool_stream },
+  { "blockchain",         "gettxout",               &gettxout,               true,  true  },
+  { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  false },
+  { "blockchain",         "verifychain",            &verifychain,            true,  false },
+  { "dao",                "listconsultations",      &listconsultations,      true,  false },
+  { "dao",                "getconsultation",        &getconsultation,        true,  true  },
+  { "dao",                "getconsultationanswer",  &getconsultationanswer,  true,  true  },
+  { "dao",                "getcfunddbstatehash",    &getcfunddbstatehash,    true,  false },
 
   /* Not shown in help */
-  { "hidden",             "invalidateblock",        &invalidateblock,        true  },
-  { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
+  { "hidden",             "invalidateblock",        &invalidateblock,        true,  false },
+  { "hidden",             "reconsiderblock",        &reconsiderblock,        true,  false },
 };
 
 void RegisterBlockchainRPCCommands(CRPCTable &tableRPC)
@@ -96,6 +96,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "gettoken", 1 },
     { "getnft", 1 },
     { "getnft", 2 },
+    { "getnftutxos", 1 },
+    { "getnftutxos", 2 },
     { "gettransaction", 1 },
     { "gettxout", 1 },
     { "gettxout", 2 },
@@ -97,12 +97,12 @@ UniValue getinfo(const UniValue& params, bool fHelp)
     obj.pushKV("blocks",        (int)chainActive.Height());
 
     UniValue cf(UniValue::VOBJ);
-    cf.pushKV("available",           ValueFromAmount(chainActive.Tip()->nCFSupply));
-    cf.pushKV("locked",              ValueFromAmount(chainActive.Tip()->nCFLocked));
+    cf.pushKV("available",           ValueFromAmount(chainActive.Tip()->GetCold().nCFSupply));
+    cf.pushKV("locked",              ValueFromAmount(chainActive.Tip()->GetCold().nCFLocked));
 
     obj.pushKV("communityfund",      cf);
-    obj.pushKV("publicmoneysupply",  FormatMoney(chainActive.Tip()->nPublicMoneySupply));
-    obj.pushKV("privatemoneysupply", FormatMoney(chainActive.Tip()->nPrivateMoneySupply));
+    obj.pushKV("publicmoneysupply",  FormatMoney(chainActive.Tip()->GetCold().nPublicMoneySupply));
+    obj.pushKV("privatemoneysupply", FormatMoney(chainActive.Tip()->GetCold().nPrivateMoneySupply));
     obj.pushKV("timeoffset",         GetTimeOffset());
     obj.pushKV("ntptimeoffset",      GetNtpTimeOffset());
     obj.pushKV("connections",        (int)vNodes.size());
@@ -778,6 +778,147 @@ bool getAddressesFromParamsForHistory(const UniValue& params, std::vector<std::p
     return true;
 }
 
+/** Most index entries returned in one page by the address RPCs */
+static const int MAX_ADDRESS_PAGE_SIZE = 10000;
+
+//! Serialized size of the address at the start of the address index and unspent index keys
+static const size_t ADDRESS_INDEX_KEY_ADDRESS_SIZE = 21;
+//! Serialized size of the two addresses at the start of the address history keys
+static const size_t ADDRESS_HISTORY_KEY_ADDRESS_SIZE = 40;
+
+typedef std::map<uint160, CAddressHistoryValue> AddressBalanceMap;
+
+/**
+ * Pages of the address RPCs merge the entries of all the requested addresses
+ * in the order of their serialized keys with the address moved to the end.
+ * Within one address this is the database order, so every address can resume
+ * reading at the position of the last entry returned.
+ */
+template<typename K>
+std::vector<unsigned char> getIndexPosition(const K& key, size_t nAddressSize)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    std::vector<unsigned char> vPosition(ss.begin() + nAddressSize, ss.end());
+    vPosition.insert(vPosition.end(), ss.begin(), ss.begin() + nAddressSize);
+    return vPosition;
+}
+
+//! The key of the address of addressKey where reading resumes after vAfter (addressKey itself if vAfter is empty)
+template<typename K>
+K getIndexStart(const K& addressKey, size_t nAddressSize, const std::vector<unsigned char>& vAfter)
+{
+    if (vAfter.empty())
+        return addressKey;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << addressKey;
+    if (vAfter.size() != ss.size())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+
+    std::vector<unsigned char> vKey(ss.begin(), ss.begin() + nAddressSize);
+    vKey.insert(vKey.end(), vAfter.begin(), vAfter.end() - nAddressSize);
+
+    K key;
+    CDataStream(vKey, SER_DISK, CLIENT_VERSION) >> key;
+    return key;
+}
+
+/**
+ * Number of the entries from nBegin on which come after vAfter in page order.
+ * Reading resumes at the last entry returned, which is read again but does
+ * not belong to the page.
+ */
+template<typename K, typename V>
+size_t countIndexAfter(const std::vector<std::pair<K, V> >& vEntries, size_t nBegin, size_t nAddressSize, const std::vector<unsigned char>& vAfter)
+{
+    size_t nCount = 0;
+    for (size_t i = nBegin; i < vEntries.size(); i++) {
+        if (vAfter < getIndexPosition(vEntries[i].first, nAddressSize))
+            nCount++;
+    }
+    return nCount;
+}
+
+/**
+ * Keep the first nLimit entries after vAfter in page order, setting vLast to
+ * the position of the last one. Returns whether entries were left out.
+ */
+template<typename K, typename V>
+bool sortIndexPage(std::vector<std::pair<K, V> >& vEntries, size_t nAddressSize, const std::vector<unsigned char>& vAfter,
+                   size_t nLimit, std::vector<unsigned char>& vLast)
+{
+    std::vector<std::pair<std::vector<unsigned char>, size_t> > vPositions;
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        std::vector<unsigned char> vPosition = getIndexPosition(vEntries[i].first, nAddressSize);
+        if (vAfter < vPosition)
+            vPositions.push_back(std::make_pair(vPosition, i));
+    }
+    std::sort(vPositions.begin(), vPositions.end());
+
+    bool fTruncated = vPositions.size() > nLimit;
+    if (fTruncated)
+        vPositions.resize(nLimit);
+
+    std::vector<std::pair<K, V> > vPage;
+    vPage.reserve(vPositions.size());
+    for (const std::pair<std::vector<unsigned char>, size_t>& position: vPositions)
+        vPage.push_back(vEntries[position.second]);
+    vEntries.swap(vPage);
+
+    if (!vPositions.empty())
+        vLast = vPositions.back().first;
+    return fTruncated;
+}
+
+/**
+ * Read the limit and continuation token of an address request, false if it
+ * does not ask for a page. The history pages also carry the balances reached.
+ */
+bool getPageFromParams(const UniValue& params, size_t& nLimit, std::vector<unsigned char>& vAfter, AddressBalanceMap* pBalances = nullptr)
+{
+    if (!params[0].isObject())
+        return false;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (limitValue.isNull())
+        return false;
+
+    int limit = limitValue.get_int();
+    if (limit <= 0 || limit > MAX_ADDRESS_PAGE_SIZE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Limit is expected to be between 1 and %d", MAX_ADDRESS_PAGE_SIZE));
+    nLimit = limit;
+
+    UniValue nextValue = find_value(params[0].get_obj(), "next");
+    if (nextValue.isNull())
+        return true;
+
+    if (!nextValue.isStr() || !IsHex(nextValue.get_str()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+
+    try {
+        CDataStream ss(ParseHex(nextValue.get_str()), SER_NETWORK, PROTOCOL_VERSION);
+        ss >> vAfter;
+        if (pBalances)
+            ss >> *pBalances;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+    }
+    if (vAfter.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+
+    return true;
+}
+
+std::string getPageToken(const std::vector<unsigned char>& vLast, const AddressBalanceMap* pBalances = nullptr)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << vLast;
+    if (pBalances)
+        ss << *pBalances;
+    return HexStr(ss.begin(), ss.end());
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -873,6 +1014,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number, optional) Return at most this many outputs, ordered by txid, and a token for the next ones\n"
+            "  \"next\"  (string, optional) The token returned with the previous page\n"
             "}\n"
             "\nResult\n"
             "[\n"
@@ -885,6 +1028,13 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit or chainInfo)\n"
+            "{\n"
+            "  \"utxos\"  (array) The outputs as above\n"
+            "  \"next\"  (string) The token to pass to get the next page, if there are more outputs\n"
+            "  \"hash\"  (string) The hash of the tip, with chainInfo\n"
+            "  \"height\"  (number) The height of the tip, with chainInfo\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -904,15 +1054,30 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    size_t nLimit = 0;
+    std::vector<unsigned char> vAfter, vLast;
+    bool fPaged = getPageFromParams(params, nLimit, vAfter);
+    bool fMore = false;
+
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+        if (fPaged) {
+            CAddressUnspentKey start = getIndexStart(CAddressUnspentKey((*it).second, (*it).first, uint256(), 0), ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter);
+            size_t nBefore = unspentOutputs.size();
+            if (!GetAddressUnspent(start, nLimit + (vAfter.empty() ? 1 : 2), unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            fMore |= countIndexAfter(unspentOutputs, nBefore, ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter) > nLimit;
+        } else if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
     }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    if (fPaged)
+        fMore |= sortIndexPage(unspentOutputs, ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter, nLimit, vLast);
+    else
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
 
     UniValue utxos(UniValue::VARR);
 
@@ -932,13 +1097,17 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || fPaged) {
         UniValue result(UniValue::VOBJ);
         result.pushKV("utxos", utxos);
+        if (fMore)
+            result.pushKV("next", getPageToken(vLast));
 
-        LOCK(cs_main);
-        result.pushKV("hash", chainActive.Tip()->GetBlockHash().GetHex());
-        result.pushKV("height", (int)chainActive.Height());
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.pushKV("hash", chainActive.Tip()->GetBlockHash().GetHex());
+            result.pushKV("height", (int)chainActive.Height());
+        }
         return result;
     } else {
         return utxos;
@@ -961,6 +1130,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number, optional) Return at most this many deltas, in chain order, and a token for the next ones\n"
+            "  \"next\" (string, optional) The token returned with the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -972,6 +1143,13 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit or chainInfo):\n"
+            "{\n"
+            "  \"deltas\"  (array) The deltas as above\n"
+            "  \"next\"  (string) The token to pass to get the next page, if there are more deltas\n"
+            "  \"start\"  (object) The hash and height of the start block, with chainInfo\n"
+            "  \"end\"  (object) The hash and height of the end block, with chainInfo\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -1007,10 +1185,22 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    size_t nLimit = 0;
+    std::vector<unsigned char> vAfter, vLast;
+    bool fPaged = getPageFromParams(params, nLimit, vAfter);
+    bool fMore = false;
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
+        if (fPaged) {
+            CAddressIndexKey first((*it).second, (*it).first, start > 0 && end > 0 ? start : 0, 0, uint256(), 0, false);
+            size_t nBefore = addressIndex.size();
+            if (!GetAddressIndex(getIndexStart(first, ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter), start > 0 && end > 0 ? end : 0, nLimit + (vAfter.empty() ? 1 : 2), addressIndex)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            fMore |= countIndexAfter(addressIndex, nBefore, ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter) > nLimit;
+        } else if (start > 0 && end > 0) {
             if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
@@ -1021,6 +1211,9 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         }
     }
 
+    if (fPaged)
+        fMore |= sortIndexPage(addressIndex, ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter, nLimit, vLast);
+
     UniValue deltas(UniValue::VARR);
 
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
@@ -1061,9 +1254,17 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         endInfo.pushKV("height", end);
 
         result.pushKV("deltas", deltas);
+        if (fMore)
+            result.pushKV("next", getPageToken(vLast));
         result.pushKV("start", startInfo);
         result.pushKV("end", endInfo);
 
+        return result;
+    } else if (fPaged) {
+        result.pushKV("deltas", deltas);
+        if (fMore)
+            result.pushKV("next", getPageToken(vLast));
+
         return result;
     } else {
         return deltas;
@@ -1087,7 +1288,12 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "\nResult:\n"
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
+            "  \"stakable\"  (string) The current stakable balance in satoshis\n"
+            "  \"voting_weight\"  (string) The current voting weight in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"txcount\"  (numeric) The number of transactions involving the address\n"
+            "  \"firstheight\"  (numeric) The height of the first of them, -1 if there are none\n"
+            "  \"lastheight\"  (numeric) The height of the last of them, -1 if there are none\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
@@ -1100,28 +1306,38 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > addressHistory;
-
-    for (std::vector<std::pair<std::pair<uint160, uint160>, AddressHistoryFilter>>::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressHistory((*it).first.first, (*it).first.second, addressHistory, (*it).second)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-
     CAmount spending = 0;
     CAmount stakable = 0;
     CAmount voting_weight = 0;
     CAmount received = 0;
     CAmount staked = 0;
+    unsigned int txcount = 0;
+    int firstHeight = -1;
+    int lastHeight = -1;
 
-    for (std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> >::const_iterator it=addressHistory.begin(); it!=addressHistory.end(); it++) {
-        spending += (*it).second.spendable;
-        stakable += (*it).second.stakable;
-        voting_weight += (*it).second.voting_weight;
-        if ((*it).second.spendable > 0)
-            received += (*it).second.spendable;
-    }
+    for (std::vector<std::pair<std::pair<uint160, uint160>, AddressHistoryFilter>>::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAddressSummaryValue summary;
+        if (!GetAddressSummary((*it).first.first, (*it).first.second, summary)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+        if (summary.IsNull())
+            continue;
 
+        if ((*it).second & AddressHistoryFilter::SPENDABLE) {
+            spending += summary.spendable;
+            received += summary.received;
+        }
+        if ((*it).second & AddressHistoryFilter::STAKABLE)
+            stakable += summary.stakable;
+        if ((*it).second & AddressHistoryFilter::VOTING_WEIGHT)
+            voting_weight += summary.voting_weight;
+
+        // The parts of a cold staking address are touched by the same transactions
+        txcount = std::max(txcount, summary.txcount);
+        if (firstHeight < 0 || summary.firstHeight < firstHeight)
+            firstHeight = summary.firstHeight;
+        lastHeight = std::max(lastHeight, summary.lastHeight);
+    }
 
     UniValue result(UniValue::VOBJ);
     result.pushKV("balance", spending);
@@ -1129,6 +1345,9 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
     result.pushKV("voting_weight", voting_weight);
     result.pushKV("received", received);
     result.pushKV("staked", staked);
+    result.pushKV("txcount", (int64_t)txcount);
+    result.pushKV("firstheight", firstHeight);
+    result.pushKV("lastheight", lastHeight);
 
     return result;
 
@@ -1149,6 +1368,8 @@ UniValue getaddresshistory(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number, optional) The start block height\n"
             "  \"end\" (number, optional) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many entries and a token for the next ones\n"
+            "  \"next\" (string, optional) The token returned with the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -1172,6 +1393,11 @@ UniValue getaddresshistory(const UniValue& params, bool fHelp)
             "    }\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"history\": (array) the entries as above\n"
+            "  \"next\": (string) the token to pass to get the next page, if there are more entries\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresshistory", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddresshistory", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -1205,34 +1431,54 @@ UniValue getaddresshistory(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    // Balances reached by each address, keyed by its hash
+    AddressBalanceMap balance;
+
+    size_t nLimit = 0;
+    std::vector<unsigned char> vAfter, vLast;
+    bool fPaged = getPageFromParams(params, nLimit, vAfter, &balance);
+    bool fMore = false;
+
     std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > addressHistory;
 
     for (std::vector<std::pair<std::pair<uint160, uint160>, AddressHistoryFilter>>::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressHistory((*it).first.first, (*it).first.second, addressHistory, (*it).second)) {
+        if (fPaged) {
+            // The first page builds on the balances before the range, later ones on those in the token
+            if (vAfter.empty()) {
+                CAddressHistoryValue total;
+                if (!GetAddressHistoryTotal((*it).first.first, (*it).first.second, (*it).second, start, total)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+                balance[(*it).first.second].spendable += total.spendable;
+                balance[(*it).first.second].stakable += total.stakable;
+                balance[(*it).first.second].voting_weight += total.voting_weight;
+            }
+            CAddressHistoryKey first((*it).first.first, (*it).first.second, start, 0, uint256(), 0);
+            size_t nBefore = addressHistory.size();
+            if (!GetAddressHistory(getIndexStart(first, ADDRESS_HISTORY_KEY_ADDRESS_SIZE, vAfter), end, nLimit + (vAfter.empty() ? 1 : 2), (*it).second, addressHistory)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            fMore |= countIndexAfter(addressHistory, nBefore, ADDRESS_HISTORY_KEY_ADDRESS_SIZE, vAfter) > nLimit;
+        } else if (!GetAddressHistory((*it).first.first, (*it).first.second, addressHistory, (*it).second)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
     }
 
-    std::sort(addressHistory.begin(), addressHistory.end(), [](const std::pair<CAddressHistoryKey, CAddressHistoryValue> &a, const std::pair<CAddressHistoryKey, CAddressHistoryValue> &b) -> bool
-    {
-        auto a_ = a.first;
-        auto b_ = b.first;
-
-        if (a_.blockHeight == b_.blockHeight) {
-            return a_.txindex < b_.txindex;
-        } else {
-            return a_.blockHeight < b_.blockHeight;
-        }
-    });
-
-    struct balStruct
-    {
-        CAmount spendable;
-        CAmount stakable;
-        CAmount voting_weight;
-    };
+    if (fPaged) {
+        fMore |= sortIndexPage(addressHistory, ADDRESS_HISTORY_KEY_ADDRESS_SIZE, vAfter, nLimit, vLast);
+    } else {
+        std::sort(addressHistory.begin(), addressHistory.end(), [](const std::pair<CAddressHistoryKey, CAddressHistoryValue> &a, const std::pair<CAddressHistoryKey, CAddressHistoryValue> &b) -> bool
+        {
+            auto a_ = a.first;
+            auto b_ = b.first;
 
-    std::map<CStockAddress, balStruct> balance;
+            if (a_.blockHeight == b_.blockHeight) {
+                return a_.txindex < b_.txindex;
+            } else {
+                return a_.blockHeight < b_.blockHeight;
+            }
+        });
+    }
 
     UniValue result(UniValue::VARR);
 
@@ -1240,13 +1486,10 @@ UniValue getaddresshistory(const UniValue& params, bool fHelp)
         CStockAddress address;
         address.Set(CKeyID((*it).first.hashBytes2));
 
-        if (balance.count(address) == 0) {
-            balance.insert(std::make_pair(address, (struct balStruct){.spendable = 0, .stakable = 0, .voting_weight = 0}));
-        }
-
-        balance[address].spendable += (*it).second.spendable;
-        balance[address].stakable += (*it).second.stakable;
-        balance[address].voting_weight += (*it).second.voting_weight;
+        CAddressHistoryValue& addressBalance = balance[(*it).first.hashBytes2];
+        addressBalance.spendable += (*it).second.spendable;
+        addressBalance.stakable += (*it).second.stakable;
+        addressBalance.voting_weight += (*it).second.voting_weight;
 
         if (!(!range || (range && (*it).first.blockHeight >= start && (*it).first.blockHeight <= end)))
             continue;
@@ -1266,14 +1509,22 @@ UniValue getaddresshistory(const UniValue& params, bool fHelp)
         entry.pushKV("changes", changes);
 
         UniValue balanceObj(UniValue::VOBJ);
-        balanceObj.pushKV("balance", balance[address].spendable);
-        balanceObj.pushKV("stakable", balance[address].stakable);
-        balanceObj.pushKV("voting_weight", balance[address].voting_weight);
+        balanceObj.pushKV("balance", addressBalance.spendable);
+        balanceObj.pushKV("stakable", addressBalance.stakable);
+        balanceObj.pushKV("voting_weight", addressBalance.voting_weight);
         entry.pushKV("result", balanceObj);
 
         result.push_back(entry);
     }
 
+    if (fPaged) {
+        UniValue page(UniValue::VOBJ);
+        page.pushKV("history", result);
+        if (fMore)
+            page.pushKV("next", getPageToken(vLast, &balance));
+        return page;
+    }
+
     return result;
 
 }
@@ -1293,12 +1544,19 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Read at most this many index entries, in chain order, and return a token for the next ones\n"
+            "  \"next\" (string, optional) The token returned with the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"txids\"  (array) The transaction ids as above\n"
+            "  \"next\"  (string) The token to pass to get the next page, if there are more transactions\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -1321,10 +1579,22 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
+    size_t nLimit = 0;
+    std::vector<unsigned char> vAfter, vLast;
+    bool fPaged = getPageFromParams(params, nLimit, vAfter);
+    bool fMore = false;
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
+        if (fPaged) {
+            CAddressIndexKey first((*it).second, (*it).first, start > 0 && end > 0 ? start : 0, 0, uint256(), 0, false);
+            size_t nBefore = addressIndex.size();
+            if (!GetAddressIndex(getIndexStart(first, ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter), start > 0 && end > 0 ? end : 0, nLimit + (vAfter.empty() ? 1 : 2), addressIndex)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            fMore |= countIndexAfter(addressIndex, nBefore, ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter) > nLimit;
+        } else if (start > 0 && end > 0) {
             if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
@@ -1335,9 +1605,31 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
-    std::set<std::pair<int, std::string> > txids;
     UniValue result(UniValue::VARR);
 
+    if (fPaged) {
+        fMore |= sortIndexPage(addressIndex, ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter, nLimit, vLast);
+
+        // Entries of the same transaction are next to each other in the page order, also across pages
+        uint256 lastTxid;
+        if (!vAfter.empty())
+            lastTxid = getIndexStart(CAddressIndexKey(), ADDRESS_INDEX_KEY_ADDRESS_SIZE, vAfter).txhash;
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+            if (it->first.txhash == lastTxid)
+                continue;
+            lastTxid = it->first.txhash;
+            result.push_back(lastTxid.GetHex());
+        }
+
+        UniValue page(UniValue::VOBJ);
+        page.pushKV("txids", result);
+        if (fMore)
+            page.pushKV("next", getPageToken(vLast));
+        return page;
+    }
+
+    std::set<std::pair<int, std::string> > txids;
+
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
         int height = it->first.blockHeight;
         std::string txid = it->first.txhash.GetHex();
@@ -1410,28 +1702,28 @@ UniValue getspentinfo(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "createwitnessaddress",   &createwitnessaddress,   true  },
-    { "util",               "verifymessage",          &verifymessage,          true  },
-    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true  },
+{ //  category              name                      actor (function)         okSafeMode threadSafe
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
+    { "control",            "getinfo",                &getinfo,                true,  false }, /* uses wallet if enabled */
+    { "util",               "validateaddress",        &validateaddress,        true,  false }, /* uses wallet if enabled */
+    { "util",               "createmultisig",         &createmultisig,         true,  false },
+    { "util",               "createwitnessaddress",   &createwitnessaddress,   true,  false },
+    { "util",               "verifymessage",          &verifymessage,          true,  false },
+    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true,  false },
 
     /* Address index */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  },
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false },
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false },
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false },
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false },
-    { "addressindex",       "getaddresshistory",      &getaddresshistory,      false },
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,  true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false, true  },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false, true  },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false, true  },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false, true  },
+    { "addressindex",       "getaddresshistory",      &getaddresshistory,      false, true  },
 
     /* Blockchain */
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false, true  },
 
     /* Not shown in help */
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
+    { "hidden",             "setmocktime",            &setmocktime,            true,  false },
 };
 
 void RegisterMiscRPCCommands(CRPCTable &tableRPC)
@@ -109,6 +109,9 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ]\n"
+            "    \"blockdownloadrate\": n,    (numeric) The measured rate in bytes per second this peer sends blocks at, 0 if unknown\n"
+            "    \"blockdownloadlatency\": n, (numeric) The measured time in microseconds a requested block takes to start arriving\n"
+            "    \"inflightlimit\": n,        (numeric) The number of blocks we ask from this peer at a time\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,             (numeric) The total bytes sent aggregated by message type\n"
             "       ...\n"
@@ -170,6 +173,9 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("blockdownloadrate", statestats.nBlockDownloadRate);
+            obj.pushKV("blockdownloadlatency", statestats.nBlockDownloadLatency);
+            obj.pushKV("inflightlimit", statestats.nBlocksInTransitLimit);
         }
         obj.pushKV("whitelisted", stats.fWhitelisted);
 
@@ -59,6 +59,86 @@ UniValue JSONRPCError(int code, const std::string& message)
     return error;
 }
 
+JSONStreamWriter::JSONStreamWriter(const ChunkFunction& writeChunkIn, size_t nChunkSizeIn) :
+    writeChunk(writeChunkIn), nChunkSize(nChunkSizeIn), fAfterKey(false), fStarted(false)
+{
+}
+
+void JSONStreamWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            strBuffer += ',';
+        vEmpty.back() = false;
+    }
+}
+
+void JSONStreamWriter::MaybeFlush()
+{
+    if (strBuffer.size() < nChunkSize || !writeChunk)
+        return;
+    writeChunk(strBuffer);
+    strBuffer.clear();
+    fStarted = true;
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    Separate();
+    strBuffer += '{';
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    strBuffer += '}';
+    MaybeFlush();
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    Separate();
+    strBuffer += '[';
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    strBuffer += ']';
+    MaybeFlush();
+}
+
+void JSONStreamWriter::Key(const std::string& strKey)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    Separate();
+    strBuffer += UniValue(strKey).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& val)
+{
+    Separate();
+    strBuffer += val.write();
+    MaybeFlush();
+}
+
+std::string JSONStreamWriter::Release()
+{
+    std::string strRet;
+    strRet.swap(strBuffer);
+    return strRet;
+}
+
 /** Username used when cookie authentication is in use (arbitrary, only for
  * recognizability in debugging/logging purposes)
  */
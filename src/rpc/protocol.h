@@ -6,10 +6,12 @@
 #ifndef STOCK_RPCPROTOCOL_H
 #define STOCK_RPCPROTOCOL_H
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <fs.h>
 #include <univalue.h>
@@ -82,6 +84,50 @@ UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const Un
 std::string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id);
 UniValue JSONRPCError(int code, const std::string& message);
 
+/** Bytes of JSON buffered by JSONStreamWriter before they are handed to its sink */
+static const size_t DEFAULT_JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Writes a JSON document piece by piece instead of building it as a UniValue
+ * first. Output is buffered and passed to the sink every nChunkSize bytes;
+ * whatever is left when the document is complete is returned by Release().
+ * A caller that never passes nChunkSize bytes gets the whole document from
+ * Release() and the sink is not called at all.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string& strChunk)> ChunkFunction;
+
+    JSONStreamWriter(const ChunkFunction& writeChunkIn, size_t nChunkSizeIn = DEFAULT_JSON_STREAM_CHUNK_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    //! Start a member of the current object; its value is the next thing written
+    void Key(const std::string& strKey);
+    void Value(const UniValue& val);
+    void Pair(const std::string& strKey, const UniValue& val) { Key(strKey); Value(val); }
+
+    //! Whether part of the document has already been passed to the sink
+    bool Started() const { return fStarted; }
+    //! Take the output not yet passed to the sink
+    std::string Release();
+
+private:
+    ChunkFunction writeChunk;
+    size_t nChunkSize;
+    std::string strBuffer;
+    //! for each open object or array, whether nothing has been written to it yet
+    std::vector<bool> vEmpty;
+    bool fAfterKey;
+    bool fStarted;
+
+    void Separate();
+    void MaybeFlush();
+};
+
 /** Get name of RPC authentication cookie file */
 fs::path GetAuthCookieFile();
 /** Generate a new RPC authentication cookie and write it to disk */
@@ -1264,19 +1264,19 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
-    { "rawtransactions",    "gettransactionkeys",     &gettransactionkeys,     true  },
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
-    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
-
-    { "blockchain",         "getstakerscript",        &getstakerscript,        true  },
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
+{ //  category              name                      actor (function)         okSafeMode threadSafe
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  true  },
+    { "rawtransactions",    "gettransactionkeys",     &gettransactionkeys,     true,  false },
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,  false },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  true  },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,  true  },
+    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, false },
+    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, false }, /* uses wallet if enabled */
+
+    { "blockchain",         "getstakerscript",        &getstakerscript,        true,  false },
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  true  },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,  true  },
 };
 
 void RegisterRawTransactionRPCCommands(CRPCTable &tableRPC)
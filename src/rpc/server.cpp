@@ -410,16 +410,112 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/**
+ * A run of consecutive thread-safe requests of a batch. The threads working
+ * on it claim requests one at a time until none are left.
+ */
+class CRPCBatchRun
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<UniValue> vRequests;
+    std::vector<UniValue> vReplies;
+    std::vector<bool> vDone;
+    size_t nNext;
+
+public:
+    CRPCBatchRun(const UniValue& vReq, size_t nBegin, size_t nEnd) :
+        vRequests(vReq.getValues().begin() + nBegin, vReq.getValues().begin() + nEnd),
+        vReplies(nEnd - nBegin), vDone(nEnd - nBegin, false), nNext(0)
+    {
+    }
+
+    size_t Size() const { return vRequests.size(); }
+
+    //! Execute the next request nobody has claimed yet, false if there is none
+    bool ExecuteNext()
+    {
+        size_t i;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nNext == vRequests.size())
+                return false;
+            i = nNext++;
+        }
+        UniValue reply = JSONRPCExecOne(vRequests[i]);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        vReplies[i] = reply;
+        vDone[i] = true;
+        cond.notify_all();
+        return true;
+    }
+
+    //! Wait for the reply to request i, executing requests in the meantime
+    UniValue TakeReply(size_t i)
+    {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!vDone[i] && nNext == vRequests.size())
+                    cond.wait(lock);
+                if (vDone[i]) {
+                    UniValue reply = vReplies[i];
+                    vReplies[i].setNull();
+                    return reply;
+                }
+            }
+            ExecuteNext();
+        }
+    }
+};
+
+static bool IsThreadSafeRequest(const UniValue& req)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    if (!method.isStr())
+        return false;
+    const CRPCCommand *pcmd = tableRPC[method.get_str()];
+    return pcmd && pcmd->threadSafe;
+}
+
+void JSONRPCExecBatch(const UniValue& vReq, JSONStreamWriter& result, const RPCQueueWorkFn& queueWork)
+{
+    size_t nThreads = 1;
+    if (queueWork)
+        nThreads = std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 1);
+
+    // Write each reply as soon as it is ready instead of keeping all of them
+    result.BeginArray();
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t nEnd = reqIdx;
+        while (nThreads > 1 && nEnd < vReq.size() && IsThreadSafeRequest(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - reqIdx < 2) {
+            result.Value(JSONRPCExecOne(vReq[reqIdx]));
+            reqIdx++;
+            continue;
+        }
 
-    return ret.write() + "\n";
+        // This thread works on the run as well, so it completes even when
+        // no worker thread is free to help.
+        std::shared_ptr<CRPCBatchRun> run = std::make_shared<CRPCBatchRun>(vReq, reqIdx, nEnd);
+        size_t nHelpers = std::min(nThreads, run->Size()) - 1;
+        for (size_t i = 0; i < nHelpers; i++) {
+            if (!queueWork([run]() { while (run->ExecuteNext()) {} }))
+                break;
+        }
+        for (size_t i = 0; i < run->Size(); i++)
+            result.Value(run->TakeReply(i));
+        reqIdx = nEnd;
+    }
+    result.EndArray();
 }
 
-UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+static const CRPCCommand* FindCommand(const std::string& strMethod)
 {
     // Return immediately if in warmup
     {
@@ -432,6 +528,34 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     const CRPCCommand *pcmd = tableRPC[strMethod];
     if (!pcmd)
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+    return pcmd;
+}
+
+void CRPCTable::execute(const std::string &strMethod, const UniValue &params, JSONStreamWriter& result) const
+{
+    const CRPCCommand *pcmd = FindCommand(strMethod);
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    try
+    {
+        // Execute
+        if (pcmd->streamActor)
+            pcmd->streamActor(params, result);
+        else
+            result.Value(pcmd->actor(params, false));
+    }
+    catch (const std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+
+    g_rpcSignals.PostCommand(*pcmd);
+}
+
+UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+{
+    const CRPCCommand *pcmd = FindCommand(strMethod);
 
     g_rpcSignals.PreCommand(*pcmd);
 
@@ -122,6 +122,7 @@ void RPCUnsetTimerInterface(RPCTimerInterface *iface);
 void RPCRunLater(const std::string& name, std::function<void(void)> func, int64_t nSeconds);
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
+typedef void(*rpcstreamfn_type)(const UniValue& params, JSONStreamWriter& result);
 
 class CRPCCommand
 {
@@ -130,6 +131,10 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    //! may run concurrently with other requests of the same batch
+    bool threadSafe;
+    //! optional variant of actor writing its result straight into the reply
+    rpcstreamfn_type streamActor;
 };
 
 /**
@@ -153,6 +158,14 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method, writing its result into result as a single value.
+     * Commands with a streamActor write it piece by piece, so the reply can
+     * be sent while it is being produced.
+     * @throws an exception (UniValue) when an error happens.
+     */
+    void execute(const std::string &method, const UniValue &params, JSONStreamWriter& result) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -192,6 +205,17 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+/** Most requests of one batch that run at the same time */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+
+/** Runs a function on another thread; returns false if it could not be queued */
+typedef std::function<bool(const std::function<void(void)>&)> RPCQueueWorkFn;
+
+/**
+ * Execute a batch of requests, writing the array of replies into result.
+ * Consecutive thread-safe requests are spread over queueWork, at most
+ * -rpcbatchthreads at a time; other requests run on their own, in order.
+ */
+void JSONRPCExecBatch(const UniValue& vReq, JSONStreamWriter& result, const RPCQueueWorkFn& queueWork = RPCQueueWorkFn());
 
 #endif // STOCK_RPCSERVER_H
@@ -0,0 +1,111 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <main.h>
+
+#include <test/test_stock.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockdownload_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blocks_in_transit_limit)
+{
+    // Until the rate and the block size are known, the old fixed limit is used
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(0, 0, 0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(100000, 500000, 0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(0, 500000, 10000), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // 100kB/s over a 0.5s round trip plus the pipeline time is 250kB, or 25 blocks of 10kB
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(100000, 500000, 10000), 25);
+
+    // A slow peer with large blocks still gets a few blocks in flight
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(1000, 0, 1000000), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(MIN_BLOCKS_IN_TRANSIT_PER_PEER, 2);
+
+    // A fast peer with small blocks does not get an unbounded number
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(1000000000, 1000000, 1000), MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER, 1024);
+}
+
+BOOST_AUTO_TEST_CASE(block_download_window)
+{
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(1000000, 0), (int)BLOCK_DOWNLOAD_WINDOW);
+
+    // 1MB/s from all peers for 30 seconds is 3000 blocks of 10kB
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(1000000, 10000), 3000);
+
+    // The window is never smaller than the old fixed one...
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(0, 10000), (int)BLOCK_DOWNLOAD_WINDOW);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(1000, 1000000), (int)BLOCK_DOWNLOAD_WINDOW);
+    BOOST_CHECK_EQUAL(BLOCK_DOWNLOAD_WINDOW, 1024);
+
+    // ...nor larger than the maximum
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(1000000000, 1000), (int)MAX_BLOCK_DOWNLOAD_WINDOW);
+    BOOST_CHECK_EQUAL(MAX_BLOCK_DOWNLOAD_WINDOW, 16384);
+}
+
+BOOST_AUTO_TEST_CASE(block_stalling_timeout)
+{
+    BOOST_CHECK_EQUAL(GetExpectedBlockDownloadTime(0, 500000, 4, 10000), 0);
+    BOOST_CHECK_EQUAL(GetExpectedBlockDownloadTime(100000, 500000, 4, 0), 0);
+
+    // A round trip plus 4 blocks of 10kB at 100kB/s
+    int64_t nExpected = GetExpectedBlockDownloadTime(100000, 500000, 4, 10000);
+    BOOST_CHECK_EQUAL(nExpected, 900000);
+
+    // Peers are given twice the time they are expected to take, but at least the old timeout
+    BOOST_CHECK_EQUAL(GetBlockStallingTimeout(0), 1000000 * BLOCK_STALLING_TIMEOUT);
+    BOOST_CHECK_EQUAL(GetBlockStallingTimeout(nExpected), 1000000 * BLOCK_STALLING_TIMEOUT);
+    BOOST_CHECK_EQUAL(GetBlockStallingTimeout(GetExpectedBlockDownloadTime(10000, 500000, 4, 100000)), 2 * 40500000);
+}
+
+BOOST_AUTO_TEST_CASE(block_download_timeout)
+{
+    // 600 second blocks with two other peers: 10 + 2 * 5 minutes
+    int64_t nOldTimeout = GetBlockDownloadTimeout(600, 2, 0, 0, 10000);
+    BOOST_CHECK_EQUAL(nOldTimeout, 1200 * 1000000LL);
+    BOOST_CHECK_EQUAL(GetBlockDownloadTimeout(600, 2, 100000, 0, 0), nOldTimeout);
+
+    // A fast peer is given the minimum timeout
+    BOOST_CHECK_EQUAL(GetBlockDownloadTimeout(600, 2, 1000000, 100000, 10000), BLOCK_DOWNLOAD_TIMEOUT_MIN * 1000000);
+
+    // Otherwise ten times the time the first block should take: 10s for 100kB at 10kB/s
+    BOOST_CHECK_EQUAL(GetBlockDownloadTimeout(600, 2, 10000, 0, 100000), 100 * 1000000LL);
+
+    // But never later than the old timeout
+    BOOST_CHECK_EQUAL(GetBlockDownloadTimeout(600, 2, 1000, 0, 1000000), nOldTimeout);
+}
+
+BOOST_AUTO_TEST_CASE(block_download_stats)
+{
+    CBlockDownloadStats stats;
+    int64_t nAvgBlockSize = 0;
+
+    // A block requested of an idle peer measures the latency
+    UpdateBlockDownloadStats(stats, nAvgBlockSize, 10000, 0, 300000);
+    BOOST_CHECK_EQUAL(stats.nLatency, 300000);
+    BOOST_CHECK_EQUAL(stats.nRate, 0);
+    BOOST_CHECK_EQUAL(nAvgBlockSize, 10000);
+
+    // Blocks requested while the peer was busy measure the rate, once enough time is sampled
+    UpdateBlockDownloadStats(stats, nAvgBlockSize, 10000, 100000, 350000);
+    BOOST_CHECK_EQUAL(stats.nRate, 0);
+    BOOST_CHECK_EQUAL(stats.nSampleBytes, 10000);
+    BOOST_CHECK_EQUAL(stats.nSampleTime, 50000);
+    UpdateBlockDownloadStats(stats, nAvgBlockSize, 10000, 200000, 400000);
+    BOOST_CHECK_EQUAL(stats.nRate, 200000);
+    BOOST_CHECK_EQUAL(stats.nSampleBytes, 0);
+    BOOST_CHECK_EQUAL(stats.nSampleTime, 0);
+    BOOST_CHECK_EQUAL(stats.nLatency, 300000);
+
+    // The transfer time is not counted as latency, and the averages move by a quarter
+    UpdateBlockDownloadStats(stats, nAvgBlockSize, 20000, 1000000, 1100000);
+    BOOST_CHECK_EQUAL(stats.nLatency, 300000 + (1 - 300000) / 4);
+    BOOST_CHECK_EQUAL(stats.nRate, 200000);
+    BOOST_CHECK_EQUAL(stats.nLastReceived, 1100000);
+    BOOST_CHECK_EQUAL(nAvgBlockSize, 12500);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <blockencodings.h>
+#include <blsct/verification.h>
 #include <consensus/merkle.h>
 #include <chainparams.h>
 #include <random.h>
@@ -289,6 +290,165 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(StempoolRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CTxMemPool stempool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+
+    // vtx[1] is only known in its stem phase, vtx[2] is in both pools
+    pool.addUnchecked(block.vtx[2].GetHash(), entry.FromTx(block.vtx[2]));
+    stempool.addUnchecked(block.vtx[1].GetHash(), entry.FromTx(block.vtx[1]));
+    stempool.addUnchecked(block.vtx[2].GetHash(), entry.FromTx(block.vtx[2]));
+
+    {
+        CBlockHeaderAndShortTxIDs shortIDs(block);
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << shortIDs;
+
+        CBlockHeaderAndShortTxIDs shortIDs2;
+        stream >> shortIDs2;
+
+        PartiallyDownloadedBlock partialBlockNoStem(&pool);
+        BOOST_CHECK(partialBlockNoStem.InitData(shortIDs2) == READ_STATUS_OK);
+        BOOST_CHECK(!partialBlockNoStem.IsTxAvailable(1));
+        BOOST_CHECK( partialBlockNoStem.IsTxAvailable(2));
+
+        PartiallyDownloadedBlock partialBlock(&pool, &stempool);
+        BOOST_CHECK(partialBlock.InitData(shortIDs2) == READ_STATUS_OK);
+        BOOST_CHECK( partialBlock.IsTxAvailable(0));
+        BOOST_CHECK( partialBlock.IsTxAvailable(1));
+        BOOST_CHECK( partialBlock.IsTxAvailable(2));
+
+        CBlock block2;
+        std::vector<CTransaction> vtx_missing;
+        BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+        bool mutated;
+        BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block2, &mutated).ToString());
+        BOOST_CHECK(!mutated);
+    }
+}
+
+static CTransaction BuildCombinedPartTestCase(unsigned char nSeed) {
+    unsigned char seed[32];
+    memset(seed, nSeed, sizeof(seed));
+    bls::PrivateKey key = bls::PrivateKey::FromSeed(seed, sizeof(seed));
+    std::vector<uint8_t> msg(1, nSeed);
+
+    CMutableTransaction tx;
+    tx.nVersion = TX_BLS_INPUT_FLAG;
+    tx.vin.resize(2);
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        tx.vin[i].prevout.hash = GetRandHash();
+        tx.vin[i].prevout.n = 0;
+    }
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 40 + nSeed;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[1] = CTxOut(2, CScript(OP_RETURN));
+    tx.SetBalanceSignature(bls::BasicSchemeMPL::Sign(key, msg));
+    tx.SetTxSignature(bls::BasicSchemeMPL::Sign(key, msg));
+    return tx;
+}
+
+class TestCombinedShortIDs : public CBlockHeaderAndShortTxIDs {
+    // Utility to add combined transactions to a CBlockHeaderAndShortTxIDs
+public:
+    TestCombinedShortIDs(const CBlock& block) : CBlockHeaderAndShortTxIDs(block) {}
+
+    size_t CombinedTxCount() const { return combinedtxn.size(); }
+    void DuplicateCombinedTx() { combinedtxn.push_back(combinedtxn.back()); }
+};
+
+BOOST_AUTO_TEST_CASE(CombinedBLSCTRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+
+    // Put vtx[1] together from two parts as BlockAssembler::addCombinedBLSCT does
+    std::set<CTransaction> setParts;
+    setParts.insert(BuildCombinedPartTestCase(1));
+    setParts.insert(BuildCombinedPartTestCase(2));
+
+    CMutableTransaction combined;
+    CAmount nFee;
+    CValidationState state;
+    BOOST_CHECK(BuildCombinedBLSCTTransaction(setParts, combined, nFee, state));
+    BOOST_CHECK_EQUAL(nFee, 4);
+    combined.nTime = 1600000000;
+    std::reverse(combined.vin.begin(), combined.vin.end());
+    std::reverse(combined.vout.begin(), combined.vout.end());
+    combined.vout.push_back(CTxOut(nFee, CScript(OP_RETURN)));
+    block.vtx[1] = combined;
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus())) ++block.nNonce;
+
+    std::vector<uint256> vParts;
+    for (CTransaction part: setParts) {
+        pool.addUnchecked(part.GetHash(), entry.FromTx(part));
+        vParts.push_back(part.GetHash());
+    }
+    pool.addUnchecked(block.vtx[2].GetHash(), entry.FromTx(block.vtx[2]));
+    AddCombinedBLSCTParts(block.vtx[1].GetHash(), vParts);
+
+    {
+        TestCombinedShortIDs shortIDs(block);
+        BOOST_CHECK_EQUAL(shortIDs.CombinedTxCount(), 1);
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << shortIDs;
+
+        CBlockHeaderAndShortTxIDs shortIDs2;
+        stream >> shortIDs2;
+
+        // The combined transaction is put together from its parts in the mempool
+        PartiallyDownloadedBlock partialBlock(&pool);
+        BOOST_CHECK(partialBlock.InitData(shortIDs2) == READ_STATUS_OK);
+        BOOST_CHECK( partialBlock.IsTxAvailable(0));
+        BOOST_CHECK( partialBlock.IsTxAvailable(1));
+        BOOST_CHECK( partialBlock.IsTxAvailable(2));
+
+        CBlock block2;
+        std::vector<CTransaction> vtx_missing;
+        BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+        BOOST_CHECK_EQUAL(block.vtx[1].GetHash().ToString(), block2.vtx[1].GetHash().ToString());
+        BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block2, &mutated).ToString());
+        BOOST_CHECK(!mutated);
+
+        // Without a part it is requested like any other missing transaction
+        std::list<CTransaction> removed;
+        pool.removeRecursive(*setParts.begin(), removed);
+        BOOST_CHECK_EQUAL(removed.size(), 1);
+
+        PartiallyDownloadedBlock partialBlockMissing(&pool);
+        BOOST_CHECK(partialBlockMissing.InitData(shortIDs2) == READ_STATUS_OK);
+        BOOST_CHECK(!partialBlockMissing.IsTxAvailable(1));
+        BOOST_CHECK( partialBlockMissing.IsTxAvailable(2));
+
+        // Combined transactions after the ones a block can have are ignored
+        pool.addUnchecked(removed.front().GetHash(), entry.FromTx(removed.front()));
+        shortIDs.DuplicateCombinedTx();
+        CDataStream streamDup(SER_NETWORK, PROTOCOL_VERSION);
+        streamDup << shortIDs;
+
+        CBlockHeaderAndShortTxIDs shortIDs3;
+        streamDup >> shortIDs3;
+
+        PartiallyDownloadedBlock partialBlockDup(&pool);
+        BOOST_CHECK(partialBlockDup.InitData(shortIDs3) == READ_STATUS_OK);
+        BOOST_CHECK( partialBlockDup.IsTxAvailable(1));
+        BOOST_CHECK( partialBlockDup.IsTxAvailable(2));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = GetRandHash();
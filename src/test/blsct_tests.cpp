@@ -149,6 +149,14 @@ BOOST_AUTO_TEST_CASE(blsct)
     BOOST_CHECK(vData[0].message == "test2test2test2test2test2test2test2test2test2test2test");
     BOOST_CHECK(vData[0].amount == 10*COIN);
 
+    // Same transaction, with its stateless checks done ahead
+    std::vector<RangeproofEncodedData> vDataPrechecked;
+    state = CValidationState();
+    BOOST_CHECK(PrecheckBLSCT(spendingTx, viewKey, state));
+    BOOST_CHECK(VerifyBLSCT(spendingTx, viewKey, vDataPrechecked, view, state));
+    BOOST_CHECK(vDataPrechecked[0].message == "test2test2test2test2test2test2test2test2test2test2test");
+    BOOST_CHECK(vDataPrechecked[0].amount == 10*COIN);
+
     vBLSSignatures.clear();
     spendingTx.vchTxSig.clear();
     spendingTx.vchBalanceSig.clear();
@@ -179,6 +187,14 @@ BOOST_AUTO_TEST_CASE(blsct)
     BOOST_CHECK(!VerifyBLSCT(spendingTx, viewKey, vData, view, state));
     BOOST_CHECK(state.GetRejectReason() == "could-not-read-blstxsig");
 
+    // A failed precheck is reported again by VerifyBLSCT
+    state = CValidationState();
+    BOOST_CHECK(!PrecheckBLSCT(spendingTx, viewKey, state));
+    BOOST_CHECK(state.GetRejectReason() == "could-not-read-blstxsig");
+    state = CValidationState();
+    BOOST_CHECK(!VerifyBLSCT(spendingTx, viewKey, vData, view, state));
+    BOOST_CHECK(state.GetRejectReason() == "could-not-read-blstxsig");
+
     spendingTx.vchTxSig = bls::BasicSchemeMPL::Aggregate(vBLSSignatures).Serialize();
 
     // Private to Private. Same amount. Balance signature correct. Tx signature incomplete.
@@ -9,6 +9,8 @@
 #include <uint256.h>
 #include <test/test_stock.h>
 #include <main.h>
+#include <tinyformat.h>
+#include <versionbits.h>
 
 #include <vector>
 #include <map>
@@ -554,5 +556,185 @@ BOOST_AUTO_TEST_CASE(cfund_prequests)
 
 }
 
+BOOST_AUTO_TEST_CASE(cfund_votelist_compact)
+{
+    uint256 a = GetRandHash();
+    uint256 b = GetRandHash();
+    uint256 c = GetRandHash();
+
+    CVoteList list;
+
+    BOOST_CHECK(!list.Compact(100));
+
+    list.Set(10, a, 1);
+    list.Set(20, b, 0);
+    list.Set(30, a, -1);
+    list.Set(40, c, 1);
+    list.Set(50, b, 1);
+
+    std::map<uint256, int64_t> before = list.GetList();
+
+    BOOST_CHECK(list.Compact(35));
+    BOOST_CHECK(list.GetFullList()->size() == 3);
+    BOOST_CHECK(list.GetFullList()->count(30) == 1);
+    BOOST_CHECK(list.GetList() == before);
+    BOOST_CHECK(list.GetLastVoteHeight() == 50);
+
+    // Disconnecting blocks above the compacted height still works
+    list.Clear(50);
+    int64_t val;
+    BOOST_CHECK(list.Get(b, val) && val == 0);
+    BOOST_CHECK(list.Get(a, val) && val == -1);
+
+    // Nothing left to collapse
+    BOOST_CHECK(!list.Compact(35));
+
+    // The merged entries can be restored to disconnect blocks below the
+    // compacted height
+    CVoteList full;
+    full.Set(10, a, 1);
+    full.Set(20, b, 0);
+    full.Set(30, a, -1);
+    full.Set(40, c, 1);
+
+    CVoteList compacted = full;
+    std::map<int, std::map<uint256, int64_t>> mapRemoved;
+    BOOST_CHECK(compacted.Compact(35, &mapRemoved));
+    BOOST_CHECK(mapRemoved.size() == 3);
+    compacted.Uncompact(mapRemoved);
+    BOOST_CHECK(compacted == full);
+
+    compacted.Clear(40);
+    compacted.Clear(30);
+    BOOST_CHECK(compacted.Get(a, val) && val == 1);
+}
+
+struct DAORegtestingSetup : public TestingSetup {
+    DAORegtestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+static CBlockIndex* AddVotingBlock(CBlockIndex* prev)
+{
+    CBlockHeader header;
+    // Every block signals the community fund, which activates it after three
+    // confirmation windows.
+    header.nVersion = VERSIONBITS_TOP_BITS | (1 << Params().GetConsensus().vDeployments[Consensus::DEPLOYMENT_COMMUNITYFUND].bit);
+    header.nTime = 1500000000 + prev->nHeight + 1;
+    header.nNonce = 0;
+
+    CBlockIndex* next = new CBlockIndex(header);
+    next->phashBlock = new uint256(GetRandHash());
+    mapBlockIndex.insert(std::make_pair(*next->phashBlock, next));
+    next->pprev = prev;
+    next->nHeight = prev->nHeight + 1;
+    next->BuildSkip();
+    return next;
+}
+
+static std::vector<std::string> RunVoteSteps(const std::vector<std::pair<CBlockIndex*, bool>>& vSteps,
+                                             const std::vector<CProposal>& vProposals, bool fRecompute)
+{
+    CStateViewDB db(1<<23, true);
+    CStateViewCache view(&db);
+    CValidationState state;
+    std::vector<std::string> vResults;
+
+    for (const CProposal& proposal: vProposals)
+        BOOST_CHECK(view.AddProposal(proposal));
+
+    ResetDAOVoteCaches();
+
+    for (const auto& step: vSteps)
+    {
+        if (fRecompute)
+            ResetDAOVoteCaches();
+
+        BOOST_CHECK(VoteStep(state, step.first, step.second, view));
+
+        for (const CProposal& it: vProposals)
+        {
+            CProposal proposal;
+            BOOST_CHECK(view.GetProposal(it.hash, proposal));
+
+            const CBlockIndex* pindexState = proposal.GetLastStateBlockIndex();
+            vResults.push_back(strprintf("%s %d: yes=%d no=%d abs=%d cycle=%d state=%d at %d", step.second ? "undo" : "connect",
+                                         step.first->nHeight, proposal.nVotesYes, proposal.nVotesNo, proposal.nVotesAbs,
+                                         proposal.nVotingCycle, proposal.GetLastState(), pindexState ? pindexState->nHeight : -1));
+        }
+    }
+
+    return vResults;
+}
+
+BOOST_FIXTURE_TEST_CASE(cfund_incremental_vote_step, DAORegtestingSetup)
+{
+    LOCK(cs_main);
+
+    const int nCycleLength = Params().GetConsensus().vParameters[Consensus::CONSENSUS_PARAM_VOTING_CYCLE_LENGTH].value;
+    const int nForkHeight = 4 * nCycleLength - 10;
+    const int nTipHeight = 6 * nCycleLength + 10;
+
+    std::vector<CBlockIndex*> vMain(1, chainActive.Tip());
+    while (vMain.back()->nHeight < nTipHeight)
+        vMain.push_back(AddVotingBlock(vMain.back()));
+
+    std::vector<CBlockIndex*> vFork(vMain.begin(), vMain.begin() + nForkHeight + 1);
+    while (vFork.back()->nHeight < nTipHeight)
+        vFork.push_back(AddVotingBlock(vFork.back()));
+
+    const int nCreatedHeight = 2 * nCycleLength + 90;
+    BOOST_CHECK(IsCommunityFundEnabled(vMain[nCreatedHeight], Params().GetConsensus()));
+
+    std::vector<CProposal> vProposals(3);
+    for (CProposal& proposal: vProposals)
+    {
+        proposal.nVersion = CProposal::BASE_VERSION | CProposal::ABSTAIN_VOTE_VERSION;
+        proposal.nDeadline = 1000000;
+        proposal.hash = GetRandHash();
+        proposal.txblockhash = vMain[nCreatedHeight]->GetBlockHash();
+    }
+
+    // The first proposal gets accepted, the second rejected and the third only gets
+    // a few votes in its first cycle. The fork votes differently after it splits.
+    for (int i = nCreatedHeight + 1; i <= nTipHeight; i++)
+    {
+        const uint256& hash = vMain[i]->GetBlockHash();
+        AddProposalVote(hash, vProposals[0].hash, i % 3 ? VoteFlags::VOTE_YES : VoteFlags::VOTE_ABSTAIN);
+        if (i % 4)
+            AddProposalVote(hash, vProposals[1].hash, VoteFlags::VOTE_NO);
+        if (i < 3 * nCycleLength && i % 2)
+            AddProposalVote(hash, vProposals[2].hash, VoteFlags::VOTE_YES);
+
+        if (i <= nForkHeight)
+            continue;
+
+        const uint256& hashFork = vFork[i]->GetBlockHash();
+        if (i % 2)
+            AddProposalVote(hashFork, vProposals[0].hash, VoteFlags::VOTE_NO);
+        if (i % 5)
+            AddProposalVote(hashFork, vProposals[1].hash, VoteFlags::VOTE_YES);
+        AddProposalVote(hashFork, vProposals[2].hash, VoteFlags::VOTE_ABSTAIN);
+    }
+
+    // Connect the main chain across several cycle boundaries, reorganize to the fork
+    // back across one of them and connect the fork.
+    std::vector<std::pair<CBlockIndex*, bool>> vSteps;
+    for (int i = nCreatedHeight + 1; i <= nTipHeight; i++)
+        vSteps.push_back(std::make_pair(vMain[i], false));
+    for (int i = nTipHeight; i > nForkHeight; i--)
+        vSteps.push_back(std::make_pair(vMain[i], true));
+    for (int i = nForkHeight + 1; i <= nTipHeight; i++)
+        vSteps.push_back(std::make_pair(vFork[i], false));
+
+    std::vector<std::string> vIncremental = RunVoteSteps(vSteps, vProposals, false);
+    std::vector<std::string> vRecomputed = RunVoteSteps(vSteps, vProposals, true);
+
+    BOOST_CHECK_EQUAL(vIncremental.size(), vRecomputed.size());
+    for (unsigned int i = 0; i < std::min(vIncremental.size(), vRecomputed.size()); i++)
+        BOOST_CHECK_EQUAL(vIncremental[i], vRecomputed[i]);
+
+    ResetDAOVoteCaches();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
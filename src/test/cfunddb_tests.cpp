@@ -433,5 +433,50 @@ BOOST_AUTO_TEST_CASE(cfunddb_state)
     }
 }
 
-BOOST_AUTO_TEST_SUITE_END()
+BOOST_AUTO_TEST_CASE(cfunddb_cache_usage)
+{
+    CStateViewDB *pcoinsdbview = new CStateViewDB(1<<23, true);
+    CStateViewCache base(pcoinsdbview);
+    CStateViewCache view(&base);
+
+    BOOST_CHECK(view.DynamicMemoryUsage(STATE_CACHE_PROPOSALS) == 0);
 
+    std::vector<uint256> vHashes;
+    for (unsigned int i = 0; i < NUM_SIMULATION_ITERATIONS; i++) {
+        CProposal proposal;
+        proposal.hash = GetRandHash();
+        proposal.nAmount = 1 + i;
+        proposal.strDZeel = std::string(insecure_rand() % 200, 'x');
+        BOOST_CHECK(view.AddProposal(proposal));
+        vHashes.push_back(proposal.hash);
+    }
+    BOOST_CHECK(view.GetCacheSize(STATE_CACHE_PROPOSALS) == NUM_SIMULATION_ITERATIONS);
+    size_t nAdded = view.DynamicMemoryUsage(STATE_CACHE_PROPOSALS);
+    BOOST_CHECK(nAdded > 0);
+
+    // Growing an entry through a modifier is accounted for
+    {
+        CProposalModifier mProposal = view.ModifyProposal(vHashes[0]);
+        mProposal->strDZeel = std::string(1000, 'y');
+    }
+    BOOST_CHECK(view.DynamicMemoryUsage(STATE_CACHE_PROPOSALS) > nAdded);
+    BOOST_CHECK(view.DynamicMemoryUsage() >= view.DynamicMemoryUsage(STATE_CACHE_PROPOSALS));
+
+    // The running count agrees with the recount done on Sync
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK(view.DynamicMemoryUsage(STATE_CACHE_PROPOSALS) == 0);
+    size_t nRunning = base.DynamicMemoryUsage(STATE_CACHE_PROPOSALS);
+    BOOST_CHECK(base.Sync());
+    BOOST_CHECK_EQUAL(base.DynamicMemoryUsage(STATE_CACHE_PROPOSALS), nRunning);
+
+    // Clean entries can be dropped and are read back from the database
+    base.UncacheClean(STATE_CACHE_PROPOSALS);
+    BOOST_CHECK(base.GetCacheSize(STATE_CACHE_PROPOSALS) == 0);
+    BOOST_CHECK(base.DynamicMemoryUsage(STATE_CACHE_PROPOSALS) == 0);
+    BOOST_CHECK(base.HaveProposal(vHashes[0]));
+    BOOST_CHECK(base.GetCacheSize(STATE_CACHE_PROPOSALS) == 1);
+
+    delete pcoinsdbview;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
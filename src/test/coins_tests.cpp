@@ -3,13 +3,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <coins.h>
+#include <dotstock/names.h>
 #include <random.h>
 #include <script/standard.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <utilstrencodings.h>
 #include <test/test_stock.h>
 #include <main.h>
 #include <consensus/validation.h>
+#include <undo.h>
 
 #include <vector>
 #include <map>
@@ -70,6 +73,52 @@ public:
     }
 };
 
+//! Base view counting how often each coins entry is written to it
+class CStateViewSyncTest : public CStateView
+{
+public:
+    std::map<uint256, CCoins> mapCoins_;
+    std::map<uint256, int> mapWrites_;
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        std::map<uint256, CCoins>::const_iterator it = mapCoins_.find(txid);
+        if (it == mapCoins_.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    bool HaveCoins(const uint256& txid) const
+    {
+        return mapCoins_.count(txid) > 0;
+    }
+
+    bool BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
+                    CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
+                    CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
+                    CConsensusParameterMap& mapConsensus, TokenMap& mapTokens, TokenUtxoMap& mapTokenUtxos,
+                    NameRecordMap& mapNameRecords, NameDataMap& mapNameData, NameStateMap& mapNameStates,
+                    const uint256 &hashBlock, const int &nCacheExcludeVotes, const CStateStats& stats)
+    {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            mapWrites_[it->first]++;
+            if (it->second.coins.IsPruned())
+                mapCoins_.erase(it->first);
+            else
+                mapCoins_[it->first] = it->second.coins;
+        }
+        mapTokens.clear();
+        mapTokenUtxos.clear();
+        mapNameRecords.clear();
+        mapNameData.clear();
+        mapNameStates.clear();
+        return true;
+    }
+};
+
 class CStateViewCacheTest : public CStateViewCache
 {
 public:
@@ -351,6 +400,83 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
     BOOST_CHECK(spent_a_duplicate_coinbase);
 }
 
+BOOST_AUTO_TEST_CASE(state_cache_sync_trim)
+{
+    CStateViewSyncTest base;
+    CStateViewCacheTest cache(&base);
+
+    std::vector<uint256> vTxids;
+    for (int i = 0; i < 20; i++) {
+        uint256 txid = GetRandHash();
+        CCoins coins;
+        coins.vout.resize(1);
+        coins.vout[0].nValue = i + 1;
+        coins.vout[0].scriptPubKey.assign(100, 0x51);
+        base.mapCoins_[txid] = coins;
+        vTxids.push_back(txid);
+        BOOST_CHECK(cache.AccessCoins(txid) != nullptr);
+    }
+
+    // Modified and new entries are written once and stay in the cache
+    for (int i = 0; i < 5; i++)
+        cache.ModifyCoins(vTxids[i])->vout[0].nValue += 100;
+    uint256 txidNew = GetRandHash();
+    {
+        CCoinsModifier coins = cache.ModifyNewCoins(txidNew, false);
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 1000;
+    }
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(base.mapWrites_.size(), 6U);
+    for (int i = 0; i < 5; i++) {
+        BOOST_CHECK_EQUAL(base.mapWrites_[vTxids[i]], 1);
+        BOOST_CHECK_EQUAL(base.mapCoins_[vTxids[i]].vout[0].nValue, i + 101);
+    }
+    BOOST_CHECK_EQUAL(base.mapWrites_[txidNew], 1);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 21U);
+    cache.SelfTest();
+
+    // Nothing is written again until it changes
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(base.mapWrites_.size(), 6U);
+    BOOST_CHECK_EQUAL(base.mapWrites_[vTxids[0]], 1);
+    cache.ModifyCoins(vTxids[0])->vout[0].nValue += 100;
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(base.mapWrites_[vTxids[0]], 2);
+    BOOST_CHECK_EQUAL(base.mapWrites_[vTxids[1]], 1);
+
+    // Stamp the entries in order, then leave two of them modified
+    for (const uint256& txid: vTxids)
+        cache.AccessCoins(txid);
+    cache.AccessCoins(txidNew);
+    cache.ModifyCoins(vTxids[0])->vout[0].nValue += 100;
+    cache.ModifyCoins(vTxids[10])->vout[0].nValue += 100;
+
+    // The least recently used clean entry goes first, modified ones are skipped
+    size_t nTarget = cache.DynamicMemoryUsage() - 1;
+    cache.Trim(nTarget);
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= nTarget);
+    BOOST_CHECK(cache.HaveCoinsInCache(vTxids[0]));
+    BOOST_CHECK(!cache.HaveCoinsInCache(vTxids[1]));
+    BOOST_CHECK(cache.HaveCoinsInCache(vTxids[2]));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 20U);
+    cache.SelfTest();
+
+    // A budget the clean entries cannot meet evicts all of them and nothing else
+    cache.Trim(0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2U);
+    BOOST_CHECK(cache.HaveCoinsInCache(vTxids[0]));
+    BOOST_CHECK(cache.HaveCoinsInCache(vTxids[10]));
+    cache.SelfTest();
+
+    // The modified entries are still written after the trim
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(base.mapWrites_[vTxids[0]], 3);
+    BOOST_CHECK_EQUAL(base.mapWrites_[vTxids[10]], 2);
+    BOOST_CHECK_EQUAL(base.mapWrites_[vTxids[2]], 1);
+    BOOST_CHECK_EQUAL(base.mapCoins_[vTxids[10]].vout[0].nValue, 111);
+}
+
 BOOST_AUTO_TEST_CASE(ccoins_serialization)
 {
     // Good example
@@ -420,4 +546,286 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     }
 }
 
+static void CheckTokenUtxos(CStateViewCache& view, const uint256& id, const std::map<TokenUtxoKey, TokenUtxoValue>& model)
+{
+    std::vector<TokenUtxoKey> vExpected;
+    for (auto& it: model)
+        if (it.first.id == id)
+            vExpected.push_back(it.first);
+
+    // Read the whole index in pages of 7 entries
+    std::vector<TokenUtxoKey> vRead;
+    TokenUtxoKey start(id, 0);
+    while (true) {
+        TokenUtxoValues page;
+        view.GetTokenUtxos(start, 8, page);
+        for (unsigned int i = 0; i < page.size() && i < 7; i++)
+            vRead.push_back(MakeTokenUtxoKey(id, page[i]));
+        if (page.size() < 8)
+            break;
+        start = MakeTokenUtxoKey(id, page.back());
+    }
+    BOOST_CHECK(vRead == vExpected);
+
+    TokenUtxoEntry last;
+    BOOST_CHECK_EQUAL(view.GetLastTokenUtxo(TokenUtxoKey::End(id), last), !vExpected.empty());
+    if (!vExpected.empty())
+        BOOST_CHECK(MakeTokenUtxoKey(id, last) == vExpected.back());
+}
+
+BOOST_AUTO_TEST_CASE(token_utxo_index)
+{
+    CStateViewDB db(1 << 20, true);
+    CStateViewCache base(&db);
+    CStateViewCache view(&base);
+
+    uint256 id = GetRandHash();
+    uint256 other = GetRandHash();
+    std::map<TokenUtxoKey, TokenUtxoValue> model;
+
+    // Entries spread over the database and the cache below the view, then
+    // changed by the view on top of them.
+    for (unsigned int i = 0; i < 1500; i++) {
+        CStateViewCache& target = i < 1000 ? base : view;
+        if (i == 500)
+            BOOST_CHECK(base.Flush());
+        if (!model.empty() && insecure_rand() % 4 == 0) {
+            auto it = std::next(model.begin(), insecure_rand() % model.size());
+            BOOST_CHECK(target.RemoveTokenUtxo(it->first));
+            model.erase(it);
+        } else {
+            TokenUtxoValue value(GetRandHash(), std::vector<uint8_t>(1, i), insecure_rand() % 4);
+            TokenUtxoKey key(insecure_rand() % 2 ? id : other, insecure_rand() % 100, value.hash, value.n);
+            BOOST_CHECK(target.AddTokenUtxo(key, value));
+            model[key] = value;
+        }
+    }
+
+    CheckTokenUtxos(view, id, model);
+    CheckTokenUtxos(view, other, model);
+
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK(base.Flush());
+
+    CheckTokenUtxos(view, id, model);
+    CheckTokenUtxos(view, other, model);
+}
+
+BOOST_AUTO_TEST_CASE(token_utxo_current)
+{
+    CStateViewDB db(1 << 20, true);
+    CStateViewCache view(&db);
+
+    uint256 id = GetRandHash();
+
+    // The token is minted at height 10, then moves twice at height 20: from
+    // the first output there to the second one, which sorts before it.
+    uint256 hashMint = GetRandHash();
+    uint256 hashMove1 = GetRandHash();
+    uint256 hashMove2 = GetRandHash();
+    if (hashMove2 > hashMove1)
+        std::swap(hashMove1, hashMove2);
+
+    BOOST_CHECK(view.AddTokenUtxo(TokenUtxoKey(id, 10, hashMint, 0), TokenUtxoValue(hashMint, std::vector<uint8_t>(1, 1), 0)));
+    BOOST_CHECK(view.AddTokenUtxo(TokenUtxoKey(id, 20, hashMove1, 1), TokenUtxoValue(hashMove1, std::vector<uint8_t>(1, 2), 1)));
+    BOOST_CHECK(view.AddTokenUtxo(TokenUtxoKey(id, 20, hashMove2, 0), TokenUtxoValue(hashMove2, std::vector<uint8_t>(1, 3), 0)));
+
+    // Only the last output is unspent, the transaction of the first move keeps another one
+    {
+        CCoinsModifier coins = view.ModifyNewCoins(hashMove1, false);
+        coins->vout.resize(2);
+        coins->vout[0].nValue = 5;
+        coins->vout[0].scriptPubKey = CScript() << OP_TRUE;
+    }
+    {
+        CCoinsModifier coins = view.ModifyNewCoins(hashMove2, false);
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 1;
+        coins->vout[0].scriptPubKey = CScript() << OP_TRUE;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        TokenUtxoEntry utxo;
+        BOOST_CHECK(view.GetLastTokenUtxo(TokenUtxoKey::End(id), utxo));
+        BOOST_CHECK(utxo.second.hash == hashMove1);
+
+        BOOST_CHECK(view.GetCurrentTokenUtxo(id, utxo));
+        BOOST_CHECK_EQUAL(utxo.first, 20U);
+        BOOST_CHECK(utxo.second.hash == hashMove2);
+        BOOST_CHECK_EQUAL(utxo.second.n, 0U);
+
+        BOOST_CHECK(view.Flush());
+    }
+
+    // A single output in the newest block is returned as is
+    uint256 hashMove3 = GetRandHash();
+    BOOST_CHECK(view.AddTokenUtxo(TokenUtxoKey(id, 30, hashMove3, 0), TokenUtxoValue(hashMove3, std::vector<uint8_t>(1, 4), 0)));
+    TokenUtxoEntry utxo;
+    BOOST_CHECK(view.GetCurrentTokenUtxo(id, utxo));
+    BOOST_CHECK(utxo.second.hash == hashMove3);
+
+    BOOST_CHECK(!view.GetCurrentTokenUtxo(GetRandHash(), utxo));
+}
+
+/** Write the running stats with the view and check they match a full pass over the database */
+static void CheckStateStats(CStateViewDB& db, CStateViewCache& view, const CStateStats& stats)
+{
+    view.SetBestBlock(GetRandHash());
+    BOOST_CHECK(view.SetStateStats(stats));
+    BOOST_CHECK(view.Flush());
+
+    CStateStats full;
+    BOOST_CHECK(ComputeStateStats(&db, full));
+    BOOST_CHECK_EQUAL(stats.nTransactions, full.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, full.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, full.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, full.nTotalAmount);
+    BOOST_CHECK_EQUAL(stats.nTotalColdAmount, full.nTotalColdAmount);
+    BOOST_CHECK_EQUAL(stats.nTotalColdv2Amount, full.nTotalColdv2Amount);
+    BOOST_CHECK(stats.GetHash() == full.GetHash());
+
+    CStateStats stored;
+    BOOST_CHECK(db.GetStateStats(stored));
+    BOOST_CHECK(stored.GetHash() == full.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(state_stats_connect_disconnect)
+{
+    CStateViewDB db(1 << 20, true);
+    CStateViewCache view(&db);
+    CStateStats stats;
+    BOOST_CHECK(db.GetStateStats(stats));
+
+    // A coinbase with three outputs
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(3);
+    for (unsigned int i = 0; i < coinbase.vout.size(); i++) {
+        coinbase.vout[i].nValue = 100 + i;
+        coinbase.vout[i].scriptPubKey = CScript() << OP_TRUE << i;
+    }
+    CTxUndo undoDummy;
+    UpdateCoins(coinbase, view, undoDummy, 1, &stats);
+    CheckStateStats(db, view, stats);
+    CStateStats statsBefore = stats;
+
+    // A block partly spending it, then spending its last output and an output created in the same block
+    std::vector<CTransaction> vtx;
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+    tx.vin[1].prevout = COutPoint(coinbase.GetHash(), 1);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 150;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[1].nValue = 50;
+    tx.vout[1].scriptPubKey = CScript() << OP_FALSE;
+    vtx.push_back(tx);
+
+    tx.vin[0].prevout = COutPoint(coinbase.GetHash(), 2);
+    tx.vin[1].prevout = COutPoint(vtx[0].GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 250;
+    vtx.push_back(tx);
+
+    std::vector<CTxUndo> vtxundo(vtx.size());
+    for (unsigned int i = 0; i < vtx.size(); i++)
+        UpdateCoins(vtx[i], view, vtxundo[i], 2, &stats);
+    BOOST_CHECK_EQUAL(stats.nTransactions, 2U);
+    CheckStateStats(db, view, stats);
+
+    // Disconnect it again as DisconnectBlock does
+    for (int i = vtx.size() - 1; i >= 0; i--) {
+        {
+            CCoinsModifier outs = view.ModifyCoins(vtx[i].GetHash());
+            stats.RemoveCoins(vtx[i].GetHash(), *outs);
+            outs->Clear();
+        }
+        for (int j = vtx[i].vin.size() - 1; j >= 0; j--)
+            BOOST_CHECK(ApplyTxInUndo(vtxundo[i].vprevout[j], view, vtx[i].vin[j].prevout, &stats));
+    }
+    CheckStateStats(db, view, stats);
+    BOOST_CHECK_EQUAL(stats.nTransactions, statsBefore.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, statsBefore.nTransactionOutputs);
+    BOOST_CHECK(stats.GetHash() == statsBefore.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(name_data_state)
+{
+    CStateViewDB db(1 << 20, true);
+    CStateViewCache base(&db);
+    CStateViewCache view(&base);
+    BOOST_CHECK(db.UpgradeNameStates());
+
+    uint256 id = SerializeHash(std::string("stock.0dyns"));
+    const char* subdomains[] = {"", "www"};
+    const char* keys[] = {"_key", "a", "b"};
+    NameDataValues history;
+    NameDataState state;
+
+    // Connect updates, deep enough to let the oldest lose their undo data.
+    for (uint64_t height = 1; height <= 400; height++) {
+        for (unsigned int i = insecure_rand() % 3; i > 0; i--) {
+            NameDataValue value(keys[insecure_rand() % 3], insecure_rand() % 4 ? HexStr(GetRandHash()) : "", subdomains[insecure_rand() % 2]);
+            BOOST_CHECK(view.AddNameData(id, std::make_pair(height, value)));
+            // The database keeps one entry per height and key, the last one
+            history.erase(std::remove_if(history.begin(), history.end(),
+                [height, &value](const NameDataEntry& o) { return o.first == height && o.second.key == value.key; }), history.end());
+            history.push_back(std::make_pair(height, value));
+        }
+        if (height % 100 == 0) {
+            BOOST_CHECK(view.Flush());
+            BOOST_CHECK(base.Flush());
+        }
+        if (view.GetNameState(id, state))
+            for (auto sub: subdomains)
+                BOOST_CHECK(state.Get(height, sub) == DotStock::Consolidate(history, height, sub));
+    }
+
+    // Disconnect them again, past the undo data.
+    for (uint64_t height = 400; height > 50; height--) {
+        view.RemoveNameData(NameDataKey(id, height));
+        history.erase(std::remove_if(history.begin(), history.end(),
+            [height](const NameDataEntry& o) { return o.first >= height; }), history.end());
+        if (height % 100 == 0) {
+            BOOST_CHECK(view.Flush());
+            BOOST_CHECK(base.Flush());
+        }
+        if (view.GetNameState(id, state))
+            for (auto sub: subdomains)
+                BOOST_CHECK(state.Get(height - 1, sub) == DotStock::Consolidate(history, height - 1, sub));
+    }
+
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK(base.Flush());
+
+    // Nothing is left in the database of the disconnected heights.
+    NameDataValues stored;
+    db.GetNameData(id, stored);
+    for (auto& it: stored)
+        BOOST_CHECK(it.first <= 50);
+    BOOST_CHECK_EQUAL(stored.size(), history.size());
+
+    // An update keeps only itself in the cache, and a height connected again
+    // after a disconnect does not bring back what was written at it before.
+    CStateViewCache view2(&db);
+    BOOST_CHECK(view2.AddNameData(id, std::make_pair(51, NameDataValue("a", "first", "www"))));
+    BOOST_CHECK(view2.AddNameData(id, std::make_pair(51, NameDataValue("b", "gone", "www"))));
+    BOOST_CHECK(view2.GetNameData(id, stored));
+    BOOST_CHECK_EQUAL(stored.size(), history.size() + 2);
+    BOOST_CHECK(view2.RemoveNameData(NameDataKey(id, 51)));
+    BOOST_CHECK(view2.AddNameData(id, std::make_pair(51, NameDataValue("a", "second", ""))));
+    BOOST_CHECK(view2.AddNameData(id, std::make_pair(51, NameDataValue("a", "third", "www"))));
+    BOOST_CHECK_EQUAL(view2.GetCacheSize(STATE_CACHE_NAME_DATA), 1U);
+    BOOST_CHECK(view2.Flush());
+
+    history.push_back(std::make_pair(51, NameDataValue("a", "third", "www")));
+    BOOST_CHECK(db.GetNameData(id, stored));
+    BOOST_CHECK_EQUAL(stored.size(), history.size());
+    BOOST_CHECK(db.GetNameState(id, state));
+    for (auto sub: subdomains)
+        BOOST_CHECK(state.Get(51, sub) == DotStock::Consolidate(history, 51, sub));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,7 @@
 #include <crypto/sha512.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/muhash.h>
 #include <random.h>
 #include <utilstrencodings.h>
 #include <test/test_stock.h>
@@ -441,4 +442,55 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
                   "b2eb05e2c39be9fcda6c19078c6a9d1b3f461796d6b0d6b2e0c2a72b4d80e644");
 }
 
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    std::vector<std::vector<unsigned char>> elems;
+    for (int i = 0; i < 8; i++) {
+        std::vector<unsigned char> elem(32 + i);
+        GetRandBytes(elem.data(), elem.size());
+        elems.push_back(elem);
+    }
+
+    unsigned char out[MuHash3072::OUTPUT_SIZE];
+    unsigned char out2[MuHash3072::OUTPUT_SIZE];
+
+    // Insertion order does not matter.
+    MuHash3072 acc, acc2;
+    for (size_t i = 0; i < elems.size(); i++) {
+        acc.Insert(elems[i].data(), elems[i].size());
+        acc2.Insert(elems[elems.size() - 1 - i].data(), elems[elems.size() - 1 - i].size());
+    }
+    acc.Finalize(out);
+    acc2.Finalize(out2);
+    BOOST_CHECK(memcmp(out, out2, sizeof(out)) == 0);
+
+    // Removing everything again gives back the empty set.
+    for (size_t i = 0; i < elems.size(); i++)
+        acc.Remove(elems[i].data(), elems[i].size());
+    acc.Finalize(out);
+    MuHash3072().Finalize(out2);
+    BOOST_CHECK(memcmp(out, out2, sizeof(out)) == 0);
+
+    // Union and difference of sets.
+    MuHash3072 a(elems[0].data(), elems[0].size());
+    MuHash3072 b(elems[1].data(), elems[1].size());
+    MuHash3072 ab = a;
+    ab *= b;
+    ab /= a;
+    ab.Finalize(out);
+    b.Finalize(out2);
+    BOOST_CHECK(memcmp(out, out2, sizeof(out)) == 0);
+    a.Finalize(out2);
+    BOOST_CHECK(memcmp(out, out2, sizeof(out)) != 0);
+
+    // The normalized representation round trips.
+    unsigned char bytes[MuHash3072::BYTE_SIZE];
+    acc2.GetBytes(bytes);
+    MuHash3072 restored;
+    restored.SetBytes(bytes);
+    acc2.Finalize(out);
+    restored.Finalize(out2);
+    BOOST_CHECK(memcmp(out, out2, sizeof(out)) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
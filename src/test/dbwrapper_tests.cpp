@@ -2,9 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <arith_uint256.h>
 #include <dbwrapper.h>
+#include <indexer.h>
+#include <main.h>
 #include <uint256.h>
 #include <random.h>
+#include <script/standard.h>
+#include <txdb.h>
 #include <test/test_stock.h>
 
 #include <boost/assign/std/vector.hpp> // for 'operator+=()'
@@ -127,6 +132,49 @@ BOOST_AUTO_TEST_CASE(dbwrapper_batch)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_batch_async)
+{
+    // Perform tests both obfuscated and non-obfuscated.
+    for (int i = 0; i < 2; i++) {
+        bool obfuscate = (bool)i;
+        path ph = temp_directory_path() / unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        char key = 'i';
+        uint256 in = GetRandHash();
+        char key2 = 'j';
+        uint256 in2 = GetRandHash();
+        char key3 = 'k';
+        uint256 in3 = GetRandHash();
+
+        uint256 res;
+        BOOST_CHECK(dbw.Write(key3, in3));
+
+        std::unique_ptr<CDBBatch> batch(new CDBBatch(dbw));
+        batch->Write(key, in);
+        batch->Write(key2, in);
+        batch->Write(key2, in2);
+        batch->Erase(key3);
+
+        BOOST_CHECK(dbw.WriteBatchAsync(std::move(batch)));
+
+        // Whether or not the write is committed yet, reads see its last record per key
+        BOOST_CHECK(dbw.Read(key, res));
+        BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+        BOOST_CHECK(dbw.Read(key2, res));
+        BOOST_CHECK_EQUAL(res.ToString(), in2.ToString());
+        BOOST_CHECK(!dbw.Exists(key3));
+
+        dbw.WaitForPendingWrite();
+
+        BOOST_CHECK(dbw.Read(key, res));
+        BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+        BOOST_CHECK(dbw.Read(key2, res));
+        BOOST_CHECK_EQUAL(res.ToString(), in2.ToString());
+        BOOST_CHECK(dbw.Read(key3, res) == false);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
 {
     // Perform tests both obfuscated and non-obfuscated.
@@ -364,6 +412,97 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
+static CTransaction AddressTransaction(const COutPoint& prevout, const std::vector<CTxOut>& vout, unsigned int nTime)
+{
+    CMutableTransaction tx;
+    tx.nTime = nTime;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    if (prevout.IsNull())
+        tx.vin[0].scriptSig = CScript() << nTime << OP_0;
+    tx.vout = vout;
+    return tx;
+}
 
+static void CheckSummary(CBlockTreeDB& db, const uint160& address, CAmount nSpendable, CAmount nReceived, unsigned int nTxCount,
+                         int nFirstHeight, int nLastHeight)
+{
+    CAddressSummaryValue summary;
+    BOOST_CHECK(db.ReadAddressSummary(address, address, summary));
+    BOOST_CHECK_EQUAL(summary.spendable, nSpendable);
+    BOOST_CHECK_EQUAL(summary.received, nReceived);
+    BOOST_CHECK_EQUAL(summary.txcount, nTxCount);
+    BOOST_CHECK_EQUAL(summary.firstHeight, nFirstHeight);
+    BOOST_CHECK_EQUAL(summary.lastHeight, nLastHeight);
+}
+
+BOOST_AUTO_TEST_CASE(address_summary)
+{
+    CBlockTreeDB db(1 << 20, true);
+    bool fAddressIndexOld = fAddressIndex;
+    fAddressIndex = true;
+
+    uint160 hashFrom, hashTo;
+    hashFrom.SetHex("1");
+    hashTo.SetHex("2");
+    CScript scriptFrom = GetScriptForDestination(CKeyID(hashFrom));
+    CScript scriptTo = GetScriptForDestination(CKeyID(hashTo));
+
+    // Block 10 pays 100 to the first address, block 12 sends 60 of it to the second one
+    CBlock block10;
+    block10.vtx.push_back(AddressTransaction(COutPoint(), std::vector<CTxOut>(1, CTxOut(100, scriptFrom)), 10));
+    CBlockUndo undo10;
+
+    CBlock block12;
+    block12.vtx.push_back(AddressTransaction(COutPoint(), std::vector<CTxOut>(1, CTxOut(5, CScript() << OP_TRUE)), 12));
+    std::vector<CTxOut> vout;
+    vout.push_back(CTxOut(60, scriptTo));
+    vout.push_back(CTxOut(40, scriptFrom));
+    block12.vtx.push_back(AddressTransaction(COutPoint(block10.vtx[0].GetHash(), 0), vout, 12));
+    CBlockUndo undo12;
+    undo12.vtxundo.resize(1);
+    undo12.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(100, scriptFrom), true, 10));
+
+    std::vector<CIndexUpdate> vUpdates(1);
+    GetConnectIndexUpdate(block10, undo10, 10, vUpdates[0]);
+    BOOST_CHECK(db.WriteIndexUpdates(vUpdates));
+    CheckSummary(db, hashFrom, 100, 100, 1, 10, 10);
+
+    vUpdates.assign(1, CIndexUpdate());
+    GetConnectIndexUpdate(block12, undo12, 12, vUpdates[0]);
+    BOOST_CHECK(db.WriteIndexUpdates(vUpdates));
+    CheckSummary(db, hashFrom, 40, 100, 2, 10, 12);
+    CheckSummary(db, hashTo, 60, 60, 1, 12, 12);
+
+    // Connecting a block again does not count it twice
+    BOOST_CHECK(db.WriteIndexUpdates(vUpdates));
+    CheckSummary(db, hashFrom, 40, 100, 2, 10, 12);
+
+    // Disconnecting takes away the amounts the block added
+    vUpdates.assign(1, CIndexUpdate());
+    GetDisconnectIndexUpdate(block12, undo12, 12, vUpdates[0]);
+    BOOST_CHECK(db.WriteIndexUpdates(vUpdates));
+    CheckSummary(db, hashFrom, 100, 100, 1, 10, 10);
+    CheckSummary(db, hashTo, 0, 0, 0, -1, -1);
+
+    // And only once
+    BOOST_CHECK(db.WriteIndexUpdates(vUpdates));
+    CheckSummary(db, hashFrom, 100, 100, 1, 10, 10);
+
+    // A reorg within a single batch, connecting the block and disconnecting it again
+    vUpdates.assign(2, CIndexUpdate());
+    GetConnectIndexUpdate(block12, undo12, 12, vUpdates[0]);
+    GetDisconnectIndexUpdate(block12, undo12, 12, vUpdates[1]);
+    BOOST_CHECK(db.WriteIndexUpdates(vUpdates));
+    CheckSummary(db, hashFrom, 100, 100, 1, 10, 10);
+    CheckSummary(db, hashTo, 0, 0, 0, -1, -1);
+
+    vUpdates.assign(1, CIndexUpdate());
+    GetDisconnectIndexUpdate(block10, undo10, 10, vUpdates[0]);
+    BOOST_CHECK(db.WriteIndexUpdates(vUpdates));
+    CheckSummary(db, hashFrom, 0, 0, 0, -1, -1);
+
+    fAddressIndex = fAddressIndexOld;
+}
 
 BOOST_AUTO_TEST_SUITE_END()
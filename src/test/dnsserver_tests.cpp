@@ -0,0 +1,159 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dnsserver.h>
+
+#include <test/test_stock.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/test/unit_test.hpp>
+
+static std::vector<unsigned char> BuildQuery(const std::string& name, uint16_t type)
+{
+    std::vector<unsigned char> query = {0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    std::vector<std::string> vLabels;
+    boost::split(vLabels, name, boost::is_any_of("."));
+    for (const std::string& label: vLabels) {
+        query.push_back(label.size());
+        query.insert(query.end(), label.begin(), label.end());
+    }
+    query.push_back(0);
+    query.insert(query.end(), {(unsigned char)(type >> 8), (unsigned char)(type & 0xff), 0x00, 0x01});
+    return query;
+}
+
+static int GetRcode(const std::vector<unsigned char>& response)
+{
+    return response[3] & 0x0f;
+}
+
+static int GetAnswerCount(const std::vector<unsigned char>& response)
+{
+    return (response[6] << 8) | response[7];
+}
+
+BOOST_FIXTURE_TEST_SUITE(dnsserver_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(dnsserver_answers)
+{
+    int nLookups = 0;
+    CDNSResponder responder([&nLookups](const std::string& name, const std::string& subdomain, std::map<std::string, std::string>& data) {
+        nLookups++;
+        if (name != "example.0dyns")
+            return CDNSResponder::LOOKUP_NOT_FOUND;
+        data["_expiry"] = "1000";
+        data["a"] = subdomain == "www" ? "192.0.2.9" : "192.0.2.1, 192.0.2.2";
+        data["aaaa"] = "2001:db8::1";
+        data["txt"] = std::string(600, 'x');
+        return CDNSResponder::LOOKUP_FOUND;
+    });
+    std::vector<unsigned char> response;
+
+    std::vector<unsigned char> query = BuildQuery("Example.0dyns", 1);
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK(response[0] == 0x12 && response[1] == 0x34);
+    BOOST_CHECK(response[2] & 0x80);
+    BOOST_CHECK_EQUAL(GetRcode(response), 0);
+    BOOST_CHECK_EQUAL(GetAnswerCount(response), 2);
+    BOOST_CHECK_EQUAL(response.size(), query.size() + 2 * 16);
+    BOOST_CHECK_EQUAL(response.back(), 2);
+
+    // Answered from the cache until it is cleared
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(nLookups, 1);
+    BOOST_CHECK_EQUAL(responder.GetCacheSize(), 1);
+    responder.Clear();
+    BOOST_CHECK_EQUAL(responder.GetCacheSize(), 0);
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(nLookups, 2);
+
+    query = BuildQuery("www.example.0dyns", 1);
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(GetAnswerCount(response), 1);
+    BOOST_CHECK_EQUAL(response.back(), 9);
+
+    query = BuildQuery("example.0dyns", 28);
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(GetAnswerCount(response), 1);
+
+    // Reserved keys are not served, too large answers are truncated over UDP
+    query = BuildQuery("example.0dyns", 16);
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK(response[2] & 0x02);
+    BOOST_CHECK_EQUAL(GetAnswerCount(response), 0);
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_TCP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK(!(response[2] & 0x02));
+    BOOST_CHECK_EQUAL(GetAnswerCount(response), 3);
+
+    query = BuildQuery("missing.0dyns", 1);
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(GetRcode(response), 3);
+
+    query = BuildQuery("example.org", 1);
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(GetRcode(response), 5);
+}
+
+BOOST_AUTO_TEST_CASE(dnsserver_malformed)
+{
+    CDNSResponder responder([](const std::string& name, const std::string& subdomain, std::map<std::string, std::string>& data) {
+        return CDNSResponder::LOOKUP_NOT_FOUND;
+    });
+    std::vector<unsigned char> response;
+
+    std::vector<unsigned char> query = BuildQuery("example.0dyns", 1);
+    BOOST_CHECK(responder.HandleQuery(query.data(), 11, DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_IGNORED);
+
+    // Responses are never answered
+    query[2] |= 0x80;
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_IGNORED);
+    query[2] &= ~0x80;
+
+    BOOST_CHECK(responder.HandleQuery(query.data(), 15, DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(GetRcode(response), 1);
+
+    query[12] = 0xc0;
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(GetRcode(response), 1);
+    query[12] = 7;
+
+    query[2] |= 0x10;
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(GetRcode(response), 4);
+    query[2] &= ~0x10;
+
+    // A dot inside a label would be taken for a label boundary
+    query[12 + 1 + 3] = '.';
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(GetRcode(response), 1);
+}
+
+BOOST_AUTO_TEST_CASE(dnsserver_pending)
+{
+    bool fFetched = false;
+    int nLookups = 0;
+    CDNSResponder responder([&fFetched, &nLookups](const std::string& name, const std::string& subdomain, std::map<std::string, std::string>& data) {
+        nLookups++;
+        if (!fFetched)
+            return CDNSResponder::LOOKUP_PENDING;
+        data["a"] = "192.0.2.1";
+        return CDNSResponder::LOOKUP_FOUND;
+    });
+    std::vector<unsigned char> response;
+
+    // Pending answers are not cached, the query is answered once the data is there
+    std::vector<unsigned char> query = BuildQuery("example.0dyns", 1);
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_PENDING);
+    BOOST_CHECK(response.empty());
+    BOOST_CHECK_EQUAL(responder.GetCacheSize(), 0);
+
+    fFetched = true;
+    BOOST_CHECK(responder.HandleQuery(query.data(), query.size(), DNS_MAX_UDP_SIZE, response) == CDNSResponder::QUERY_ANSWERED);
+    BOOST_CHECK_EQUAL(GetRcode(response), 0);
+    BOOST_CHECK_EQUAL(GetAnswerCount(response), 1);
+    BOOST_CHECK_EQUAL(responder.GetCacheSize(), 1);
+    BOOST_CHECK_EQUAL(nLookups, 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
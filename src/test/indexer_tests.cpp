@@ -0,0 +1,124 @@
+// Copyright (c) 2021 The Stock developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <indexer.h>
+#include <main.h>
+#include <random.h>
+#include <txdb.h>
+#include <util.h>
+
+#include <test/test_stock.h>
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+
+extern std::atomic<bool> fRequestShutdown;
+
+BOOST_FIXTURE_TEST_SUITE(indexer_tests, TestingSetup)
+
+/** A block on top of the active tip with a coinbase and nExtraTx transactions the undo data does not cover. */
+static CBlockIndex* AddIndexerBlock(CBlock& block, unsigned int nTime, unsigned int nExtraTx = 0)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << nTime << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    coinbase.vout[0].nValue = 1;
+
+    block.vtx.assign(1 + nExtraTx, coinbase);
+    block.nTime = nTime;
+
+    CBlockIndex* pindex = new CBlockIndex(block);
+    pindex->phashBlock = new uint256(GetRandHash());
+    mapBlockIndex.insert(std::make_pair(*pindex->phashBlock, pindex));
+    pindex->pprev = chainActive.Tip();
+    pindex->nHeight = chainActive.Height() + 1;
+    return pindex;
+}
+
+static bool HaveTimestamp(unsigned int nTime, const uint256& hash)
+{
+    std::vector<std::pair<uint256, unsigned int> > hashes;
+    BOOST_CHECK(pblocktree->ReadTimestampIndex(nTime + 1, nTime, false, hashes));
+    for (const auto& it: hashes) {
+        if (it.first == hash)
+            return true;
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(indexer_queue_sync_failure_restart)
+{
+    fTimestampIndex = true;
+    uint256 hashIndexed;
+
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(asyncIndexer.Start());
+    }
+    // A fresh database starts out indexed up to the tip
+    BOOST_CHECK(pblocktree->ReadIndexBestBlock(hashIndexed));
+    BOOST_CHECK(hashIndexed == chainActive.Tip()->GetBlockHash());
+
+    // Queued blocks are written once Sync returns
+    CBlock block;
+    CBlockIndex* pindex = AddIndexerBlock(block, 1600000000);
+    asyncIndexer.BlockConnected(block, CBlockUndo(), pindex);
+    BOOST_CHECK(asyncIndexer.Sync());
+    BOOST_CHECK(asyncIndexer.GetIndexedBlock() == pindex->GetBlockHash());
+    BOOST_CHECK(HaveTimestamp(1600000000, pindex->GetBlockHash()));
+
+    // but the last indexed block on disk only moves with the block index flush
+    BOOST_CHECK(pblocktree->ReadIndexBestBlock(hashIndexed));
+    BOOST_CHECK(hashIndexed == chainActive.Tip()->GetBlockHash());
+    FlushStateToDisk();
+    BOOST_CHECK(pblocktree->ReadIndexBestBlock(hashIndexed));
+    BOOST_CHECK(hashIndexed == pindex->GetBlockHash());
+
+    // Disconnecting goes back to the previous block
+    asyncIndexer.BlockDisconnected(block, CBlockUndo(), pindex);
+    BOOST_CHECK(asyncIndexer.Sync());
+    BOOST_CHECK(asyncIndexer.GetIndexedBlock() == chainActive.Tip()->GetBlockHash());
+    FlushStateToDisk();
+    BOOST_CHECK(pblocktree->ReadIndexBestBlock(hashIndexed));
+    BOOST_CHECK(hashIndexed == chainActive.Tip()->GetBlockHash());
+
+    // A block which can not be indexed stops the indexer, and Sync reports it
+    CBlock blockBad;
+    CBlockIndex* pindexBad = AddIndexerBlock(blockBad, 1600000100, 1);
+    asyncIndexer.BlockConnected(blockBad, CBlockUndo(), pindexBad);
+    BOOST_CHECK(!asyncIndexer.Sync());
+    BOOST_CHECK(!asyncIndexer.Sync());
+    BOOST_CHECK(asyncIndexer.GetIndexedBlock() == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(!HaveTimestamp(1600000100, pindexBad->GetBlockHash()));
+    fRequestShutdown = false;
+    strMiscWarning = "";
+
+    // Blocks queued while stopped are covered by the catch-up of the restart
+    asyncIndexer.Stop();
+    asyncIndexer.BlockConnected(blockBad, CBlockUndo(), pindexBad);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(asyncIndexer.Start());
+    }
+    BOOST_CHECK(asyncIndexer.Sync());
+    BOOST_CHECK(asyncIndexer.GetIndexedBlock() == chainActive.Tip()->GetBlockHash());
+
+    // And the restarted indexer goes on with the blocks queued after
+    CBlock blockNext;
+    CBlockIndex* pindexNext = AddIndexerBlock(blockNext, 1600000200);
+    asyncIndexer.BlockConnected(blockNext, CBlockUndo(), pindexNext);
+    BOOST_CHECK(asyncIndexer.Sync());
+    BOOST_CHECK(asyncIndexer.GetIndexedBlock() == pindexNext->GetBlockHash());
+    BOOST_CHECK(HaveTimestamp(1600000200, pindexNext->GetBlockHash()));
+
+    asyncIndexer.Stop();
+    BOOST_CHECK(asyncIndexer.Sync());
+    fTimestampIndex = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,9 +4,12 @@
 
 #include <chainparams.h>
 #include <main.h>
+#include <random.h>
 
 #include <test/test_stock.h>
 
+#include <thread>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -72,4 +75,142 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_AUTO_TEST_CASE(raw_block_read)
+{
+    CBlock block(Params().GenesisBlock());
+    CDiskBlockPos pos(100, 0);
+    BOOST_CHECK(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+    // The bytes on disk are what is sent to peers
+    std::vector<unsigned char> vBlock;
+    BOOST_CHECK(ReadRawBlockFromDisk(vBlock, pos, Params().MessageStart()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    BOOST_CHECK(std::vector<unsigned char>(ss.begin(), ss.end()) == vBlock);
+
+    CMessageHeader::MessageStartChars wrongStart = {0, 0, 0, 0};
+    BOOST_CHECK(!ReadRawBlockFromDisk(vBlock, pos, wrongStart));
+}
+
+static CBlockIndex* AddFakeBlockIndex(int nHeight)
+{
+    CBlockIndex* pindex = new CBlockIndex();
+    pindex->nHeight = nHeight;
+    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(GetRandHash(), pindex)).first;
+    pindex->phashBlock = &mi->first;
+    return pindex;
+}
+
+BOOST_AUTO_TEST_CASE(block_votes_cache)
+{
+    LOCK(cs_main);
+    unsigned int nBlockVotesCacheSizeSaved = nBlockVotesCacheSize;
+    nBlockVotesCacheSize = 1;
+
+    CBlockIndex* pindex1 = AddFakeBlockIndex(1);
+    CBlockIndex* pindex2 = AddFakeBlockIndex(2);
+    uint256 hash1 = pindex1->GetBlockHash(), hash2 = pindex2->GetBlockHash();
+    uint256 proposal1 = GetRandHash(), proposal2 = GetRandHash();
+
+    BOOST_CHECK(GetProposalVotes(hash1) == nullptr);
+
+    // A snapshot is not changed by votes added later
+    AddProposalVote(hash1, proposal1, 1);
+    auto pVotes = GetProposalVotes(hash1);
+    BOOST_CHECK_EQUAL(pVotes->size(), 1U);
+    AddProposalVote(hash1, proposal2, 0);
+    BOOST_CHECK_EQUAL(pVotes->size(), 1U);
+    pVotes = GetProposalVotes(hash1);
+    BOOST_CHECK_EQUAL(pVotes->size(), 2U);
+    AddSupport(hash2, proposal1);
+    BOOST_CHECK(GetSupport(hash2) != nullptr);
+    BOOST_CHECK(GetProposalVotes(hash2) == nullptr);
+
+    // After a flush the votes are read back from disk and evicted past the cache size,
+    // without invalidating the snapshots handed out before
+    FlushStateToDisk();
+    pVotes = GetProposalVotes(hash1);
+    BOOST_CHECK_EQUAL(pVotes->size(), 2U);
+    auto supp = GetSupport(hash2);
+    BOOST_CHECK(supp != nullptr && supp->count(proposal1));
+    BOOST_CHECK_EQUAL(pVotes->size(), 2U);
+    BOOST_CHECK((*pVotes)[0] == std::make_pair(proposal1, 1));
+    BOOST_CHECK((*pVotes)[1] == std::make_pair(proposal2, 0));
+    BOOST_CHECK_EQUAL(GetProposalVotes(hash1)->size(), 2U);
+
+    // Votes added to a stored block keep the ones already written
+    AddPaymentRequestVote(hash1, proposal2, 1);
+    BOOST_CHECK_EQUAL(GetProposalVotes(hash1)->size(), 2U);
+    BOOST_CHECK_EQUAL(GetPaymentRequestVotes(hash1)->size(), 1U);
+
+    FlushStateToDisk();
+    mapBlockIndex.erase(hash1);
+    mapBlockIndex.erase(hash2);
+    delete pindex1;
+    delete pindex2;
+    nBlockVotesCacheSize = nBlockVotesCacheSizeSaved;
+}
+
+BOOST_AUTO_TEST_CASE(block_index_cold)
+{
+    LOCK(cs_main);
+
+    // Entries which were never written start out empty
+    CBlockIndex* pindex = AddFakeBlockIndex(1);
+    BOOST_CHECK(!pindex->HaveCold());
+    BOOST_CHECK_EQUAL(pindex->GetCold().nMint, 0);
+    BOOST_CHECK(pindex->HaveCold());
+
+    // Evicted fields are read back from the block tree
+    pindex->nStatus |= BLOCK_OPT_MINT;
+    pindex->Cold().nMint = 5;
+    pindex->Cold().nCFSupply = 7;
+    pindex->Cold().strDZeel = "cold";
+    std::vector<const CBlockIndex*> vBlocks(1, pindex);
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vBlocks,
+                                           std::vector<std::pair<CBlockVotesKey, std::shared_ptr<const CBlockVotes>> >()));
+    pindex->Cold().nMint = 6;
+    pindex->EvictCold();
+    BOOST_CHECK(!pindex->HaveCold());
+    BOOST_CHECK_EQUAL(pindex->GetCold().nMint, 5);
+    BOOST_CHECK_EQUAL(pindex->GetCold().nCFSupply, 7);
+    BOOST_CHECK_EQUAL(pindex->GetCold().strDZeel, "cold");
+
+    // Threads loading the same entry at once share one copy
+    pindex->EvictCold();
+    const CBlockIndexCold* pcold1 = nullptr;
+    const CBlockIndexCold* pcold2 = nullptr;
+    std::thread t1([&] { pcold1 = &pindex->GetCold(); });
+    std::thread t2([&] { pcold2 = &pindex->GetCold(); });
+    t1.join();
+    t2.join();
+    BOOST_CHECK(pcold1 != nullptr && pcold1 == pcold2);
+    BOOST_CHECK_EQUAL(pcold1->nMint, 5);
+
+    // Writing the block index drops the fields of entries deep below the tip only
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+    std::vector<CBlockIndex*> vChain;
+    CBlockIndex* pprev = pindexGenesis;
+    for (int i = 1; i <= BLOCK_INDEX_COLD_KEEP_DEPTH + 2; i++) {
+        CBlockIndex* pnext = AddFakeBlockIndex(pprev->nHeight + 1);
+        pnext->pprev = pprev;
+        pnext->Cold().nMint = i;
+        vChain.push_back(pnext);
+        pprev = pnext;
+    }
+    chainActive.SetTip(pprev);
+    FlushStateToDisk();
+    BOOST_CHECK(!vChain[0]->HaveCold());
+    BOOST_CHECK(vChain.back()->HaveCold());
+    BOOST_CHECK_EQUAL(vChain.back()->GetCold().nMint, BLOCK_INDEX_COLD_KEEP_DEPTH + 2);
+
+    chainActive.SetTip(pindexGenesis);
+    vChain.push_back(pindex);
+    for (CBlockIndex* p: vChain) {
+        mapBlockIndex.erase(p->GetBlockHash());
+        delete p;
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
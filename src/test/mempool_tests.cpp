@@ -423,6 +423,83 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolRelayInfoTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_11;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(20000LL).FromTx(tx2));
+
+    std::vector<uint256> vHashes = {tx1.GetHash(), tx2.GetHash(), GetRandHash()};
+    std::map<uint256, TxRelayInfo> mapInfo;
+    pool.relayInfo(vHashes, mapInfo);
+    BOOST_CHECK_EQUAL(mapInfo.size(), 2U);
+    BOOST_CHECK_EQUAL(mapInfo[tx1.GetHash()].nCountWithAncestors, 1U);
+    BOOST_CHECK_EQUAL(mapInfo[tx2.GetHash()].nCountWithAncestors, 2U);
+    BOOST_CHECK_EQUAL(mapInfo[tx2.GetHash()].nModFeesWithAncestors, 30000);
+    BOOST_CHECK(mapInfo[tx2.GetHash()].tx->GetHash() == tx2.GetHash());
+
+    // Adding a transaction with no children in the pool leaves the ancestors of the others as they are
+    unsigned int nEpoch = pool.GetAncestorStateEpoch();
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 5 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(10000LL).FromTx(tx3));
+    BOOST_CHECK_EQUAL(pool.GetAncestorStateEpoch(), nEpoch);
+
+    // Removing one may not
+    std::list<CTransaction> removed;
+    pool.removeRecursive(tx3, removed);
+    BOOST_CHECK(pool.GetAncestorStateEpoch() != nEpoch);
+
+    // Nor may prioritising one, which changes its fees with ancestors
+    nEpoch = pool.GetAncestorStateEpoch();
+    pool.PrioritiseTransaction(tx1.GetHash(), tx1.GetHash().ToString(), 0, 5000LL);
+    BOOST_CHECK(pool.GetAncestorStateEpoch() != nEpoch);
+    mapInfo.clear();
+    pool.relayInfo(vHashes, mapInfo);
+    BOOST_CHECK_EQUAL(mapInfo[tx1.GetHash()].nModFeesWithAncestors, 15000);
+
+    // Nor re-adding the transactions of a disconnected block, which become
+    // ancestors of the entries spending them
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx4.vout[0].nValue = 4 * COIN;
+
+    CMutableTransaction tx5 = CMutableTransaction();
+    tx5.vin.resize(1);
+    tx5.vin[0].prevout = COutPoint(tx4.GetHash(), 0);
+    tx5.vin[0].scriptSig = CScript() << OP_11;
+    tx5.vout.resize(1);
+    tx5.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx5.vout[0].nValue = 3 * COIN;
+    pool.addUnchecked(tx5.GetHash(), entry.Fee(10000LL).FromTx(tx5));
+
+    nEpoch = pool.GetAncestorStateEpoch();
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(10000LL).FromTx(tx4));
+    std::vector<uint256> vHashesToUpdate = {tx4.GetHash()};
+    pool.UpdateTransactionsFromBlock(vHashesToUpdate);
+    BOOST_CHECK(pool.GetAncestorStateEpoch() != nEpoch);
+    mapInfo.clear();
+    pool.relayInfo(std::vector<uint256>(1, tx5.GetHash()), mapInfo);
+    BOOST_CHECK_EQUAL(mapInfo[tx5.GetHash()].nCountWithAncestors, 2U);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool(CFeeRate(1000));
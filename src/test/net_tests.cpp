@@ -8,8 +8,15 @@
 #include <hash.h>
 #include <serialize.h>
 #include <streams.h>
+#include <sync.h>
+#include <util.h>
 #include <net.h>
+#include <netbase.h>
+#include <netpreprocess.h>
 #include <chainparams.h>
+#include <main.h>
+
+#include <boost/thread.hpp>
 
 class CAddrManSerializationMock : public CAddrMan
 {
@@ -140,4 +147,241 @@ BOOST_AUTO_TEST_CASE(caddrdb_read_corrupted)
     BOOST_CHECK(addrman2.size() == 0);
 }
 
+static std::shared_ptr<CPreprocessedMessage> PreprocessTx(const CMutableTransaction& mtx, unsigned int nTruncate = 0)
+{
+    CDataStream ssMsg(SER_NETWORK, PROTOCOL_VERSION);
+    ssMsg << CTransaction(mtx);
+    ssMsg.resize(ssMsg.size() - nTruncate);
+    std::shared_ptr<CPreprocessedMessage> pmsg = std::make_shared<CPreprocessedMessage>(NetMsgType::TX, ssMsg, ssMsg.size());
+    BOOST_CHECK(ssMsg.empty());
+    BOOST_CHECK(!pmsg->fDone);
+    // Without running threads the message is decoded by the caller
+    msgPreprocessor.Submit(pmsg);
+    BOOST_CHECK(pmsg->fDone);
+    return pmsg;
+}
+
+BOOST_AUTO_TEST_CASE(message_preprocessing)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = COIN;
+    mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+    std::shared_ptr<CPreprocessedMessage> pmsg = PreprocessTx(mtx);
+    BOOST_CHECK(pmsg->fPrecheckOK);
+    CTransaction tx;
+    pmsg->Take(tx);
+    BOOST_CHECK(tx.GetHash() == CTransaction(mtx).GetHash());
+
+    // The context-free checks are run along with the decoding
+    mtx.vin.push_back(mtx.vin[0]);
+    pmsg = PreprocessTx(mtx);
+    BOOST_CHECK(!pmsg->fPrecheckOK);
+    BOOST_CHECK_EQUAL(pmsg->precheckState.GetRejectReason(), "bad-txns-inputs-duplicate");
+
+    // Decoding errors are thrown when the message handler takes the object
+    pmsg = PreprocessTx(mtx, 1);
+    BOOST_CHECK_THROW(pmsg->Take(tx), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(message_preprocessing_order)
+{
+    CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0), NODE_NONE), "", true);
+    std::vector<std::shared_ptr<CPreprocessedMessage> > vMsgs;
+    LOCK(node.cs_vRecvMsg);
+
+    for (unsigned int i = 0; i < 3; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        CSharedNetMsg msg = MakeSharedNetMsg(NetMsgType::TX, PROTOCOL_VERSION, CTransaction(mtx));
+        BOOST_CHECK(node.ReceiveMsgBytes((const char*)msg->data(), msg->size()));
+    }
+
+    BOOST_REQUIRE_EQUAL(node.vRecvMsg.size(), 3U);
+    for (CNetMessage& msg: node.vRecvMsg) {
+        vMsgs.push_back(std::make_shared<CPreprocessedMessage>(msg.hdr.GetCommand(), msg.vRecv, msg.hdr.nMessageSize));
+        msg.preprocessed = vMsgs.back();
+    }
+
+    // The later messages are decoded first, on other threads
+    boost::thread thread3(&CPreprocessedMessage::Process, vMsgs[2].get());
+    boost::thread thread2(&CPreprocessedMessage::Process, vMsgs[1].get());
+    thread3.join();
+    thread2.join();
+
+    // and wait for the first one
+    BOOST_CHECK(ProcessMessages(&node));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 3U);
+
+    boost::thread thread1(&CPreprocessedMessage::Process, vMsgs[0].get());
+    thread1.join();
+
+    // Then they are handled one per call in the order they were received
+    for (unsigned int i = 0; i < 3; i++) {
+        BOOST_CHECK(node.vRecvMsg.front().preprocessed == vMsgs[i]);
+        BOOST_CHECK(ProcessMessages(&node));
+        BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 2U - i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dandelion_embargo_queue)
+{
+    CDandelionEmbargoQueue queue;
+    uint256 hash1 = GetRandHash(), hash2 = GetRandHash(), hash3 = GetRandHash();
+
+    BOOST_CHECK(queue.Insert(hash1, 300));
+    BOOST_CHECK(queue.Insert(hash2, 100));
+    BOOST_CHECK(queue.Insert(hash3, 200));
+    BOOST_CHECK(!queue.Insert(hash1, 50));
+    BOOST_CHECK(queue.Contains(hash1));
+    BOOST_CHECK_EQUAL(queue.size(), 3U);
+
+    std::vector<uint256> vExpired;
+    queue.PopExpired(100, vExpired);
+    BOOST_CHECK(vExpired.empty());
+
+    // Expired embargoes come out oldest first
+    queue.PopExpired(301, vExpired);
+    BOOST_CHECK_EQUAL(vExpired.size(), 3U);
+    BOOST_CHECK(vExpired[0] == hash2);
+    BOOST_CHECK(vExpired[1] == hash3);
+    BOOST_CHECK(vExpired[2] == hash1);
+    BOOST_CHECK_EQUAL(queue.size(), 0U);
+    BOOST_CHECK(!queue.Contains(hash1));
+
+    // A removed embargo does not expire
+    BOOST_CHECK(queue.Insert(hash1, 100));
+    BOOST_CHECK(queue.Remove(hash1));
+    BOOST_CHECK(!queue.Remove(hash1));
+    vExpired.clear();
+    queue.PopExpired(1000, vExpired);
+    BOOST_CHECK(vExpired.empty());
+}
+
+BOOST_AUTO_TEST_CASE(shared_message_cache)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = COIN;
+    mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    CTransaction tx(mtx);
+
+    // The header carries the same size and checksum as one written by EndMessage
+    CSharedNetMsg msg = MakeSharedNetMsg(NetMsgType::TX, PROTOCOL_VERSION, tx);
+    CDataStream ssMsg(msg->begin(), msg->end(), SER_NETWORK, PROTOCOL_VERSION);
+    CMessageHeader hdr(Params().MessageStart());
+    ssMsg >> hdr;
+    BOOST_CHECK(hdr.IsValid(Params().MessageStart()));
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::TX);
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, ssMsg.size());
+    uint256 hash = Hash(ssMsg.begin(), ssMsg.end());
+    BOOST_CHECK_EQUAL(memcmp(&hash, &hdr.nChecksum, sizeof(hdr.nChecksum)), 0);
+    CTransaction txOut;
+    ssMsg >> txOut;
+    BOOST_CHECK(txOut.GetHash() == tx.GetHash());
+
+    CNetMessageCache cache(msg->size() * 2);
+    cache.Add(NetMsgType::TX, tx.GetHash(), PROTOCOL_VERSION, msg);
+    BOOST_CHECK(cache.Get(NetMsgType::TX, tx.GetHash(), PROTOCOL_VERSION) == msg);
+    BOOST_CHECK(!cache.Get(NetMsgType::TX, tx.GetHash(), PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
+    BOOST_CHECK(!cache.Get(NetMsgType::DANDELIONTX, tx.GetHash(), PROTOCOL_VERSION));
+    BOOST_CHECK_EQUAL(cache.GetTotalSize(), msg->size());
+
+    // The oldest messages make room for new ones, without invalidating the buffers handed out
+    uint256 hash2 = GetRandHash(), hash3 = GetRandHash();
+    cache.Add(NetMsgType::TX, hash2, PROTOCOL_VERSION, MakeSharedNetMsg(NetMsgType::TX, PROTOCOL_VERSION, tx));
+    cache.Add(NetMsgType::TX, hash3, PROTOCOL_VERSION, MakeSharedNetMsg(NetMsgType::TX, PROTOCOL_VERSION, tx));
+    BOOST_CHECK(!cache.Get(NetMsgType::TX, tx.GetHash(), PROTOCOL_VERSION));
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hash2, PROTOCOL_VERSION));
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hash3, PROTOCOL_VERSION));
+    BOOST_CHECK_EQUAL(cache.GetTotalSize(), msg->size() * 2);
+    BOOST_CHECK_EQUAL(hdr.nMessageSize + CMessageHeader::HEADER_SIZE, msg->size());
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetTotalSize(), 0U);
+}
+
+#ifdef USE_EPOLL
+BOOST_AUTO_TEST_CASE(socket_events_epoll)
+{
+    InitSocketEvents();
+    BOOST_REQUIRE(UsingSocketEvents());
+
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    SOCKET hSocket = fds[0];
+    BOOST_REQUIRE(SetSocketNonBlocking(hSocket, true));
+    CNode* pnode = new CNode(hSocket, CAddress(CService("127.0.0.1", 0), NODE_NONE), "", true);
+    AddSocketEvents(pnode);
+    std::vector<const ListenSocket*> vAccept;
+    char ch = 'x';
+
+    // A new socket can be written to, but has nothing to read
+    WaitSocketEvents(0, vAccept);
+    BOOST_CHECK(pnode->fSendReady);
+    BOOST_CHECK(!pnode->fRecvReady);
+
+    // Edge-triggered: readiness is reported when it changes, and kept in the node until used up
+    pnode->fSendReady = false;
+    WaitSocketEvents(0, vAccept);
+    BOOST_CHECK(!pnode->fSendReady);
+    BOOST_CHECK_EQUAL(send(fds[1], &ch, 1, 0), 1);
+    WaitSocketEvents(0, vAccept);
+    BOOST_CHECK(pnode->fRecvReady);
+    WaitSocketEvents(0, vAccept);
+    BOOST_CHECK(pnode->fRecvReady);
+    pnode->fRecvReady = false;
+    WaitSocketEvents(0, vAccept);
+    BOOST_CHECK(!pnode->fRecvReady);
+    BOOST_CHECK_EQUAL(send(fds[1], &ch, 1, 0), 1);
+    WaitSocketEvents(0, vAccept);
+    BOOST_CHECK(pnode->fRecvReady);
+    BOOST_CHECK(vAccept.empty());
+
+    // Receiving is paused while there is data to send, and resuming wakes the wait up
+    {
+        LOCK(pnode->cs_vRecvMsg);
+        {
+            LOCK(pnode->cs_vSend);
+            pnode->vSendMsg.push_back(std::make_shared<const CSerializeData>(1, 0));
+        }
+        BOOST_CHECK(PauseRecvIfBlocked(pnode));
+        BOOST_CHECK(pnode->fRecvPaused);
+        {
+            LOCK(pnode->cs_vSend);
+            pnode->vSendMsg.clear();
+        }
+        ResumeRecv(pnode);
+        BOOST_CHECK(!pnode->fRecvPaused);
+        BOOST_CHECK(!PauseRecvIfBlocked(pnode));
+    }
+    int64_t nStart = GetTimeMillis();
+    WaitSocketEvents(60000, vAccept);
+    BOOST_CHECK(GetTimeMillis() - nStart < 30000);
+
+    // The wakeup is used up, and resuming a node which was not paused does not wake
+    ResumeRecv(pnode);
+    nStart = GetTimeMillis();
+    WaitSocketEvents(100, vAccept);
+    BOOST_CHECK(GetTimeMillis() - nStart >= 90);
+
+    WakeSocketHandler();
+    nStart = GetTimeMillis();
+    WaitSocketEvents(60000, vAccept);
+    BOOST_CHECK(GetTimeMillis() - nStart < 30000);
+
+    RemoveSocketEvents(hSocket);
+    delete pnode;
+    close(fds[1]);
+    CloseSocketEvents();
+    BOOST_CHECK(!UsingSocketEvents());
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
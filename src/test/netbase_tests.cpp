@@ -233,6 +233,58 @@ BOOST_AUTO_TEST_CASE(subnet_test)
     BOOST_CHECK_EQUAL(subnet.ToString(), "1:2:3:4:5:6:7:8/ffff:ffff:ffff:fffe:ffff:ffff:ffff:ff0f");
 }
 
+BOOST_AUTO_TEST_CASE(subnet_trie_test)
+{
+    CSubNetTrie trie;
+    BOOST_CHECK(trie.Insert(CSubNet("1.2.0.0/16")));
+    BOOST_CHECK(trie.Insert(CSubNet("1.2.3.4")));
+    BOOST_CHECK(trie.Insert(CSubNet("1:2::/32")));
+    BOOST_CHECK(trie.Insert(CSubNet("FD87:D87E:EB43::/48"))); // all of Tor
+    BOOST_CHECK(trie.Insert(CSubNet("5.6.7.8/255.0.255.0")));
+    BOOST_CHECK(!trie.Insert(CSubNet("1.2.3.4/16")));
+    BOOST_CHECK(!trie.Insert(CSubNet("1.2.3.4/33")));
+    BOOST_CHECK_EQUAL(trie.size(), 5U);
+
+    BOOST_CHECK(trie.Match(CNetAddr("1.2.255.255")));
+    BOOST_CHECK(!trie.Match(CNetAddr("1.3.0.1")));
+    BOOST_CHECK(trie.Match(CNetAddr("1:2:ffff::1")));
+    BOOST_CHECK(!trie.Match(CNetAddr("1:3::1")));
+    BOOST_CHECK(trie.Match(CNetAddr("FD87:D87E:EB43:edb1:8e4:3588:e546:35ca")));
+    BOOST_CHECK(trie.Match(CNetAddr("5.1.7.1")));
+    BOOST_CHECK(!trie.Match(CNetAddr("6.6.7.8")));
+    BOOST_CHECK(!trie.Match(CNetAddr()));
+
+    std::vector<CSubNet> vMatches;
+    trie.GetMatches(CNetAddr("1.2.3.4"), vMatches);
+    BOOST_CHECK_EQUAL(vMatches.size(), 2U);
+    BOOST_CHECK(vMatches[0] == CSubNet("1.2.0.0/16"));
+    BOOST_CHECK(vMatches[1] == CSubNet("1.2.3.4"));
+
+    // Irregular netmasks come before the prefixes
+    BOOST_CHECK(trie.Insert(CSubNet("1.2.3.4/255.0.255.0")));
+    vMatches.clear();
+    trie.GetMatches(CNetAddr("1.2.3.4"), vMatches);
+    BOOST_CHECK_EQUAL(vMatches.size(), 3U);
+    BOOST_CHECK(vMatches[0] == CSubNet("1.2.3.4/255.0.255.0"));
+    BOOST_CHECK(vMatches[1] == CSubNet("1.2.0.0/16"));
+    BOOST_CHECK(vMatches[2] == CSubNet("1.2.3.4"));
+    BOOST_CHECK(trie.Erase(CSubNet("1.2.3.4/255.0.255.0")));
+
+    BOOST_CHECK(trie.Erase(CSubNet("1.2.0.0/16")));
+    BOOST_CHECK(!trie.Erase(CSubNet("1.2.0.0/16")));
+    BOOST_CHECK(!trie.Match(CNetAddr("1.2.3.5")));
+    BOOST_CHECK(trie.Match(CNetAddr("1.2.3.4")));
+    BOOST_CHECK(trie.Erase(CSubNet("5.6.7.8/255.0.255.0")));
+    BOOST_CHECK(!trie.Match(CNetAddr("5.1.7.1")));
+    BOOST_CHECK_EQUAL(trie.size(), 3U);
+
+    trie.Clear();
+    BOOST_CHECK_EQUAL(trie.size(), 0U);
+    BOOST_CHECK(!trie.Match(CNetAddr("1.2.3.4")));
+    BOOST_CHECK(trie.Insert(CSubNet("::/0")));
+    BOOST_CHECK(trie.Match(CNetAddr("1.2.3.4")));
+}
+
 BOOST_AUTO_TEST_CASE(netbase_getgroup)
 {
     BOOST_CHECK(CNetAddr("127.0.0.1").GetGroup() == boost::assign::list_of(0)); // Local -> !Routable()
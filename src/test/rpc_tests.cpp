@@ -332,4 +332,85 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_json_stream_writer)
+{
+    UniValue expected(UniValue::VOBJ);
+    UniValue arr(UniValue::VARR);
+    for (int i = 0; i < 100; i++)
+        arr.push_back(strprintf("item \"%d\"", i));
+    expected.pushKV("result", arr);
+    expected.pushKV("empty", UniValue(UniValue::VARR));
+    expected.pushKV("error", NullUniValue);
+
+    // Small chunks are passed on as soon as they are complete values
+    std::string strStreamed;
+    int nChunks = 0;
+    JSONStreamWriter writer([&](const std::string& strChunk) { strStreamed += strChunk; nChunks++; }, 16);
+    writer.BeginObject();
+    writer.Key("result");
+    writer.BeginArray();
+    for (size_t i = 0; i < arr.size(); i++)
+        writer.Value(arr[i]);
+    writer.EndArray();
+    writer.Key("empty");
+    writer.BeginArray();
+    writer.EndArray();
+    writer.Pair("error", NullUniValue);
+    writer.EndObject();
+    BOOST_CHECK(writer.Started());
+    BOOST_CHECK(nChunks > 1);
+    strStreamed += writer.Release();
+    BOOST_CHECK_EQUAL(strStreamed, expected.write());
+
+    // Output that stays below the chunk size is only returned by Release
+    JSONStreamWriter small([&](const std::string& strChunk) { BOOST_ERROR("unexpected chunk"); });
+    small.Value(expected);
+    BOOST_CHECK(!small.Started());
+    BOOST_CHECK_EQUAL(small.Release(), expected.write());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_parallel)
+{
+    SetRPCWarmupFinished();
+
+    // Thread-safe requests around ones that are not, or are invalid
+    UniValue vReq(UniValue::VARR);
+    const char* methods[] = {"getblockcount", "getbestblockhash", "getblockhash", "decodescript", "nosuchmethod",
+                             "getblockcount", "getdifficulty", "setmocktime", "getblockhash", "getblockcount"};
+    for (int i = 0; i < 10; i++) {
+        UniValue params(UniValue::VARR);
+        if (std::string(methods[i]) == "getblockhash" || std::string(methods[i]) == "setmocktime")
+            params.push_back(0);
+        else if (std::string(methods[i]) == "decodescript")
+            params.push_back("51");
+        UniValue req(UniValue::VOBJ);
+        req.pushKV("method", methods[i]);
+        req.pushKV("params", params);
+        req.pushKV("id", i);
+        vReq.push_back(req);
+    }
+
+    JSONStreamWriter sequential(nullptr);
+    JSONRPCExecBatch(vReq, sequential);
+    std::string strSequential = sequential.Release();
+
+    std::vector<boost::thread> threads;
+    JSONStreamWriter parallel(nullptr);
+    JSONRPCExecBatch(vReq, parallel, [&](const std::function<void(void)>& func) {
+        threads.emplace_back(func);
+        return true;
+    });
+    for (boost::thread& thread : threads)
+        thread.join();
+    BOOST_CHECK(!threads.empty());
+    BOOST_CHECK_EQUAL(parallel.Release(), strSequential);
+
+    UniValue replies;
+    BOOST_CHECK(replies.read(strSequential));
+    BOOST_CHECK_EQUAL(replies.size(), 10);
+    for (size_t i = 0; i < replies.size(); i++)
+        BOOST_CHECK_EQUAL(find_value(replies[i], "id").get_int(), (int)i);
+    BOOST_CHECK(find_value(replies[4], "error").isObject());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -22,11 +22,14 @@ static const char DB_PROPINDEX = 'o';
 static const char DB_PREQINDEX = 'r';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSHISTORY = 'h';
+static const char DB_ADDRESSSUMMARY = 'H';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'q';
+static const char DB_INDEX_BEST_BLOCK = 'I';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_BLOCK_VOTES = 'v';
 
 static const char DB_VOTEINDEX = 'C';
 static const char DB_CONSULTINDEX = 'K';
@@ -38,13 +41,19 @@ static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 static const char DB_EXCLUDE_VOTES = 'X';
+static const char DB_STATE_STATS = 'S';
 
 static const char DB_TOKENS = 'T';
-static const char DB_TOKEN_UTXO = 'Z';
+static const char DB_TOKEN_UTXO_LEGACY = 'Z';
+static const char DB_TOKEN_UTXO = 'W';
 static const char DB_NAME_RECORDS = 'n';
 static const char DB_NAME_DATA = 'N';
+static const char DB_NAME_STATE = 'M';
 
-CStateViewDB::CStateViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, false, 64)
+//! History entries read at a time when summing the history of an address
+static const size_t ADDRESS_HISTORY_SUM_CHUNK = 10000;
+
+CStateViewDB::CStateViewDB(size_t nCacheSize, bool fMemory, bool fWipe, bool fWriteBehindIn) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, false, 64), fWriteBehind(fWriteBehindIn)
 {
 }
 
@@ -68,33 +77,109 @@ bool CStateViewDB::GetToken(const uint256 &id, TokenInfo &token) const {
     return db.Read(std::make_pair(DB_TOKENS, id), token);
 }
 
-bool CStateViewDB::GetTokenUtxos(const uint256 &id, TokenUtxoValues &vect) {
+bool CStateViewDB::GetTokenUtxos(const TokenUtxoKey &start, size_t nLimit, TokenUtxoValues &vect) {
     vect.clear();
 
     boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_TOKEN_UTXO, uint256()));
+    pcursor->Seek(std::make_pair(DB_TOKEN_UTXO, start));
 
-    while (pcursor->Valid()) {
+    while (pcursor->Valid() && (nLimit == 0 || vect.size() < nLimit)) {
         boost::this_thread::interruption_point();
         std::pair<char, TokenUtxoKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_TOKEN_UTXO) {
-            if (key.second.id == id) {
-                TokenUtxoValue data;
-                if (pcursor->GetValue(data)) {
-                    vect.push_back(std::make_pair(key.second.blockHeight, data));
-                    pcursor->Next();
-                } else {
-                    return error("GetTokenUtxos() : failed to read value");
-                }
+        if (pcursor->GetKey(key) && key.first == DB_TOKEN_UTXO && key.second.id == start.id) {
+            TokenUtxoValue data;
+            if (pcursor->GetValue(data)) {
+                vect.push_back(std::make_pair(key.second.blockHeight, data));
+                pcursor->Next();
             } else {
+                return error("GetTokenUtxos() : failed to read value");
+            }
+        } else {
+            break;
+        }
+    }
+
+    return vect.size() > 0;
+}
+
+bool CStateViewDB::GetLastTokenUtxo(const TokenUtxoKey &end, TokenUtxoEntry &entry) {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_TOKEN_UTXO, end));
+    if (pcursor->Valid())
+        pcursor->Prev();
+    else
+        pcursor->SeekToLast();
+
+    std::pair<char, TokenUtxoKey> key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_TOKEN_UTXO || key.second.id != end.id)
+        return false;
+
+    if (!pcursor->GetValue(entry.second))
+        return error("GetLastTokenUtxo() : failed to read value");
+    entry.first = key.second.blockHeight;
+
+    return true;
+}
+
+/** Key of the token utxo index before each output got its own entry: only the token and the height. */
+struct LegacyTokenUtxoKey {
+    uint256 id;
+    uint32_t blockHeight;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 32 + 4;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        id.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, blockHeight);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        id.Unserialize(s, nType, nVersion);
+        blockHeight = ser_readdata32be(s);
+    }
+};
+
+bool CStateViewDB::UpgradeTokenUtxos() {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    pcursor->Seek(DB_TOKEN_UTXO_LEGACY);
+
+    CDBBatch batch(db);
+    int nMigrated = 0;
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, LegacyTokenUtxoKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_TOKEN_UTXO_LEGACY) {
+            TokenUtxoValue data;
+            if (pcursor->GetValue(data)) {
+                batch.Erase(key);
+                if (!data.IsNull())
+                    batch.Write(std::make_pair(DB_TOKEN_UTXO, TokenUtxoKey(key.second.id, key.second.blockHeight, data.hash, data.n)), data);
+                if (++nMigrated % 1000 == 0) {
+                    if (!db.WriteBatch(batch))
+                        return error("UpgradeTokenUtxos() : failed to migrate token utxos");
+                    batch.Clear();
+                }
                 pcursor->Next();
+            } else {
+                return error("UpgradeTokenUtxos() : failed to read value");
             }
         } else {
             break;
         }
     }
 
+    if (nMigrated > 0) {
+        if (!db.WriteBatch(batch, true))
+            return error("UpgradeTokenUtxos() : failed to migrate token utxos");
+        LogPrintf("%s: moved %d token utxos to per-output keys\n", __func__, nMigrated);
+    }
+
     return true;
 }
 
@@ -102,10 +187,6 @@ bool CStateViewDB::HaveToken(const uint256 &id) const {
     return db.Exists(std::make_pair(DB_TOKENS, id));
 }
 
-bool CStateViewDB::HaveTokenUtxos(const uint256 &id) const {
-    return db.Exists(std::make_pair(DB_TOKEN_UTXO, id));
-}
-
 bool CStateViewDB::GetNameRecord(const uint256 &id, NameRecordValue &height) const {
     return db.Read(std::make_pair(DB_NAME_RECORDS, id), height);
 }
@@ -115,7 +196,60 @@ bool CStateViewDB::HaveNameRecord(const uint256 &id) const {
 }
 
 bool CStateViewDB::HaveNameData(const uint256 &id) const {
-    return db.Exists(std::make_pair(DB_NAME_DATA, id));
+    // Every name with a history has a state, which unlike the history sits under a single key.
+    return db.Exists(std::make_pair(DB_NAME_STATE, id));
+}
+
+bool CStateViewDB::GetNameState(const uint256 &id, NameDataState &state) const {
+    return db.Read(std::make_pair(DB_NAME_STATE, id), state);
+}
+
+bool CStateViewDB::UpgradeNameStates() {
+    if (db.Exists(std::make_pair(DB_FLAG, std::string("namestates"))))
+        return true;
+
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    pcursor->Seek(DB_NAME_DATA);
+
+    CDBBatch batch(db);
+    int nMigrated = 0;
+    uint256 id;
+    NameDataValues data;
+
+    // The history is sorted by name, so each state is complete once the next name starts.
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, NameDataKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_NAME_DATA;
+        if (!data.empty() && (!fValid || key.second.id != id)) {
+            NameDataState state;
+            state.Rebuild(data);
+            batch.Write(std::make_pair(DB_NAME_STATE, id), state);
+            data.clear();
+            if (++nMigrated % 1000 == 0) {
+                if (!db.WriteBatch(batch))
+                    return error("UpgradeNameStates() : failed to write name states");
+                batch.Clear();
+            }
+        }
+        if (!fValid)
+            break;
+        NameDataValue value;
+        if (!pcursor->GetValue(value))
+            return error("UpgradeNameStates() : failed to read value");
+        id = key.second.id;
+        data.push_back(std::make_pair(key.second.height, value));
+        pcursor->Next();
+    }
+
+    batch.Write(std::make_pair(DB_FLAG, std::string("namestates")), '1');
+    if (!db.WriteBatch(batch, true))
+        return error("UpgradeNameStates() : failed to write name states");
+    if (nMigrated > 0)
+        LogPrintf("%s: built the current data of %d names\n", __func__, nMigrated);
+
+    return true;
 }
 
 bool CStateViewDB::GetPaymentRequest(const uint256 &prid, CPaymentRequest &prequest) const {
@@ -172,6 +306,21 @@ int CStateViewDB::GetExcludeVotes() const {
     return ret;
 }
 
+bool CStateViewDB::GetStateStats(CStateStats& stats) const {
+    stats.SetNull();
+    uint256 hashBestChain = GetBestBlock();
+    if (hashBestChain.IsNull()) {
+        // An empty chainstate has trivially known statistics.
+        stats.fValid = true;
+        return true;
+    }
+    if (!db.Read(std::make_pair(DB_STATE_STATS, hashBestChain), stats)) {
+        stats.SetNull();
+        return false;
+    }
+    return true;
+}
+
 bool CStateViewDB::GetAllProposals(CProposalMap& map) {
     map.clear();
 
@@ -229,22 +378,18 @@ bool CStateViewDB::GetNameData(const uint256& id, NameDataValues& map) {
 
     boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_NAME_DATA, uint256()));
+    pcursor->Seek(std::make_pair(DB_NAME_DATA, NameDataKey(id, 0)));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char, NameDataKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_NAME_DATA) {
-            if (key.second.id == id) {
-                NameDataValue data;
-                if (pcursor->GetValue(data)) {
-                    map.push_back(std::make_pair(key.second.height, data));
-                    pcursor->Next();
-                } else {
-                    return error("GetNameData() : failed to read value");
-                }
-            } else {
+        if (pcursor->GetKey(key) && key.first == DB_NAME_DATA && key.second.id == id) {
+            NameDataValue data;
+            if (pcursor->GetValue(data)) {
+                map.push_back(std::make_pair(key.second.height, data));
                 pcursor->Next();
+            } else {
+                return error("GetNameData() : failed to read value");
             }
         } else {
             break;
@@ -384,15 +529,31 @@ bool CStateViewDB::GetAllConsultationAnswers(CConsultationAnswerMap &map) {
     return true;
 }
 
+void CStateViewDB::EraseNameDataAtHeight(CDBBatch& batch, const uint256& id, const uint64_t& height) {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_NAME_DATA, NameDataKey(id, height)));
+
+    while (pcursor->Valid()) {
+        std::pair<char, NameDataKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_NAME_DATA || key.second.id != id || key.second.height != height)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+}
+
 bool CStateViewDB::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
                               CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                               CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
                               CConsensusParameterMap &mapConsensus,
                               TokenMap &mapTokens, TokenUtxoMap &mapTokenUtxos, NameRecordMap &mapNameRecords,
-                              NameDataMap& mapNameData,
-                              const uint256 &hashBlock, const int &nExcludeVotes) {
+                              NameDataMap& mapNameData, NameStateMap& mapNameStates,
+                              const uint256 &hashBlock, const int &nExcludeVotes,
+                              const CStateStats &stats) {
 
-    CDBBatch batch(db);
+    std::unique_ptr<CDBBatch> pbatch(new CDBBatch(db));
+    CDBBatch& batch = *pbatch;
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
@@ -494,17 +655,10 @@ bool CStateViewDB::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
     }
 
     for (TokenUtxoMap::iterator it = mapTokenUtxos.begin(); it != mapTokenUtxos.end();) {
-        if (it->second.size() == 0) {
+        if (it->second.IsNull()) {
             batch.Erase(std::make_pair(DB_TOKEN_UTXO, it->first));
         } else {
-            for (auto &it2: it->second) {
-                if (it2.second.IsNull())
-                {
-                    batch.Erase(std::make_pair(DB_TOKEN_UTXO, TokenUtxoKey(it->first, it2.first)));
-                } else {
-                    batch.Write(std::make_pair(DB_TOKEN_UTXO, TokenUtxoKey(it->first, it2.first)), it2.second);
-                }
-            }
+            batch.Write(std::make_pair(DB_TOKEN_UTXO, it->first), it->second);
         }
         TokenUtxoMap::iterator itOld = it++;
         mapTokenUtxos.erase(itOld);
@@ -527,7 +681,8 @@ bool CStateViewDB::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
             for (auto &it2: it->second) {
                 if (it2.second.IsNull())
                 {
-                    batch.Erase(std::make_pair(DB_NAME_DATA, NameDataKey(it->first, it2.first)));
+                    // Marks a disconnected height: the keys written at it are not known anymore.
+                    EraseNameDataAtHeight(batch, it->first, it2.first);
                 } else {
                     batch.Write(std::make_pair(DB_NAME_DATA, NameDataKey(it->first, it2.first, it2.second.key)), it2.second);
                 }
@@ -537,13 +692,32 @@ bool CStateViewDB::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
         mapNameData.erase(itOld);
     }
 
-    if (!hashBlock.IsNull())
+    for (NameStateMap::iterator it = mapNameStates.begin(); it != mapNameStates.end();) {
+        if (it->second.IsNull()) {
+            batch.Erase(std::make_pair(DB_NAME_STATE, it->first));
+        } else {
+            batch.Write(std::make_pair(DB_NAME_STATE, it->first), it->second);
+        }
+        NameStateMap::iterator itOld = it++;
+        mapNameStates.erase(itOld);
+    }
+
+    if (!hashBlock.IsNull()) {
+        // Only keep the statistics of the state we are about to commit.
+        uint256 hashOldBlock = GetBestBlock();
+        if (!hashOldBlock.IsNull() && hashOldBlock != hashBlock)
+            batch.Erase(std::make_pair(DB_STATE_STATS, hashOldBlock));
+        if (stats.fValid)
+            batch.Write(std::make_pair(DB_STATE_STATS, hashBlock), stats);
         batch.Write(DB_BEST_BLOCK, hashBlock);
+    }
 
     if (nExcludeVotes != -1)
         batch.Write(DB_EXCLUDE_VOTES, nExcludeVotes);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    if (fWriteBehind)
+        return db.WriteBatchAsync(std::move(pbatch));
     return db.WriteBatch(batch);
 }
 
@@ -614,39 +788,41 @@ void CStateViewDBCursor::Next()
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                                  const std::vector<std::pair<CBlockVotesKey, std::shared_ptr<const CBlockVotes>> >& votesinfo) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        CDiskBlockIndex dbi(*it);
-        auto pVotes = GetProposalVotes(dbi.GetBlockHash());
-        if (pVotes != nullptr)
-        {
-            dbi.vProposalVotes = *pVotes;
-        }
-        auto prVotes = GetPaymentRequestVotes(dbi.GetBlockHash());
-        if (prVotes != nullptr)
-        {
-            dbi.vPaymentRequestVotes = *prVotes;
-        }
-        auto supp = GetSupport(dbi.GetBlockHash());
-        if (supp != nullptr)
-        {
-            dbi.mapSupport = *supp;
-        }
-        auto cVotes = GetConsultationVotes(dbi.GetBlockHash());
-        if (cVotes != nullptr)
-        {
-            dbi.mapConsultationVotes = *cVotes;
-        }
-        batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), dbi);
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+    }
+    for (std::vector<std::pair<CBlockVotesKey, std::shared_ptr<const CBlockVotes>> >::const_iterator it=votesinfo.begin(); it != votesinfo.end(); it++) {
+        if (it->second->IsEmpty())
+            batch.Erase(std::make_pair(DB_BLOCK_VOTES, it->first));
+        else
+            batch.Write(std::make_pair(DB_BLOCK_VOTES, it->first), *it->second);
     }
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadBlockVotes(const CBlockVotesKey &key, CBlockVotes &votes) {
+    return Read(std::make_pair(DB_BLOCK_VOTES, key), votes);
+}
+
+bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex) {
+    return Read(std::make_pair(DB_BLOCK_INDEX, hash), diskindex);
+}
+
+bool ReadBlockIndexCold(const uint256& hash, CBlockIndexCold& cold) {
+    CDiskBlockIndex diskindex;
+    if (pblocktree == nullptr || !pblocktree->ReadDiskBlockIndex(hash, diskindex))
+        return false;
+    cold = diskindex.GetCold();
+    return true;
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
@@ -812,18 +988,25 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    return ReadAddressUnspentIndex(CAddressUnspentKey(type, addressHash, uint256(), 0), 0, unspentOutputs);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const CAddressUnspentKey &start, size_t nLimit,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, start));
 
-    while (pcursor->Valid()) {
+    size_t nRead = 0;
+    while (pcursor->Valid() && (nLimit == 0 || nRead < nLimit)) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressUnspentKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.type == start.type && key.second.hashBytes == start.hashBytes) {
             CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
                 unspentOutputs.push_back(std::make_pair(key.second, nValue));
+                nRead++;
                 pcursor->Next();
             } else {
                 return error("failed to get address unspent value");
@@ -853,25 +1036,30 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
+    if (start > 0 && end > 0)
+        return ReadAddressIndex(CAddressIndexKey(type, addressHash, start, 0, uint256(), 0, false), end, 0, addressIndex);
+    return ReadAddressIndex(CAddressIndexKey(type, addressHash, 0, 0, uint256(), 0, false), 0, 0, addressIndex);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const CAddressIndexKey &start, int end, size_t nLimit,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
-    }
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, start));
 
-    while (pcursor->Valid()) {
+    size_t nRead = 0;
+    while (pcursor->Valid() && (nLimit == 0 || nRead < nLimit)) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.type == start.type && key.second.hashBytes == start.hashBytes) {
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
             CAmount nValue;
             if (pcursor->GetValue(nValue)) {
                 addressIndex.push_back(std::make_pair(key.second, nValue));
+                nRead++;
                 pcursor->Next();
             } else {
                 return error("failed to get address index value");
@@ -901,24 +1089,29 @@ bool CBlockTreeDB::EraseAddressHistory(const std::vector<std::pair<CAddressHisto
 bool CBlockTreeDB::ReadAddressHistory(uint160 addressHash, uint160 addressHash2,
                                     std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &addressIndex,
                                     AddressHistoryFilter filter, int start, int end) {
+    if (start > 0 && end > 0)
+        return ReadAddressHistory(CAddressHistoryKey(addressHash, addressHash2, start, 0, uint256(), 0), end, 0, filter, addressIndex);
+    return ReadAddressHistory(CAddressHistoryKey(addressHash, addressHash2, 0, 0, uint256(), 0), 0, 0, filter, addressIndex);
+}
+
+bool CBlockTreeDB::ReadAddressHistory(const CAddressHistoryKey &start, int end, size_t nLimit, AddressHistoryFilter filter,
+                                    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &addressIndex) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSHISTORY, CAddressHistoryIteratorHeightKey(addressHash, addressHash2, start)));
-    } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSHISTORY, CAddressHistoryIteratorKey(addressHash, addressHash2)));
-    }
+    pcursor->Seek(std::make_pair(DB_ADDRESSHISTORY, start));
 
-    while (pcursor->Valid()) {
+    size_t nRead = 0;
+    while (pcursor->Valid() && (nLimit == 0 || nRead < nLimit)) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressHistoryKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSHISTORY && key.second.hashBytes == addressHash && key.second.hashBytes2 == addressHash2) {
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSHISTORY && key.second.hashBytes == start.hashBytes && key.second.hashBytes2 == start.hashBytes2) {
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
             CAddressHistoryValue nValue;
             if (pcursor->GetValue(nValue)) {
+                pcursor->Next();
                 if (!(filter & AddressHistoryFilter::SPENDABLE))
                     nValue.spendable = 0;
                 if (!(filter & AddressHistoryFilter::STAKABLE))
@@ -928,7 +1121,7 @@ bool CBlockTreeDB::ReadAddressHistory(uint160 addressHash, uint160 addressHash2,
                 if (filter & AddressHistoryFilter::GENERATED_FILTER && !(nValue.flags & AddressHistoryFlag::GENERATED_FLAG))
                     continue;
                 addressIndex.push_back(std::make_pair(key.second, nValue));
-                pcursor->Next();
+                nRead++;
             } else {
                 return error("failed to get address history value");
             }
@@ -940,6 +1133,91 @@ bool CBlockTreeDB::ReadAddressHistory(uint160 addressHash, uint160 addressHash2,
     return true;
 }
 
+bool CBlockTreeDB::SumAddressHistory(uint160 addressHash, uint160 addressHash2, AddressHistoryFilter filter, int nBelowHeight,
+                                     CAddressHistoryValue &total) {
+
+    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > vHistory;
+    CAddressHistoryKey start(addressHash, addressHash2, 0, 0, uint256(), 0);
+    int end = nBelowHeight - 1;
+
+    total.SetNull();
+    if (end <= 0)
+        return true;
+
+    // Read in chunks, so that the whole history is never in memory
+    do {
+        vHistory.clear();
+        if (!ReadAddressHistory(start, end, ADDRESS_HISTORY_SUM_CHUNK + 1, filter, vHistory))
+            return false;
+        for (size_t i = 0; i < vHistory.size() && i < ADDRESS_HISTORY_SUM_CHUNK; i++) {
+            total.spendable += vHistory[i].second.spendable;
+            total.stakable += vHistory[i].second.stakable;
+            total.voting_weight += vHistory[i].second.voting_weight;
+        }
+        if (!vHistory.empty())
+            start = vHistory.back().first;
+    } while (vHistory.size() > ADDRESS_HISTORY_SUM_CHUNK);
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressSummary(uint160 addressHash, uint160 addressHash2, CAddressSummaryValue &summary) {
+    summary.SetNull();
+    std::pair<char, CAddressHistoryIteratorKey> key = std::make_pair(DB_ADDRESSSUMMARY, CAddressHistoryIteratorKey(addressHash, addressHash2));
+    if (!Exists(key))
+        return true;
+    return Read(key, summary);
+}
+
+bool CBlockTreeDB::UpgradeAddressSummaries() {
+    if (Exists(std::make_pair(DB_FLAG, std::string("addresssummary"))))
+        return true;
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(DB_ADDRESSHISTORY);
+
+    CDBBatch batch(*this);
+    int nMigrated = 0;
+    CAddressHistoryIteratorKey address;
+    CAddressSummaryValue summary;
+
+    // The history is sorted by address and height, so each summary is complete once the next address starts.
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressHistoryKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSHISTORY;
+        if (!summary.IsNull() && (!fValid || key.second.hashBytes != address.hashBytes || key.second.hashBytes2 != address.hashBytes2)) {
+            batch.Write(std::make_pair(DB_ADDRESSSUMMARY, address), summary);
+            summary.SetNull();
+            if (++nMigrated % 1000 == 0) {
+                if (!WriteBatch(batch))
+                    return error("UpgradeAddressSummaries() : failed to write address summaries");
+                batch.Clear();
+            }
+        }
+        if (!fValid)
+            break;
+        CAddressHistoryValue value;
+        if (!pcursor->GetValue(value))
+            return error("UpgradeAddressSummaries() : failed to read value");
+        address = CAddressHistoryIteratorKey(key.second.hashBytes, key.second.hashBytes2);
+        if (summary.IsNull())
+            summary.firstHeight = key.second.blockHeight;
+        summary.lastHeight = key.second.blockHeight;
+        summary.Apply(value, true);
+        pcursor->Next();
+    }
+
+    batch.Write(std::make_pair(DB_FLAG, std::string("addresssummary")), '1');
+    if (!WriteBatch(batch, true))
+        return error("UpgradeAddressSummaries() : failed to write address summaries");
+    if (nMigrated > 0)
+        LogPrintf("%s: built the summaries of %d addresses\n", __func__, nMigrated);
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch(*this);
     batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
@@ -989,6 +1267,141 @@ bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &lt
     return true;
 }
 
+namespace {
+/** An address summary being brought up to date by a batch of index updates */
+struct CAddressSummaryUpdate
+{
+    CAddressSummaryValue summary;
+    //! heights of the history entries added by the batch, which the database does not hold yet
+    std::set<int> setConnected;
+    //! heights of the history entries removed by the batch, which the database still holds
+    std::set<int> setDisconnected;
+};
+}
+
+bool CBlockTreeDB::FindAddressLastHeight(const uint160& addressHash, const uint160& addressHash2, int nHeight, const std::set<int>& setSkip, int& nLastHeight) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_ADDRESSHISTORY, CAddressHistoryIteratorHeightKey(addressHash, addressHash2, nHeight)));
+    if (pcursor->Valid())
+        pcursor->Prev();
+    else
+        pcursor->SeekToLast();
+
+    while (pcursor->Valid()) {
+        std::pair<char, CAddressHistoryKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSHISTORY || key.second.hashBytes != addressHash || key.second.hashBytes2 != addressHash2)
+            break;
+        if (!setSkip.count(key.second.blockHeight)) {
+            nLastHeight = key.second.blockHeight;
+            return true;
+        }
+        pcursor->Prev();
+    }
+
+    return false;
+}
+
+bool CBlockTreeDB::WriteIndexUpdates(const std::vector<CIndexUpdate>& vUpdates) {
+    CDBBatch batch(*this);
+    std::map<std::pair<uint160, uint160>, CAddressSummaryUpdate> mapSummaries;
+    // History entries as left by the batch so far (present or not, and their value)
+    std::map<CAddressHistoryKey, std::pair<bool, CAddressHistoryValue> > mapHistory;
+    for (const CIndexUpdate& update: vUpdates) {
+        for (auto &it: update.addressIndex) {
+            if (update.fConnect)
+                batch.Write(std::make_pair(DB_ADDRESSINDEX, it.first), it.second);
+            else
+                batch.Erase(std::make_pair(DB_ADDRESSINDEX, it.first));
+        }
+        // All the history entries of an update belong to the same block
+        std::set<std::pair<uint160, uint160> > setTouched;
+        for (auto &it: update.addressHistory) {
+            // The summaries follow the entries actually added and removed: a block indexed twice
+            // is counted once, and disconnecting takes away the amounts stored when connecting.
+            auto itHistory = mapHistory.find(it.first);
+            if (itHistory == mapHistory.end()) {
+                itHistory = mapHistory.insert(std::make_pair(it.first, std::make_pair(false, CAddressHistoryValue()))).first;
+                itHistory->second.first = Read(std::make_pair(DB_ADDRESSHISTORY, it.first), itHistory->second.second);
+            }
+            if (itHistory->second.first == update.fConnect)
+                continue;
+            const CAddressHistoryValue value = update.fConnect ? it.second : itHistory->second.second;
+            itHistory->second = std::make_pair(update.fConnect, value);
+
+            if (update.fConnect)
+                batch.Write(std::make_pair(DB_ADDRESSHISTORY, it.first), value);
+            else
+                batch.Erase(std::make_pair(DB_ADDRESSHISTORY, it.first));
+
+            std::pair<uint160, uint160> address = std::make_pair(it.first.hashBytes, it.first.hashBytes2);
+            auto itSummary = mapSummaries.find(address);
+            if (itSummary == mapSummaries.end()) {
+                itSummary = mapSummaries.insert(std::make_pair(address, CAddressSummaryUpdate())).first;
+                if (!ReadAddressSummary(address.first, address.second, itSummary->second.summary))
+                    return error("%s: failed to read address summary", __func__);
+            }
+            itSummary->second.summary.Apply(value, update.fConnect);
+            setTouched.insert(address);
+        }
+        for (const std::pair<uint160, uint160>& address: setTouched) {
+            CAddressSummaryUpdate& summaryUpdate = mapSummaries[address];
+            CAddressSummaryValue& summary = summaryUpdate.summary;
+            int nHeight = update.addressHistory.front().first.blockHeight;
+            if (update.fConnect) {
+                if (summary.firstHeight < 0)
+                    summary.firstHeight = nHeight;
+                summary.lastHeight = nHeight;
+                summaryUpdate.setConnected.insert(nHeight);
+                continue;
+            }
+            if (summaryUpdate.setConnected.erase(nHeight) == 0)
+                summaryUpdate.setDisconnected.insert(nHeight);
+            if (summary.IsNull()) {
+                summary.SetNull();
+            } else if (summary.lastHeight == nHeight) {
+                // Blocks are disconnected from the tip, so the entries added by the batch are above any left in the database
+                if (!summaryUpdate.setConnected.empty())
+                    summary.lastHeight = *summaryUpdate.setConnected.rbegin();
+                else if (!FindAddressLastHeight(address.first, address.second, nHeight, summaryUpdate.setDisconnected, summary.lastHeight))
+                    return error("%s: no history left for address with a summary", __func__);
+            }
+        }
+        for (auto &it: update.addressUnspentIndex) {
+            if (it.second.IsNull())
+                batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it.first));
+            else
+                batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it.first), it.second);
+        }
+        for (auto &it: update.spentIndex) {
+            if (it.second.IsNull())
+                batch.Erase(std::make_pair(DB_SPENTINDEX, it.first));
+            else
+                batch.Write(std::make_pair(DB_SPENTINDEX, it.first), it.second);
+        }
+        if (update.fConnect && update.nLogicalTS > 0) {
+            batch.Write(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(update.nLogicalTS, update.hashBlock)), 0);
+            batch.Write(std::make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(update.hashBlock)), CTimestampBlockIndexValue(update.nLogicalTS));
+        }
+    }
+    for (auto &it: mapSummaries) {
+        std::pair<char, CAddressHistoryIteratorKey> key = std::make_pair(DB_ADDRESSSUMMARY, CAddressHistoryIteratorKey(it.first.first, it.first.second));
+        if (it.second.summary.IsNull())
+            batch.Erase(key);
+        else
+            batch.Write(key, it.second.summary);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadIndexBestBlock(uint256& hashBestIndexed) {
+    return Read(DB_INDEX_BEST_BLOCK, hashBestIndexed);
+}
+
+bool CBlockTreeDB::WriteIndexBestBlock(const uint256& hashBestIndexed) {
+    return Write(DB_INDEX_BEST_BLOCK, hashBestIndexed);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -1001,11 +1414,7 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex,
-                                      std::function<std::vector<std::pair<uint256, int>>*(const uint256&)> insertProposalVotes,
-                                      std::function<std::vector<std::pair<uint256, int>>*(const uint256&)> insertPaymentRequestVotes,
-                                      std::function<std::map<uint256, bool>*(const uint256&)> insertSupport,
-                                      std::function<std::map<uint256, uint64_t>*(const uint256&)> insertConsultationVotes)
+bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -1013,6 +1422,11 @@ bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)
 
     int nCount = 0;
 
+    // Block votes used to be stored inside the block index records. Move
+    // them to their own records, which are only read when needed.
+    CDBBatch batchMigrate(*this);
+    int nMigrated = 0;
+
     // Load mapBlockIndex
     while (pcursor->Valid()) {
         if (++nCount % PROGRESS_INTERVAL == 0) {
@@ -1038,36 +1452,25 @@ bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)
                 pindexNew->nNonce         = diskindex.nNonce;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nMint          = diskindex.nMint;
-                pindexNew->nCFSupply      = diskindex.nCFSupply;
-                pindexNew->nCFLocked      = diskindex.nCFLocked;
-                pindexNew->strDZeel       = diskindex.strDZeel;
                 pindexNew->nFlags         = diskindex.nFlags;
                 pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->hashProof      = diskindex.hashProof;
-                pindexNew->nPrivateMoneySupply
-                                          = diskindex.nPrivateMoneySupply;
-                pindexNew->nPublicMoneySupply
-                                          = diskindex.nPublicMoneySupply;
-                if (diskindex.vProposalVotes.size() > 0)
-                {
-                    auto pVotes = insertProposalVotes(diskindex.GetBlockHash());
-                    *pVotes = diskindex.vProposalVotes;
-                }
-                if (diskindex.vPaymentRequestVotes.size() > 0)
+                // The cold fields are read again from this record when needed
+
+                CBlockVotes votes;
+                votes.vProposalVotes.swap(diskindex.vProposalVotes);
+                votes.vPaymentRequestVotes.swap(diskindex.vPaymentRequestVotes);
+                votes.mapSupport.swap(diskindex.mapSupport);
+                votes.mapConsultationVotes.swap(diskindex.mapConsultationVotes);
+                if (!votes.IsEmpty())
                 {
-                    auto prVotes = insertPaymentRequestVotes(diskindex.GetBlockHash());
-                    *prVotes = diskindex.vPaymentRequestVotes;
-                }
-                if (diskindex.mapSupport.size() > 0)
-                {
-                    auto supp = insertSupport(diskindex.GetBlockHash());
-                    *supp = diskindex.mapSupport;
-                }
-                if (diskindex.mapConsultationVotes.size() > 0)
-                {
-                    auto cVotes = insertConsultationVotes(diskindex.GetBlockHash());
-                    *cVotes = diskindex.mapConsultationVotes;
+                    batchMigrate.Write(std::make_pair(DB_BLOCK_VOTES, CBlockVotesKey(diskindex.nHeight, key.second)), votes);
+                    batchMigrate.Write(std::make_pair(DB_BLOCK_INDEX, key.second), diskindex);
+                    if (++nMigrated % 1000 == 0)
+                    {
+                        if (!WriteBatch(batchMigrate))
+                            return error("LoadBlockIndex() : failed to migrate block votes");
+                        batchMigrate.Clear();
+                    }
                 }
 
                 pcursor->Next();
@@ -1079,5 +1482,12 @@ bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)
         }
     }
 
+    if (nMigrated > 0)
+    {
+        if (!WriteBatch(batchMigrate, true))
+            return error("LoadBlockIndex() : failed to migrate block votes");
+        LogPrintf("%s: moved the votes of %d blocks out of the block index\n", __func__, nMigrated);
+    }
+
     return true;
 }
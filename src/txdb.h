@@ -16,6 +16,8 @@
 
 #include <functional>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -44,6 +46,8 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -dbwritebehind default
+static const bool DEFAULT_DB_WRITE_BEHIND = true;
 
 template<typename T, typename M, template<typename> class C = std::less>
 struct member_comparer : std::binary_function<T, T, bool>
@@ -95,8 +99,13 @@ class CStateViewDB : public CStateView
 {
 protected:
     CDBWrapper db;
+    //! Commit BatchWrite on a background thread (see CDBWrapper::WriteBatchAsync)
+    bool fWriteBehind;
+
+    //! Queue the erasure of every history entry of a name written at height
+    void EraseNameDataAtHeight(CDBBatch& batch, const uint256& id, const uint64_t& height);
 public:
-    CStateViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CStateViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool fWriteBehind = false);
 
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
@@ -113,23 +122,25 @@ public:
     bool GetConsensusParameter(const int &pid, CConsensusParameter& cparameter) const;
     bool HaveConsensusParameter(const int &pid) const;
     bool GetToken(const uint256 &id, TokenInfo &token) const;
-    bool GetTokenUtxos(const uint256 &id, TokenUtxoValues &vect);
+    bool GetTokenUtxos(const TokenUtxoKey &start, size_t nLimit, TokenUtxoValues &vect);
+    bool GetLastTokenUtxo(const TokenUtxoKey &end, TokenUtxoEntry &entry);
     bool HaveToken(const uint256 &id) const;
-    bool HaveTokenUtxos(const uint256 &id) const;
 
     bool GetNameRecord(const uint256 &id, NameRecordValue &height) const;
     bool HaveNameRecord(const uint256 &id) const;
 
     bool GetNameData(const uint256& id, NameDataValues &data);
     bool HaveNameData(const uint256& id) const;
+    bool GetNameState(const uint256& id, NameDataState &state) const;
 
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
                     CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                     CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
                     CConsensusParameterMap& mapConsensus, TokenMap& mapTokens, TokenUtxoMap &mapTokenUtxos,
-                    NameRecordMap& mapNameRecords, NameDataMap& mapNameData,
-                    const uint256 &hashBlock, const int &nExcludeVotes);
+                    NameRecordMap& mapNameRecords, NameDataMap& mapNameData, NameStateMap& mapNameStates,
+                    const uint256 &hashBlock, const int &nExcludeVotes,
+                    const CStateStats &stats);
     bool GetAllProposals(CProposalMap& map);
     bool GetAllPaymentRequests(CPaymentRequestMap& map);
     bool GetAllVotes(CVoteMap &map);
@@ -138,7 +149,14 @@ public:
     bool GetAllTokens(TokenMap &map);
     bool GetAllNameRecords(NameRecordMap &map);
     int GetExcludeVotes() const;
+    bool GetStateStats(CStateStats& stats) const;
     CStateViewCursor *Cursor() const;
+
+    //! Rewrite token utxo index entries of older versions, keyed by token and height only
+    bool UpgradeTokenUtxos();
+
+    //! Build the current data of every name from its history, if not done yet
+    bool UpgradeNameStates();
 };
 
 /** Specialization of CStateViewCursor to iterate over a CStateViewDB */
@@ -163,6 +181,22 @@ private:
     friend class CStateViewDB;
 };
 
+/** Changes to the address, spent and timestamp indexes of one connected or disconnected block */
+struct CIndexUpdate
+{
+    bool fConnect;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    //! the values of a disconnected block are not used, the ones stored for its entries are removed
+    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > addressHistory;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    //! logical timestamp of a connected block, 0 if the timestamp index is not maintained
+    unsigned int nLogicalTS;
+    uint256 hashBlock;
+
+    CIndexUpdate() : fConnect(true), nLogicalTS(0) {}
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -171,8 +205,11 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+    //! Height of the last history entry of the address below nHeight, ignoring the heights in setSkip
+    bool FindAddressLastHeight(const uint160& addressHash, const uint160& addressHash2, int nHeight, const std::set<int>& setSkip, int& nLastHeight);
 public:
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                        const std::vector<std::pair<CBlockVotesKey, std::shared_ptr<const CBlockVotes>> >& votesinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
@@ -184,27 +221,46 @@ public:
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    //! Read at most nLimit (0 for all) unspent outputs of the address of start, in key order from start on
+    bool ReadAddressUnspentIndex(const CAddressUnspentKey &start, size_t nLimit,
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    //! Read at most nLimit (0 for all) entries of the address of start, in key order from start on and up to height end (0 for all)
+    bool ReadAddressIndex(const CAddressIndexKey &start, int end, size_t nLimit,
+                          std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
     bool WriteAddressHistory(const std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &vect);
     bool EraseAddressHistory(const std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &vect);
     bool ReadAddressHistory(uint160 addressHash, uint160 addressHash2,
                           std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &addressIndex,
                           AddressHistoryFilter filter = AddressHistoryFilter::ALL, int start = 0, int end = 0);
+    bool ReadAddressHistory(const CAddressHistoryKey &start, int end, size_t nLimit, AddressHistoryFilter filter,
+                          std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &addressIndex);
+    //! Sum of the history entries of an address below nBelowHeight
+    bool SumAddressHistory(uint160 addressHash, uint160 addressHash2, AddressHistoryFilter filter, int nBelowHeight,
+                           CAddressHistoryValue &total);
+    //! A null summary is returned for addresses without history
+    bool ReadAddressSummary(uint160 addressHash, uint160 addressHash2, CAddressSummaryValue &summary);
+    //! Build the address summaries of a database indexed before they existed
+    bool UpgradeAddressSummaries();
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
+    //! Apply the updates in order in a single batch. History entries already added (or removed)
+    //! are skipped, and the address summaries with them, so blocks can be indexed again.
+    bool WriteIndexUpdates(const std::vector<CIndexUpdate>& vUpdates);
+    //! The last block indexed whose block index entry and undo data are on disk too
+    bool ReadIndexBestBlock(uint256& hashBestIndexed);
+    bool WriteIndexBestBlock(const uint256& hashBestIndexed);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex,
-                            std::function<std::vector<std::pair<uint256, int>>*(const uint256&)> insertProposalVotes,
-                            std::function<std::vector<std::pair<uint256, int>>*(const uint256&)> insertPaymentRequestVotes,
-                            std::function<std::map<uint256, bool>*(const uint256&)> insertSupport,
-                            std::function<std::map<uint256, uint64_t>*(const uint256&)> insertConsultationVotes);
+    bool ReadBlockVotes(const CBlockVotesKey &key, CBlockVotes &votes);
+    bool ReadDiskBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex);
+    bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
     bool ReadProposalIndex(const uint256 &proposalid, CProposal &proposal);
     bool WriteProposalIndex(const std::vector<std::pair<uint256, CProposal> >&vect);
     bool GetProposalIndex(std::vector<CProposal>&vect);
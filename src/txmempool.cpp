@@ -171,6 +171,9 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         }
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
+    // The transactions of the block are now ancestors of the entries spending them
+    if (!vHashesToUpdate.empty())
+        nAncestorStateEpoch++;
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
@@ -351,7 +354,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), nAncestorStateEpoch(0)
 {
     _clear(); //lock free clear
 
@@ -394,6 +397,12 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+unsigned int CTxMemPool::GetAncestorStateEpoch() const
+{
+    LOCK(cs);
+    return nAncestorStateEpoch;
+}
+
 bool CTxMemPool::AddProposal(const CProposal& proposal)
 {
     mapProposal.insert(std::make_pair(proposal.hash, proposal));
@@ -675,6 +684,7 @@ void CTxMemPool::removeUnchecked(txiter it)
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    nAncestorStateEpoch++;
     minerPolicyEstimator->removeTx(hash);
     removeAddressIndex(hash);
     removeSpentIndex(hash);
@@ -843,6 +853,7 @@ void CTxMemPool::_clear()
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    ++nAncestorStateEpoch;
 }
 
 void CTxMemPool::clear()
@@ -1053,6 +1064,18 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+void CTxMemPool::relayInfo(const std::vector<uint256>& vHashes, std::map<uint256, TxRelayInfo>& mapInfo) const
+{
+    LOCK(cs);
+    for (const uint256& hash: vHashes) {
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        if (i == mapTx.end())
+            continue;
+        mapInfo[hash] = TxRelayInfo{i->GetSharedTx(), CFeeRate(i->GetFee(), i->GetTxSize()),
+                                    i->GetCountWithAncestors(), i->GetModFeesWithAncestors(), i->GetSizeWithAncestors()};
+    }
+}
+
 std::shared_ptr<const CTransaction> CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -1145,6 +1168,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string str
             for(txiter ancestorIt: setAncestors) {
                 mapTx.modify(ancestorIt, update_descendant_state(0, nFeeDelta, 0));
             }
+            nAncestorStateEpoch++;
         }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
@@ -1272,6 +1296,21 @@ bool CStateViewMemPool::GetNameData(const uint256 &prid, NameDataValues &data)
     return temp.size() > 0;
 }
 
+bool CStateViewMemPool::GetNameState(const uint256 &prid, NameDataState &state) const
+{
+    if (!base->GetNameState(prid, state))
+        state.SetNull();
+
+    if (mempool.mapNameData.count(prid))
+    {
+        for (auto&it: mempool.mapNameData.at(prid)) {
+            state.Apply(it.first, it.second);
+        }
+        return true;
+    }
+    return !state.IsNull();
+}
+
 bool CStateViewMemPool::GetAllPaymentRequests(CPaymentRequestMap& mapPaymentRequests) {
     mapPaymentRequests.clear();
 
@@ -334,6 +334,22 @@ struct TxMempoolInfo
     CFeeRate feeRate;
 };
 
+/**
+ * A mempool transaction with what orders its announcement to peers: parents
+ * before their children, then by feerate including the ancestors.
+ */
+struct TxRelayInfo
+{
+    std::shared_ptr<const CTransaction> tx;
+
+    /** Feerate of the transaction alone, as compared with the peer's feefilter. */
+    CFeeRate feeRate;
+
+    uint64_t nCountWithAncestors;
+    CAmount nModFeesWithAncestors;
+    uint64_t nSizeWithAncestors;
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -416,6 +432,7 @@ class CTxMemPool
 private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated;
+    unsigned int nAncestorStateEpoch; //!< Changes whenever the ancestor state of entries already in the pool may have changed
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx' byte sizes
@@ -578,6 +595,7 @@ public:
     void pruneSpent(const uint256& hash, CCoins &coins);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    unsigned int GetAncestorStateEpoch() const;
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
@@ -725,6 +743,8 @@ public:
     std::shared_ptr<const CTransaction> get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Add the relay information of the transactions of vHashes that are in the mempool to mapInfo */
+    void relayInfo(const std::vector<uint256>& vHashes, std::map<uint256, TxRelayInfo>& mapInfo) const;
 
     /** Estimate fee rate needed to get into the next nBlocks
      *  If no answer can be given at nBlocks, return an estimate
@@ -823,6 +843,7 @@ public:
     bool AddConsultationAnswer(const CConsultationAnswer& answer) const;
     bool HaveNameData(const uint256 &prid) const;
     bool GetNameData(const uint256 &prid, NameDataValues& data);
+    bool GetNameState(const uint256 &prid, NameDataState& state) const;
     bool AddNameData(const uint256 &txid, const uint256 &prid, const NameDataEntry& record);
 };
 
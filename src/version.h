@@ -9,7 +9,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 80021;
+static const int PROTOCOL_VERSION = 80022;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -42,4 +42,7 @@ static const int FEEFILTER_VERSION = 70013;
 //! shord-id-based block download starts with this version
 static const int SHORT_IDS_BLOCKS_VERSION = 70014;
 
+//! compact blocks describe combined BLSCT transactions by their parts starting with this version
+static const int COMBINED_BLSCT_CMPCT_VERSION = 80022;
+
 #endif // STOCK_VERSION_H
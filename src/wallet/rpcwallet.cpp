@@ -1356,17 +1356,14 @@ UniValue resolvename(const UniValue& params, bool fHelp)
     if (!DotStock::IsValid(sName))
         throw JSONRPCError(RPC_TYPE_ERROR, "Invalid name");
 
-    if (!view.HaveNameData(DotStock::GetHashName(sName)))
-        return ret;
-
-    NameDataValues data;
+    NameDataState nameState;
 
-    if (!view.GetNameData(DotStock::GetHashName(sName), data))
+    if (!view.GetNameState(DotStock::GetHashName(sName), nameState))
     {
         return ret;
     }
 
-    auto mapData = DotStock::Consolidate(data, chainActive.Tip()->nHeight, subdomain);
+    auto mapData = nameState.Get(chainActive.Tip()->nHeight, subdomain);
 
     for (auto &it: mapData) {
         if (it.first.substr(0,1) == "_") {
@@ -1375,7 +1372,7 @@ UniValue resolvename(const UniValue& params, bool fHelp)
     }
 
     if (getSubdomains && subdomain == "") {
-        auto subData = DotStock::ConsolidateSubdomains(data, chainActive.Tip()->nHeight);
+        auto subData = nameState.GetSubdomains(chainActive.Tip()->nHeight);
         UniValue subUniMain(UniValue::VOBJ);
 
         for (auto &it: subData) {
@@ -1480,17 +1477,13 @@ UniValue updatename(const UniValue& params, bool fHelp)
 
     bool first = false;
 
-    NameDataValues data;
+    NameDataState nameState;
     uint64_t dataSize = 0;
 
-    if (!view.HaveNameData(DotStock::GetHashName(sName)))
+    if (!view.GetNameState(DotStock::GetHashName(sName), nameState))
         first = true;
     else {
-        if (!view.GetNameData(DotStock::GetHashName(sName), data))
-        {
-            throw JSONRPCError(RPC_TYPE_ERROR, "Could not find the name");
-        }
-        auto mapData = DotStock::Consolidate(data, chainActive.Tip()->nHeight);
+        auto mapData = nameState.Get(chainActive.Tip()->nHeight);
         if (!mapData.count("_key"))
         {
             first = true;
@@ -5719,10 +5712,13 @@ UniValue getstakervote(const UniValue& params, bool fHelp)
         throw std::runtime_error(
                 "getstakervote <stakerscript>\n"
                 "\nReturns a list of all the votes stored for a staker script.\n"
+                "Votes cast more than " + std::to_string(VOTE_HISTORY_COMPACTION_DEPTH) + " blocks before the last vote of the script\n"
+                "are merged into one entry, listed at the height of the newest of them, which holds\n"
+                "the value each item had at that height.\n"
                 "\nResult:\n"
                 "[\n"
                 "     {\n"
-                "          \"height\":   height of the vote,\n"
+                "          \"height\":   height of the vote, or of the merged older votes,\n"
                 "          \"hash\":     hash of the item,\n"
                 "          \"val\":      value of the vote\n"
                 "     }\n"
@@ -6056,6 +6052,15 @@ UniValue listtokens(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static UniValue TokenUtxoToJSON(const TokenUtxoEntry& entry)
+{
+    UniValue utxo(UniValue::VOBJ);
+    utxo.pushKV("n", std::to_string(entry.second.n));
+    utxo.pushKV("hash", entry.second.hash.ToString());
+    utxo.pushKV("spendingKey", HexStr(entry.second.spendingKey));
+    return utxo;
+}
+
 UniValue listnfts(const UniValue& params, bool fHelp)
 {
     if (fHelp)
@@ -6111,28 +6116,9 @@ UniValue listnfts(const UniValue& params, bool fHelp)
                 n.pushKV("metadata", it_.second);
                 n.pushKV("balance", pwalletMain->GetPrivateBalance(TokenId(it->first, it_.first)));
 
-                TokenUtxoValues utxos;
-                if (fWithUtxo && view.GetTokenUtxos(SerializeHash(TokenId(it->first, it_.first)), utxos)) {
-                    if (utxos.size() > 0) {
-                        TokenUtxoValue txout;
-                        auto i = utxos.end();
-                        while (i != utxos.begin())
-                        {
-                            --i;
-                            if (!i->second.IsNull()) {
-                                txout = i->second;
-                                break;
-                            }
-                        }
-                        if (!txout.IsNull()) {
-                            UniValue utxo(UniValue::VOBJ);
-                            utxo.pushKV("n", std::to_string(txout.n));
-                            utxo.pushKV("hash", txout.hash.ToString());
-                            utxo.pushKV("spendingKey", HexStr(txout.spendingKey));
-                            n.pushKV("utxo", utxo);
-                        }
-                    }
-                }
+                TokenUtxoEntry utxo;
+                if (fWithUtxo && view.GetCurrentTokenUtxo(SerializeHash(TokenId(it->first, it_.first)), utxo))
+                    n.pushKV("utxo", TokenUtxoToJSON(utxo));
 
                 a.push_back(n);
             }
@@ -6248,28 +6234,9 @@ UniValue getnft(const UniValue& params, bool fHelp)
         n.pushKV("metadata", it_.second);
         n.pushKV("balance", pwalletMain->GetPrivateBalance(TokenId(uint256S(params[0].get_str()), it_.first)));
 
-        TokenUtxoValues utxos;
-        if (fWithUtxo && view.GetTokenUtxos(SerializeHash(TokenId(uint256S(params[0].get_str()), it_.first)), utxos)) {
-            if (utxos.size() > 0) {
-                TokenUtxoValue txout;
-                auto i = utxos.end();
-                while (i != utxos.begin())
-                {
-                    --i;
-                    if (!i->second.IsNull()) {
-                        txout = i->second;
-                        break;
-                    }
-                }
-                if (!txout.IsNull()) {
-                    UniValue utxo(UniValue::VOBJ);
-                    utxo.pushKV("n", std::to_string(txout.n));
-                    utxo.pushKV("hash", txout.hash.ToString());
-                    utxo.pushKV("spendingKey", HexStr(txout.spendingKey));
-                    n.pushKV("utxo", utxo);
-                }
-            }
-        }
+        TokenUtxoEntry utxo;
+        if (fWithUtxo && view.GetCurrentTokenUtxo(SerializeHash(TokenId(uint256S(params[0].get_str()), it_.first)), utxo))
+            n.pushKV("utxo", TokenUtxoToJSON(utxo));
 
         a.push_back(n);
     }
@@ -6279,6 +6246,78 @@ UniValue getnft(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getnftutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 2 || params.size() > 4)
+        throw std::runtime_error(
+                "getnftutxos hash subid (count) (\"start\")\n"
+                "\nLists the outputs an nft has been sent to, oldest first, a page at a time.\n"
+
+                "\nArguments:\n"
+                "1. hash          (string, required) The token id\n"
+                "2. subid         (numeric, required) The index of the nft\n"
+                "3. count         (numeric, optional, default=100) The number of outputs to return\n"
+                "4. \"start\"       (string, optional) The \"next\" value of the previous page\n"
+
+                "\nResult:\n"
+                "{\n"
+                "  \"utxos\": [\n"
+                "    {\n"
+                "      \"height\": n,            (numeric) The height of the block creating the output\n"
+                "      \"n\": \"n\",               (string) The output index\n"
+                "      \"hash\": \"hash\",         (string) The transaction id\n"
+                "      \"spendingKey\": \"hex\"    (string) The spending key of the output\n"
+                "    }, ...\n"
+                "  ],\n"
+                "  \"next\": \"start\"            (string) Where the next page starts, if there is one\n"
+                "}\n"
+
+                "\nExamples:\n"
+                + HelpExampleCli("getnftutxos", "90fc7410164a466b78096967ec948fcc13142b0f5fb4397462304c517840d74f 1")
+                + HelpExampleCli("getnftutxos", "90fc7410164a466b78096967ec948fcc13142b0f5fb4397462304c517840d74f 1 10 \"12345:3b4c...:1\"")
+                );
+
+    if (!fNftIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Nft index not enabled");
+
+    uint256 id = SerializeHash(TokenId(uint256S(params[0].get_str()), params[1].get_int()));
+
+    int nCount = params.size() > 2 ? params[2].get_int() : 100;
+    if (nCount <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be positive");
+
+    TokenUtxoKey start(id, 0);
+    if (params.size() > 3) {
+        std::vector<std::string> vParts;
+        boost::split(vParts, params[3].get_str(), boost::is_any_of(":"));
+        if (vParts.size() != 3 || !IsHex(vParts[1]) || vParts[1].size() != 64)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start");
+        start = TokenUtxoKey(id, atoi(vParts[0]), uint256S(vParts[1]), atoi(vParts[2]));
+    }
+
+    LOCK(cs_main);
+
+    CStateViewCache view(pcoinsTip);
+
+    // Ask for one more, its key is where the next page starts
+    TokenUtxoValues utxos;
+    view.GetTokenUtxos(start, nCount + 1, utxos);
+
+    UniValue a(UniValue::VARR);
+    for (unsigned int i = 0; i < utxos.size() && i < (unsigned int)nCount; i++) {
+        UniValue utxo = TokenUtxoToJSON(utxos[i]);
+        utxo.pushKV("height", utxos[i].first);
+        a.push_back(utxo);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("utxos", a);
+    if (utxos.size() > (unsigned int)nCount)
+        ret.pushKV("next", strprintf("%d:%s:%d", utxos.back().first, utxos.back().second.hash.ToString(), utxos.back().second.n));
+
+    return ret;
+}
+
 
 extern UniValue dumpprivkey(const UniValue& params, bool fHelp); // in rpcdump.cpp
 extern UniValue dumpmasterprivkey(const UniValue& params, bool fHelp);
@@ -6326,6 +6365,7 @@ static const CRPCCommand commands[] =
   { "wallet",             "listnfts",                 &listnfts,                 true  },
   { "wallet",             "gettoken",                 &gettoken,                 true  },
   { "wallet",             "getnft",                   &getnft,                   true  },
+  { "wallet",             "getnftutxos",              &getnftutxos,              true  },
   { "wallet",             "getbalance",               &getbalance,               false },
   { "wallet",             "getnewaddress",            &getnewaddress,            true  },
   { "wallet",             "getcoldstakingaddress",    &getcoldstakingaddress,    true  },
@@ -3892,13 +3892,13 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                         {
                             CStateViewCache inputs(pcoinsTip);
 
-                            NameDataValues data;
-                            if (!inputs.GetNameData(DotStock::GetHashName(program.sParameters[0]), data))
+                            NameDataState nameState;
+                            if (!inputs.GetNameState(DotStock::GetHashName(program.sParameters[0]), nameState))
                             {
                                 strFailReason = strprintf("Could not find the name");
                                 return false;
                             }
-                            auto mapData = DotStock::Consolidate(data, chainActive.Tip()->nHeight);
+                            auto mapData = nameState.Get(chainActive.Tip()->nHeight);
                             if (!mapData.count("_key"))
                             {
                                 strFailReason = strprintf("Name has not an associated key");
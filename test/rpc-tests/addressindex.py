@@ -129,6 +129,18 @@ class AddressIndexTest(StockTestFramework):
         assert_equal(len(txidsmany), 4)
         assert_equal(txidsmany[3], sent_txid)
 
+        # Check that the txids can be read a page at a time, without repeating
+        # the transaction whose two outputs end up on different pages
+        pages = []
+        page = self.nodes[1].getaddresstxids({"addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br"], "limit": 1})
+        pages += page["txids"]
+        while "next" in page:
+            page = self.nodes[1].getaddresstxids({"addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br"], "limit": 1, "next": page["next"]})
+            pages += page["txids"]
+        assert_equal(len(pages), len(txidsmany))
+        assert_equal(sorted(pages), sorted(txidsmany))
+        assert_equal(pages[-1], sent_txid)
+
         # Check that balances are correct
         print("Testing balances...")
         balance0 = self.nodes[1].getaddressbalance("2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br")
@@ -183,6 +195,30 @@ class AddressIndexTest(StockTestFramework):
         deltasAll = self.nodes[1].getaddressdeltas({"addresses": [address2]})
         assert_equal(len(deltasAll), len(deltas))
 
+        # Check that the deltas can be read a page at a time
+        pages = []
+        page = self.nodes[1].getaddressdeltas({"addresses": [address2], "limit": 1})
+        pages += page["deltas"]
+        while "next" in page:
+            page = self.nodes[1].getaddressdeltas({"addresses": [address2], "limit": 1, "next": page["next"]})
+            # The last page has no token, rather than one leading to an empty page
+            assert_equal(len(page["deltas"]), 1)
+            pages += page["deltas"]
+        assert_equal(pages, deltasAll)
+
+        # Check that the history can be read a page at a time, the running
+        # balance carrying over from one page to the next
+        historyAll = self.nodes[1].getaddresshistory({"addresses": [address2]})
+        assert(len(historyAll) > 1)
+        pages = []
+        page = self.nodes[1].getaddresshistory({"addresses": [address2], "limit": 1})
+        pages += page["history"]
+        while "next" in page:
+            page = self.nodes[1].getaddresshistory({"addresses": [address2], "limit": 1, "next": page["next"]})
+            pages += page["history"]
+        assert_equal(pages, historyAll)
+        assert_equal(pages[-1]["result"]["balance"], change_amount)
+
         # Check that deltas can be returned from range of block heights
         deltas = self.nodes[1].getaddressdeltas({"addresses": [address2], "start": 113, "end": 113})
         assert_equal(len(deltas), 1)
@@ -225,6 +261,17 @@ class AddressIndexTest(StockTestFramework):
         assert_equal(utxos3[1]["height"], 264)
         assert_equal(utxos3[2]["height"], 265)
 
+        # Check that the utxos can be read a page at a time
+        pages = []
+        page = self.nodes[1].getaddressutxos({"addresses": [address2], "limit": 1})
+        pages += page["utxos"]
+        while "next" in page:
+            page = self.nodes[1].getaddressutxos({"addresses": [address2], "limit": 1, "next": page["next"]})
+            pages += page["utxos"]
+        outpoint = lambda utxo: (utxo["txid"], utxo["outputIndex"])
+        assert_equal(len(pages), len(utxos3))
+        assert_equal(sorted(pages, key=outpoint), sorted(utxos3, key=outpoint))
+
         # Check mempool indexing
         print("Testing mempool indexing...")
 
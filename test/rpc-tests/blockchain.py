@@ -55,9 +55,22 @@ class BlockchainTest(StockTestFramework):
         assert_equal(res['transactions'], 200)
         assert_equal(res['height'], 200)
         assert_equal(res['txouts'], 200)
-        assert_equal(res['bytes_serialized'], 13924),
         assert_equal(len(res['bestblock']), 64)
-        assert_equal(len(res['hash_serialized']), 64)
+        assert_is_hash_string(res['muhash'])
+        assert res['bogosize'] > 0
+        assert 'bytes_serialized' not in res
+        assert 'hash_serialized' not in res
+
+        # The full scan agrees with the maintained statistics
+        legacy = node.gettxoutsetinfo("legacy")
+        for key in ['total_amount', 'transactions', 'height', 'txouts', 'bestblock',
+                    'total_cold_amount', 'total_coldv2_amount']:
+            assert_equal(legacy[key], res[key])
+        assert_equal(legacy['bytes_serialized'], 13924)
+        assert_equal(len(legacy['hash_serialized']), 64)
+        assert 'muhash' not in legacy
+
+        assert_raises(JSONRPCException, node.gettxoutsetinfo, "sha256")
 
     def _test_getblockheader(self):
         node = self.nodes[0]